@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "tcon.h"
+#include "utf8.h"
+
+// Worst case bytes for one cell: a full SGR sequence with attributes and two RGB colors plus a
+// 4 byte UTF-8 sequence
+#define ANSI_MAX_CELL_BYTES 64
+// Worst case bytes for a cursor move
+#define ANSI_MAX_MOVE_BYTES 16
+
+static void ansiReserve(AnsiSink *as, size_t extra)
+{
+    if (as->len + extra <= as->cap)
+        return;
+
+    size_t cap = as->cap ? as->cap : 4096;
+    while (cap < as->len + extra)
+        cap *= 2;
+
+    TCON_STAT_ALLOC(1);
+    char *buf = realloc(as->buf, cap);
+    if (!buf)
+    {
+        perror("realloc");
+        exit(1);
+    }
+
+    as->buf = buf;
+    as->cap = cap;
+}
+
+static char *appendInt(char *p, int32_t value)
+{
+    char digits[12];
+    int32_t n = 0;
+
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    while (n > 0)
+        *p++ = digits[--n];
+
+    return p;
+}
+
+// Maps the Windows attribute bits (blue = 1, green = 2, red = 4) to the ANSI color index
+// (red = 1, green = 2, blue = 4)
+static int32_t ansiColorIndex(int32_t bits)
+{
+    return ((bits & 0x04) ? 1 : 0) | (bits & 0x02) | ((bits & 0x01) ? 4 : 0);
+}
+
+// Appends the SGR parameters of a color, base is 30 for foregrounds and 40 for backgrounds
+static char *appendColor(char *p, uint32_t color, int32_t base)
+{
+    switch (TCON_COLOR_KIND(color))
+    {
+    case TCON_COLOR_PALETTE:
+        p = appendInt(p, base + 8);
+        *p++ = ';';
+        *p++ = '5';
+        *p++ = ';';
+        return appendInt(p, color & 0xFF);
+    case TCON_COLOR_RGB:
+        p = appendInt(p, base + 8);
+        *p++ = ';';
+        *p++ = '2';
+        *p++ = ';';
+        p = appendInt(p, (color >> 16) & 0xFF);
+        *p++ = ';';
+        p = appendInt(p, (color >> 8) & 0xFF);
+        *p++ = ';';
+        return appendInt(p, color & 0xFF);
+    default:
+        return appendInt(p, ((color & 0x08) ? base + 60 : base) + ansiColorIndex(color & 0x07));
+    }
+}
+
+// Switches the terminal to a style. Attributes that are on and not wanted anymore need a reset
+// of all of them first
+static char *appendSgr(AnsiSink *as, char *p, uint32_t index)
+{
+    TconStyle style = getStyle(as->sink.styles, index);
+
+    *p++ = '\x1b';
+    *p++ = '[';
+
+    uint32_t on = as->attributes;
+    if (as->style == TCON_STYLE_UNKNOWN || (on & ~style.attributes) != 0)
+    {
+        *p++ = '0';
+        *p++ = ';';
+        on = 0;
+    }
+
+    static const struct { uint32_t attribute; char code; } codes[] = {
+        {TCON_BOLD, '1'}, {TCON_UNDERLINE, '4'}, {TCON_REVERSE, '7'}};
+    for (int32_t i = 0; i < 3; i++)
+    {
+        if ((style.attributes & codes[i].attribute) && !(on & codes[i].attribute))
+        {
+            *p++ = codes[i].code;
+            *p++ = ';';
+        }
+    }
+
+    p = appendColor(p, style.foreground, 30);
+    *p++ = ';';
+    p = appendColor(p, style.background, 40);
+    *p++ = 'm';
+
+    as->style = index;
+    as->attributes = style.attributes;
+    return p;
+}
+
+static char *appendChar(char *p, uint32_t c)
+{
+    // Control characters would move the terminal cursor, draw them as blanks
+    if (c < 0x20 || c == 0x7F)
+    {
+        *p++ = ' ';
+        return p;
+    }
+
+    return utf8Encode(p, c);
+}
+
+static void ansiBeginFrame(TconSink *sink, int32_t rows, int32_t cols)
+{
+    AnsiSink *as = (AnsiSink *)sink;
+    as->len = 0;
+    as->cols = cols;
+
+    // Something else may have moved the cursor or changed colors between frames
+    as->cursorRow = -1;
+    as->cursorCol = -1;
+    as->style = TCON_STYLE_UNKNOWN;
+}
+
+static void ansiWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    AnsiSink *as = (AnsiSink *)sink;
+    ansiReserve(as, ANSI_MAX_MOVE_BYTES + (size_t)len * ANSI_MAX_CELL_BYTES);
+
+    char *p = as->buf + as->len;
+
+    if (row != as->cursorRow || col != as->cursorCol)
+    {
+        *p++ = '\x1b';
+        *p++ = '[';
+        p = appendInt(p, row + 1);
+        *p++ = ';';
+        p = appendInt(p, col + 1);
+        *p++ = 'H';
+    }
+
+    for (int32_t i = 0; i < len; i++)
+    {
+        if (cells[i].Style != as->style)
+            p = appendSgr(as, p, cells[i].Style);
+
+        // The terminal moves the cursor past both cells of a wide char, its tail is not sent.
+        // Halves of a wide char whose other half was overwritten are blanks
+        uint32_t c = cells[i].Char;
+        if (c == TCON_WIDE_TAIL)
+        {
+            c = ' ';
+        }
+        else if (utf8CharWidth(c) == 2)
+        {
+            if (i + 1 < len && cells[i + 1].Char == TCON_WIDE_TAIL)
+                i++;
+            else
+                c = ' ';
+        }
+
+        p = appendChar(p, c);
+    }
+
+    as->len = p - as->buf;
+
+    // Writing the last column leaves the cursor in the pending wrap state
+    as->cursorRow = row;
+    as->cursorCol = col + len;
+    if (as->cursorCol >= as->cols)
+        as->cursorRow = -1;
+}
+
+static void ansiScroll(TconSink *sink, int32_t top, int32_t rows, int32_t count)
+{
+    AnsiSink *as = (AnsiSink *)sink;
+    int32_t lines = count > 0 ? count : -count;
+    ansiReserve(as, 3 * ANSI_MAX_MOVE_BYTES + (size_t)lines * 2);
+
+    char *p = as->buf + as->len;
+
+    // Limits scrolling to the region (DECSTBM)
+    *p++ = '\x1b';
+    *p++ = '[';
+    p = appendInt(p, top + 1);
+    *p++ = ';';
+    p = appendInt(p, top + rows);
+    *p++ = 'r';
+
+    // Index at the bottom margin scrolls the region up a line, reverse index at the top margin down
+    *p++ = '\x1b';
+    *p++ = '[';
+    p = appendInt(p, count > 0 ? top + rows : top + 1);
+    *p++ = ';';
+    *p++ = '1';
+    *p++ = 'H';
+
+    for (int32_t i = 0; i < lines; i++)
+    {
+        *p++ = '\x1b';
+        *p++ = count > 0 ? 'D' : 'M';
+    }
+
+    // Back to the whole screen, which also moves the cursor home
+    *p++ = '\x1b';
+    *p++ = '[';
+    *p++ = 'r';
+
+    as->len = p - as->buf;
+    as->cursorRow = -1;
+}
+
+static void ansiEndFrame(TconSink *sink)
+{
+    AnsiSink *as = (AnsiSink *)sink;
+    sink->frameBytes += as->len;
+
+    if (as->fd < 0)
+        return;
+
+    const char *p = as->buf;
+    size_t left = as->len;
+
+    while (left > 0)
+    {
+#ifdef _WIN32
+        int written = _write(as->fd, p, (unsigned int)left);
+#else
+        ssize_t written = write(as->fd, p, left);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        p += written;
+        left -= written;
+    }
+}
+
+static void ansiFreeBand(TconSink *band)
+{
+    freeAnsiSink((AnsiSink *)band);
+    free(band);
+}
+
+static TconSink *ansiCreateBand(TconSink *sink)
+{
+    TCON_STAT_ALLOC(1);
+    AnsiSink *band = malloc(sizeof(AnsiSink));
+    if (!band)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    // Bands only encode, the parent writes their bytes
+    initAnsiSink(band, -1);
+    band->sink.freeBand = ansiFreeBand;
+
+    return &band->sink;
+}
+
+static void ansiJoinBand(TconSink *sink, TconSink *band)
+{
+    AnsiSink *as = (AnsiSink *)sink;
+    AnsiSink *bs = (AnsiSink *)band;
+
+    if (bs->len == 0)
+        return;
+
+    ansiReserve(as, bs->len);
+    memcpy(as->buf + as->len, bs->buf, bs->len);
+    as->len += bs->len;
+
+    // A band starts with a cursor move and colors of its own, so it leaves the terminal in its end state
+    as->cursorRow = bs->cursorRow;
+    as->cursorCol = bs->cursorCol;
+    as->style = bs->style;
+    as->attributes = bs->attributes;
+}
+
+void initAnsiSink(AnsiSink *sink, int fd)
+{
+    memset(sink, 0, sizeof(AnsiSink));
+    sink->sink.beginFrame = ansiBeginFrame;
+    sink->sink.writeRun = ansiWriteRun;
+    sink->sink.scroll = ansiScroll;
+    sink->sink.endFrame = ansiEndFrame;
+    sink->sink.createBand = ansiCreateBand;
+    sink->sink.joinBand = ansiJoinBand;
+    sink->fd = fd;
+    sink->cursorRow = -1;
+    sink->cursorCol = -1;
+    sink->style = TCON_STYLE_UNKNOWN;
+}
+
+void freeAnsiSink(AnsiSink *sink)
+{
+    free(sink->buf);
+    sink->buf = NULL;
+    sink->len = 0;
+    sink->cap = 0;
+}
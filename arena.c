@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "arena.h"
+#include "stats.h"
+
+// Every allocation is preceded by a header recording its size class, keeping the payload 16 byte aligned
+#define ARENA_HEADER_SIZE 16
+#define ARENA_LARGE_CLASS 0xFF
+
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    size_t padding; // Keeps data 16 byte aligned
+    unsigned char data[];
+};
+
+struct ArenaLarge
+{
+    ArenaLarge *prev;
+    ArenaLarge *next;
+    size_t size;
+    size_t padding;
+    // Followed by the allocation header and the payload
+};
+
+typedef struct ArenaHeader
+{
+    uint32_t sizeClass;
+    uint32_t unused;
+    size_t size; // Requested size, used by arenaRealloc
+} ArenaHeader;
+
+static void *checkedMalloc(size_t size)
+{
+    TCON_STAT_ALLOC(1);
+    void *ptr = malloc(size);
+    if (!ptr)
+    {
+        perror("arena malloc");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int32_t sizeClassOf(size_t size)
+{
+    int32_t sizeClass = 0;
+    size_t classSize = ARENA_MIN_SIZE;
+
+    while (classSize < size)
+    {
+        classSize <<= 1;
+        sizeClass++;
+    }
+
+    return sizeClass;
+}
+
+static size_t classSize(int32_t sizeClass)
+{
+    return (size_t)ARENA_MIN_SIZE << sizeClass;
+}
+
+static ArenaHeader *headerOf(void *ptr)
+{
+    return (ArenaHeader *)((unsigned char *)ptr - ARENA_HEADER_SIZE);
+}
+
+Arena *createArena(void)
+{
+    Arena *arena = checkedMalloc(sizeof(Arena));
+    memset(arena, 0, sizeof(Arena));
+
+    return arena;
+}
+
+// Bumps a chunk off the current block. Blocks are kept in allocation order, so the ones after
+// the current block are unused since the last reset and are taken before asking for a new one
+static void *bump(Arena *arena, size_t size)
+{
+    while (arena->current && arena->current->used + size > arena->current->size && arena->current->next)
+    {
+        arena->current = arena->current->next;
+        arena->current->used = 0;
+    }
+
+    if (!arena->current || arena->current->used + size > arena->current->size)
+    {
+        ArenaBlock *block = checkedMalloc(sizeof(ArenaBlock) + ARENA_BLOCK_SIZE);
+        block->size = ARENA_BLOCK_SIZE;
+        block->used = 0;
+        block->next = NULL;
+
+        if (arena->current)
+            arena->current->next = block;
+        else
+            arena->blocks = block;
+
+        arena->current = block;
+        arena->blockAllocs++;
+    }
+
+    void *chunk = arena->current->data + arena->current->used;
+    arena->current->used += size;
+
+    return chunk;
+}
+
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    ArenaHeader *header;
+
+    if (size > ARENA_MAX_CLASS_SIZE)
+    {
+        ArenaLarge *large = checkedMalloc(sizeof(ArenaLarge) + ARENA_HEADER_SIZE + size);
+        large->size = size;
+        large->prev = NULL;
+        large->next = arena->large;
+        if (arena->large)
+            arena->large->prev = large;
+        arena->large = large;
+        arena->blockAllocs++;
+
+        header = (ArenaHeader *)(large + 1);
+        header->sizeClass = ARENA_LARGE_CLASS;
+    }
+    else
+    {
+        int32_t sizeClass = sizeClassOf(size);
+        void *recycled = arena->freeLists[sizeClass];
+
+        if (recycled)
+        {
+            // The freelist link lives in the first bytes of the free payload
+            arena->freeLists[sizeClass] = *(void **)recycled;
+            header = headerOf(recycled);
+        }
+        else
+        {
+            header = bump(arena, ARENA_HEADER_SIZE + classSize(sizeClass));
+        }
+
+        header->sizeClass = (uint32_t)sizeClass;
+    }
+
+    header->size = size;
+    arena->allocated += size;
+
+    return (unsigned char *)header + ARENA_HEADER_SIZE;
+}
+
+void *arenaRealloc(Arena *arena, void *ptr, size_t size)
+{
+    if (!ptr)
+        return arenaAlloc(arena, size);
+
+    ArenaHeader *header = headerOf(ptr);
+
+    if (header->sizeClass != ARENA_LARGE_CLASS && size <= classSize(header->sizeClass))
+    {
+        arena->allocated = arena->allocated - header->size + size;
+        header->size = size;
+        return ptr;
+    }
+
+    void *moved = arenaAlloc(arena, size);
+    memcpy(moved, ptr, header->size < size ? header->size : size);
+    arenaFree(arena, ptr);
+
+    return moved;
+}
+
+void arenaFree(Arena *arena, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    ArenaHeader *header = headerOf(ptr);
+    arena->allocated -= header->size;
+
+    if (header->sizeClass == ARENA_LARGE_CLASS)
+    {
+        ArenaLarge *large = (ArenaLarge *)header - 1;
+        if (large->prev)
+            large->prev->next = large->next;
+        else
+            arena->large = large->next;
+        if (large->next)
+            large->next->prev = large->prev;
+
+        free(large);
+        return;
+    }
+
+    *(void **)ptr = arena->freeLists[header->sizeClass];
+    arena->freeLists[header->sizeClass] = ptr;
+}
+
+static void freeLarge(Arena *arena)
+{
+    ArenaLarge *large = arena->large;
+    while (large)
+    {
+        ArenaLarge *next = large->next;
+        free(large);
+        large = next;
+    }
+
+    arena->large = NULL;
+}
+
+void resetArena(Arena *arena)
+{
+    freeLarge(arena);
+
+    memset(arena->freeLists, 0, sizeof(arena->freeLists));
+    arena->current = arena->blocks;
+    if (arena->current)
+        arena->current->used = 0;
+    arena->allocated = 0;
+}
+
+void freeArena(Arena *arena)
+{
+    if (!arena)
+        return;
+
+    freeLarge(arena);
+
+    ArenaBlock *block = arena->blocks;
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
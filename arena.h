@@ -0,0 +1,104 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifndef ARENA_H
+#define ARENA_H
+
+// Allocations are rounded up to a power of two size class from ARENA_MIN_SIZE to
+// ARENA_MAX_CLASS_SIZE, larger ones get their own block
+#define ARENA_MIN_SIZE 16
+#define ARENA_MAX_CLASS_SIZE 4096
+#define ARENA_SIZE_CLASSES 9
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+typedef struct ArenaLarge ArenaLarge;
+
+/*
+Bump allocator with a freelist per size class. Memory is handed out from large blocks, freed
+allocations are recycled by later ones of the same class, and everything is given back at
+once by resetArena/freeArena instead of one free per allocation.
+*/
+typedef struct Arena
+{
+   ArenaBlock *blocks;  // All blocks in allocation order
+   ArenaBlock *current; // Block being bumped
+   ArenaLarge *large;   // Allocations above ARENA_MAX_CLASS_SIZE
+   void *freeLists[ARENA_SIZE_CLASSES];
+   size_t allocated;    // Bytes currently handed out, headers excluded
+   uint64_t blockAllocs; // Blocks requested from malloc over the arena's lifetime
+} Arena;
+
+/*
+Creates an empty arena. No memory is taken until the first allocation.
+
+Arguments:
+   Void
+
+Returns:
+   Pointer to the arena
+*/
+Arena *createArena(void);
+
+/*
+Allocates memory from an arena, aligned to 16 bytes.
+
+Arguments:
+   arena - the arena to allocate from
+   size - the amount of bytes
+
+Returns:
+   Pointer to the memory
+*/
+void *arenaAlloc(Arena *arena, size_t size);
+
+/*
+Resizes an allocation. Stays in place while the new size fits the allocation's size class.
+
+Arguments:
+   arena - the arena the allocation belongs to
+   ptr - the allocation, NULL to allocate
+   size - the new size in bytes
+
+Returns:
+   Pointer to the memory, the contents up to the smaller size are kept
+*/
+void *arenaRealloc(Arena *arena, void *ptr, size_t size);
+
+/*
+Returns an allocation to the freelist of its size class.
+
+Arguments:
+   arena - the arena the allocation belongs to
+   ptr - the allocation, NULL is ignored
+
+Returns:
+   Void
+*/
+void arenaFree(Arena *arena, void *ptr);
+
+/*
+Releases every allocation at once. Blocks are kept for reuse, only large allocations
+are given back to the system.
+
+Arguments:
+   arena - the arena to reset
+
+Returns:
+   Void
+*/
+void resetArena(Arena *arena);
+
+/*
+Releases an arena and all memory allocated from it.
+
+Arguments:
+   arena - the arena to free, NULL is ignored
+
+Returns:
+   Void
+*/
+void freeArena(Arena *arena);
+
+#endif
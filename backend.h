@@ -0,0 +1,329 @@
+#include <stdbool.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+/*
+Platform layer behind initConsole, renderConsole and resetConsole. backend_win32.c implements
+it on top of the Windows console api, backend_posix.c with termios and VT/ANSI sequences.
+Exactly one of them is compiled in, selected by _WIN32. Not part of the public api.
+*/
+
+/*
+Gets the visible size of the console.
+
+Arguments:
+   hConsole - the console handle
+   rows - receives the amount of rows
+   cols - receives the amount of columns
+
+Returns:
+   Void
+*/
+void backendGetWindowSize(HANDLE hConsole, int32_t *rows, int32_t *cols);
+
+/*
+Stores everything resetConsole needs to restore and prepares the terminal for drawing.
+
+Arguments:
+   hConsole - the console handle
+   original - receives the pre execution state
+
+Returns:
+   Void
+*/
+void backendInit(HANDLE hConsole, OriginalVals *original);
+
+/*
+Restores the state stored by backendInit, including the cursor, and moves the cursor home.
+
+Arguments:
+   hConsole - the console handle
+   original - the state stored by backendInit
+
+Returns:
+   Void
+*/
+void backendReset(HANDLE hConsole, OriginalVals *original);
+
+/*
+Shows or hides the cursor.
+
+Arguments:
+   hConsole - the console handle
+   visible - true to show the cursor
+
+Returns:
+   Void
+*/
+void backendSetCursorVisible(HANDLE hConsole, bool visible);
+
+/*
+Restores the cursor shape and visibility stored by backendInit.
+
+Arguments:
+   hConsole - the console handle
+   original - the state stored by backendInit
+
+Returns:
+   Void
+*/
+void backendResetCursor(HANDLE hConsole, OriginalVals *original);
+
+/*
+Moves the cursor to a cell.
+
+Arguments:
+   hConsole - the console handle
+   row - zero based row
+   col - zero based column
+
+Returns:
+   Void
+*/
+void backendSetCursorPosition(HANDLE hConsole, int32_t row, int32_t col);
+
+/*
+Removes the scrollable area of the console, if the platform has one.
+
+Arguments:
+   Void
+
+Returns:
+   Void
+*/
+void backendDisableScroll(void);
+
+/*
+Initializes the sink renderConsole writes to when no custom sink is set.
+
+Arguments:
+   sink - the console sink to initialize
+   hConsole - the console handle
+
+Returns:
+   Void
+*/
+void backendInitSink(ConsoleSink *sink, HANDLE hConsole);
+
+/*
+Points the console sink at the handle passed to renderConsole.
+
+Arguments:
+   sink - the console sink
+   hConsole - the console handle
+
+Returns:
+   Void
+*/
+void backendBindSink(ConsoleSink *sink, HANDLE hConsole);
+
+/*
+Blocks until a single key is pressed.
+
+Arguments:
+   Void
+
+Returns:
+   Void
+*/
+void backendWaitKey(void);
+
+/*
+Reads a line of user input with echo, including its line break.
+
+Arguments:
+   buffer - receives the input, not null-terminated
+   maxLen - the maximum amount of bytes to read
+
+Returns:
+   The amount of bytes read
+*/
+int32_t backendReadLine(char *buffer, int32_t maxLen);
+
+/*
+Returns the handle of the process' standard output.
+
+Arguments:
+   Void
+
+Returns:
+   HANDLE
+*/
+HANDLE backendStdHandle(void);
+
+/*
+Returns the handle of the process' standard input.
+
+Arguments:
+   Void
+
+Returns:
+   HANDLE
+*/
+HANDLE backendStdInputHandle(void);
+
+/*
+Returns a monotonic timestamp in nanoseconds.
+
+Arguments:
+   Void
+
+Returns:
+   Nanoseconds since an unspecified point in time
+*/
+uint64_t backendNowNs(void);
+
+typedef struct BackendThread BackendThread;
+typedef struct BackendWakeup BackendWakeup;
+
+/*
+Runs a function on a new thread.
+
+Arguments:
+   fn - the function to run
+   arg - passed to fn
+
+Returns:
+   The thread, to be passed to backendJoinThread
+*/
+BackendThread *backendStartThread(void (*fn)(void *arg), void *arg);
+
+/*
+Waits for a thread to return and releases it.
+
+Arguments:
+   thread - the thread returned by backendStartThread
+
+Returns:
+   Void
+*/
+void backendJoinThread(BackendThread *thread);
+
+/*
+Gives up the rest of the calling thread's time slice.
+
+Arguments:
+   Void
+
+Returns:
+   Void
+*/
+void backendYield(void);
+
+/*
+Creates a wakeup one thread can sleep on and any thread can signal without taking a lock.
+Signals are counted, so one sent before the sleeper waits is not lost.
+
+Arguments:
+   Void
+
+Returns:
+   The wakeup
+*/
+BackendWakeup *backendCreateWakeup(void);
+
+/*
+Wakes the thread waiting on a wakeup, or the next one to wait.
+
+Arguments:
+   wakeup - the wakeup to signal
+
+Returns:
+   Void
+*/
+void backendSignalWakeup(BackendWakeup *wakeup);
+
+/*
+Sleeps until the wakeup is signaled or the timeout passes.
+
+Arguments:
+   wakeup - the wakeup to wait on
+   timeoutNs - the longest time to sleep in nanoseconds
+
+Returns:
+   true if the wakeup was signaled, false on timeout
+*/
+bool backendWaitWakeup(BackendWakeup *wakeup, uint64_t timeoutNs);
+
+/*
+Releases a wakeup nobody waits on anymore.
+
+Arguments:
+   wakeup - the wakeup to free
+
+Returns:
+   Void
+*/
+void backendFreeWakeup(BackendWakeup *wakeup);
+
+// Readiness of a watched handle, same values as EVENT_READABLE and EVENT_WRITABLE
+#define BACKEND_READABLE 0x1
+#define BACKEND_WRITABLE 0x2
+
+typedef struct BackendPoller BackendPoller;
+
+// A handle backendPoll waits on besides the terminal input
+typedef struct BackendWatch
+{
+   HANDLE handle;
+   uint32_t events; // BACKEND_READABLE and/or BACKEND_WRITABLE, Windows only waits for signaled handles
+   uint32_t ready;  // Set by backendPoll to the events that occurred
+} BackendWatch;
+
+/*
+Creates a poller that waits on terminal input and window size changes. Resizes are seen
+through SIGWINCH on POSIX and window buffer size records on Windows.
+
+Arguments:
+   hInput - the terminal input handle, see backendStdInputHandle()
+
+Returns:
+   The poller
+*/
+BackendPoller *backendCreatePoller(HANDLE hInput);
+
+/*
+Waits until terminal input arrives, the window is resized, one of the watched handles is
+ready, the poller is woken, or the timeout passes. Terminal input is returned as UTF-8 with
+VT escape sequences for special keys on every platform.
+
+Arguments:
+   poller - the poller
+   watches - the handles to wait on, their ready fields are updated
+   count - the amount of watches
+   timeoutNs - the longest time to wait, negative to wait without a timeout
+   input - receives the terminal input that arrived
+   inputSize - the size of input
+   resized - set to true if the window size may have changed
+
+Returns:
+   The amount of bytes stored in input
+*/
+int32_t backendPoll(BackendPoller *poller, BackendWatch *watches, int32_t count, int64_t timeoutNs, char *input, int32_t inputSize, bool *resized);
+
+/*
+Makes a backendPoll call on another thread return early. Safe to call from any thread.
+
+Arguments:
+   poller - the poller to wake
+
+Returns:
+   Void
+*/
+void backendWakePoller(BackendPoller *poller);
+
+/*
+Releases a poller and restores the input mode it changed.
+
+Arguments:
+   poller - the poller to free
+
+Returns:
+   Void
+*/
+void backendFreePoller(BackendPoller *poller);
+
+#endif
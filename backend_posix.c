@@ -0,0 +1,486 @@
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/ioctl.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "backend.h"
+
+#define ESC "\x1b"
+
+static int handleToFd(HANDLE hConsole)
+{
+    return (int)(intptr_t)hConsole;
+}
+
+// Control sequences outside of frames are short and rare, they are written directly
+static void writeSequence(HANDLE hConsole, const char *seq)
+{
+    int fd = handleToFd(hConsole);
+    size_t len = strlen(seq);
+
+    while (len > 0)
+    {
+        ssize_t written = write(fd, seq, len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        seq += written;
+        len -= written;
+    }
+}
+
+void backendGetWindowSize(HANDLE hConsole, int32_t *rows, int32_t *cols)
+{
+    if (hConsole == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Error: invalid handle\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct winsize ws;
+    if (ioctl(handleToFd(hConsole), TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0)
+    {
+        *rows = ws.ws_row;
+        *cols = ws.ws_col;
+        return;
+    }
+
+    // Not a terminal (pipe, file), fall back to the environment and then to 80x24
+    const char *lines = getenv("LINES");
+    const char *columns = getenv("COLUMNS");
+
+    *rows = lines ? atoi(lines) : 0;
+    *cols = columns ? atoi(columns) : 0;
+
+    if (*rows <= 0)
+        *rows = 24;
+    if (*cols <= 0)
+        *cols = 80;
+}
+
+void backendInit(HANDLE hConsole, OriginalVals *original)
+{
+    original->originalAttributes = FWHITE | BBLACK;
+    original->isTerminal = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &original->originalTermios) == 0;
+
+    if (original->isTerminal)
+    {
+        // Raw mode: single key reads without echo, signals stay enabled for ctrl-c
+        struct termios raw = original->originalTermios;
+        raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    }
+
+    if (isatty(handleToFd(hConsole)))
+        writeSequence(hConsole, ESC "[?1049h" ESC "[H");
+}
+
+void backendReset(HANDLE hConsole, OriginalVals *original)
+{
+    writeSequence(hConsole, ESC "[0m");
+    backendResetCursor(hConsole, original);
+
+    // Leaving the alternate screen brings back the original contents and cursor position
+    if (isatty(handleToFd(hConsole)))
+        writeSequence(hConsole, ESC "[?1049l");
+
+    if (original->isTerminal)
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &original->originalTermios);
+}
+
+void backendSetCursorVisible(HANDLE hConsole, bool visible)
+{
+    writeSequence(hConsole, visible ? ESC "[?25h" : ESC "[?25l");
+}
+
+void backendResetCursor(HANDLE hConsole, OriginalVals *original)
+{
+    backendSetCursorVisible(hConsole, true);
+}
+
+void backendSetCursorPosition(HANDLE hConsole, int32_t row, int32_t col)
+{
+    char seq[32];
+    snprintf(seq, sizeof(seq), ESC "[%" PRId32 ";%" PRId32 "H", row + 1, col + 1);
+    writeSequence(hConsole, seq);
+}
+
+void backendDisableScroll(void)
+{
+    // The alternate screen entered by backendInit has no scrollback
+}
+
+void backendInitSink(ConsoleSink *sink, HANDLE hConsole)
+{
+    initAnsiSink(sink, handleToFd(hConsole));
+}
+
+void backendBindSink(ConsoleSink *sink, HANDLE hConsole)
+{
+    sink->fd = handleToFd(hConsole);
+}
+
+void backendWaitKey(void)
+{
+    char c;
+    while (read(STDIN_FILENO, &c, 1) < 0 && errno == EINTR)
+        ;
+}
+
+int32_t backendReadLine(char *buffer, int32_t maxLen)
+{
+    struct termios current;
+    bool isTerminal = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &current) == 0;
+
+    // Line input needs canonical mode and echo, raw mode is restored afterwards
+    if (isTerminal)
+    {
+        struct termios line = current;
+        line.c_lflag |= ICANON | ECHO;
+        line.c_iflag |= ICRNL;
+        tcsetattr(STDIN_FILENO, TCSANOW, &line);
+    }
+
+    ssize_t charsRead;
+    while ((charsRead = read(STDIN_FILENO, buffer, maxLen)) < 0 && errno == EINTR)
+        ;
+
+    if (isTerminal)
+        tcsetattr(STDIN_FILENO, TCSANOW, &current);
+
+    return charsRead < 0 ? 0 : (int32_t)charsRead;
+}
+
+HANDLE backendStdHandle(void)
+{
+    return (HANDLE)(intptr_t)STDOUT_FILENO;
+}
+
+HANDLE backendStdInputHandle(void)
+{
+    return (HANDLE)(intptr_t)STDIN_FILENO;
+}
+
+uint64_t backendNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+struct BackendThread
+{
+    pthread_t thread;
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+struct BackendWakeup
+{
+    sem_t semaphore;
+};
+
+static void *threadMain(void *arg)
+{
+    BackendThread *thread = arg;
+    thread->fn(thread->arg);
+
+    return NULL;
+}
+
+BackendThread *backendStartThread(void (*fn)(void *arg), void *arg)
+{
+    TCON_STAT_ALLOC(1);
+    BackendThread *thread = malloc(sizeof(BackendThread));
+    if (!thread)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    thread->fn = fn;
+    thread->arg = arg;
+
+    if (pthread_create(&thread->thread, NULL, threadMain, thread) != 0)
+    {
+        fprintf(stderr, "Error: could not start thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return thread;
+}
+
+void backendJoinThread(BackendThread *thread)
+{
+    pthread_join(thread->thread, NULL);
+    free(thread);
+}
+
+void backendYield(void)
+{
+    sched_yield();
+}
+
+BackendWakeup *backendCreateWakeup(void)
+{
+    TCON_STAT_ALLOC(1);
+    BackendWakeup *wakeup = malloc(sizeof(BackendWakeup));
+    if (!wakeup)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    sem_init(&wakeup->semaphore, 0, 0);
+
+    return wakeup;
+}
+
+void backendSignalWakeup(BackendWakeup *wakeup)
+{
+    sem_post(&wakeup->semaphore);
+}
+
+bool backendWaitWakeup(BackendWakeup *wakeup, uint64_t timeoutNs)
+{
+    // sem_timedwait takes an absolute CLOCK_REALTIME deadline
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    uint64_t nsec = (uint64_t)deadline.tv_nsec + timeoutNs % 1000000000ull;
+    deadline.tv_sec += timeoutNs / 1000000000ull + nsec / 1000000000ull;
+    deadline.tv_nsec = nsec % 1000000000ull;
+
+    for (;;)
+    {
+        if (sem_timedwait(&wakeup->semaphore, &deadline) == 0)
+            return true;
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+void backendFreeWakeup(BackendWakeup *wakeup)
+{
+    sem_destroy(&wakeup->semaphore);
+    free(wakeup);
+}
+
+struct BackendPoller
+{
+    int inputFd;
+    bool inputOpen;          // Cleared at end of input, which would otherwise poll as readable forever
+    int wakeFds[2];
+    sig_atomic_t resizeSeen; // resizeCount when this poller last reported a resize
+    struct pollfd *fds;
+    int32_t fdCapacity;
+};
+
+// SIGWINCH only bumps the count and writes to a pipe, every poller watches the read end
+static int resizeFds[2] = {-1, -1};
+static volatile sig_atomic_t resizeCount;
+static struct sigaction previousResize;
+
+static void onResize(int sig)
+{
+    int saved = errno;
+
+    resizeCount++;
+
+    // A full pipe already holds a wakeup
+    ssize_t written = write(resizeFds[1], "r", 1);
+    (void)written;
+
+    // Keep a handler installed by the application working
+    if (!(previousResize.sa_flags & SA_SIGINFO) && previousResize.sa_handler != SIG_DFL && previousResize.sa_handler != SIG_IGN)
+        previousResize.sa_handler(sig);
+
+    errno = saved;
+}
+
+static void openPipe(int fds[2])
+{
+    if (pipe(fds) != 0)
+    {
+        fprintf(stderr, "Error: could not create pipe\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+static void drainPipe(int fd)
+{
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+BackendPoller *backendCreatePoller(HANDLE hInput)
+{
+    TCON_STAT_ALLOC(1);
+    BackendPoller *poller = calloc(1, sizeof(BackendPoller));
+    if (!poller)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    // The handler stays installed for the rest of the process, later pollers share it
+    if (resizeFds[0] < 0)
+    {
+        openPipe(resizeFds);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onResize;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGWINCH, &action, &previousResize);
+    }
+
+    poller->inputFd = handleToFd(hInput);
+    poller->inputOpen = poller->inputFd >= 0;
+    poller->resizeSeen = resizeCount;
+    openPipe(poller->wakeFds);
+
+    return poller;
+}
+
+static uint32_t readyEvents(short revents, uint32_t events)
+{
+    uint32_t ready = 0;
+
+    if (revents & (POLLIN | POLLHUP))
+        ready |= BACKEND_READABLE;
+    if (revents & POLLOUT)
+        ready |= BACKEND_WRITABLE;
+
+    // Errors are reported as whatever was asked for, the next read or write tells what happened
+    if (revents & (POLLERR | POLLNVAL))
+        ready |= events;
+
+    return ready & events;
+}
+
+int32_t backendPoll(BackendPoller *poller, BackendWatch *watches, int32_t count, int64_t timeoutNs, char *input, int32_t inputSize, bool *resized)
+{
+    int32_t needed = count + 3;
+    if (needed > poller->fdCapacity)
+    {
+        TCON_STAT_ALLOC(1);
+        struct pollfd *fds = realloc(poller->fds, needed * sizeof(struct pollfd));
+        if (!fds)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        poller->fds = fds;
+        poller->fdCapacity = needed;
+    }
+
+    struct pollfd *fds = poller->fds;
+    int32_t n = 0;
+
+    fds[n++] = (struct pollfd){ resizeFds[0], POLLIN, 0 };
+    fds[n++] = (struct pollfd){ poller->wakeFds[0], POLLIN, 0 };
+
+    int32_t inputIndex = -1;
+    if (poller->inputOpen && inputSize > 0)
+    {
+        inputIndex = n;
+        fds[n++] = (struct pollfd){ poller->inputFd, POLLIN, 0 };
+    }
+
+    int32_t firstWatch = n;
+    for (int32_t i = 0; i < count; i++)
+    {
+        short events = ((watches[i].events & BACKEND_READABLE) ? POLLIN : 0) | ((watches[i].events & BACKEND_WRITABLE) ? POLLOUT : 0);
+        fds[n++] = (struct pollfd){ handleToFd(watches[i].handle), events, 0 };
+        watches[i].ready = 0;
+    }
+
+    // Rounded up, so short timeouts still sleep instead of spinning
+    int timeout = -1;
+    if (timeoutNs >= 0)
+    {
+        uint64_t ms = ((uint64_t)timeoutNs + 999999) / 1000000;
+        timeout = ms > INT_MAX ? INT_MAX : (int)ms;
+    }
+
+    // A signal interrupts the wait like any other event, SIGWINCH is picked up below
+    if (poll(fds, n, timeout) <= 0)
+    {
+        for (int32_t i = 0; i < n; i++)
+            fds[i].revents = 0;
+    }
+
+    if (fds[0].revents & POLLIN)
+        drainPipe(resizeFds[0]);
+    if (fds[1].revents & POLLIN)
+        drainPipe(poller->wakeFds[0]);
+
+    sig_atomic_t resizes = resizeCount;
+    if (resizes != poller->resizeSeen)
+    {
+        poller->resizeSeen = resizes;
+        *resized = true;
+    }
+
+    int32_t len = 0;
+    if (inputIndex >= 0 && fds[inputIndex].revents)
+    {
+        ssize_t charsRead = read(poller->inputFd, input, inputSize);
+        if (charsRead > 0)
+            len = (int32_t)charsRead;
+        else if (charsRead == 0 || (errno != EINTR && errno != EAGAIN))
+            poller->inputOpen = false;
+    }
+
+    for (int32_t i = 0; i < count; i++)
+        watches[i].ready = readyEvents(fds[firstWatch + i].revents, watches[i].events);
+
+    return len;
+}
+
+void backendWakePoller(BackendPoller *poller)
+{
+    // A full pipe already holds a wakeup
+    ssize_t written = write(poller->wakeFds[1], "w", 1);
+    (void)written;
+}
+
+void backendFreePoller(BackendPoller *poller)
+{
+    close(poller->wakeFds[0]);
+    close(poller->wakeFds[1]);
+    free(poller->fds);
+    free(poller);
+}
+
+#endif
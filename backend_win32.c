@@ -0,0 +1,569 @@
+#ifdef _WIN32
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "backend.h"
+#include "utf8.h"
+
+// Input records read per backendPoll call, each one expands to at most BACKEND_KEY_BYTES bytes
+#define BACKEND_INPUT_RECORDS 32
+#define BACKEND_KEY_BYTES 16
+
+void backendGetWindowSize(HANDLE hConsole, int32_t *rows, int32_t *cols)
+{
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+
+    if (hConsole == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Error: invalid handle\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!GetConsoleScreenBufferInfo(hConsole, &csbi))
+    {
+        fprintf(stderr, "Error: could not get console info\n");
+        exit(EXIT_FAILURE);
+    }
+
+    *cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    *rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+}
+
+void backendInit(HANDLE hConsole, OriginalVals *original)
+{
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    GetConsoleScreenBufferInfo(hConsole, &csbi);
+
+    DWORD mode;
+    GetConsoleMode(hConsole, &mode);
+
+    CONSOLE_CURSOR_INFO cursorInfo;
+    GetConsoleCursorInfo(hConsole, &cursorInfo);
+
+    original->originalAttributes = csbi.wAttributes;
+    original->originalBufferSize = csbi.dwSize;
+    original->originalWindow = csbi.srWindow;
+    original->originalMode = mode;
+    original->originalCursor = cursorInfo;
+}
+
+void backendReset(HANDLE hConsole, OriginalVals *original)
+{
+    SetConsoleTextAttribute(hConsole, original->originalAttributes);
+    SetConsoleScreenBufferSize(hConsole, original->originalBufferSize);
+    SetConsoleWindowInfo(hConsole, TRUE, &original->originalWindow);
+    SetConsoleMode(hConsole, original->originalMode);
+
+    backendResetCursor(hConsole, original);
+
+    COORD topLeft = {0, 0};
+    SetConsoleCursorPosition(hConsole, topLeft);
+}
+
+void backendSetCursorVisible(HANDLE hConsole, bool visible)
+{
+    CONSOLE_CURSOR_INFO cursorInfo;
+    GetConsoleCursorInfo(hConsole, &cursorInfo);
+    cursorInfo.bVisible = visible;
+    SetConsoleCursorInfo(hConsole, &cursorInfo);
+}
+
+void backendResetCursor(HANDLE hConsole, OriginalVals *original)
+{
+    SetConsoleCursorInfo(hConsole, &original->originalCursor);
+}
+
+void backendSetCursorPosition(HANDLE hConsole, int32_t row, int32_t col)
+{
+    COORD pos;
+    pos.X = col;
+    pos.Y = row;
+
+    SetConsoleCursorPosition(hConsole, pos);
+}
+
+void backendDisableScroll(void)
+{
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+
+    GetConsoleScreenBufferInfo(hOut, &csbi);
+
+    // Set buffer size equal to window size
+    COORD newSize;
+    newSize.X = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    newSize.Y = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+
+    SetConsoleScreenBufferSize(hOut, newSize);
+}
+
+static void consoleSinkBeginFrame(TconSink *sink, int32_t rows, int32_t cols)
+{
+    ((ConsoleSink *)sink)->cols = cols;
+}
+
+static void consoleSinkScroll(TconSink *sink, int32_t top, int32_t rows, int32_t count)
+{
+    ConsoleSink *cs = (ConsoleSink *)sink;
+
+    SMALL_RECT region;
+    region.Left = 0;
+    region.Top = top;
+    region.Right = cs->cols - 1;
+    region.Bottom = top + rows - 1;
+
+    // The region moves by count rows and is clipped to itself, the rows it leaves are filled
+    COORD destination;
+    destination.X = 0;
+    destination.Y = top - count;
+
+    CHAR_INFO fill;
+    fill.Char.UnicodeChar = L' ';
+    fill.Attributes = FWHITE | BBLACK;
+
+    ScrollConsoleScreenBufferW(cs->hConsole, &region, &region, destination, &fill);
+}
+
+static void consoleSinkWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    ConsoleSink *cs = (ConsoleSink *)sink;
+
+    if (len > cs->stagingSize)
+    {
+        TCON_STAT_ALLOC(1);
+        CHAR_INFO *staging = realloc(cs->staging, len * sizeof(CHAR_INFO));
+        if (!staging)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        cs->staging = staging;
+        cs->stagingSize = len;
+    }
+
+    for (int32_t i = 0; i < len; i++)
+    {
+        // The console shows 16 colors, other styles are drawn with the closest ones
+        uint32_t c = cells[i].Char;
+        WORD attributes = (WORD)cells[i].Style;
+        if (cells[i].Style >= TCON_STYLE_INTERNED)
+        {
+            TconStyle style = getStyle(sink->styles, cells[i].Style);
+            attributes = (WORD)getStyleConsoleColors(&style);
+            if (style.attributes & TCON_UNDERLINE)
+                attributes |= COMMON_LVB_UNDERSCORE;
+        }
+
+        // Both cells of a wide char carry it, marked as its leading and trailing half. Halves
+        // whose other half was overwritten are blanks
+        if (c == TCON_WIDE_TAIL)
+        {
+            if (i > 0 && (cs->staging[i - 1].Attributes & COMMON_LVB_LEADING_BYTE))
+            {
+                c = cs->staging[i - 1].Char.UnicodeChar;
+                attributes |= COMMON_LVB_TRAILING_BYTE;
+            }
+            else
+            {
+                c = ' ';
+            }
+        }
+        else if (utf8CharWidth(c) == 2)
+        {
+            if (i + 1 < len && cells[i + 1].Char == TCON_WIDE_TAIL)
+                attributes |= COMMON_LVB_LEADING_BYTE;
+            else
+                c = ' ';
+        }
+
+        // A cell holds one UTF-16 unit, codepoints past the BMP are not shown
+        cs->staging[i].Char.UnicodeChar = c <= 0xFFFF ? (WCHAR)c : (WCHAR)UTF8_REPLACEMENT;
+        cs->staging[i].Attributes = attributes;
+    }
+
+    COORD bufferSize;
+    bufferSize.X = len;
+    bufferSize.Y = 1;
+
+    COORD bufferCoord;
+    bufferCoord.X = 0;
+    bufferCoord.Y = 0;
+
+    SMALL_RECT writeRegion;
+    writeRegion.Top = row;
+    writeRegion.Left = col;
+    writeRegion.Right = col + len - 1;
+    writeRegion.Bottom = row;
+
+    // Cells hold UTF-16 code units, the generic name resolves to the ANSI variant without UNICODE
+    WriteConsoleOutputW(cs->hConsole, cs->staging, bufferSize, bufferCoord, &writeRegion);
+
+    sink->frameBytes += len * sizeof(CHAR_INFO);
+}
+
+void backendInitSink(ConsoleSink *sink, HANDLE hConsole)
+{
+    memset(sink, 0, sizeof(ConsoleSink));
+    sink->sink.beginFrame = consoleSinkBeginFrame;
+    sink->sink.writeRun = consoleSinkWriteRun;
+    sink->sink.scroll = consoleSinkScroll;
+    sink->hConsole = hConsole;
+}
+
+void backendBindSink(ConsoleSink *sink, HANDLE hConsole)
+{
+    sink->hConsole = hConsole;
+}
+
+void backendWaitKey(void)
+{
+    INPUT_RECORD rec;
+    DWORD read;
+    HANDLE hIn = GetStdHandle(STD_INPUT_HANDLE);
+
+    while (1)
+    {
+        ReadConsoleInput(hIn, &rec, 1, &read);
+        if (rec.EventType == KEY_EVENT && rec.Event.KeyEvent.bKeyDown)
+            break; // single key pressed
+    }
+}
+
+int32_t backendReadLine(char *buffer, int32_t maxLen)
+{
+    DWORD charsRead = 0;
+    ReadConsoleA(GetStdHandle(STD_INPUT_HANDLE), buffer, maxLen, &charsRead, NULL);
+
+    return (int32_t)charsRead;
+}
+
+HANDLE backendStdHandle(void)
+{
+    return GetStdHandle(STD_OUTPUT_HANDLE);
+}
+
+HANDLE backendStdInputHandle(void)
+{
+    return GetStdHandle(STD_INPUT_HANDLE);
+}
+
+uint64_t backendNowNs(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+
+    // Split to avoid overflowing the multiplication on long uptimes
+    uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+    uint64_t rest = counter.QuadPart % frequency.QuadPart;
+
+    return seconds * 1000000000ull + rest * 1000000000ull / frequency.QuadPart;
+}
+
+struct BackendThread
+{
+    HANDLE thread;
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+struct BackendWakeup
+{
+    HANDLE semaphore;
+};
+
+static DWORD WINAPI threadMain(LPVOID arg)
+{
+    BackendThread *thread = arg;
+    thread->fn(thread->arg);
+
+    return 0;
+}
+
+BackendThread *backendStartThread(void (*fn)(void *arg), void *arg)
+{
+    TCON_STAT_ALLOC(1);
+    BackendThread *thread = malloc(sizeof(BackendThread));
+    if (!thread)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->thread = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+
+    if (!thread->thread)
+    {
+        fprintf(stderr, "Error: could not start thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return thread;
+}
+
+void backendJoinThread(BackendThread *thread)
+{
+    WaitForSingleObject(thread->thread, INFINITE);
+    CloseHandle(thread->thread);
+    free(thread);
+}
+
+void backendYield(void)
+{
+    SwitchToThread();
+}
+
+BackendWakeup *backendCreateWakeup(void)
+{
+    TCON_STAT_ALLOC(1);
+    BackendWakeup *wakeup = malloc(sizeof(BackendWakeup));
+    if (!wakeup)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    wakeup->semaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+
+    return wakeup;
+}
+
+void backendSignalWakeup(BackendWakeup *wakeup)
+{
+    ReleaseSemaphore(wakeup->semaphore, 1, NULL);
+}
+
+bool backendWaitWakeup(BackendWakeup *wakeup, uint64_t timeoutNs)
+{
+    // Rounded up, so short timeouts still sleep instead of spinning
+    uint64_t ms = (timeoutNs + 999999) / 1000000;
+    return WaitForSingleObject(wakeup->semaphore, ms >= INFINITE ? INFINITE - 1 : (DWORD)ms) == WAIT_OBJECT_0;
+}
+
+void backendFreeWakeup(BackendWakeup *wakeup)
+{
+    CloseHandle(wakeup->semaphore);
+    free(wakeup);
+}
+
+struct BackendPoller
+{
+    HANDLE input;
+    DWORD originalMode;
+    HANDLE wake;          // Auto reset event
+    HANDLE *handles;
+    int32_t handleCapacity;
+    WCHAR highSurrogate;  // First half of a character split across two key records
+};
+
+BackendPoller *backendCreatePoller(HANDLE hInput)
+{
+    TCON_STAT_ALLOC(1);
+    BackendPoller *poller = calloc(1, sizeof(BackendPoller));
+    if (!poller)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    poller->input = hInput;
+    poller->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    // Window buffer size records are only delivered with window input enabled
+    GetConsoleMode(hInput, &poller->originalMode);
+    SetConsoleMode(hInput, poller->originalMode | ENABLE_WINDOW_INPUT);
+
+    return poller;
+}
+
+// Translates a key press into the bytes a VT terminal sends for it
+static char *translateKey(BackendPoller *poller, const KEY_EVENT_RECORD *key, char *out)
+{
+    DWORD state = key->dwControlKeyState;
+    int32_t mods = ((state & SHIFT_PRESSED) ? 1 : 0) |
+                   ((state & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) ? 2 : 0) |
+                   ((state & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) ? 4 : 0);
+
+    static const WORD fKeys[] = {VK_F1, VK_F2, VK_F3, VK_F4, VK_F5, VK_F6, VK_F7, VK_F8, VK_F9, VK_F10, VK_F11, VK_F12};
+    static const int32_t fNumbers[] = {11, 12, 13, 14, 15, 17, 18, 19, 20, 21, 23, 24};
+
+    char final = 0;
+    int32_t number = 1;
+
+    switch (key->wVirtualKeyCode)
+    {
+    case VK_UP: final = 'A'; break;
+    case VK_DOWN: final = 'B'; break;
+    case VK_RIGHT: final = 'C'; break;
+    case VK_LEFT: final = 'D'; break;
+    case VK_HOME: final = 'H'; break;
+    case VK_END: final = 'F'; break;
+    case VK_INSERT: final = '~'; number = 2; break;
+    case VK_DELETE: final = '~'; number = 3; break;
+    case VK_PRIOR: final = '~'; number = 5; break;
+    case VK_NEXT: final = '~'; number = 6; break;
+    default:
+        for (int32_t i = 0; i < 12; i++)
+        {
+            if (key->wVirtualKeyCode == fKeys[i])
+            {
+                final = '~';
+                number = fNumbers[i];
+            }
+        }
+        break;
+    }
+
+    if (final)
+    {
+        // CSI number ; modifiers final, the number is left out for unmodified letter keys
+        *out++ = '\x1b';
+        *out++ = '[';
+        if (final == '~' || mods)
+            out += sprintf(out, "%" PRId32, number);
+        if (mods)
+            out += sprintf(out, ";%" PRId32, mods + 1);
+        *out++ = final;
+        return out;
+    }
+
+    WCHAR c = key->uChar.UnicodeChar;
+
+    // Modifier keys on their own carry no character
+    if (c == 0)
+        return out;
+
+    if (c >= 0xD800 && c < 0xDC00)
+    {
+        poller->highSurrogate = c;
+        return out;
+    }
+
+    uint32_t codepoint = c;
+    if (c >= 0xDC00 && c < 0xE000)
+    {
+        if (!poller->highSurrogate)
+            return out;
+        codepoint = 0x10000 + (((uint32_t)poller->highSurrogate - 0xD800) << 10) + (c - 0xDC00);
+    }
+    poller->highSurrogate = 0;
+
+    // Alt is sent as an escape prefix, like a terminal with meta sending escape
+    if (state & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED))
+        *out++ = '\x1b';
+
+    return utf8Encode(out, codepoint);
+}
+
+static int32_t readConsoleInput(BackendPoller *poller, char *input, int32_t inputSize, bool *resized)
+{
+    DWORD available = 0;
+    if (!GetNumberOfConsoleInputEvents(poller->input, &available) || available == 0)
+        return 0;
+
+    INPUT_RECORD records[BACKEND_INPUT_RECORDS];
+    DWORD count = inputSize / BACKEND_KEY_BYTES;
+    if (count > BACKEND_INPUT_RECORDS)
+        count = BACKEND_INPUT_RECORDS;
+    if (count > available)
+        count = available;
+    if (count == 0 || !ReadConsoleInputW(poller->input, records, count, &count))
+        return 0;
+
+    char *out = input;
+    char *end = input + inputSize;
+
+    for (DWORD i = 0; i < count; i++)
+    {
+        if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
+        {
+            *resized = true;
+            continue;
+        }
+
+        if (records[i].EventType != KEY_EVENT || !records[i].Event.KeyEvent.bKeyDown)
+            continue;
+
+        // Repeats that don't fit are dropped, holding a key down produces plenty more
+        WORD repeat = records[i].Event.KeyEvent.wRepeatCount;
+        for (WORD r = 0; r < repeat && end - out >= BACKEND_KEY_BYTES; r++)
+            out = translateKey(poller, &records[i].Event.KeyEvent, out);
+    }
+
+    return (int32_t)(out - input);
+}
+
+int32_t backendPoll(BackendPoller *poller, BackendWatch *watches, int32_t count, int64_t timeoutNs, char *input, int32_t inputSize, bool *resized)
+{
+    // WaitForMultipleObjects takes a limited amount of handles, further watches are not waited on
+    if (count > MAXIMUM_WAIT_OBJECTS - 2)
+        count = MAXIMUM_WAIT_OBJECTS - 2;
+
+    if (count + 2 > poller->handleCapacity)
+    {
+        TCON_STAT_ALLOC(1);
+        HANDLE *handles = realloc(poller->handles, (count + 2) * sizeof(HANDLE));
+        if (!handles)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        poller->handles = handles;
+        poller->handleCapacity = count + 2;
+    }
+
+    HANDLE *handles = poller->handles;
+    handles[0] = poller->wake;
+    handles[1] = poller->input;
+    for (int32_t i = 0; i < count; i++)
+    {
+        handles[i + 2] = watches[i].handle;
+        watches[i].ready = 0;
+    }
+
+    // Rounded up, so short timeouts still sleep instead of spinning
+    DWORD timeout = INFINITE;
+    if (timeoutNs >= 0)
+    {
+        uint64_t ms = ((uint64_t)timeoutNs + 999999) / 1000000;
+        timeout = ms >= INFINITE ? INFINITE - 1 : (DWORD)ms;
+    }
+
+    DWORD result = WaitForMultipleObjects(count + 2, handles, FALSE, timeout);
+
+    // Only the first signaled handle is reported, waiting acquired it, the others are seen next time
+    if (result >= WAIT_OBJECT_0 + 2 && result < WAIT_OBJECT_0 + 2 + (DWORD)count)
+    {
+        BackendWatch *watch = &watches[result - WAIT_OBJECT_0 - 2];
+        watch->ready = watch->events;
+    }
+
+    // Console input stays signaled while records are queued, so it is checked whatever woke the wait
+    return readConsoleInput(poller, input, inputSize, resized);
+}
+
+void backendWakePoller(BackendPoller *poller)
+{
+    SetEvent(poller->wake);
+}
+
+void backendFreePoller(BackendPoller *poller)
+{
+    SetConsoleMode(poller->input, poller->originalMode);
+    CloseHandle(poller->wake);
+    free(poller->handles);
+    free(poller);
+}
+
+#endif
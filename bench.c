@@ -0,0 +1,951 @@
+// Benchmarks for the render, print and table hot paths on a headless console.
+//
+// Build:  cc -O2 -pthread -o tconbench bench.c tcon.c style.c surface.c record.c table.c search.c ansi.c utf8.c headless.c format.c arena.c update.c pool.c event.c stats.c backend_posix.c -lm
+// Run:    ./tconbench [--quick] [--filter <name>] [--json <file>]
+//
+// Frames are encoded by an AnsiSink that keeps its bytes in memory, so bytes/frame is what a
+// VT terminal would receive. Allocations are counted by wrapping the glibc allocator.
+//
+// The queue cases run producer threads against a render thread and check the final frame, so
+// they double as a stress run of the update queue.
+//
+// Build with -DTCON_STATS to measure what the frame statistics cost, see stats.h.
+//
+// The banded render cases encode large frames on several threads, their ns/op is wall time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "tcon.h"
+#include "table.h"
+#include "update.h"
+#include "event.h"
+#include "backend.h"
+#include "utf8.h"
+#include "surface.h"
+#include "record.h"
+
+// Measure each case for at least this long, and at least BENCH_MIN_ITERATIONS times
+#define BENCH_MIN_NS 200000000ull
+#define BENCH_MIN_ITERATIONS 3
+
+// addTableCol relayouts and redraws every row, larger tables take too long per iteration
+#define BENCH_MAX_COL_ROWS 10000
+
+// Rows kept by the ring table of the append case
+#define BENCH_RING_ROWS 10000
+
+// Rows kept by the ring table of the resize case
+#define BENCH_RESIZE_ROWS 100000
+
+// Rows of the auto width case, widths must follow single cells without rescanning the columns
+#define BENCH_AUTOWIDTH_ROWS 100000
+
+// Rows of the sort cases
+#define BENCH_SORT_ROWS 100000
+
+// Rows of the filter cases, each keystroke should filter them within a frame
+#define BENCH_FILTER_ROWS 1000000
+
+// Size of the popup moved over a full screen surface by the compositor case
+#define BENCH_POPUP_ROWS 8
+#define BENCH_POPUP_COLS 30
+
+// Frames of the session recorded for the replay case
+#define BENCH_REPLAY_FRAMES 2000
+
+// Bytes of ASCII text measured by the width cases, against strlen() over the same text
+#define BENCH_MEASURE_BYTES 4096
+
+// Cell updates each producer thread pushes in the queue cases
+#define BENCH_QUEUE_UPDATES 500000
+#define BENCH_QUEUE_CAPACITY 65536
+
+// Producer threads may allocate too, count atomically
+static atomic_uint_fast64_t allocCount;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocCount, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocCount, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocCount, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&allocCount, 1, memory_order_relaxed);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12; // ENOMEM
+}
+#define BENCH_COUNTS_ALLOCS 1
+#else
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+typedef struct BenchContext
+{
+    Console con;
+    AnsiSink sink;
+    Table table;
+    bool hasTable;
+    int32_t tableRows;
+    int32_t tableCols;
+    int32_t consoleRows; // Size the console was set up with
+    int32_t consoleCols;
+    uint64_t counter;
+} BenchContext;
+
+typedef void (*BenchFn)(BenchContext *ctx);
+
+typedef struct BenchResult
+{
+    const char *name;
+    int32_t cols;
+    int32_t rows;
+    int32_t tableRows;
+    int32_t tableCols;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerFrame;
+} BenchResult;
+
+static const char *filter;
+static FILE *jsonFile;
+static bool firstJson = true;
+
+static char values[16][16];
+
+static char measureText[BENCH_MEASURE_BYTES + 1];
+
+// Wide CJK and Hangul chars, precomposed and combining accents
+static const char *wideValues[] = {
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe5\x80\xa4", "\xea\xb0\x92 \xed\x85\x8c\xec\x8a\xa4\xed\x8a\xb8",
+    "\xc3\x89" "cole caf\xc3\xa9", "e\xcc\x81" "cole cafe\xcc\x81"};
+
+// Threads set up by the banded render cases
+static int32_t renderThreads = 1;
+
+static void benchRenderIdle(BenchContext *ctx)
+{
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void benchRenderFull(BenchContext *ctx)
+{
+    invalidateConsole(&ctx->con);
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void benchRenderOneCell(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter % ctx->con.rows);
+    int32_t col = (int32_t)((ctx->counter * 7) % ctx->con.cols);
+    setCellData(&ctx->con, row, col, FWHITE, BBLACK, (uint32_t)('a' + ctx->counter % 26));
+    ctx->counter++;
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void benchRenderOneCellPaced(BenchContext *ctx)
+{
+    // Most renders land between two 60 fps frames and only mark the frame pending
+    if (ctx->counter == 0)
+        setConsoleTargetFps(&ctx->con, 60);
+
+    benchRenderOneCell(ctx);
+    pollConsoleFrame(&ctx->con, NULL);
+}
+
+static void benchRenderAllCells(BenchContext *ctx)
+{
+    uint32_t c = (uint32_t)('a' + ctx->counter++ % 26);
+    fillFramebuffer(&ctx->con, FWHITE, BBLACK, c);
+    renderConsole(ctx->con, NULL, false);
+}
+
+// Styles of the styled render case, truecolor foregrounds on palette grays
+#define BENCH_STYLES 64
+static uint32_t benchStyles[BENCH_STYLES];
+
+static void benchRenderStyled(BenchContext *ctx)
+{
+    if (ctx->counter == 0)
+    {
+        for (int32_t i = 0; i < BENCH_STYLES; i++)
+        {
+            TconStyle style = {TCON_RGB(i * 4, 255 - i * 4, 128), TCON_PALETTE(232 + i % 24), i % 8 == 0 ? TCON_BOLD : 0};
+            benchStyles[i] = internStyle(&ctx->con, &style);
+        }
+    }
+
+    // Runs of 8 cells share a style, every frame shifts the styles by a row
+    uint64_t frame = ctx->counter++;
+    for (int32_t row = 0; row < ctx->con.rows; row++)
+    {
+        for (int32_t col = 0; col < ctx->con.cols; col++)
+            setCellStyle(&ctx->con, row, col, benchStyles[(col / 8 + row + frame) % BENCH_STYLES], (uint32_t)('a' + col % 26));
+    }
+
+    renderConsole(ctx->con, NULL, false);
+}
+
+// Kept from the first iteration of the compositor case on, the one of an earlier run is released then
+static Compositor *benchCompositor;
+static Surface *benchPopup;
+
+static void benchComposeMove(BenchContext *ctx)
+{
+    if (ctx->counter == 0)
+    {
+        freeCompositor(benchCompositor);
+        benchCompositor = createCompositor(&ctx->con, NULL);
+
+        Surface *base = createSurface(benchCompositor, 0, 0, ctx->con.rows, ctx->con.cols, 0);
+        for (int32_t row = 0; row < ctx->con.rows; row++)
+            writeFormat(&base->console, row, 0, 0, FWHITE, BBLACK, "%s %d %s %s", values[row % 16], row, values[(row + 5) % 16], values[(row + 9) % 16]);
+        renderConsole(base->console, NULL, false);
+
+        benchPopup = createSurface(benchCompositor, 0, 0, BENCH_POPUP_ROWS, BENCH_POPUP_COLS, 1);
+        fillFramebuffer(&benchPopup->console, FBLACK, BWHITE, '#');
+        renderConsole(benchPopup->console, NULL, false);
+    }
+
+    // Drags the popup by one cell per frame, only its leading and trailing edge change
+    uint64_t step = ctx->counter++;
+    int32_t col = (int32_t)(step % (uint64_t)(ctx->con.cols - BENCH_POPUP_COLS));
+    moveSurface(benchPopup, ctx->con.rows / 3, col, NULL, false);
+}
+
+// Recording replayed by the replay case, made once on a console of the case's size
+static FILE *benchRecording;
+static Replay benchReplay;
+
+// Records a log tail with a status line and a popup that comes and goes, frame by frame
+static void recordSession(int32_t rows, int32_t cols)
+{
+    benchRecording = tmpfile();
+    if (!benchRecording)
+    {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+
+    RecordSink recorder;
+    initRecordSink(&recorder, benchRecording, NULL);
+
+    Console con = initHeadlessConsole(rows, cols, &recorder.sink);
+    Table table = createRingTable(&con, 1, rows - 1, 4, BENCH_RING_ROWS);
+
+    for (int32_t frame = 0; frame < BENCH_REPLAY_FRAMES; frame++)
+    {
+        beginConsoleFrame(&con);
+
+        TableCellValue cellValues[4];
+        for (int32_t c = 0; c < 4; c++)
+        {
+            cellValues[c].content = values[(frame * 3 + c) % 16];
+            cellValues[c].fgColor = c == 0 ? FGREEN : FWHITE;
+            cellValues[c].bgColor = BBLACK;
+        }
+        appendTableRow(&table, &con, cellValues, NULL, false);
+        writeFormat(&con, 0, 0, 0, FBLACK, BWHITE, "%-*s frame %6d", cols - 13, "tail", frame);
+
+        if (frame % 100 < 20)
+            writeFormat(&con, rows / 2, cols / 4, cols / 2, FWHITE, BRED, "%-*s", cols / 2, " popup");
+
+        commitConsoleFrame(&con, NULL);
+    }
+
+    removeTable(&table);
+    freeConsole(&con);
+    freeRecordSink(&recorder);
+}
+
+static void benchReplayFrames(BenchContext *ctx)
+{
+    if (ctx->counter++ == 0)
+    {
+        if (benchRecording)
+        {
+            closeReplay(&benchReplay);
+            fclose(benchRecording);
+        }
+        recordSession(ctx->con.rows, ctx->con.cols);
+
+        rewind(benchRecording);
+        openReplay(&benchReplay, benchRecording);
+    }
+
+    // Starts over at the end, the first frame is a keyframe again
+    if (!readReplayFrame(&benchReplay, &ctx->con))
+    {
+        closeReplay(&benchReplay);
+        rewind(benchRecording);
+        openReplay(&benchReplay, benchRecording);
+        readReplayFrame(&benchReplay, &ctx->con);
+    }
+
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void benchRenderAllCellsBanded(BenchContext *ctx)
+{
+    if (ctx->counter == 0)
+        setConsoleRenderThreads(&ctx->con, renderThreads);
+
+    benchRenderAllCells(ctx);
+}
+
+// Typing mixed with the escape sequences of cursor, function and modified keys
+static const char keyInput[] = "ls -la\r\x1b[A\x1b[A\x1b[B\x1b[1;5C\x1b[3~\x1bOP\x1b[15;2~\xc3\xa9t\xc3\xa9\t\x7f\x1b" "b\x1b[5~\x1b[6~q";
+
+static void benchDecodeKeys(BenchContext *ctx)
+{
+    KeyDecoder decoder;
+    KeyEvent key;
+
+    initKeyDecoder(&decoder);
+    feedKeyDecoder(&decoder, keyInput, sizeof(keyInput) - 1);
+
+    while (decodeKey(&decoder, &key, false))
+        ctx->counter += key.code;
+}
+
+static void benchPrint(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter++ % ctx->con.rows);
+    print(ctx->con, NULL, row, 0, values[ctx->counter % 16], FGREEN, BBLACK, false);
+}
+
+static void benchPrintWide(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter++ % ctx->con.rows);
+    print(ctx->con, NULL, row, 0, (char *)wideValues[(ctx->counter / ctx->con.rows) % 4], FGREEN, BBLACK, false);
+}
+
+static void benchMeasureStrlen(BenchContext *ctx)
+{
+    ctx->counter += strlen(measureText);
+}
+
+static void benchMeasureWidth(BenchContext *ctx)
+{
+    ctx->counter += utf8Width(measureText, BENCH_MEASURE_BYTES);
+}
+
+static void benchWriteFormat(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter % ctx->con.rows);
+    int32_t col = (int32_t)((ctx->counter / ctx->con.rows) % 4) * 20;
+    ctx->counter++;
+    writeFormat(&ctx->con, row, col, 20, FWHITE, BBLACK, "%6" PRIu64 " %F%9.2f%R%%", ctx->counter, FGREEN, ctx->counter * 0.37);
+}
+
+static void benchSetCellValue(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter % ctx->tableRows);
+    int32_t col = (int32_t)((ctx->counter * 3) % ctx->tableCols);
+    ctx->counter++;
+    setCellValue(&ctx->table, values[ctx->counter % 16], row, col, FWHITE, BBLACK);
+}
+
+static void benchSetCellValueRender(BenchContext *ctx)
+{
+    benchSetCellValue(ctx);
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void benchSetCellValueWide(BenchContext *ctx)
+{
+    int32_t row = (int32_t)(ctx->counter % ctx->tableRows);
+    int32_t col = (int32_t)((ctx->counter * 3) % ctx->tableCols);
+    ctx->counter++;
+    setCellValue(&ctx->table, (char *)wideValues[(ctx->counter / ctx->tableRows) % 4], row, col, FWHITE, BBLACK);
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void virtualSource(void *userData, int64_t row, TableCellValue *cellValues, int32_t cols)
+{
+    for (int32_t c = 0; c < cols; c++)
+        cellValues[c].content = values[(row + c) % 16];
+}
+
+static void benchScrollVirtual(BenchContext *ctx)
+{
+    scrollTable(&ctx->table, &ctx->con, (int64_t)(ctx->counter++ * 7919) % ctx->table.sourceRows, NULL, false);
+}
+
+static void benchReDrawTable(BenchContext *ctx)
+{
+    reDrawTable(&ctx->table, &ctx->con, NULL, false);
+}
+
+static void benchTableRow(BenchContext *ctx)
+{
+    addTableRow(&ctx->table, &ctx->con, NULL, false);
+    removeTableRow(&ctx->table, &ctx->con, ctx->table.rows - 1, NULL, false);
+}
+
+static void benchTableCol(BenchContext *ctx)
+{
+    addTableCol(&ctx->table, &ctx->con, NULL, false);
+    removeTableCol(&ctx->table, &ctx->con, ctx->table.cols - 1, NULL, false);
+}
+
+static void appendRingRow(BenchContext *ctx)
+{
+    TableCellValue cellValues[4];
+    for (int32_t c = 0; c < 4; c++)
+    {
+        cellValues[c].content = values[(ctx->counter + c) % 16];
+        cellValues[c].fgColor = FWHITE;
+        cellValues[c].bgColor = BBLACK;
+    }
+    ctx->counter++;
+
+    appendTableRow(&ctx->table, &ctx->con, cellValues, NULL, false);
+}
+
+static void benchAppendRing(BenchContext *ctx)
+{
+    // The warm-up call fills the ring, so every timed append evicts the oldest row
+    if (!ctx->hasTable)
+    {
+        ctx->table = createRingTable(&ctx->con, 0, ctx->con.rows, 4, BENCH_RING_ROWS);
+        ctx->hasTable = true;
+
+        for (int32_t r = 0; r < BENCH_RING_ROWS; r++)
+            appendRingRow(ctx);
+    }
+
+    appendRingRow(ctx);
+}
+
+static void benchResizeReflow(BenchContext *ctx)
+{
+    // The console was set up at its largest size, each step shrinks or restores the height or the width
+    static const int32_t steps[][2] = {{0, 0}, {-5, 0}, {-5, -10}, {0, -10}};
+
+    if (!ctx->hasTable)
+    {
+        ctx->table = createRingTable(&ctx->con, 0, ctx->con.rows, 4, BENCH_RESIZE_ROWS);
+        ctx->hasTable = true;
+
+        for (int32_t r = 0; r < BENCH_RESIZE_ROWS; r++)
+            appendRingRow(ctx);
+    }
+
+    int32_t step = (int32_t)(ctx->counter++ % 4);
+    resizeConsole(&ctx->con, ctx->consoleRows + steps[step][0], ctx->consoleCols + steps[step][1]);
+    reflowTable(&ctx->table, &ctx->con, NULL, false);
+}
+
+static void benchSetCellAutoWidth(BenchContext *ctx)
+{
+    if (!ctx->hasTable)
+    {
+        ctx->table = createRingTable(&ctx->con, 0, ctx->con.rows, 4, BENCH_AUTOWIDTH_ROWS);
+        ctx->hasTable = true;
+
+        for (int32_t r = 0; r < BENCH_AUTOWIDTH_ROWS; r++)
+            appendRingRow(ctx);
+
+        setTableAutoWidth(&ctx->table, &ctx->con, true, NULL, false);
+    }
+
+    // Contents change width, but the widest one of each column stays, so only the tracking is measured
+    int32_t row = (int32_t)((ctx->counter * 7919) % BENCH_AUTOWIDTH_ROWS);
+    int32_t col = (int32_t)(ctx->counter % 4);
+    setCellValue(&ctx->table, values[ctx->counter % 16], row, col, FWHITE, BBLACK);
+    ctx->counter++;
+    renderConsole(ctx->con, NULL, false);
+}
+
+// Fills a ring table of BENCH_SORT_ROWS rows on the first call
+static void setupSortTable(BenchContext *ctx)
+{
+    if (ctx->hasTable)
+        return;
+
+    ctx->table = createRingTable(&ctx->con, 0, ctx->con.rows, 4, BENCH_SORT_ROWS);
+    ctx->hasTable = true;
+
+    for (int32_t r = 0; r < BENCH_SORT_ROWS; r++)
+        appendRingRow(ctx);
+}
+
+static void benchSortTable(BenchContext *ctx)
+{
+    setupSortTable(ctx);
+
+    // Alternate between a text and a numeric first key, so every call sorts from scratch
+    TableSortColumn columns[2] = {{0, SORT_TEXT, false}, {1, SORT_NUMBER, true}};
+    if (ctx->counter++ % 2)
+    {
+        columns[0].col = 2;
+        columns[0].type = SORT_NUMBER;
+    }
+
+    sortTable(&ctx->table, &ctx->con, columns, 2, NULL, false);
+}
+
+static void benchSetCellSorted(BenchContext *ctx)
+{
+    if (!ctx->hasTable)
+    {
+        setupSortTable(ctx);
+
+        TableSortColumn columns[2] = {{0, SORT_TEXT, false}, {1, SORT_TEXT, false}};
+        sortTable(&ctx->table, &ctx->con, columns, 2, NULL, false);
+    }
+
+    // Changing the first sort column moves the row to another position
+    int32_t row = (int32_t)((ctx->counter * 7919) % BENCH_SORT_ROWS);
+    setCellValue(&ctx->table, values[ctx->counter % 16], row, 0, FWHITE, BBLACK);
+    ctx->counter++;
+    renderConsole(ctx->con, NULL, false);
+}
+
+// Fills a ring table of BENCH_FILTER_ROWS log like rows on the first call
+static void setupFilterTable(BenchContext *ctx, bool indexed)
+{
+    static const char *levels[] = {"info", "debug", "warn", "error"};
+
+    if (ctx->hasTable)
+        return;
+
+    ctx->table = createRingTable(&ctx->con, 0, ctx->con.rows, 4, BENCH_FILTER_ROWS);
+    ctx->hasTable = true;
+    setTableIndex(&ctx->table, indexed);
+
+    char text[4][32];
+    TableCellValue cellValues[4];
+    for (int32_t r = 0; r < BENCH_FILTER_ROWS; r++)
+    {
+        snprintf(text[0], sizeof(text[0]), "req-%07" PRId32, r);
+        snprintf(text[1], sizeof(text[1]), "%s", levels[(r / 7) % 4]);
+        snprintf(text[2], sizeof(text[2]), "node-%02" PRId32, (r * 31) % 64);
+        snprintf(text[3], sizeof(text[3]), "latency %" PRId32 " ms", (r * 37) % 1000);
+
+        for (int32_t c = 0; c < 4; c++)
+        {
+            cellValues[c].content = text[c];
+            cellValues[c].fgColor = FWHITE;
+            cellValues[c].bgColor = BBLACK;
+        }
+
+        appendTableRow(&ctx->table, &ctx->con, cellValues, NULL, false);
+
+        // A view that stops following the tail is not drawn again for rows appended below it
+        if (r == ctx->con.rows)
+            scrollTable(&ctx->table, &ctx->con, 0, NULL, false);
+    }
+}
+
+// Types and clears a few searches, one keystroke per call
+static void typeFilterKey(BenchContext *ctx)
+{
+    static const char *keys[] = {"e", "er", "err", "erro", "error", "", "n", "no", "nod", "node", "node-",
+                                 "node-4", "node-42", "", "7", "71", "713", "713 ", "713 ms", ""};
+
+    filterTable(&ctx->table, &ctx->con, keys[ctx->counter++ % (sizeof(keys) / sizeof(keys[0]))], NULL, false);
+}
+
+static void benchFilterScan(BenchContext *ctx)
+{
+    setupFilterTable(ctx, false);
+    typeFilterKey(ctx);
+}
+
+static void benchFilterIndexed(BenchContext *ctx)
+{
+    setupFilterTable(ctx, true);
+    typeFilterKey(ctx);
+}
+
+static void benchSetCellFiltered(BenchContext *ctx)
+{
+    if (!ctx->hasTable)
+    {
+        setupFilterTable(ctx, true);
+        filterTable(&ctx->table, &ctx->con, "error", NULL, false);
+    }
+
+    // Rows go in and out of the filter as their level changes
+    static const char *levels[] = {"info", "error"};
+    int32_t row = (int32_t)((ctx->counter * 7919) % BENCH_FILTER_ROWS);
+    setCellValue(&ctx->table, (char *)levels[ctx->counter % 2], row, 1, FWHITE, BBLACK);
+    ctx->counter++;
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void setupContext(BenchContext *ctx, int32_t rows, int32_t cols, int32_t tableRows, int32_t tableCols)
+{
+    memset(ctx, 0, sizeof(BenchContext));
+    initAnsiSink(&ctx->sink, -1);
+    ctx->con = initHeadlessConsole(rows, cols, &ctx->sink.sink);
+    ctx->tableRows = tableRows;
+    ctx->tableCols = tableCols;
+    ctx->consoleRows = rows;
+    ctx->consoleCols = cols;
+
+    if (tableRows < 0)
+    {
+        // Negative sizes ask for a virtual table over -tableRows source rows
+        ctx->table = createVirtualTable(&ctx->con, 0, rows, tableCols, -(int64_t)tableRows, virtualSource, NULL);
+        ctx->hasTable = true;
+    }
+    else if (tableRows > 0)
+    {
+        ctx->table = createTable(&ctx->con, tableRows, tableCols);
+        ctx->hasTable = true;
+
+        for (int32_t r = 0; r < tableRows; r++)
+        {
+            for (int32_t c = 0; c < tableCols; c++)
+                setCellValue(&ctx->table, values[(r + c) % 16], r, c, FWHITE, BBLACK);
+        }
+    }
+
+    renderConsole(ctx->con, NULL, false);
+}
+
+static void writeResult(BenchResult *result)
+{
+    printf("%-24s %4" PRId32 "x%-4" PRId32 " table %6" PRId32 "x%-2" PRId32 " %10.0f ns/op %9.2f allocs/op %10.0f bytes/frame  (%" PRIu64 " ops)\n",
+           result->name, result->cols, result->rows, result->tableRows, result->tableCols,
+           result->nsPerOp, result->allocsPerOp, result->bytesPerFrame, result->iterations);
+    fflush(stdout);
+
+    if (!jsonFile)
+        return;
+
+    fprintf(jsonFile, "%s\n  {\"name\": \"%s\", \"cols\": %" PRId32 ", \"rows\": %" PRId32 ", \"table_rows\": %" PRId32
+            ", \"table_cols\": %" PRId32 ", \"iterations\": %" PRIu64 ", \"ns_per_op\": %.1f, \"allocs_per_op\": %.3f, \"bytes_per_frame\": %.1f}",
+            firstJson ? "" : ",", result->name, result->cols, result->rows, result->tableRows, result->tableCols,
+            result->iterations, result->nsPerOp, BENCH_COUNTS_ALLOCS ? result->allocsPerOp : -1.0, result->bytesPerFrame);
+    firstJson = false;
+}
+
+static void runBench(const char *name, BenchFn fn, int32_t rows, int32_t cols, int32_t tableRows, int32_t tableCols)
+{
+    if (filter && !strstr(name, filter))
+        return;
+
+    BenchContext ctx;
+    setupContext(&ctx, rows, cols, tableRows, tableCols);
+
+    // One warm-up call so lazily grown buffers don't count
+    fn(&ctx);
+
+    uint64_t frames = ctx.con.state->frames;
+    uint64_t bytes = ctx.sink.sink.totalBytes;
+    uint64_t allocs = allocCount;
+    uint64_t iterations = 0;
+    uint64_t start = tconNowNs();
+    uint64_t elapsed = 0;
+
+    while (elapsed < BENCH_MIN_NS || iterations < BENCH_MIN_ITERATIONS)
+    {
+        fn(&ctx);
+        iterations++;
+        elapsed = tconNowNs() - start;
+    }
+
+    frames = ctx.con.state->frames - frames;
+
+    BenchResult result;
+    result.name = name;
+    result.rows = rows;
+    result.cols = cols;
+    result.tableRows = tableRows < 0 ? -tableRows : tableRows;
+    result.tableCols = tableCols;
+    result.iterations = iterations;
+    result.nsPerOp = (double)elapsed / iterations;
+    result.allocsPerOp = (double)(allocCount - allocs) / iterations;
+    result.bytesPerFrame = frames ? (double)(ctx.sink.sink.totalBytes - bytes) / frames : 0;
+
+    writeResult(&result);
+
+    // Consoles and tables have no destructors, keep the leak per case bounded to the table
+    if (ctx.hasTable)
+        removeTable(&ctx.table);
+    setConsoleRenderThreads(&ctx.con, 1);
+    freeAnsiSink(&ctx.sink);
+}
+
+typedef struct QueueProducer
+{
+    UpdateQueue *queue;
+    int32_t index;
+    int32_t producers;
+    int32_t cols;
+    int32_t ownedCells;
+    int32_t updates;
+} QueueProducer;
+
+// Producers own every producers-th row, so the final frame does not depend on the interleaving
+static void queueTarget(QueueProducer *producer, int32_t cell, int32_t *row, int32_t *col)
+{
+    *row = producer->index + (cell / producer->cols) * producer->producers;
+    *col = cell % producer->cols;
+}
+
+static uint32_t queueChar(QueueProducer *producer, int32_t update)
+{
+    return (uint32_t)('a' + (update / producer->ownedCells) % 26);
+}
+
+static void queueProducerMain(void *arg)
+{
+    QueueProducer *producer = arg;
+
+    for (int32_t i = 0; i < producer->updates; i++)
+    {
+        int32_t row, col;
+        queueTarget(producer, i % producer->ownedCells, &row, &col);
+        queueCellUpdate(producer->queue, row, col, FWHITE, BBLACK, queueChar(producer, i));
+    }
+}
+
+// Checks that every update arrived and the last one to each cell is what the frame shows
+static bool queueFrameValid(Console *con, QueueProducer *producer)
+{
+    for (int32_t cell = 0; cell < producer->ownedCells && cell < producer->updates; cell++)
+    {
+        int32_t last = cell + (producer->updates - 1 - cell) / producer->ownedCells * producer->ownedCells;
+        int32_t row, col;
+        queueTarget(producer, cell, &row, &col);
+
+        if (getCell(con, row, col)->Char != queueChar(producer, last))
+            return false;
+    }
+
+    return true;
+}
+
+static void runQueueBench(int32_t producers, int32_t rows, int32_t cols, int32_t updates)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "queue_cells_%" PRId32 "p", producers);
+
+    if (filter && !strstr(name, filter))
+        return;
+
+    AnsiSink sink;
+    initAnsiSink(&sink, -1);
+    Console con = initHeadlessConsole(rows, cols, &sink.sink);
+    renderConsole(con, NULL, false);
+
+    UpdateQueue *queue = createUpdateQueue(BENCH_QUEUE_CAPACITY);
+    QueueProducer producer[16];
+    BackendThread *threads[16];
+
+    uint64_t frames = con.state->frames;
+    uint64_t allocs = allocCount;
+    uint64_t start = tconNowNs();
+
+    RenderThread *renderThread = startRenderThread(&con, NULL, queue);
+
+    for (int32_t p = 0; p < producers; p++)
+    {
+        producer[p].queue = queue;
+        producer[p].index = p;
+        producer[p].producers = producers;
+        producer[p].cols = cols;
+        producer[p].ownedCells = (rows - p + producers - 1) / producers * cols;
+        producer[p].updates = updates;
+        threads[p] = backendStartThread(queueProducerMain, &producer[p]);
+    }
+
+    for (int32_t p = 0; p < producers; p++)
+        backendJoinThread(threads[p]);
+
+    stopRenderThread(renderThread);
+
+    uint64_t elapsed = tconNowNs() - start;
+    uint64_t total = (uint64_t)producers * updates;
+
+    bool valid = queue->applied == total;
+    for (int32_t p = 0; p < producers && valid; p++)
+        valid = queueFrameValid(&con, &producer[p]);
+
+    if (!valid)
+    {
+        fprintf(stderr, "%s: %" PRIu64 " of %" PRIu64 " updates applied or frame mismatch\n", name, queue->applied, total);
+        exit(EXIT_FAILURE);
+    }
+
+    frames = con.state->frames - frames;
+
+    BenchResult result;
+    result.name = name;
+    result.rows = rows;
+    result.cols = cols;
+    result.tableRows = 0;
+    result.tableCols = 0;
+    result.iterations = total;
+    result.nsPerOp = (double)elapsed / total;
+    result.allocsPerOp = (double)(allocCount - allocs) / total;
+    result.bytesPerFrame = frames ? (double)sink.sink.totalBytes / frames : 0;
+
+    writeResult(&result);
+
+    freeUpdateQueue(queue);
+    freeAnsiSink(&sink);
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--filter <name>] [--json <file>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (jsonPath)
+    {
+        jsonFile = fopen(jsonPath, "w");
+        if (!jsonFile)
+        {
+            perror(jsonPath);
+            return EXIT_FAILURE;
+        }
+        fprintf(jsonFile, "[");
+    }
+
+    for (int32_t i = 0; i < 16; i++)
+        snprintf(values[i], sizeof(values[i]), "value-%" PRId32, i * 7919);
+
+    for (int32_t i = 0; i < BENCH_MEASURE_BYTES; i++)
+        measureText[i] = (char)(' ' + i % 95);
+
+    static const int32_t consoleSizes[][2] = {{80, 24}, {120, 40}, {200, 60}, {400, 120}};
+    static const int32_t tableRowCounts[] = {100, 1000, 10000, 100000};
+    int32_t consoleCount = quick ? 2 : 4;
+    int32_t tableCount = quick ? 2 : 4;
+
+    for (int32_t i = 0; i < consoleCount; i++)
+    {
+        int32_t cols = consoleSizes[i][0];
+        int32_t rows = consoleSizes[i][1];
+
+        runBench("render_idle", benchRenderIdle, rows, cols, 0, 0);
+        runBench("render_one_cell", benchRenderOneCell, rows, cols, 0, 0);
+        runBench("render_one_cell_paced", benchRenderOneCellPaced, rows, cols, 0, 0);
+        runBench("render_all_cells", benchRenderAllCells, rows, cols, 0, 0);
+        runBench("render_full_repaint", benchRenderFull, rows, cols, 0, 0);
+        runBench("render_all_cells_styled", benchRenderStyled, rows, cols, 0, 0);
+        runBench("print", benchPrint, rows, cols, 0, 0);
+        runBench("writeFormat", benchWriteFormat, rows, cols, 0, 0);
+        runBench("moveSurface_popup", benchComposeMove, rows, cols, 0, 0);
+    }
+
+    runBench("decodeKey_mixed", benchDecodeKeys, 24, 80, 0, 0);
+
+    // A recorded log tail session fed back through the renderer, deterministic output path load
+    for (int32_t i = 0; i < consoleCount; i++)
+        runBench("replay_log_tail", benchReplayFrames, consoleSizes[i][1], consoleSizes[i][0], 0, 0);
+
+    // Display widths of UTF-8 text, ASCII should measure about as fast as strlen()
+    runBench("measure_ascii_strlen", benchMeasureStrlen, 24, 80, 0, 0);
+    runBench("measure_ascii_utf8Width", benchMeasureWidth, 24, 80, 0, 0);
+    runBench("print_wide", benchPrintWide, 24, 80, 0, 0);
+    runBench("setCellValue_wide_render", benchSetCellValueWide, 101, 80, 100, 4);
+
+    // Very large terminals, every frame changes every cell
+    static const int32_t largeSizes[][2] = {{400, 120}, {800, 240}, {1600, 480}};
+    static const int32_t threadCounts[] = {1, 2, 4, 8};
+    static const char *bandedNames[] = {"render_all_cells_1t", "render_all_cells_2t", "render_all_cells_4t", "render_all_cells_8t"};
+    for (int32_t i = 0; i < (quick ? 2 : 3); i++)
+    {
+        for (int32_t t = 0; t < 4; t++)
+        {
+            renderThreads = threadCounts[t];
+            runBench(bandedNames[t], benchRenderAllCellsBanded, largeSizes[i][1], largeSizes[i][0], 0, 0);
+        }
+    }
+
+    // Tables are tied to framebuffer rows, so the console grows with the table
+    for (int32_t i = 0; i < tableCount; i++)
+    {
+        int32_t tableRows = tableRowCounts[i];
+        int32_t rows = tableRows + 1;
+
+        runBench("setCellValue", benchSetCellValue, rows, 80, tableRows, 4);
+        runBench("setCellValue_render", benchSetCellValueRender, rows, 80, tableRows, 4);
+        runBench("reDrawTable", benchReDrawTable, rows, 80, tableRows, 4);
+        runBench("addTableRow_removeTableRow", benchTableRow, rows, 80, tableRows, 4);
+
+        if (tableRows <= BENCH_MAX_COL_ROWS)
+            runBench("addTableCol_removeTableCol", benchTableCol, rows, 80, tableRows, 4);
+    }
+
+    // Virtual tables only materialize the viewport, whatever the size of the source
+    for (int32_t i = 0; i < consoleCount; i++)
+        runBench("scrollTable_virtual_1M", benchScrollVirtual, consoleSizes[i][1], consoleSizes[i][0], -1000000, 4);
+
+    // Log tails append into a full ring that evicts its oldest row each time
+    for (int32_t i = 0; i < consoleCount; i++)
+        runBench("appendTableRow_ring", benchAppendRing, consoleSizes[i][1], consoleSizes[i][0], 0, 4);
+
+    // Content fitted column widths over a large ring table
+    runBench("setCellValue_autowidth", benchSetCellAutoWidth, 60, 200, 0, 4);
+
+    // Sorting through the row permutation, and keeping it sorted as single cells change
+    runBench("sortTable_100k", benchSortTable, 60, 200, 0, 4);
+    runBench("setCellValue_sorted", benchSetCellSorted, 60, 200, 0, 4);
+
+    // Filtering as a search is typed, by scanning every row and through a trigram index
+    runBench("filterTable_1M_scan", benchFilterScan, 60, 200, 0, 4);
+    runBench("filterTable_1M_indexed", benchFilterIndexed, 60, 200, 0, 4);
+    runBench("setCellValue_filtered", benchSetCellFiltered, 60, 200, 0, 4);
+
+    // Live window resizes over a large ring table, alternating height and width changes
+    for (int32_t i = 2; i < 4; i++)
+        runBench("resize_reflow_ring", benchResizeReflow, consoleSizes[i][1], consoleSizes[i][0], 0, 4);
+
+    // Worker threads feeding a render thread through the update queue
+    static const int32_t producerCounts[] = {1, 2, 4, 8};
+    for (int32_t i = 0; i < 4; i++)
+        runQueueBench(producerCounts[i], 40, 120, quick ? BENCH_QUEUE_UPDATES / 10 : BENCH_QUEUE_UPDATES);
+
+    if (jsonFile)
+    {
+        fprintf(jsonFile, "\n]\n");
+        fclose(jsonFile);
+    }
+
+    return EXIT_SUCCESS;
+}
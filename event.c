@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "event.h"
+#include "backend.h"
+#include "utf8.h"
+
+// Longest escape sequence decoded, longer ones are taken as typed characters
+#define KEY_SEQUENCE_MAX 32
+
+// Keys reported by CSI number ~, indexed by the number
+static const KeyCode tildeKeys[] = {
+    [1] = KEY_HOME, [2] = KEY_INSERT, [3] = KEY_DELETE, [4] = KEY_END, [5] = KEY_PAGEUP, [6] = KEY_PAGEDOWN,
+    [7] = KEY_HOME, [8] = KEY_END, [11] = KEY_F1, [12] = KEY_F2, [13] = KEY_F3, [14] = KEY_F4, [15] = KEY_F5,
+    [17] = KEY_F6, [18] = KEY_F7, [19] = KEY_F8, [20] = KEY_F9, [21] = KEY_F10, [23] = KEY_F11, [24] = KEY_F12,
+};
+
+void initKeyDecoder(KeyDecoder *decoder)
+{
+    decoder->len = 0;
+}
+
+int32_t feedKeyDecoder(KeyDecoder *decoder, const char *bytes, int32_t len)
+{
+    int32_t space = KEY_DECODER_SIZE - decoder->len;
+    if (len > space)
+        len = space;
+
+    memcpy(decoder->pending + decoder->len, bytes, len);
+    decoder->len += len;
+
+    return len;
+}
+
+static void setKey(KeyEvent *key, KeyCode code, uint32_t ch, uint32_t mods)
+{
+    key->code = code;
+    key->ch = ch;
+    key->mods = mods;
+}
+
+// Maps a single codepoint to a key, control characters are what ctrl plus a key sends
+static void charKey(uint32_t c, KeyEvent *key)
+{
+    if (c == '\r' || c == '\n')
+        setKey(key, KEY_ENTER, 0, 0);
+    else if (c == '\t')
+        setKey(key, KEY_TAB, 0, 0);
+    else if (c == 0x7F || c == 0x08)
+        setKey(key, KEY_BACKSPACE, 0, 0);
+    else if (c == 0x1B)
+        setKey(key, KEY_ESCAPE, 0, 0);
+    else if (c == 0)
+        setKey(key, KEY_CHAR, ' ', KEYMOD_CTRL);
+    else if (c < 0x1B)
+        setKey(key, KEY_CHAR, 'a' + c - 1, KEYMOD_CTRL);
+    else if (c < 0x20)
+        setKey(key, KEY_CHAR, c + 0x40, KEYMOD_CTRL);
+    else
+        setKey(key, KEY_CHAR, c, 0);
+}
+
+// Bytes a UTF-8 sequence starting with lead needs, 1 for anything that is not a valid lead byte
+static int32_t utf8Length(unsigned char lead)
+{
+    if (lead >= 0xF0 && lead <= 0xF4)
+        return 4;
+    if (lead >= 0xE0)
+        return lead <= 0xEF ? 3 : 1;
+    if (lead >= 0xC2)
+        return 2;
+    return 1;
+}
+
+// Key of the final byte of a CSI or SS3 sequence, false for finals that are not keys
+static bool finalKey(char final, KeyCode *code)
+{
+    switch (final)
+    {
+    case 'A': *code = KEY_UP; return true;
+    case 'B': *code = KEY_DOWN; return true;
+    case 'C': *code = KEY_RIGHT; return true;
+    case 'D': *code = KEY_LEFT; return true;
+    case 'H': *code = KEY_HOME; return true;
+    case 'F': *code = KEY_END; return true;
+    case 'P': *code = KEY_F1; return true;
+    case 'Q': *code = KEY_F2; return true;
+    case 'R': *code = KEY_F3; return true;
+    case 'S': *code = KEY_F4; return true;
+    default: return false;
+    }
+}
+
+/*
+Decodes a CSI sequence, bytes points behind "ESC [". Sets known to false for sequences that are
+not keys. Returns the bytes consumed after the introducer, 0 if the sequence is unfinished and
+-1 if it is malformed.
+*/
+static int32_t decodeCsi(const char *bytes, int32_t len, KeyEvent *key, bool *known)
+{
+    // Only the key number and the modifiers are used, further parameters are ignored
+    int32_t params[2] = {0, 0};
+    int32_t param = 0;
+    int32_t i = 0;
+
+    for (; i < len; i++)
+    {
+        unsigned char b = (unsigned char)bytes[i];
+
+        if (b >= '0' && b <= '9')
+        {
+            if (param < 2 && params[param] < 100000)
+                params[param] = params[param] * 10 + (b - '0');
+        }
+        else if (b == ';')
+        {
+            param++;
+        }
+        else if (b >= 0x20 && b <= 0x3F)
+        {
+            // Private markers and intermediates only occur in sequences that are not keys
+            *known = false;
+        }
+        else if (b >= 0x40 && b <= 0x7E)
+        {
+            break;
+        }
+        else
+        {
+            return -1;
+        }
+
+        if (i + 2 >= KEY_SEQUENCE_MAX)
+            return -1;
+    }
+
+    if (i == len)
+        return 0;
+
+    char final = bytes[i];
+    uint32_t mods = params[1] > 1 ? (uint32_t)(params[1] - 1) & (KEYMOD_SHIFT | KEYMOD_ALT | KEYMOD_CTRL) : 0;
+    KeyCode code;
+
+    if (!*known)
+        return i + 1;
+
+    if (final == '~' && params[0] < (int32_t)(sizeof(tildeKeys) / sizeof(tildeKeys[0])) && tildeKeys[params[0]] != KEY_CHAR)
+    {
+        setKey(key, tildeKeys[params[0]], 0, mods);
+    }
+    else if (final == 'u' && params[0] > 0)
+    {
+        // Keys sent as CSI codepoint ; modifiers u by terminals with extended keyboard reporting
+        charKey((uint32_t)params[0], key);
+        key->mods |= mods;
+    }
+    else if (final == 'Z')
+    {
+        setKey(key, KEY_TAB, 0, mods | KEYMOD_SHIFT);
+    }
+    else if (finalKey(final, &code))
+    {
+        setKey(key, code, 0, mods);
+    }
+    else
+    {
+        *known = false;
+    }
+
+    return i + 1;
+}
+
+/*
+Decodes the key at the start of bytes. Returns the bytes consumed, 0 if the key is unfinished.
+Sets known to false for sequences that were consumed but are not keys.
+*/
+static int32_t decodeAt(const char *bytes, int32_t len, KeyEvent *key, bool *known, bool flush)
+{
+    unsigned char lead = (unsigned char)bytes[0];
+    *known = true;
+
+    if (lead == 0x1B)
+    {
+        if (len == 1)
+        {
+            if (!flush)
+                return 0;
+            charKey(lead, key);
+            return 1;
+        }
+
+        if (bytes[1] == '[')
+        {
+            int32_t used = decodeCsi(bytes + 2, len - 2, key, known);
+            if (used > 0)
+                return used + 2;
+            if (used == 0 && !flush)
+                return 0;
+        }
+        else if (bytes[1] == 'O')
+        {
+            KeyCode code;
+            if (len == 2 && !flush)
+                return 0;
+            if (len > 2 && finalKey(bytes[2], &code))
+            {
+                setKey(key, code, 0, 0);
+                return 3;
+            }
+        }
+        else
+        {
+            // Escape followed by a key is that key with alt, as terminals send meta
+            int32_t used = decodeAt(bytes + 1, len - 1, key, known, flush);
+            if (used == 0)
+                return 0;
+            key->mods |= KEYMOD_ALT;
+            return used + 1;
+        }
+
+        // Unfinished when flushed or malformed, the escape byte goes on its own
+        charKey(lead, key);
+        return 1;
+    }
+
+    int32_t need = utf8Length(lead);
+    if (need > len)
+    {
+        if (!flush)
+            return 0;
+        need = len;
+    }
+
+    uint32_t c;
+    int32_t used = utf8Decode(bytes, need, &c);
+    charKey(c, key);
+
+    return used;
+}
+
+bool decodeKey(KeyDecoder *decoder, KeyEvent *key, bool flush)
+{
+    int32_t start = 0;
+    bool found = false;
+
+    while (start < decoder->len && !found)
+    {
+        bool known;
+        int32_t used = decodeAt(decoder->pending + start, decoder->len - start, key, &known, flush);
+        if (used == 0)
+            break;
+
+        start += used;
+        found = known;
+    }
+
+    decoder->len -= start;
+    memmove(decoder->pending, decoder->pending + start, decoder->len);
+
+    return found;
+}
+
+EventLoop *createEventLoop(Console *con, HANDLE hInput, HANDLE hConsole)
+{
+    TCON_STAT_ALLOC(1);
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    if (!loop)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    loop->con = con;
+    loop->hConsole = hConsole;
+    loop->poller = backendCreatePoller(hInput);
+    loop->nextTimerId = 1;
+    initKeyDecoder(&loop->decoder);
+    atomic_init(&loop->woken, false);
+
+    backendGetWindowSize(hConsole, &loop->rows, &loop->cols);
+
+    return loop;
+}
+
+void freeEventLoop(EventLoop *loop)
+{
+    if (!loop)
+        return;
+
+    backendFreePoller(loop->poller);
+    free(loop->timers);
+    free(loop->watches);
+    free(loop->watchData);
+    free(loop->events);
+    free(loop);
+}
+
+static void pushEvent(EventLoop *loop, const Event *event)
+{
+    if (loop->eventCount == loop->eventCapacity)
+    {
+        int32_t capacity = loop->eventCapacity ? loop->eventCapacity * 2 : 16;
+        TCON_STAT_ALLOC(1);
+        Event *events = malloc(capacity * sizeof(Event));
+        if (!events)
+        {
+            perror("malloc");
+            exit(1);
+        }
+
+        // Unroll the ring into the new array
+        for (int32_t i = 0; i < loop->eventCount; i++)
+            events[i] = loop->events[(loop->eventHead + i) % loop->eventCapacity];
+
+        free(loop->events);
+        loop->events = events;
+        loop->eventHead = 0;
+        loop->eventCapacity = capacity;
+    }
+
+    loop->events[(loop->eventHead + loop->eventCount) % loop->eventCapacity] = *event;
+    loop->eventCount++;
+}
+
+static bool popEvent(EventLoop *loop, Event *event)
+{
+    if (loop->eventCount == 0)
+        return false;
+
+    *event = loop->events[loop->eventHead];
+    loop->eventHead = (loop->eventHead + 1) % loop->eventCapacity;
+    loop->eventCount--;
+
+    return true;
+}
+
+int32_t addEventTimer(EventLoop *loop, uint64_t intervalNs, bool repeat, void *userData)
+{
+    if (loop->timerCount == loop->timerCapacity)
+    {
+        int32_t capacity = loop->timerCapacity ? loop->timerCapacity * 2 : 8;
+        TCON_STAT_ALLOC(1);
+        EventTimer *timers = realloc(loop->timers, capacity * sizeof(EventTimer));
+        if (!timers)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        loop->timers = timers;
+        loop->timerCapacity = capacity;
+    }
+
+    // A repeating timer without an interval would fire on every poll
+    if (repeat && intervalNs == 0)
+        intervalNs = 1;
+
+    EventTimer *timer = &loop->timers[loop->timerCount++];
+    timer->id = loop->nextTimerId++;
+    timer->dueNs = tconNowNs() + intervalNs;
+    timer->intervalNs = intervalNs;
+    timer->repeat = repeat;
+    timer->userData = userData;
+
+    return timer->id;
+}
+
+void removeEventTimer(EventLoop *loop, int32_t id)
+{
+    for (int32_t i = 0; i < loop->timerCount; i++)
+    {
+        if (loop->timers[i].id == id)
+        {
+            loop->timers[i] = loop->timers[--loop->timerCount];
+            return;
+        }
+    }
+}
+
+void watchEventHandle(EventLoop *loop, HANDLE handle, uint32_t events, void *userData)
+{
+    int32_t index = 0;
+    while (index < loop->watchCount && loop->watches[index].handle != handle)
+        index++;
+
+    if (index == loop->watchCapacity)
+    {
+        int32_t capacity = loop->watchCapacity ? loop->watchCapacity * 2 : 8;
+        TCON_STAT_ALLOC(2);
+        BackendWatch *watches = realloc(loop->watches, capacity * sizeof(BackendWatch));
+        void **watchData = realloc(loop->watchData, capacity * sizeof(void *));
+        if (!watches || !watchData)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        loop->watches = watches;
+        loop->watchData = watchData;
+        loop->watchCapacity = capacity;
+    }
+
+    if (index == loop->watchCount)
+        loop->watchCount++;
+
+    // The flags are passed to the backend as they are, EVENT_* and BACKEND_* share their values
+    loop->watches[index].handle = handle;
+    loop->watches[index].events = events & (EVENT_READABLE | EVENT_WRITABLE);
+    loop->watches[index].ready = 0;
+    loop->watchData[index] = userData;
+}
+
+void unwatchEventHandle(EventLoop *loop, HANDLE handle)
+{
+    for (int32_t i = 0; i < loop->watchCount; i++)
+    {
+        if (loop->watches[i].handle == handle)
+        {
+            loop->watchCount--;
+            loop->watches[i] = loop->watches[loop->watchCount];
+            loop->watchData[i] = loop->watchData[loop->watchCount];
+            return;
+        }
+    }
+}
+
+// Queues due timers and returns the nanoseconds until the next one, -1 without timers
+static int64_t fireTimers(EventLoop *loop, uint64_t now)
+{
+    int64_t next = -1;
+
+    for (int32_t i = 0; i < loop->timerCount;)
+    {
+        EventTimer *timer = &loop->timers[i];
+
+        if (timer->dueNs <= now)
+        {
+            Event event;
+            memset(&event, 0, sizeof(Event));
+            event.type = EVENT_TIMER;
+            event.timer = timer->id;
+            event.userData = timer->userData;
+            pushEvent(loop, &event);
+
+            if (!timer->repeat)
+            {
+                loop->timers[i] = loop->timers[--loop->timerCount];
+                continue;
+            }
+
+            // Missed expiries are not caught up on, the timer fires once and continues from now
+            timer->dueNs += timer->intervalNs;
+            if (timer->dueNs <= now)
+                timer->dueNs = now + timer->intervalNs;
+        }
+
+        int64_t wait = (int64_t)(timer->dueNs - now);
+        if (next < 0 || wait < next)
+            next = wait;
+        i++;
+    }
+
+    return next;
+}
+
+static void queueKeys(EventLoop *loop, bool flush)
+{
+    Event event;
+    memset(&event, 0, sizeof(Event));
+    event.type = EVENT_KEY;
+
+    while (decodeKey(&loop->decoder, &event.key, flush))
+        pushEvent(loop, &event);
+}
+
+static void queueResize(EventLoop *loop)
+{
+    int32_t rows;
+    int32_t cols;
+    backendGetWindowSize(loop->hConsole, &rows, &cols);
+
+    // Several signals for one resize, or a change of the Windows buffer only, are not reported
+    if (rows == loop->rows && cols == loop->cols)
+        return;
+
+    loop->rows = rows;
+    loop->cols = cols;
+
+    // The framebuffer already has the new size when the application sees the event
+    if (loop->con && !loop->con->state->headless)
+        resizeConsole(loop->con, rows, cols);
+
+    Event event;
+    memset(&event, 0, sizeof(Event));
+    event.type = EVENT_RESIZE;
+    event.rows = rows;
+    event.cols = cols;
+    pushEvent(loop, &event);
+}
+
+// The shorter of two waits, negative waits are unlimited
+static int64_t shorterWait(int64_t a, int64_t b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+bool pollEvent(EventLoop *loop, Event *event, int64_t timeoutNs)
+{
+    uint64_t start = tconNowNs();
+    bool expired = false;
+    char input[KEY_DECODER_SIZE];
+
+    for (;;)
+    {
+        if (popEvent(loop, event))
+            return true;
+        if (expired || atomic_exchange(&loop->woken, false))
+            return false;
+
+        uint64_t now = tconNowNs();
+        int64_t wait = -1;
+        if (timeoutNs >= 0)
+            wait = now - start < (uint64_t)timeoutNs ? (int64_t)(start + timeoutNs - now) : 0;
+
+        wait = shorterWait(wait, fireTimers(loop, now));
+
+        // A lone escape byte is the Escape key once the rest of a sequence would have arrived
+        if (loop->escapeDeadlineNs && now >= loop->escapeDeadlineNs)
+        {
+            loop->escapeDeadlineNs = 0;
+            queueKeys(loop, true);
+        }
+        else if (loop->escapeDeadlineNs)
+        {
+            wait = shorterWait(wait, (int64_t)(loop->escapeDeadlineNs - now));
+        }
+
+        // Frames held back by the target frame rate go out while the application waits for input
+        if (loop->con)
+        {
+            int64_t frameWait = pollConsoleFrame(loop->con, loop->hConsole);
+            if (frameWait > 0)
+                wait = shorterWait(wait, frameWait);
+        }
+
+        if (loop->eventCount > 0)
+            continue;
+
+        bool resized = false;
+        int32_t len = backendPoll(loop->poller, loop->watches, loop->watchCount, wait, input, KEY_DECODER_SIZE - loop->decoder.len, &resized);
+
+        if (len > 0)
+        {
+            feedKeyDecoder(&loop->decoder, input, len);
+            queueKeys(loop, false);
+
+            // Whatever is left is the start of a sequence, the deadline runs from its first byte
+            if (loop->decoder.len == 0)
+                loop->escapeDeadlineNs = 0;
+            else if (loop->escapeDeadlineNs == 0)
+                loop->escapeDeadlineNs = tconNowNs() + EVENT_ESCAPE_DELAY_NS;
+        }
+
+        if (resized)
+            queueResize(loop);
+
+        for (int32_t i = 0; i < loop->watchCount; i++)
+        {
+            if (!loop->watches[i].ready)
+                continue;
+
+            Event watchEvent;
+            memset(&watchEvent, 0, sizeof(Event));
+            watchEvent.type = EVENT_HANDLE;
+            watchEvent.handle = loop->watches[i].handle;
+            watchEvent.ready = loop->watches[i].ready;
+            watchEvent.userData = loop->watchData[i];
+            pushEvent(loop, &watchEvent);
+        }
+
+        if (timeoutNs >= 0 && tconNowNs() - start >= (uint64_t)timeoutNs)
+            expired = true;
+    }
+}
+
+void wakeEventLoop(EventLoop *loop)
+{
+    atomic_store(&loop->woken, true);
+    backendWakePoller(loop->poller);
+}
@@ -0,0 +1,275 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#ifndef EVENT_H
+#define EVENT_H
+
+// Readiness a watched handle is waited for, see watchEventHandle()
+#define EVENT_READABLE 0x1
+#define EVENT_WRITABLE 0x2
+
+// Key modifiers, the same bits xterm encodes as modifier parameter - 1
+#define KEYMOD_SHIFT 0x1
+#define KEYMOD_ALT 0x2
+#define KEYMOD_CTRL 0x4
+
+// Time a lone escape byte waits for the rest of an escape sequence before it counts as the Escape key
+#define EVENT_ESCAPE_DELAY_NS 25000000ull
+
+// Undecoded terminal input a key decoder holds, far more than the longest escape sequence
+#define KEY_DECODER_SIZE 256
+
+typedef enum KeyCode
+{
+   KEY_CHAR,      // A character, see KeyEvent.ch. Control characters come as ch with KEYMOD_CTRL
+   KEY_ENTER,
+   KEY_TAB,
+   KEY_BACKSPACE,
+   KEY_ESCAPE,
+   KEY_UP,
+   KEY_DOWN,
+   KEY_LEFT,
+   KEY_RIGHT,
+   KEY_HOME,
+   KEY_END,
+   KEY_PAGEUP,
+   KEY_PAGEDOWN,
+   KEY_INSERT,
+   KEY_DELETE,
+   KEY_F1,
+   KEY_F2,
+   KEY_F3,
+   KEY_F4,
+   KEY_F5,
+   KEY_F6,
+   KEY_F7,
+   KEY_F8,
+   KEY_F9,
+   KEY_F10,
+   KEY_F11,
+   KEY_F12
+} KeyCode;
+
+typedef struct KeyEvent
+{
+   KeyCode code;
+   uint32_t ch;   // The codepoint for KEY_CHAR, 0 otherwise
+   uint32_t mods; // KEYMOD_* bits
+} KeyEvent;
+
+/*
+Turns terminal input into key events. Input may be split anywhere, including in the middle
+of UTF-8 and escape sequences, the decoder keeps incomplete sequences until the rest arrives.
+*/
+typedef struct KeyDecoder
+{
+   char pending[KEY_DECODER_SIZE];
+   int32_t len;
+} KeyDecoder;
+
+typedef enum EventType
+{
+   EVENT_KEY,    // A key was pressed
+   EVENT_RESIZE, // The window changed its size, the console of the loop is already resized
+   EVENT_TIMER,  // A timer added with addEventTimer is due
+   EVENT_HANDLE  // A handle watched with watchEventHandle is ready
+} EventType;
+
+typedef struct Event
+{
+   EventType type;
+   KeyEvent key;   // EVENT_KEY
+   int32_t rows;   // EVENT_RESIZE, the new window size
+   int32_t cols;
+   int32_t timer;  // EVENT_TIMER, the id returned by addEventTimer
+   HANDLE handle;  // EVENT_HANDLE
+   uint32_t ready; // EVENT_HANDLE, EVENT_READABLE and/or EVENT_WRITABLE
+   void *userData; // EVENT_TIMER and EVENT_HANDLE, as registered
+} Event;
+
+typedef struct EventTimer
+{
+   int32_t id;
+   uint64_t dueNs;      // tconNowNs() of the next expiry
+   uint64_t intervalNs;
+   bool repeat;
+   void *userData;
+} EventTimer;
+
+/*
+Waits on terminal input, resizes, timers and user handles together. Keys are decoded as they
+arrive, so the application never blocks in a read and can keep updating the console between
+events. Paced frames of the console are presented while the loop waits.
+*/
+typedef struct EventLoop
+{
+   Console *con;             // May be NULL
+   HANDLE hConsole;
+   struct BackendPoller *poller;
+   KeyDecoder decoder;
+   uint64_t escapeDeadlineNs; // When an unfinished escape sequence is taken as typed, 0 if none is pending
+   int32_t rows;             // Window size reported last
+   int32_t cols;
+   EventTimer *timers;
+   int32_t timerCount;
+   int32_t timerCapacity;
+   int32_t nextTimerId;
+   struct BackendWatch *watches;
+   void **watchData;
+   int32_t watchCount;
+   int32_t watchCapacity;
+   Event *events;            // Ring of events not returned yet
+   int32_t eventHead;
+   int32_t eventCount;
+   int32_t eventCapacity;
+   atomic_bool woken;        // Set by wakeEventLoop
+} EventLoop;
+
+/*
+Resets a key decoder.
+
+Arguments:
+   decoder - the decoder to initialize
+
+Returns:
+   Void
+*/
+void initKeyDecoder(KeyDecoder *decoder);
+
+/*
+Hands terminal input to a key decoder.
+
+Arguments:
+   decoder - the decoder
+   bytes - the input, UTF-8 with VT escape sequences
+   len - the amount of bytes
+
+Returns:
+   The amount of bytes taken, less than len once KEY_DECODER_SIZE bytes are undecoded
+*/
+int32_t feedKeyDecoder(KeyDecoder *decoder, const char *bytes, int32_t len);
+
+/*
+Takes the next key off a key decoder. Unknown escape sequences are skipped.
+
+Arguments:
+   decoder - the decoder
+   key - receives the key
+   flush - take an unfinished sequence as typed, e.g. a lone escape byte as the Escape key
+
+Returns:
+   false if no complete key is left
+*/
+bool decodeKey(KeyDecoder *decoder, KeyEvent *key, bool flush);
+
+/*
+Creates an event loop. On POSIX it installs a SIGWINCH handler that stays for the rest of the
+process, a handler installed before is still called. The terminal input should be in raw mode,
+as set up by initConsole.
+
+Arguments:
+   con - the console whose paced frames are presented while waiting and that is resized with
+         the window, NULL for none
+   hInput - the terminal input, see tconGetStdInputHandle()
+   hConsole - the console handle, queried for the window size on resizes
+
+Returns:
+   Pointer to the event loop
+*/
+EventLoop *createEventLoop(Console *con, HANDLE hInput, HANDLE hConsole);
+
+/*
+Frees an event loop.
+
+Arguments:
+   loop - the loop to free
+
+Returns:
+   Void
+*/
+void freeEventLoop(EventLoop *loop);
+
+/*
+Adds a timer that produces EVENT_TIMER events.
+
+Arguments:
+   loop - the event loop
+   intervalNs - the time until the timer is due, and between repeats
+   repeat - keep firing every intervalNs. A repeating timer that falls behind fires once and
+            is rescheduled from now
+   userData - passed on in the events
+
+Returns:
+   The timer id
+*/
+int32_t addEventTimer(EventLoop *loop, uint64_t intervalNs, bool repeat, void *userData);
+
+/*
+Removes a timer. Events it already produced are still returned.
+
+Arguments:
+   loop - the event loop
+   id - the id returned by addEventTimer
+
+Returns:
+   Void
+*/
+void removeEventTimer(EventLoop *loop, int32_t id);
+
+/*
+Watches a handle for readiness, producing EVENT_HANDLE events. Watching a handle again
+replaces its events and userData. On POSIX the handle carries a file descriptor, e.g. of a
+socket or pipe. On Windows it is any waitable handle, reported as EVENT_READABLE when it is
+signaled.
+
+Arguments:
+   loop - the event loop
+   handle - the handle to watch
+   events - EVENT_READABLE and/or EVENT_WRITABLE
+   userData - passed on in the events
+
+Returns:
+   Void
+*/
+void watchEventHandle(EventLoop *loop, HANDLE handle, uint32_t events, void *userData);
+
+/*
+Stops watching a handle.
+
+Arguments:
+   loop - the event loop
+   handle - the handle passed to watchEventHandle
+
+Returns:
+   Void
+*/
+void unwatchEventHandle(EventLoop *loop, HANDLE handle);
+
+/*
+Returns the next event, waiting for one if none is queued.
+
+Arguments:
+   loop - the event loop
+   event - receives the event
+   timeoutNs - the longest time to wait, 0 to only check, negative to wait without a timeout
+
+Returns:
+   false if the timeout passed without an event, or wakeEventLoop was called
+*/
+bool pollEvent(EventLoop *loop, Event *event, int64_t timeoutNs);
+
+/*
+Makes a waiting pollEvent return, e.g. after another thread changed data the console shows.
+Safe to call from any thread.
+
+Arguments:
+   loop - the event loop to wake
+
+Returns:
+   Void
+*/
+void wakeEventLoop(EventLoop *loop);
+
+#endif
@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "utf8.h"
+
+// Largest precision handled by the fixed point path of %f, larger ones go through snprintf
+#define FORMAT_MAX_FAST_PRECISION 9
+
+// Scaled values from 2^52 on go through snprintf, the fast path would make up digits beyond 2^53
+#define FORMAT_MAX_FAST_SCALED 4503599627370496.0
+
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t powersOf10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull};
+
+// Writes cells of a single framebuffer row, everything outside [start, end) is clipped
+typedef struct FormatCursor
+{
+    Cell *cells;
+    int32_t col;
+    int32_t start;
+    int32_t end;
+    uint16_t fg;
+    uint16_t bg;
+    uint32_t style; // Set by %S, or the console colors fg | bg
+    int32_t written;
+} FormatCursor;
+
+typedef struct FormatSpec
+{
+    bool leftAlign;
+    bool zeroPad;
+    bool plus;
+    bool space;
+    int32_t width;
+    int32_t precision; // -1 when not given
+    int32_t length;    // 0, 'h', 'H' (hh), 'l', 'L' (ll), 'z', 'j', 't'
+} FormatSpec;
+
+static void putCell(FormatCursor *cur, uint32_t c)
+{
+    if (cur->col >= cur->start && cur->col < cur->end)
+    {
+        Cell *cell = &cur->cells[cur->col];
+        cell->Char = c;
+        cell->Style = cur->style;
+        cur->written++;
+    }
+
+    cur->col++;
+}
+
+// Writes a codepoint taking width columns. A cell shows a single codepoint, zero width ones are
+// dropped. A wide char with only one of its cells inside the clip leaves a blank there
+static void putGlyph(FormatCursor *cur, uint32_t c, int32_t width)
+{
+    if (width == 2)
+    {
+        bool whole = cur->col >= cur->start && cur->col + 1 < cur->end;
+        putCell(cur, whole ? c : ' ');
+        putCell(cur, whole ? TCON_WIDE_TAIL : ' ');
+    }
+    else if (width == 1)
+    {
+        putCell(cur, c);
+    }
+}
+
+static void putChar(FormatCursor *cur, uint32_t c)
+{
+    putGlyph(cur, c, utf8CharWidth(c));
+}
+
+static void putRepeat(FormatCursor *cur, uint32_t c, int32_t count)
+{
+    for (int32_t i = 0; i < count; i++)
+        putCell(cur, c);
+}
+
+// ASCII only, used for the digits and signs of numbers
+static void putAscii(FormatCursor *cur, const char *str, int32_t len)
+{
+    for (int32_t i = 0; i < len; i++)
+        putCell(cur, (unsigned char)str[i]);
+}
+
+// Writes a UTF-8 string grapheme by grapheme, runs of ASCII a byte per cell
+static void putUtf8(FormatCursor *cur, const char *str, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len)
+    {
+        size_t ascii = pos + utf8AsciiPrefix(str + pos, len - pos);
+        for (; pos < ascii; pos++)
+            putCell(cur, (unsigned char)str[pos]);
+
+        if (pos < len)
+        {
+            uint32_t c;
+            int32_t width;
+            pos += utf8Grapheme(str + pos, len - pos, &c, &width);
+            putGlyph(cur, c, width);
+        }
+    }
+}
+
+// Writes the digits of value right-aligned so they end at end, returns the first digit
+static char *formatDecimal(char *end, uint64_t value)
+{
+    while (value >= 100)
+    {
+        uint32_t pair = (uint32_t)(value % 100) * 2;
+        value /= 100;
+        *--end = digitPairs[pair + 1];
+        *--end = digitPairs[pair];
+    }
+
+    if (value >= 10)
+    {
+        uint32_t pair = (uint32_t)value * 2;
+        *--end = digitPairs[pair + 1];
+        *--end = digitPairs[pair];
+    }
+    else
+    {
+        *--end = (char)('0' + value);
+    }
+
+    return end;
+}
+
+static char *formatHex(char *end, uint64_t value, bool upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    do
+    {
+        *--end = digits[value & 0x0F];
+        value >>= 4;
+    } while (value > 0);
+
+    return end;
+}
+
+// Pads and writes a converted number: sign/prefix, zero padding and digits
+static void putNumber(FormatCursor *cur, FormatSpec *spec, const char *prefix, int32_t prefixLen, const char *digits, int32_t digitsLen)
+{
+    // A precision sets the minimum amount of digits, "%.0d" of 0 prints nothing
+    int32_t zeros = 0;
+    if (spec->precision >= 0)
+    {
+        if (spec->precision == 0 && digitsLen == 1 && digits[0] == '0')
+            digitsLen = 0;
+        if (spec->precision > digitsLen)
+            zeros = spec->precision - digitsLen;
+    }
+
+    int32_t len = prefixLen + zeros + digitsLen;
+    int32_t pad = spec->width > len ? spec->width - len : 0;
+
+    if (spec->zeroPad && !spec->leftAlign && spec->precision < 0)
+    {
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (!spec->leftAlign)
+        putRepeat(cur, ' ', pad);
+
+    putAscii(cur, prefix, prefixLen);
+    putRepeat(cur, '0', zeros);
+    putAscii(cur, digits, digitsLen);
+
+    if (spec->leftAlign)
+        putRepeat(cur, ' ', pad);
+}
+
+static void putSigned(FormatCursor *cur, FormatSpec *spec, int64_t value)
+{
+    char buffer[24];
+    char *end = buffer + sizeof(buffer);
+    uint64_t magnitude = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+    char *digits = formatDecimal(end, magnitude);
+
+    const char *sign = value < 0 ? "-" : spec->plus ? "+" : spec->space ? " " : "";
+    putNumber(cur, spec, sign, (int32_t)strlen(sign), digits, (int32_t)(end - digits));
+}
+
+static void putFloat(FormatCursor *cur, FormatSpec *spec, double value)
+{
+    int32_t precision = spec->precision < 0 ? 6 : spec->precision;
+    bool negative = signbit(value);
+    double magnitude = fabs(value);
+    const char *sign = negative ? "-" : spec->plus ? "+" : spec->space ? " " : "";
+
+    FormatSpec plain = *spec;
+    plain.precision = -1;
+
+    if (isnan(value) || isinf(value))
+    {
+        plain.zeroPad = false;
+        putNumber(cur, &plain, sign, (int32_t)strlen(sign), isnan(value) ? "nan" : "inf", 3);
+        return;
+    }
+
+    // Fixed point fast path while the scaled value is below 2^52, where every product is an
+    // integer plus a multiple of its ulp and the rounding error of the product is at most a quarter
+    if (precision <= FORMAT_MAX_FAST_PRECISION && magnitude * powersOf10[precision] < FORMAT_MAX_FAST_SCALED)
+    {
+        uint64_t scale = powersOf10[precision];
+        double product = magnitude * scale;
+        uint64_t scaled = (uint64_t)product;
+
+        // The product is rounded, fma gives what rounding took off. The fraction is compared
+        // against a half with that error added, the sign of the sum is exact, so near halves
+        // round like printf does on the exact decimal value, and exact halves round to even
+        double error = fma(magnitude, (double)scale, -product);
+        double excess = (product - (double)scaled - 0.5) + error;
+        if (excess > 0 || (excess == 0 && (scaled & 1)))
+            scaled++;
+
+        char buffer[48];
+        char *end = buffer + sizeof(buffer);
+        char *p = end;
+
+        if (precision > 0)
+        {
+            uint64_t fraction = scaled % scale;
+            for (int32_t i = 0; i < precision; i++)
+            {
+                *--p = (char)('0' + fraction % 10);
+                fraction /= 10;
+            }
+            *--p = '.';
+        }
+
+        p = formatDecimal(p, scaled / scale);
+        putNumber(cur, &plain, sign, (int32_t)strlen(sign), p, (int32_t)(end - p));
+        return;
+    }
+
+    // Huge values or precisions, snprintf into a stack buffer is still free of heap allocations
+    char buffer[512];
+    int32_t len = snprintf(buffer, sizeof(buffer), "%.*f", precision > 64 ? 64 : precision, magnitude);
+    if (len < 0 || len >= (int32_t)sizeof(buffer))
+        len = (int32_t)sizeof(buffer) - 1;
+
+    putNumber(cur, &plain, sign, (int32_t)strlen(sign), buffer, len);
+}
+
+static int64_t nextSigned(va_list *args, int32_t length)
+{
+    switch (length)
+    {
+    case 'l':
+        return va_arg(*args, long);
+    case 'L':
+        return va_arg(*args, long long);
+    case 'z':
+    case 't':
+        return va_arg(*args, ptrdiff_t);
+    case 'j':
+        return va_arg(*args, intmax_t);
+    case 'h':
+        return (short)va_arg(*args, int);
+    case 'H':
+        return (signed char)va_arg(*args, int);
+    default:
+        return va_arg(*args, int);
+    }
+}
+
+static uint64_t nextUnsigned(va_list *args, int32_t length)
+{
+    switch (length)
+    {
+    case 'l':
+        return va_arg(*args, unsigned long);
+    case 'L':
+        return va_arg(*args, unsigned long long);
+    case 'z':
+    case 't':
+        return va_arg(*args, size_t);
+    case 'j':
+        return va_arg(*args, uintmax_t);
+    case 'h':
+        return (unsigned short)va_arg(*args, unsigned int);
+    case 'H':
+        return (unsigned char)va_arg(*args, unsigned int);
+    default:
+        return va_arg(*args, unsigned int);
+    }
+}
+
+// Parses flags, width, precision and length of a conversion, returns the conversion char
+static const char *parseSpec(const char *p, FormatSpec *spec, va_list *args)
+{
+    memset(spec, 0, sizeof(FormatSpec));
+    spec->precision = -1;
+
+    for (;; p++)
+    {
+        if (*p == '-')
+            spec->leftAlign = true;
+        else if (*p == '0')
+            spec->zeroPad = true;
+        else if (*p == '+')
+            spec->plus = true;
+        else if (*p == ' ')
+            spec->space = true;
+        else
+            break;
+    }
+
+    if (*p == '*')
+    {
+        spec->width = va_arg(*args, int);
+        if (spec->width < 0)
+        {
+            spec->leftAlign = true;
+            spec->width = -spec->width;
+        }
+        p++;
+    }
+    else
+    {
+        while (*p >= '0' && *p <= '9')
+            spec->width = spec->width * 10 + (*p++ - '0');
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        spec->precision = 0;
+        if (*p == '*')
+        {
+            spec->precision = va_arg(*args, int);
+            p++;
+        }
+        else
+        {
+            while (*p >= '0' && *p <= '9')
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    if (p[0] == 'h' && p[1] == 'h')
+    {
+        spec->length = 'H';
+        p += 2;
+    }
+    else if (p[0] == 'l' && p[1] == 'l')
+    {
+        spec->length = 'L';
+        p += 2;
+    }
+    else if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't')
+    {
+        spec->length = *p++;
+    }
+
+    return p;
+}
+
+int32_t vwriteFormat(Console *con, int32_t row, int32_t col, int32_t maxWidth, ColorForeground fgColor, ColorBackground bgColor, const char *format, va_list args)
+{
+    if (row < 0 || row >= con->rows || !format)
+        return 0;
+
+    FormatCursor cur;
+    cur.cells = getCell(con, row, 0);
+    cur.col = col;
+    cur.start = col < 0 ? 0 : col;
+    cur.end = con->cols;
+    if (maxWidth > 0 && col + maxWidth < cur.end)
+        cur.end = col + maxWidth;
+    cur.fg = fgColor;
+    cur.bg = bgColor;
+    cur.style = TCON_CONSOLE_STYLE(fgColor, bgColor);
+    cur.written = 0;
+
+    // Work on a copy so the caller's va_list stays usable, and so it can be passed by pointer
+    va_list ap;
+    va_copy(ap, args);
+
+    const char *p = format;
+    while (*p)
+    {
+        // Literal text up to the next conversion
+        const char *text = p;
+        while (*p && *p != '%')
+            p++;
+        if (p > text)
+            putUtf8(&cur, text, p - text);
+
+        if (!*p)
+            break;
+
+        const char *conversion = p++;
+        FormatSpec spec;
+        p = parseSpec(p, &spec, &ap);
+
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+            putSigned(&cur, &spec, nextSigned(&ap, spec.length));
+            break;
+        case 'u':
+        {
+            char buffer[24];
+            char *end = buffer + sizeof(buffer);
+            char *digits = formatDecimal(end, nextUnsigned(&ap, spec.length));
+            putNumber(&cur, &spec, "", 0, digits, (int32_t)(end - digits));
+            break;
+        }
+        case 'x':
+        case 'X':
+        case 'p':
+        {
+            char buffer[24];
+            char *end = buffer + sizeof(buffer);
+            uint64_t value = *p == 'p' ? (uint64_t)(uintptr_t)va_arg(ap, void *) : nextUnsigned(&ap, spec.length);
+            char *digits = formatHex(end, value, *p == 'X');
+            putNumber(&cur, &spec, *p == 'p' ? "0x" : "", *p == 'p' ? 2 : 0, digits, (int32_t)(end - digits));
+            break;
+        }
+        case 'f':
+            putFloat(&cur, &spec, va_arg(ap, double));
+            break;
+        case 'c':
+        {
+            uint32_t c = (uint32_t)va_arg(ap, int);
+            int32_t width = utf8CharWidth(c);
+            int32_t pad = spec.width > width ? spec.width - width : 0;
+            if (!spec.leftAlign)
+                putRepeat(&cur, ' ', pad);
+            putChar(&cur, c);
+            if (spec.leftAlign)
+                putRepeat(&cur, ' ', pad);
+            break;
+        }
+        case 's':
+        {
+            const char *str = va_arg(ap, const char *);
+            if (!str)
+                str = "(null)";
+
+            // The precision cuts the string at a grapheme boundary, both count columns
+            size_t len = strlen(str);
+            int32_t width = 0;
+            if (spec.precision >= 0)
+                len = utf8Fit(str, len, spec.precision, &width);
+            else if (spec.width > 0)
+                width = utf8Width(str, len);
+            int32_t pad = spec.width > width ? spec.width - width : 0;
+
+            if (!spec.leftAlign)
+                putRepeat(&cur, ' ', pad);
+            putUtf8(&cur, str, len);
+            if (spec.leftAlign)
+                putRepeat(&cur, ' ', pad);
+            break;
+        }
+        case 'F':
+            cur.fg = (uint16_t)va_arg(ap, int);
+            cur.style = TCON_CONSOLE_STYLE(cur.fg, cur.bg);
+            break;
+        case 'B':
+            cur.bg = (uint16_t)va_arg(ap, int);
+            cur.style = TCON_CONSOLE_STYLE(cur.fg, cur.bg);
+            break;
+        case 'S':
+            cur.style = va_arg(ap, uint32_t);
+            break;
+        case 'R':
+            cur.fg = fgColor;
+            cur.bg = bgColor;
+            cur.style = TCON_CONSOLE_STYLE(fgColor, bgColor);
+            break;
+        case '%':
+            putChar(&cur, '%');
+            break;
+        default:
+            // Unknown conversion, write it as it is
+            putUtf8(&cur, conversion, (*p ? p + 1 : p) - conversion);
+            break;
+        }
+
+        if (*p)
+            p++;
+    }
+
+    va_end(ap);
+    return cur.written;
+}
+
+int32_t writeFormat(Console *con, int32_t row, int32_t col, int32_t maxWidth, ColorForeground fgColor, ColorBackground bgColor, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int32_t written = vwriteFormat(con, row, col, maxWidth, fgColor, bgColor, format, args);
+    va_end(args);
+
+    return written;
+}
+
+void printFormat(Console con, HANDLE hConsole, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor, bool hlt, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vwriteFormat(&con, row, col, 0, fgColor, bgColor, format, args);
+    va_end(args);
+
+    renderConsole(con, hConsole, hlt);
+}
@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "headless.h"
+#include "utf8.h"
+
+static const char *hexDigits = "0123456789ABCDEF";
+
+// Style keys of golden cells, the others index the styles of the frame
+#define GOLDEN_PLAIN -1
+#define GOLDEN_MISSING -2
+
+static void headlessBeginFrame(TconSink *sink, int32_t rows, int32_t cols)
+{
+    HeadlessSink *hs = (HeadlessSink *)sink;
+    hs->frameCells = 0;
+    hs->frameRuns = 0;
+    hs->frameScrolls = 0;
+}
+
+static void headlessWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    HeadlessSink *hs = (HeadlessSink *)sink;
+
+    // Clip like a terminal would
+    if (row < 0 || row >= hs->rows || col >= hs->cols)
+        return;
+    if (col + len > hs->cols)
+        len = hs->cols - col;
+
+    memcpy(&hs->grid[row * hs->cols + col], cells, len * sizeof(Cell));
+
+    hs->frameCells += len;
+    hs->frameRuns++;
+    sink->frameBytes += len * sizeof(Cell);
+}
+
+static void headlessScroll(TconSink *sink, int32_t top, int32_t rows, int32_t count)
+{
+    HeadlessSink *hs = (HeadlessSink *)sink;
+
+    // The grid may be smaller than the console, rows past it are gone like they would be on a terminal
+    if (top < 0 || top >= hs->rows)
+        return;
+    if (top + rows > hs->rows)
+        rows = hs->rows - top;
+
+    int32_t lines = count > 0 ? count : -count;
+    if (lines > rows)
+        lines = rows;
+
+    Cell *region = &hs->grid[top * hs->cols];
+    size_t rowSize = (size_t)hs->cols * sizeof(Cell);
+
+    if (count > 0)
+        memmove(region, region + lines * hs->cols, (size_t)(rows - lines) * rowSize);
+    else
+        memmove(region + lines * hs->cols, region, (size_t)(rows - lines) * rowSize);
+
+    // Exposed rows are blank, as a terminal erases them
+    Cell *exposed = count > 0 ? region + (rows - lines) * hs->cols : region;
+    for (int32_t i = 0; i < lines * hs->cols; i++)
+    {
+        exposed[i].Char = L' ';
+        exposed[i].Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+    }
+
+    hs->frameScrolls++;
+}
+
+static void headlessEndFrame(TconSink *sink)
+{
+    HeadlessSink *hs = (HeadlessSink *)sink;
+    hs->frames++;
+    hs->totalCells += hs->frameCells;
+    hs->totalRuns += hs->frameRuns;
+    hs->totalScrolls += hs->frameScrolls;
+}
+
+void initHeadlessSink(HeadlessSink *sink, int32_t rows, int32_t cols)
+{
+    memset(sink, 0, sizeof(HeadlessSink));
+    sink->sink.beginFrame = headlessBeginFrame;
+    sink->sink.writeRun = headlessWriteRun;
+    sink->sink.scroll = headlessScroll;
+    sink->sink.endFrame = headlessEndFrame;
+    sink->rows = rows;
+    sink->cols = cols;
+
+    TCON_STAT_ALLOC(1);
+    sink->grid = malloc((size_t)rows * cols * sizeof(Cell));
+    if (!sink->grid)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int32_t i = 0; i < rows * cols; i++)
+    {
+        sink->grid[i].Char = L' ';
+        sink->grid[i].Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+    }
+}
+
+void freeHeadlessSink(HeadlessSink *sink)
+{
+    free(sink->grid);
+    sink->grid = NULL;
+}
+
+Cell *getHeadlessCell(HeadlessSink *sink, int32_t row, int32_t col)
+{
+    if (row < 0 || row >= sink->rows || col < 0 || col >= sink->cols)
+        return NULL;
+
+    return &sink->grid[row * sink->cols + col];
+}
+
+// Chars as they are stored in golden frames, control chars can't be part of a text line. The
+// tail of a wide char stays TCON_WIDE_TAIL, halves of a wide char without the other are blanks
+static uint32_t goldenChar(const Cell *row, int32_t col, int32_t cols)
+{
+    uint32_t c = row[col].Char;
+
+    if (c == TCON_WIDE_TAIL)
+        return col > 0 && utf8CharWidth(row[col - 1].Char) == 2 ? c : ' ';
+    if (utf8CharWidth(c) == 2)
+        return col + 1 < cols && row[col + 1].Char == TCON_WIDE_TAIL ? c : ' ';
+
+    return (c < 0x20 || c == 0x7F) ? ' ' : c;
+}
+
+// Colors as they are stored in golden frames, styles beyond the console colors by the closest ones
+static uint32_t cellColors(HeadlessSink *sink, const Cell *cell)
+{
+    if (cell->Style < TCON_STYLE_INTERNED)
+        return cell->Style;
+
+    TconStyle style = getStyle(sink->sink.styles, cell->Style);
+    return getStyleConsoleColors(&style);
+}
+
+// Interned style of a cell, false for cells in plain console colors
+static bool cellStyle(HeadlessSink *sink, const Cell *cell, TconStyle *style)
+{
+    if (cell->Style < TCON_STYLE_INTERNED)
+        return false;
+
+    *style = getStyle(sink->sink.styles, cell->Style);
+    return true;
+}
+
+static bool styleEquals(const TconStyle *a, const TconStyle *b)
+{
+    return a->foreground == b->foreground && a->background == b->background && a->attributes == b->attributes;
+}
+
+// A color of a golden style: c and the console color in hex, p and the palette index or # and
+// the RGB value in hex
+static int32_t formatGoldenColor(char *out, size_t size, uint32_t color)
+{
+    switch (TCON_COLOR_KIND(color))
+    {
+    case TCON_COLOR_PALETTE:
+        return snprintf(out, size, "p%" PRIu32, color & 0xFF);
+    case TCON_COLOR_RGB:
+        return snprintf(out, size, "#%06" PRIx32, color & 0xFFFFFF);
+    default:
+        return snprintf(out, size, "c%" PRIX32, color & 0x0F);
+    }
+}
+
+static bool parseGoldenColor(const char *token, uint32_t *color)
+{
+    char *end = NULL;
+    unsigned long value = 0;
+
+    switch (token[0])
+    {
+    case 'p':
+        value = strtoul(token + 1, &end, 10);
+        *color = TCON_PALETTE(value);
+        return end != token + 1 && *end == '\0' && value <= 0xFF;
+    case '#':
+        value = strtoul(token + 1, &end, 16);
+        *color = TCON_RGB(value >> 16, value >> 8, value);
+        return end == token + 7 && *end == '\0';
+    case 'c':
+        value = strtoul(token + 1, &end, 16);
+        *color = (uint32_t)value;
+        return end != token + 1 && *end == '\0' && value <= 0x0F;
+    default:
+        return false;
+    }
+}
+
+// A style as it is stored in golden frames: foreground, background and the attributes as
+// b, u and r, or - without any
+static void formatGoldenStyle(char *out, size_t size, const TconStyle *style)
+{
+    int32_t len = formatGoldenColor(out, size, style->foreground);
+    out[len++] = ' ';
+    len += formatGoldenColor(out + len, size - len, style->background);
+    out[len++] = ' ';
+
+    if (style->attributes & TCON_BOLD)
+        out[len++] = 'b';
+    if (style->attributes & TCON_UNDERLINE)
+        out[len++] = 'u';
+    if (style->attributes & TCON_REVERSE)
+        out[len++] = 'r';
+    if (out[len - 1] == ' ')
+        out[len++] = '-';
+
+    out[len] = '\0';
+}
+
+static bool parseGoldenStyle(char *line, TconStyle *style)
+{
+    char fg[16];
+    char bg[16];
+    char attributes[8];
+    if (sscanf(line, "%15s %15s %7s", fg, bg, attributes) != 3)
+        return false;
+
+    style->attributes = 0;
+    for (const char *a = attributes; *a && *a != '-'; a++)
+    {
+        if (*a == 'b')
+            style->attributes |= TCON_BOLD;
+        else if (*a == 'u')
+            style->attributes |= TCON_UNDERLINE;
+        else if (*a == 'r')
+            style->attributes |= TCON_REVERSE;
+        else
+            return false;
+    }
+
+    return parseGoldenColor(fg, &style->foreground) && parseGoldenColor(bg, &style->background);
+}
+
+int32_t getHeadlessRowText(HeadlessSink *sink, int32_t row, char *out, size_t size)
+{
+    if (row < 0 || row >= sink->rows)
+        return -1;
+
+    const Cell *cells = &sink->grid[row * sink->cols];
+    char *p = out;
+    for (int32_t col = 0; col < sink->cols; col++)
+    {
+        uint32_t c = goldenChar(cells, col, sink->cols);
+        if (c == TCON_WIDE_TAIL)
+            continue;
+
+        if ((size_t)(p - out) + 5 > size)
+            return -1;
+        p = utf8Encode(p, c);
+    }
+
+    *p = '\0';
+    return (int32_t)(p - out);
+}
+
+bool saveGoldenFrame(HeadlessSink *sink, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    TCON_STAT_ALLOC(1);
+    char *line = malloc((size_t)sink->cols * 4 + 1);
+    if (!line)
+    {
+        fclose(file);
+        return false;
+    }
+
+    fprintf(file, "tcon golden 2\n%" PRId32 " %" PRId32 "\ntext\n", sink->rows, sink->cols);
+    for (int32_t row = 0; row < sink->rows; row++)
+    {
+        getHeadlessRowText(sink, row, line, (size_t)sink->cols * 4 + 1);
+        fprintf(file, "|%s|\n", line);
+    }
+
+    fprintf(file, "fg\n");
+    for (int32_t row = 0; row < sink->rows; row++)
+    {
+        for (int32_t col = 0; col < sink->cols; col++)
+            line[col] = hexDigits[cellColors(sink, &sink->grid[row * sink->cols + col]) & 0x0F];
+        line[sink->cols] = '\0';
+        fprintf(file, "%s\n", line);
+    }
+
+    fprintf(file, "bg\n");
+    for (int32_t row = 0; row < sink->rows; row++)
+    {
+        for (int32_t col = 0; col < sink->cols; col++)
+            line[col] = hexDigits[(cellColors(sink, &sink->grid[row * sink->cols + col]) >> 4) & 0x0F];
+        line[sink->cols] = '\0';
+        fprintf(file, "%s\n", line);
+    }
+
+    // Interned styles are listed once in order of their first cell, cells refer to them by
+    // their position in the list, . is a cell in plain console colors
+    TCON_STAT_ALLOC(2);
+    uint32_t *styles = malloc(((size_t)sink->rows * sink->cols + 1) * sizeof(uint32_t));
+    int32_t *keys = malloc(((size_t)sink->rows * sink->cols + 1) * sizeof(int32_t));
+    int32_t styleCount = 0;
+    if (!styles || !keys)
+    {
+        free(styles);
+        free(keys);
+        free(line);
+        fclose(file);
+        return false;
+    }
+
+    for (int32_t i = 0; i < sink->rows * sink->cols; i++)
+    {
+        keys[i] = -1;
+        if (sink->grid[i].Style < TCON_STYLE_INTERNED)
+            continue;
+
+        int32_t key = 0;
+        while (key < styleCount && styles[key] != sink->grid[i].Style)
+            key++;
+        if (key == styleCount)
+            styles[styleCount++] = sink->grid[i].Style;
+        keys[i] = key;
+    }
+
+    fprintf(file, "styles %" PRId32 "\n", styleCount);
+    for (int32_t key = 0; key < styleCount; key++)
+    {
+        TconStyle style = getStyle(sink->sink.styles, styles[key]);
+        char described[48];
+        formatGoldenStyle(described, sizeof(described), &style);
+        fprintf(file, "%s\n", described);
+    }
+
+    fprintf(file, "cells\n");
+    for (int32_t row = 0; row < sink->rows; row++)
+    {
+        for (int32_t col = 0; col < sink->cols; col++)
+        {
+            int32_t key = keys[row * sink->cols + col];
+            if (col > 0)
+                fputc(' ', file);
+
+            if (key < 0)
+                fputc('.', file);
+            else
+                fprintf(file, "%" PRId32, key);
+        }
+        fprintf(file, "\n");
+    }
+
+    free(styles);
+    free(keys);
+    free(line);
+    return fclose(file) == 0;
+}
+
+static char *readFile(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    TCON_STAT_ALLOC(1);
+    char *data = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (!data || fread(data, 1, (size_t)length, file) != (size_t)length)
+    {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    data[length] = '\0';
+    *size = (size_t)length;
+    return data;
+}
+
+// Splits off the next line, strips CR and returns NULL at the end of the data
+static char *nextLine(char **cursor, char *end, size_t *len)
+{
+    char *line = *cursor;
+    if (line >= end)
+        return NULL;
+
+    char *newline = memchr(line, '\n', end - line);
+    char *lineEnd = newline ? newline : end;
+    *cursor = newline ? newline + 1 : end;
+
+    if (lineEnd > line && lineEnd[-1] == '\r')
+        lineEnd--;
+
+    *len = lineEnd - line;
+    return line;
+}
+
+static int32_t hexValue(char c)
+{
+    const char *digit = strchr(hexDigits, c);
+    return (digit && c) ? (int32_t)(digit - hexDigits) : -1;
+}
+
+// Wide char tails are reported as <tail>
+static void reportCell(FILE *report, int32_t row, int32_t col, uint32_t expChar, int32_t expFg, int32_t expBg, uint32_t gotChar, uint32_t gotColors)
+{
+    char expected[8];
+    char actual[8];
+    strcpy(expected, "<tail>");
+    strcpy(actual, "<tail>");
+    if (expChar != TCON_WIDE_TAIL)
+        *utf8Encode(expected, expChar) = '\0';
+    if (gotChar != TCON_WIDE_TAIL)
+        *utf8Encode(actual, gotChar) = '\0';
+
+    fprintf(report, "row %" PRId32 " col %" PRId32 ": expected '%s' fg=%X bg=%X, got '%s' fg=%X bg=%X\n",
+            row, col, expected, expFg, expBg, actual, gotColors & 0x0F, (gotColors >> 4) & 0x0F);
+}
+
+static void reportStyle(FILE *report, int32_t row, int32_t col, const TconStyle *expected, const TconStyle *actual)
+{
+    char expectedText[48] = "plain";
+    char actualText[48] = "plain";
+    if (expected)
+        formatGoldenStyle(expectedText, sizeof(expectedText), expected);
+    if (actual)
+        formatGoldenStyle(actualText, sizeof(actualText), actual);
+
+    fprintf(report, "row %" PRId32 " col %" PRId32 ": expected style '%s', got '%s'\n", row, col, expectedText, actualText);
+}
+
+// Reads the styles section of a version 2 golden frame: the list of styles, then one key per
+// cell. Keys that are missing or refer to no style are GOLDEN_MISSING and never match
+static bool readGoldenStyles(char **cursor, char *end, int32_t rows, int32_t cols, TconStyle **styles, int32_t **keys)
+{
+    size_t len = 0;
+    int32_t count = -1;
+    char *line = nextLine(cursor, end, &len);
+    if (!line || sscanf(line, "styles %" SCNd32, &count) != 1 || count < 0 || count > rows * cols)
+        return false;
+
+    TCON_STAT_ALLOC(2);
+    *styles = malloc(((size_t)count + 1) * sizeof(TconStyle));
+    *keys = malloc(((size_t)rows * cols + 1) * sizeof(int32_t));
+    if (!*styles || !*keys)
+        return false;
+
+    char text[64];
+    for (int32_t i = 0; i < count; i++)
+    {
+        line = nextLine(cursor, end, &len);
+        if (!line || len >= sizeof(text))
+            return false;
+
+        memcpy(text, line, len);
+        text[len] = '\0';
+        if (!parseGoldenStyle(text, &(*styles)[i]))
+            return false;
+    }
+
+    if (!nextLine(cursor, end, &len))
+        return false;
+
+    for (int32_t row = 0; row < rows; row++)
+    {
+        line = nextLine(cursor, end, &len);
+        if (!line)
+            return false;
+
+        const char *p = line;
+        const char *lineEnd = line + len;
+        for (int32_t col = 0; col < cols; col++)
+        {
+            while (p < lineEnd && *p == ' ')
+                p++;
+
+            int32_t key = GOLDEN_MISSING;
+            if (p < lineEnd && *p == '.')
+            {
+                key = GOLDEN_PLAIN;
+                p++;
+            }
+            else if (p < lineEnd && *p >= '0' && *p <= '9')
+            {
+                int64_t value = 0;
+                while (p < lineEnd && *p >= '0' && *p <= '9')
+                {
+                    if (value <= count)
+                        value = value * 10 + (*p - '0');
+                    p++;
+                }
+                if (value < count)
+                    key = (int32_t)value;
+            }
+
+            (*keys)[row * cols + col] = key;
+        }
+    }
+
+    return true;
+}
+
+int32_t compareGoldenFrame(HeadlessSink *sink, const char *path, FILE *report)
+{
+    size_t size = 0;
+    char *data = readFile(path, &size);
+    if (!data)
+    {
+        if (report)
+            fprintf(report, "%s: can't read golden frame\n", path);
+        return -1;
+    }
+
+    char *cursor = data;
+    char *end = data + size;
+    size_t len = 0;
+    int32_t rows = 0;
+    int32_t cols = 0;
+
+    // Version 1 frames have no styles, their cells are only compared by console colors
+    char *magic = nextLine(&cursor, end, &len);
+    int32_t version = 0;
+    if (magic && len == 13 && strncmp(magic, "tcon golden ", 12) == 0)
+        version = magic[12] - '0';
+
+    char *dims = magic ? nextLine(&cursor, end, &len) : NULL;
+
+    if ((version != 1 && version != 2) || !dims || sscanf(dims, "%" SCNd32 " %" SCNd32, &rows, &cols) != 2)
+    {
+        if (report)
+            fprintf(report, "%s: not a golden frame\n", path);
+        free(data);
+        return -1;
+    }
+
+    if (rows != sink->rows || cols != sink->cols)
+    {
+        if (report)
+            fprintf(report, "%s: golden frame is %" PRId32 "x%" PRId32 ", grid is %" PRId32 "x%" PRId32 "\n",
+                    path, cols, rows, sink->cols, sink->rows);
+        free(data);
+        return -1;
+    }
+
+    TCON_STAT_ALLOC(3);
+    uint32_t *chars = malloc((size_t)rows * cols * sizeof(uint32_t));
+    int32_t *fg = malloc((size_t)rows * cols * sizeof(int32_t));
+    int32_t *bg = malloc((size_t)rows * cols * sizeof(int32_t));
+    bool valid = chars && fg && bg && nextLine(&cursor, end, &len) != NULL;
+
+    // Text rows: every char up to the closing delimiter, missing cells count as different
+    for (int32_t row = 0; row < rows && valid; row++)
+    {
+        char *line = nextLine(&cursor, end, &len);
+        if (!line || len < 2 || line[0] != '|' || line[len - 1] != '|')
+        {
+            valid = false;
+            break;
+        }
+
+        // A wide char covers its tail cell as well
+        size_t pos = 1;
+        for (int32_t col = 0; col < cols; col++)
+        {
+            uint32_t c = 0;
+            if (pos < len - 1)
+                pos += utf8Decode(line + pos, len - 1 - pos, &c);
+            chars[row * cols + col] = c;
+
+            if (utf8CharWidth(c) == 2 && col + 1 < cols)
+                chars[row * cols + ++col] = TCON_WIDE_TAIL;
+        }
+    }
+
+    int32_t *planes[2] = {fg, bg};
+    for (int32_t plane = 0; plane < 2 && valid; plane++)
+    {
+        valid = nextLine(&cursor, end, &len) != NULL;
+        for (int32_t row = 0; row < rows && valid; row++)
+        {
+            char *line = nextLine(&cursor, end, &len);
+            if (!line)
+            {
+                valid = false;
+                break;
+            }
+
+            for (int32_t col = 0; col < cols; col++)
+                planes[plane][row * cols + col] = (size_t)col < len ? hexValue(line[col]) : -1;
+        }
+    }
+
+    TconStyle *styles = NULL;
+    int32_t *keys = NULL;
+    if (valid && version >= 2)
+        valid = readGoldenStyles(&cursor, end, rows, cols, &styles, &keys);
+
+    int32_t differences = -1;
+    if (valid)
+    {
+        differences = 0;
+        for (int32_t i = 0; i < rows * cols; i++)
+        {
+            const Cell *cell = &sink->grid[i];
+            uint32_t c = goldenChar(&sink->grid[i - i % cols], i % cols, cols);
+            uint32_t colors = cellColors(sink, cell);
+            bool same = chars[i] == c && fg[i] == (int32_t)(colors & 0x0F) && bg[i] == (int32_t)((colors >> 4) & 0x0F);
+
+            // Styles are compared as a whole, truecolor, palette colors and attributes included
+            TconStyle style;
+            bool styled = cellStyle(sink, cell, &style);
+            bool sameStyle = !keys || (keys[i] == GOLDEN_PLAIN ? !styled : keys[i] >= 0 && styled && styleEquals(&styles[keys[i]], &style));
+            if (same && sameStyle)
+                continue;
+
+            if (report && differences < HEADLESS_REPORT_LIMIT)
+            {
+                if (!same)
+                    reportCell(report, i / cols, i % cols, chars[i], fg[i], bg[i], c, colors);
+                else
+                    reportStyle(report, i / cols, i % cols, keys[i] >= 0 ? &styles[keys[i]] : NULL, styled ? &style : NULL);
+            }
+            differences++;
+        }
+
+        if (report && differences > HEADLESS_REPORT_LIMIT)
+            fprintf(report, "... %" PRId32 " differing cells in total\n", differences);
+    }
+    else if (report)
+    {
+        fprintf(report, "%s: truncated golden frame\n", path);
+    }
+
+    free(styles);
+    free(keys);
+    free(chars);
+    free(fg);
+    free(bg);
+    free(data);
+    return differences;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Differing cells listed by compareGoldenFrame before it only counts the rest
+#define HEADLESS_REPORT_LIMIT 16
+
+/*
+Sink that applies every frame to an in-memory grid instead of a terminal, so the grid
+always holds what a terminal would show. Pair it with initHeadlessConsole().
+*/
+typedef struct HeadlessSink
+{
+   TconSink sink;
+   int32_t rows;
+   int32_t cols;
+   Cell *grid;            // rows * cols cells, row after row
+   uint64_t frames;       // Frames presented
+   uint64_t frameCells;   // Cells received in the last frame
+   uint64_t frameRuns;    // Runs received in the last frame
+   uint64_t frameScrolls; // Regions scrolled in the last frame
+   uint64_t totalCells;
+   uint64_t totalRuns;
+   uint64_t totalScrolls;
+} HeadlessSink;
+
+/*
+Initializes a headless sink with a blank grid.
+
+Arguments:
+   sink - the headless sink to initialize
+   rows - the amount of rows of the grid
+   cols - the amount of columns of the grid
+
+Returns:
+   Void
+*/
+void initHeadlessSink(HeadlessSink *sink, int32_t rows, int32_t cols);
+
+/*
+Releases the grid of a headless sink.
+
+Arguments:
+   sink - the headless sink to release
+
+Returns:
+   Void
+*/
+void freeHeadlessSink(HeadlessSink *sink);
+
+/*
+Returns a cell of the grid.
+
+Arguments:
+   sink - the headless sink
+   row - the row of the cell
+   col - the column of the cell
+
+Returns:
+   Pointer to the cell, NULL if it is outside of the grid
+*/
+Cell *getHeadlessCell(HeadlessSink *sink, int32_t row, int32_t col);
+
+/*
+Writes the chars of a grid row as a null-terminated UTF-8 string. A wide char stands for both
+of its cells.
+
+Arguments:
+   sink - the headless sink
+   row - the row to write
+   out - the output buffer
+   size - the size of the output buffer, 4 * cols + 1 always fits
+
+Returns:
+   The length of the string, -1 if the row does not exist or out is too small
+*/
+int32_t getHeadlessRowText(HeadlessSink *sink, int32_t row, char *out, size_t size);
+
+/*
+Stores the grid as a golden frame. The file is plain text: the size, every row between
+'|' delimiters and one hex digit per cell for foreground and background, the closest console
+colors for interned styles, see getStyleConsoleColors(). Interned styles follow as a list of
+foreground, background and attributes (c, p or # for console, palette and RGB colors, b, u
+and r for TCON_BOLD, TCON_UNDERLINE and TCON_REVERSE) and a row of keys into it per grid row,
+. for cells in plain console colors.
+
+Arguments:
+   sink - the headless sink
+   path - the file to write
+
+Returns:
+   True on success
+*/
+bool saveGoldenFrame(HeadlessSink *sink, const char *path);
+
+/*
+Compares the grid against a golden frame stored by saveGoldenFrame. Cells differ by their
+char, their console colors or their interned style, frames of the first version without
+styles are compared without them.
+
+Arguments:
+   sink - the headless sink
+   path - the golden frame to compare with
+   report - receives a line per differing cell (up to HEADLESS_REPORT_LIMIT), may be NULL
+
+Returns:
+   The amount of differing cells, -1 if the golden frame can't be read or has another size
+*/
+int32_t compareGoldenFrame(HeadlessSink *sink, const char *path, FILE *report);
+
+#endif
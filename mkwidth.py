@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Generates utf8width.h, the display width table of utf8CharWidth(), from the Unicode database
+# of the running Python:  python3 mkwidth.py > utf8width.h
+
+import sys
+import unicodedata
+
+BLOCK_BITS = 8
+BLOCK_SIZE = 1 << BLOCK_BITS
+MAX_CODEPOINT = 0x10FFFF
+
+
+def width(c):
+    ch = chr(c)
+    category = unicodedata.category(ch)
+
+    # Combining marks, format controls and the Hangul vowels and final consonants that join the
+    # syllable before them take no column. The soft hyphen is commonly drawn
+    if c != 0x00AD and category in ('Mn', 'Me', 'Cf'):
+        return 0
+    if 0x1160 <= c <= 0x11FF or 0xD7B0 <= c <= 0xD7FF or c == 0x200B:
+        return 0
+
+    # Wide and fullwidth chars, including the unassigned ones of the CJK planes
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    if 0x20000 <= c <= 0x2FFFD or 0x30000 <= c <= 0x3FFFD:
+        return 2
+
+    return 1
+
+
+def main():
+    blocks = []
+    known = {}
+    index = []
+
+    for start in range(0, MAX_CODEPOINT + 1, BLOCK_SIZE):
+        packed = bytearray(BLOCK_SIZE // 4)
+        for c in range(start, start + BLOCK_SIZE):
+            packed[(c - start) >> 2] |= width(c) << ((c & 3) * 2)
+
+        packed = bytes(packed)
+        if packed not in known:
+            known[packed] = len(blocks)
+            blocks.append(packed)
+        index.append(known[packed])
+
+    if len(blocks) > 256:
+        sys.exit('too many distinct blocks for a byte index')
+
+    out = sys.stdout
+    out.write('// Generated by mkwidth.py from Unicode %s, do not edit\n\n' % unicodedata.unidata_version)
+    out.write('#include <inttypes.h>\n\n')
+    out.write('#ifndef UTF8WIDTH_H\n#define UTF8WIDTH_H\n\n')
+    out.write('// A block of the width table covers 1 << UTF8_WIDTH_BLOCK_BITS codepoints\n')
+    out.write('#define UTF8_WIDTH_BLOCK_BITS %d\n\n' % BLOCK_BITS)
+    out.write('// Block of each run of %d codepoints\n' % BLOCK_SIZE)
+    out.write('static const uint8_t utf8WidthIndex[%d] = {\n' % len(index))
+    for i in range(0, len(index), 24):
+        out.write('    ' + ', '.join('%d' % v for v in index[i:i + 24]) + ',\n')
+    out.write('};\n\n')
+    out.write('// Widths of the codepoints of a block, 2 bits each, the lowest bits first\n')
+    out.write('static const uint8_t utf8WidthBlocks[%d][%d] = {\n' % (len(blocks), BLOCK_SIZE // 4))
+    for block in blocks:
+        out.write('    {\n')
+        for i in range(0, len(block), 16):
+            out.write('        ' + ', '.join('0x%02X' % v for v in block[i:i + 16]) + ',\n')
+        out.write('    },\n')
+    out.write('};\n\n#endif\n')
+
+
+main()
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "pool.h"
+#include "backend.h"
+#include "stats.h"
+
+// Workers and the caller wake up this often while they wait, the wakeups themselves are exact
+#define POOL_WAIT_NS 1000000000ull
+
+struct PoolWorker
+{
+    WorkerPool *pool;
+    int32_t index;
+    BackendWakeup *start;
+    BackendThread *thread;
+};
+
+// Runs the share of the current job that belongs to thread index
+static void runShare(WorkerPool *pool, int32_t index)
+{
+    for (int32_t t = index; t < pool->tasks; t += pool->threads)
+        pool->task(pool->arg, t);
+}
+
+static void workerMain(void *arg)
+{
+    PoolWorker *worker = arg;
+    WorkerPool *pool = worker->pool;
+
+    for (;;)
+    {
+        // Each job signals every worker exactly once, the signal publishes the job fields
+        if (!backendWaitWakeup(worker->start, POOL_WAIT_NS))
+            continue;
+
+        if (pool->stopping)
+            break;
+
+        runShare(pool, worker->index);
+        backendSignalWakeup(pool->done);
+    }
+}
+
+WorkerPool *createWorkerPool(int32_t threads)
+{
+    if (threads < 1)
+        threads = 1;
+
+    TCON_STAT_ALLOC(2);
+    WorkerPool *pool = calloc(1, sizeof(WorkerPool));
+    PoolWorker *workers = calloc(threads, sizeof(PoolWorker));
+    if (!pool || !workers)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    pool->threads = threads;
+    pool->workers = workers;
+    pool->done = backendCreateWakeup();
+
+    // The caller is thread 0
+    for (int32_t i = 1; i < threads; i++)
+    {
+        workers[i].pool = pool;
+        workers[i].index = i;
+        workers[i].start = backendCreateWakeup();
+        workers[i].thread = backendStartThread(workerMain, &workers[i]);
+    }
+
+    return pool;
+}
+
+void runWorkerPool(WorkerPool *pool, PoolTask task, void *arg, int32_t tasks)
+{
+    if (!pool || pool->threads == 1 || tasks <= 1)
+    {
+        for (int32_t t = 0; t < tasks; t++)
+            task(arg, t);
+        return;
+    }
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->tasks = tasks;
+
+    // Workers without a task this time are left asleep
+    int32_t busy = tasks < pool->threads ? tasks : pool->threads;
+    for (int32_t i = 1; i < busy; i++)
+        backendSignalWakeup(pool->workers[i].start);
+
+    runShare(pool, 0);
+
+    for (int32_t finished = 1; finished < busy;)
+    {
+        if (backendWaitWakeup(pool->done, POOL_WAIT_NS))
+            finished++;
+    }
+}
+
+void freeWorkerPool(WorkerPool *pool)
+{
+    if (!pool)
+        return;
+
+    pool->stopping = true;
+    for (int32_t i = 1; i < pool->threads; i++)
+        backendSignalWakeup(pool->workers[i].start);
+
+    for (int32_t i = 1; i < pool->threads; i++)
+    {
+        backendJoinThread(pool->workers[i].thread);
+        backendFreeWakeup(pool->workers[i].start);
+    }
+
+    backendFreeWakeup(pool->done);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,65 @@
+#include <stdbool.h>
+#include <inttypes.h>
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct PoolWorker PoolWorker;
+
+// Runs one task of a job, tasks are numbered from 0
+typedef void (*PoolTask)(void *arg, int32_t task);
+
+/*
+Fixed set of threads that run the tasks of one job at a time. The calling thread takes part in
+every job, so a pool of n threads starts n - 1 workers. Tasks are dealt out round robin, task t
+always runs on thread t % threads.
+*/
+typedef struct WorkerPool
+{
+   int32_t threads;     // Including the thread calling runWorkerPool
+   PoolWorker *workers;
+   struct BackendWakeup *done;
+   PoolTask task;       // Job being run, only written while the workers wait
+   void *arg;
+   int32_t tasks;
+   bool stopping;
+} WorkerPool;
+
+/*
+Creates a worker pool.
+
+Arguments:
+   threads - the amount of threads running each job, including the caller of runWorkerPool
+
+Returns:
+   Pointer to the pool
+*/
+WorkerPool *createWorkerPool(int32_t threads);
+
+/*
+Runs tasks 0 to tasks - 1 on the pool and waits for all of them. Only one thread may run jobs
+on a pool.
+
+Arguments:
+   pool - the pool, NULL runs every task on the calling thread
+   task - the function running a single task
+   arg - passed to every task
+   tasks - the amount of tasks
+
+Returns:
+   Void
+*/
+void runWorkerPool(WorkerPool *pool, PoolTask task, void *arg, int32_t tasks);
+
+/*
+Stops the workers of a pool and frees it.
+
+Arguments:
+   pool - the pool to free, NULL is ignored
+
+Returns:
+   Void
+*/
+void freeWorkerPool(WorkerPool *pool);
+
+#endif
@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "backend.h"
+#include "record.h"
+
+// Type byte and payload length in front of every record
+#define RECORD_HEADER_SIZE 5
+// Worst case bytes of one LEB128 number and of one run-length encoded cell
+#define RECORD_MAX_NUMBER_BYTES 10
+#define RECORD_MAX_CELL_BYTES 15
+
+static void reserveRecord(RecordSink *rs, size_t extra)
+{
+    if (rs->len + extra <= rs->cap)
+        return;
+
+    size_t cap = rs->cap ? rs->cap : 4096;
+    while (cap < rs->len + extra)
+        cap *= 2;
+
+    TCON_STAT_ALLOC(1);
+    uint8_t *buf = realloc(rs->buf, cap);
+    if (!buf)
+    {
+        perror("realloc");
+        exit(1);
+    }
+
+    rs->buf = buf;
+    rs->cap = cap;
+}
+
+static uint8_t *putNumber(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+
+    return p;
+}
+
+// Appends cells as runs of equal cells
+static uint8_t *putCells(uint8_t *p, const Cell *cells, int32_t len)
+{
+    int32_t i = 0;
+    while (i < len)
+    {
+        int32_t same = 1;
+        while (i + same < len && cells[i + same].Char == cells[i].Char && cells[i + same].Style == cells[i].Style)
+            same++;
+
+        p = putNumber(p, (uint64_t)same);
+        p = putNumber(p, cells[i].Char);
+        p = putNumber(p, cells[i].Style);
+        i += same;
+    }
+
+    return p;
+}
+
+// Starts a record, its length is filled in by endRecord()
+static size_t beginRecord(RecordSink *rs, RecordType type)
+{
+    reserveRecord(rs, RECORD_HEADER_SIZE);
+    size_t start = rs->len;
+    rs->buf[start] = (uint8_t)type;
+    rs->len += RECORD_HEADER_SIZE;
+    return start;
+}
+
+static void endRecord(RecordSink *rs, size_t start)
+{
+    uint32_t size = (uint32_t)(rs->len - start - RECORD_HEADER_SIZE);
+    for (int32_t i = 0; i < 4; i++)
+        rs->buf[start + 1 + i] = (uint8_t)(size >> (8 * i));
+}
+
+static void writeRecords(RecordSink *rs, size_t from, size_t to)
+{
+    if (to > from && rs->file)
+    {
+        fwrite(rs->buf + from, 1, to - from, rs->file);
+        rs->recordedBytes += to - from;
+    }
+}
+
+static void recordBeginFrame(TconSink *sink, int32_t rows, int32_t cols)
+{
+    RecordSink *rs = (RecordSink *)sink;
+    uint64_t now = tconNowNs();
+
+    if (rs->frames == 0)
+        rs->startNs = now;
+    rs->frameNs = now - rs->startNs;
+
+    // A new size starts from a blank screen, which only a keyframe describes
+    if (rows != rs->rows || cols != rs->cols || !rs->grid)
+    {
+        free(rs->grid);
+        TCON_STAT_ALLOC(1);
+        rs->grid = malloc(((size_t)rows * cols + 1) * sizeof(Cell));
+        if (!rs->grid)
+        {
+            perror("malloc");
+            exit(1);
+        }
+
+        for (int32_t i = 0; i < rows * cols; i++)
+        {
+            rs->grid[i].Char = L' ';
+            rs->grid[i].Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+        }
+
+        rs->rows = rows;
+        rs->cols = cols;
+        rs->keyframe = true;
+    }
+
+    if (rs->frames % RECORD_KEYFRAME_INTERVAL == 0)
+        rs->keyframe = true;
+
+    // Keyframes are written from the grid once the frame was applied to it
+    rs->len = 0;
+    if (!rs->keyframe)
+    {
+        beginRecord(rs, RECORD_FRAME);
+        reserveRecord(rs, RECORD_MAX_NUMBER_BYTES);
+        rs->len = putNumber(rs->buf + rs->len, rs->frameNs) - rs->buf;
+    }
+
+    if (rs->target)
+    {
+        rs->target->styles = sink->styles;
+        rs->target->frameBytes = 0;
+        if (rs->target->beginFrame)
+            rs->target->beginFrame(rs->target, rows, cols);
+    }
+}
+
+static void recordWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    RecordSink *rs = (RecordSink *)sink;
+
+    if (rs->target)
+        rs->target->writeRun(rs->target, row, col, cells, len);
+
+    if (row < 0 || row >= rs->rows || col < 0 || col >= rs->cols)
+        return;
+    if (col + len > rs->cols)
+        len = rs->cols - col;
+
+    memcpy(&rs->grid[row * rs->cols + col], cells, len * sizeof(Cell));
+
+    if (rs->keyframe)
+        return;
+
+    reserveRecord(rs, 1 + 3 * RECORD_MAX_NUMBER_BYTES + (size_t)len * RECORD_MAX_CELL_BYTES);
+    uint8_t *p = rs->buf + rs->len;
+    *p++ = RECORD_EVENT_RUN;
+    p = putNumber(p, (uint64_t)row);
+    p = putNumber(p, (uint64_t)col);
+    p = putNumber(p, (uint64_t)len);
+    p = putCells(p, cells, len);
+    rs->len = p - rs->buf;
+}
+
+static void recordScroll(TconSink *sink, int32_t top, int32_t rows, int32_t count)
+{
+    RecordSink *rs = (RecordSink *)sink;
+
+    rs->target->scroll(rs->target, top, rows, count);
+
+    if (top < 0 || top >= rs->rows || rows <= 0)
+        return;
+    if (top + rows > rs->rows)
+        rows = rs->rows - top;
+
+    int32_t lines = count > 0 ? count : -count;
+    if (lines > rows)
+        lines = rows;
+
+    Cell *region = &rs->grid[top * rs->cols];
+    size_t rowSize = (size_t)rs->cols * sizeof(Cell);
+
+    if (count > 0)
+        memmove(region, region + lines * rs->cols, (size_t)(rows - lines) * rowSize);
+    else
+        memmove(region + lines * rs->cols, region, (size_t)(rows - lines) * rowSize);
+
+    Cell *exposed = count > 0 ? region + (rows - lines) * rs->cols : region;
+    for (int32_t i = 0; i < lines * rs->cols; i++)
+    {
+        exposed[i].Char = L' ';
+        exposed[i].Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+    }
+
+    if (rs->keyframe)
+        return;
+
+    reserveRecord(rs, 1 + 3 * RECORD_MAX_NUMBER_BYTES);
+    uint8_t *p = rs->buf + rs->len;
+    *p++ = RECORD_EVENT_SCROLL;
+    p = putNumber(p, (uint64_t)top);
+    p = putNumber(p, (uint64_t)rows);
+    p = putNumber(p, count > 0 ? (uint64_t)count * 2 : (uint64_t)-count * 2 - 1);
+    rs->len = p - rs->buf;
+}
+
+static void recordEndFrame(TconSink *sink)
+{
+    RecordSink *rs = (RecordSink *)sink;
+
+    if (rs->target)
+    {
+        if (rs->target->endFrame)
+            rs->target->endFrame(rs->target);
+        sink->frameBytes += rs->target->frameBytes;
+    }
+
+    if (rs->keyframe)
+    {
+        size_t start = beginRecord(rs, RECORD_KEYFRAME);
+        reserveRecord(rs, 3 * RECORD_MAX_NUMBER_BYTES + (size_t)rs->rows * rs->cols * RECORD_MAX_CELL_BYTES);
+        uint8_t *p = rs->buf + rs->len;
+        p = putNumber(p, rs->frameNs);
+        p = putNumber(p, (uint64_t)rs->rows);
+        p = putNumber(p, (uint64_t)rs->cols);
+        p = putCells(p, rs->grid, rs->rows * rs->cols);
+        rs->len = p - rs->buf;
+        endRecord(rs, start);
+        rs->keyframes++;
+    }
+    else
+    {
+        reserveRecord(rs, 1);
+        rs->buf[rs->len++] = RECORD_EVENT_END;
+        endRecord(rs, 0);
+    }
+
+    size_t frameLen = rs->len;
+
+    // Styles interned since the last frame go in front of the frame that uses them
+    const TconStyleTable *styles = sink->styles;
+    if (styles && styles->count > rs->styleCount)
+    {
+        int32_t count = styles->count - rs->styleCount;
+        size_t start = beginRecord(rs, RECORD_STYLES);
+        reserveRecord(rs, 2 * RECORD_MAX_NUMBER_BYTES + (size_t)count * 3 * RECORD_MAX_NUMBER_BYTES);
+        uint8_t *p = rs->buf + rs->len;
+        p = putNumber(p, (uint64_t)rs->styleCount + TCON_STYLE_INTERNED);
+        p = putNumber(p, (uint64_t)count);
+        for (int32_t i = rs->styleCount; i < styles->count; i++)
+        {
+            p = putNumber(p, styles->styles[i].foreground);
+            p = putNumber(p, styles->styles[i].background);
+            p = putNumber(p, styles->styles[i].attributes);
+        }
+        rs->len = p - rs->buf;
+        endRecord(rs, start);
+        rs->styleCount = styles->count;
+
+        writeRecords(rs, frameLen, rs->len);
+    }
+
+    writeRecords(rs, 0, frameLen);
+
+    rs->keyframe = false;
+    rs->frames++;
+}
+
+void initRecordSink(RecordSink *sink, FILE *file, TconSink *target)
+{
+    memset(sink, 0, sizeof(RecordSink));
+    sink->sink.beginFrame = recordBeginFrame;
+    sink->sink.writeRun = recordWriteRun;
+    sink->sink.endFrame = recordEndFrame;
+    sink->target = target;
+    sink->file = file;
+
+    // Scrolls are only recorded when the target can show them, otherwise the renderer sends runs
+    if (target && target->scroll)
+        sink->sink.scroll = recordScroll;
+
+    if (file)
+    {
+        fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_SIZE, file);
+        sink->recordedBytes = RECORD_MAGIC_SIZE;
+    }
+}
+
+void freeRecordSink(RecordSink *sink)
+{
+    if (sink->file)
+        fflush(sink->file);
+
+    free(sink->grid);
+    free(sink->buf);
+    sink->grid = NULL;
+    sink->buf = NULL;
+    sink->len = 0;
+    sink->cap = 0;
+}
+
+// Reads the payload of a record, bounds checked
+typedef struct RecordReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool bad;
+} RecordReader;
+
+static uint64_t getNumber(RecordReader *reader)
+{
+    uint64_t value = 0;
+    for (int32_t shift = 0; shift < 64; shift += 7)
+    {
+        if (reader->p == reader->end)
+            break;
+
+        uint8_t byte = *reader->p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    reader->bad = true;
+    return 0;
+}
+
+// Style of the console for a recorded style
+static uint32_t replayStyle(Replay *replay, uint64_t style)
+{
+    if (style < TCON_STYLE_INTERNED)
+        return (uint32_t)style;
+    if (style - TCON_STYLE_INTERNED < (uint64_t)replay->styleCount)
+        return replay->styles[style - TCON_STYLE_INTERNED];
+
+    return TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+}
+
+// Reads len run-length encoded cells into a row of the framebuffer, cells from cols on are dropped
+static void getCells(Replay *replay, RecordReader *reader, Cell *dst, int32_t len, int32_t cols)
+{
+    int32_t i = 0;
+    while (i < len && !reader->bad)
+    {
+        uint64_t same = getNumber(reader);
+        Cell cell;
+        cell.Char = (uint32_t)getNumber(reader);
+        cell.Style = replayStyle(replay, getNumber(reader));
+
+        if (same == 0 || same > (uint64_t)(len - i))
+        {
+            reader->bad = true;
+            return;
+        }
+
+        for (int32_t end = i + (int32_t)same; i < end; i++)
+        {
+            if (i < cols)
+                dst[i] = cell;
+        }
+    }
+}
+
+static void readStyles(Replay *replay, RecordReader *reader, Console *con)
+{
+    uint64_t first = getNumber(reader);
+    uint64_t count = getNumber(reader);
+
+    // Styles are recorded in the order they were interned, without gaps
+    if (first != (uint64_t)replay->styleCount + TCON_STYLE_INTERNED || count > (uint64_t)(reader->end - reader->p))
+    {
+        reader->bad = true;
+        return;
+    }
+
+    for (uint64_t i = 0; i < count && !reader->bad; i++)
+    {
+        TconStyle style;
+        style.foreground = (uint32_t)getNumber(reader);
+        style.background = (uint32_t)getNumber(reader);
+        style.attributes = (uint32_t)getNumber(reader);
+
+        if (replay->styleCount == replay->styleCapacity)
+        {
+            replay->styleCapacity = replay->styleCapacity > 0 ? replay->styleCapacity * 2 : 64;
+            TCON_STAT_ALLOC(1);
+            uint32_t *styles = realloc(replay->styles, replay->styleCapacity * sizeof(uint32_t));
+            if (!styles)
+            {
+                perror("realloc");
+                exit(1);
+            }
+            replay->styles = styles;
+        }
+
+        replay->styles[replay->styleCount++] = internStyle(con, &style);
+    }
+}
+
+static void readKeyframe(Replay *replay, RecordReader *reader, Console *con)
+{
+    replay->frameNs = getNumber(reader);
+    uint64_t rows = getNumber(reader);
+    uint64_t cols = getNumber(reader);
+
+    if (reader->bad || rows > RECORD_MAX_ROWS || cols > RECORD_MAX_COLS)
+    {
+        reader->bad = true;
+        return;
+    }
+
+    // Runs of a keyframe may go on in the next row
+    int64_t cells = (int64_t)(rows * cols);
+
+    // The runs have to cover the screen exactly before the console is resized for them, so a
+    // corrupt size is never allocated
+    RecordReader runs = *reader;
+    int64_t covered = 0;
+    while (covered < cells && !runs.bad)
+    {
+        uint64_t same = getNumber(&runs);
+        getNumber(&runs);
+        getNumber(&runs);
+
+        if (same == 0 || same > (uint64_t)(cells - covered))
+            runs.bad = true;
+        else
+            covered += (int64_t)same;
+    }
+
+    if (runs.bad)
+    {
+        reader->bad = true;
+        return;
+    }
+
+    if ((int32_t)rows != con->rows || (int32_t)cols != con->cols)
+        resizeConsole(con, (int32_t)rows, (int32_t)cols);
+
+    int64_t i = 0;
+    while (i < cells && !reader->bad)
+    {
+        uint64_t same = getNumber(reader);
+        uint32_t c = (uint32_t)getNumber(reader);
+        uint32_t style = replayStyle(replay, getNumber(reader));
+
+        if (same == 0 || same > (uint64_t)(cells - i))
+        {
+            reader->bad = true;
+            return;
+        }
+
+        for (int64_t end = i + (int64_t)same; i < end; i++)
+            setCellStyle(con, (int32_t)(i / (int64_t)cols), (int32_t)(i % (int64_t)cols), style, c);
+    }
+}
+
+// Moves framebuffer rows like TconSink.scroll, exposed rows are blank
+static void replayScroll(Console *con, int32_t top, int32_t rows, int32_t count)
+{
+    if (top < 0 || top >= con->rows || rows <= 0)
+        return;
+    if (top + rows > con->rows)
+        rows = con->rows - top;
+
+    int32_t lines = count > 0 ? count : -count;
+    if (lines > rows)
+        lines = rows;
+
+    Cell *region = getCell(con, top, 0);
+    size_t rowSize = (size_t)con->stride * sizeof(Cell);
+
+    if (count > 0)
+        memmove(region, region + (size_t)lines * con->stride, (size_t)(rows - lines) * rowSize);
+    else
+        memmove(region + (size_t)lines * con->stride, region, (size_t)(rows - lines) * rowSize);
+
+    int32_t exposed = count > 0 ? top + rows - lines : top;
+    for (int32_t row = exposed; row < exposed + lines; row++)
+    {
+        for (int32_t col = 0; col < con->cols; col++)
+            setCellData(con, row, col, FWHITE, BBLACK, L' ');
+    }
+}
+
+static void readFrame(Replay *replay, RecordReader *reader, Console *con)
+{
+    replay->frameNs = getNumber(reader);
+
+    while (!reader->bad)
+    {
+        if (reader->p == reader->end)
+        {
+            reader->bad = true;
+            return;
+        }
+
+        uint8_t event = *reader->p++;
+        if (event == RECORD_EVENT_END)
+            return;
+
+        if (event == RECORD_EVENT_RUN)
+        {
+            uint64_t row = getNumber(reader);
+            uint64_t col = getNumber(reader);
+            uint64_t len = getNumber(reader);
+
+            if (reader->bad || len > INT32_MAX)
+            {
+                reader->bad = true;
+                return;
+            }
+
+            // Runs outside the console are read but not drawn
+            if (row < (uint64_t)con->rows && col < (uint64_t)con->cols)
+                getCells(replay, reader, getCell(con, (int32_t)row, (int32_t)col), (int32_t)len, con->cols - (int32_t)col);
+            else
+                getCells(replay, reader, NULL, (int32_t)len, 0);
+        }
+        else if (event == RECORD_EVENT_SCROLL)
+        {
+            uint64_t top = getNumber(reader);
+            uint64_t rows = getNumber(reader);
+            uint64_t count = getNumber(reader);
+
+            if (reader->bad || top > INT32_MAX || rows > INT32_MAX || count > INT32_MAX)
+            {
+                reader->bad = true;
+                return;
+            }
+
+            int32_t lines = (int32_t)(count >> 1) + (int32_t)(count & 1);
+            replayScroll(con, (int32_t)top, (int32_t)rows, count & 1 ? -lines : lines);
+        }
+        else
+        {
+            reader->bad = true;
+        }
+    }
+}
+
+bool openReplay(Replay *replay, FILE *file)
+{
+    memset(replay, 0, sizeof(Replay));
+    replay->file = file;
+
+    char magic[RECORD_MAGIC_SIZE];
+    return fread(magic, 1, RECORD_MAGIC_SIZE, file) == RECORD_MAGIC_SIZE && memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_SIZE) == 0;
+}
+
+void closeReplay(Replay *replay)
+{
+    free(replay->buf);
+    free(replay->styles);
+    replay->buf = NULL;
+    replay->styles = NULL;
+    replay->cap = 0;
+    replay->styleCount = 0;
+    replay->styleCapacity = 0;
+}
+
+bool readReplayFrame(Replay *replay, Console *con)
+{
+    while (!replay->corrupt)
+    {
+        uint8_t header[RECORD_HEADER_SIZE];
+        size_t got = fread(header, 1, RECORD_HEADER_SIZE, replay->file);
+        if (got == 0)
+            return false;
+
+        uint32_t size = (uint32_t)header[1] | (uint32_t)header[2] << 8 | (uint32_t)header[3] << 16 | (uint32_t)header[4] << 24;
+
+        if (size > replay->cap)
+        {
+            TCON_STAT_ALLOC(1);
+            uint8_t *buf = realloc(replay->buf, size);
+            if (!buf)
+            {
+                perror("realloc");
+                exit(1);
+            }
+            replay->buf = buf;
+            replay->cap = size;
+        }
+
+        // A recording cut off in the middle of a record ends before it
+        if (got < RECORD_HEADER_SIZE || fread(replay->buf, 1, size, replay->file) != size)
+        {
+            replay->corrupt = true;
+            return false;
+        }
+
+        RecordReader reader = {replay->buf, replay->buf + size, false};
+
+        switch (header[0])
+        {
+        case RECORD_KEYFRAME:
+            readKeyframe(replay, &reader, con);
+            break;
+        case RECORD_FRAME:
+            readFrame(replay, &reader, con);
+            break;
+        case RECORD_STYLES:
+            readStyles(replay, &reader, con);
+            break;
+        default:
+            reader.bad = true;
+            break;
+        }
+
+        if (reader.bad)
+        {
+            replay->corrupt = true;
+            return false;
+        }
+
+        if (header[0] != RECORD_STYLES)
+        {
+            replay->frames++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t replayRecording(Replay *replay, Console *con, HANDLE hConsole, bool realTime)
+{
+    BackendWakeup *wakeup = realTime ? backendCreateWakeup() : NULL;
+    uint64_t frames = 0;
+    uint64_t startNs = 0;
+    uint64_t firstFrameNs = 0;
+
+    while (readReplayFrame(replay, con))
+    {
+        if (frames == 0)
+        {
+            startNs = tconNowNs();
+            firstFrameNs = replay->frameNs;
+        }
+
+        // Nobody signals the wakeup, waiting on it only sleeps until the frame is due
+        if (wakeup && replay->frameNs > firstFrameNs)
+        {
+            uint64_t due = startNs + (replay->frameNs - firstFrameNs);
+            uint64_t now = tconNowNs();
+            if (due > now)
+                backendWaitWakeup(wakeup, due - now);
+        }
+
+        renderConsole(*con, hConsole, false);
+        frames++;
+    }
+
+    if (wakeup)
+        backendFreeWakeup(wakeup);
+
+    return frames;
+}
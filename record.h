@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#ifndef RECORD_H
+#define RECORD_H
+
+// First bytes of a recording, the last one is the format version
+#define RECORD_MAGIC "TCONREC1"
+#define RECORD_MAGIC_SIZE 8
+
+// Largest screen a keyframe may hold. Replays stop at a corrupt record beyond it instead of
+// allocating a framebuffer for a size that was never recorded, larger screens can't be replayed
+#define RECORD_MAX_ROWS 2048
+#define RECORD_MAX_COLS 2048
+
+// Frames between two keyframes, which hold the whole screen, so a recording can be read from any of them
+#define RECORD_KEYFRAME_INTERVAL 300
+
+/*
+Records of a recording. Each is its type byte, the length of its payload as 4 bytes little
+endian and the payload. Numbers in payloads are LEB128, cells are run-length encoded as the
+amount of equal cells followed by their Char and Style.
+
+RECORD_KEYFRAME: time in ns since the recording started, rows, cols, then the cells of the
+                 whole screen row after row
+RECORD_FRAME:    time, then events up to RECORD_EVENT_END. RECORD_EVENT_RUN is row, col, len and
+                 len cells, RECORD_EVENT_SCROLL is top, rows and the zigzag encoded count, see
+                 TconSink.scroll
+RECORD_STYLES:   the index of the first style, the amount of styles, then foreground, background
+                 and attributes of each, see internStyle()
+*/
+typedef enum RecordType
+{
+   RECORD_KEYFRAME = 1,
+   RECORD_FRAME = 2,
+   RECORD_STYLES = 3
+} RecordType;
+
+typedef enum RecordEvent
+{
+   RECORD_EVENT_END = 0,
+   RECORD_EVENT_RUN = 1,
+   RECORD_EVENT_SCROLL = 2
+} RecordEvent;
+
+/*
+Sink that records every frame to a file and passes it on to another sink, so a session can be
+watched and recorded at once. It keeps a grid of what the screen shows to write keyframes from.
+Frames are written with one fwrite each, after they were passed on.
+*/
+typedef struct RecordSink
+{
+   TconSink sink;
+   TconSink *target;       // Sink frames are passed on to, NULL to only record
+   FILE *file;
+   uint64_t startNs;       // tconNowNs() of the first frame
+   uint64_t frameNs;       // Time of the current frame since startNs
+   int32_t rows;
+   int32_t cols;
+   Cell *grid;             // What the screen shows, rows * cols cells
+   int32_t styleCount;     // Interned styles written so far
+   uint8_t *buf;           // Records of the current frame
+   size_t len;
+   size_t cap;
+   bool keyframe;          // The current frame is written as a keyframe
+   uint64_t frames;        // Frames recorded
+   uint64_t keyframes;
+   uint64_t recordedBytes; // Bytes written to the file
+} RecordSink;
+
+/*
+Reads a recording back, see openReplay().
+*/
+typedef struct Replay
+{
+   FILE *file;
+   uint8_t *buf;           // Payload of the last record
+   size_t cap;
+   uint32_t *styles;       // Style of the console for each recorded style from TCON_STYLE_INTERNED on
+   int32_t styleCount;
+   int32_t styleCapacity;
+   uint64_t frameNs;       // Recording time of the last frame read
+   uint64_t frames;        // Frames read, keyframes included
+   bool corrupt;           // Reading stopped at a record it could not parse
+} Replay;
+
+/*
+Initializes a sink that records frames to a file. Attach it with setConsoleSink() or
+initHeadlessConsole(), the first frame it gets is a keyframe.
+
+Arguments:
+   sink - the record sink to initialize
+   file - the file to write to, opened in binary mode, the magic is written right away
+   target - the sink to pass every frame on to, e.g. an ansi sink, NULL to only record
+
+Returns:
+   Void
+*/
+void initRecordSink(RecordSink *sink, FILE *file, TconSink *target);
+
+/*
+Releases the buffers of a record sink and flushes its file, the file stays open.
+
+Arguments:
+   sink - the record sink to release
+
+Returns:
+   Void
+*/
+void freeRecordSink(RecordSink *sink);
+
+/*
+Opens a recording for replay.
+
+Arguments:
+   replay - the replay to initialize
+   file - the recording, opened in binary mode
+
+Returns:
+   False if the file is no recording
+*/
+bool openReplay(Replay *replay, FILE *file);
+
+/*
+Releases the buffers of a replay, the file stays open.
+
+Arguments:
+   replay - the replay to release
+
+Returns:
+   Void
+*/
+void closeReplay(Replay *replay);
+
+/*
+Reads the next frame of a recording into the framebuffer of a console, without rendering.
+Keyframes resize the console to the recorded size, recorded styles are interned by it.
+
+Arguments:
+   replay - the replay
+   con - the console to draw the frame into
+
+Returns:
+   True if a frame was read, false at the end of the recording or at a corrupt record
+*/
+bool readReplayFrame(Replay *replay, Console *con);
+
+/*
+Reads every remaining frame of a recording and renders each of them.
+
+Arguments:
+   replay - the replay
+   con - the console to replay on
+   hConsole - the console handle, see tconGetStdHandle()
+   realTime - true to wait between frames as long as the recording did, false to render them
+              as fast as possible
+
+Returns:
+   The amount of frames replayed
+*/
+uint64_t replayRecording(Replay *replay, Console *con, HANDLE hConsole, bool realTime);
+
+#endif
@@ -0,0 +1,103 @@
+// Replays a recording made with a RecordSink (see record.h) on the terminal, or renders it as
+// fast as possible into memory to measure the output path with a real session.
+//
+// Build:  cc -O2 -pthread -o tconreplay replay.c tcon.c style.c surface.c record.c table.c search.c ansi.c utf8.c headless.c format.c arena.c update.c pool.c event.c stats.c backend_posix.c -lm
+// Run:    ./tconreplay [--fast] [--bench] <recording>
+//
+// --fast renders the frames back to back instead of at the pace they were recorded at. --bench
+// replays on a headless console whose AnsiSink keeps its bytes in memory and prints ns/frame
+// and bytes/frame, the recording is deterministic load, the timings of it are not used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "record.h"
+
+static int benchRecording(Replay *replay, const char *path)
+{
+    AnsiSink sink;
+    initAnsiSink(&sink, -1);
+
+    // Keyframes set the size, the first one comes before any frame
+    Console con = initHeadlessConsole(0, 0, &sink.sink);
+
+    uint64_t start = tconNowNs();
+    uint64_t frames = replayRecording(replay, &con, NULL, false);
+    uint64_t elapsed = tconNowNs() - start;
+
+    if (frames == 0)
+    {
+        fprintf(stderr, "%s: no frames\n", path);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %" PRIu64 " frames %" PRId32 "x%" PRId32 " %10.0f ns/frame %10.0f bytes/frame %" PRIu64 " scrolls\n", path, frames, con.cols, con.rows,
+           (double)elapsed / frames, (double)sink.sink.totalBytes / frames, con.state->scrolls);
+
+    freeConsole(&con);
+    freeAnsiSink(&sink);
+    return replay->corrupt ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int playRecording(Replay *replay, bool realTime)
+{
+    HANDLE hConsole = tconGetStdHandle();
+    Console con = initConsole(hConsole);
+    hideCursor(con, hConsole);
+
+    replayRecording(replay, &con, hConsole, realTime);
+
+    resetConsole(&con, hConsole);
+    return replay->corrupt ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    bool realTime = true;
+    bool bench = false;
+    bool usage = false;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fast") == 0)
+            realTime = false;
+        else if (strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else if (!path && argv[i][0] != '-')
+            path = argv[i];
+        else
+            usage = true;
+    }
+
+    if (usage || !path)
+    {
+        fprintf(stderr, "usage: %s [--fast] [--bench] <recording>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    Replay replay;
+    if (!openReplay(&replay, file))
+    {
+        fprintf(stderr, "%s: not a tcon recording\n", path);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    int status = bench ? benchRecording(&replay, path) : playRecording(&replay, realTime);
+    if (replay.corrupt)
+        fprintf(stderr, "%s: stopped at a corrupt record after %" PRIu64 " frames\n", path, replay.frames);
+
+    closeReplay(&replay);
+    fclose(file);
+    return status;
+}
@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "stats.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SEARCH_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#define TRIGRAM_INDEX_CAPACITY 1024
+#define TRIGRAM_LIST_CAPACITY 4
+
+// A record is its id and length followed by the text
+#define TEXT_RECORD_HEADER 8
+#define TEXT_STORE_CAPACITY 4096
+#define TEXT_STORE_IDS 64
+
+static inline char foldByte(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+void foldText(char *dst, const char *src, int32_t len)
+{
+    for (int32_t i = 0; i < len; i++)
+        dst[i] = foldByte(src[i]);
+}
+
+// Bit of a folded byte in the signature of a text. Letters and digits have a bit of their own,
+// other bytes share the remaining ones
+static inline uint64_t signatureBit(char c)
+{
+    uint8_t byte = (uint8_t)c;
+    if (byte >= 'a' && byte <= 'z')
+        return 1ull << (byte - 'a');
+    if (byte >= '0' && byte <= '9')
+        return 1ull << (26 + byte - '0');
+
+    return 1ull << (36 + byte % 28);
+}
+
+// Compares text to a folded needle of the same length
+static bool matchFolded(const char *text, const char *needle, int32_t len)
+{
+    for (int32_t i = 0; i < len; i++)
+    {
+        if (foldByte(text[i]) != needle[i])
+            return false;
+    }
+
+    return true;
+}
+
+#ifdef SEARCH_SSE2
+static inline int32_t lowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int32_t)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Offset of the first occurrence of a folded needle in text, -1 if there is none
+static int64_t findFolded(const char *text, int64_t len, const char *needle, int32_t needleLen)
+{
+    if (needleLen <= 0)
+        return 0;
+    if (needleLen > len)
+        return -1;
+
+    int64_t start = 0;
+    int64_t last = len - needleLen; // Last possible start
+
+#ifdef SEARCH_SSE2
+    // Setting the case bit maps both cases of a letter to the folded one. Other bytes may collide
+    // with it as well, the full compare sorts those out
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i first = _mm_set1_epi8((char)(needle[0] | 0x20));
+    const __m128i end = _mm_set1_epi8((char)(needle[needleLen - 1] | 0x20));
+
+    // Both loads of a block stay inside text
+    for (; start + needleLen - 1 + 16 <= len; start += 16)
+    {
+        __m128i head = _mm_loadu_si128((const __m128i *)(text + start));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(text + start + needleLen - 1));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(head, caseBit), first),
+                                     _mm_cmpeq_epi8(_mm_or_si128(tail, caseBit), end));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+
+        while (mask)
+        {
+            int64_t at = start + lowestBit(mask);
+            if (matchFolded(text + at, needle, needleLen))
+                return at;
+            mask &= mask - 1;
+        }
+    }
+
+    // The starts left over are checked by one more block ending at the last start, overlapping
+    // starts already checked are masked out
+    if (start <= last && last >= 15)
+    {
+        int64_t block = last - 15;
+        __m128i head = _mm_loadu_si128((const __m128i *)(text + block));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(text + block + needleLen - 1));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(head, caseBit), first),
+                                     _mm_cmpeq_epi8(_mm_or_si128(tail, caseBit), end));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hits) & (0xFFFFu << (start - block));
+
+        while (mask)
+        {
+            int64_t at = block + lowestBit(mask);
+            if (matchFolded(text + at, needle, needleLen))
+                return at;
+            mask &= mask - 1;
+        }
+
+        return -1;
+    }
+#endif
+
+    for (; start <= last; start++)
+    {
+        if (foldByte(text[start]) == needle[0] && matchFolded(text + start, needle, needleLen))
+            return start;
+    }
+
+    return -1;
+}
+
+bool findText(const char *text, int32_t len, const char *needle, int32_t needleLen)
+{
+    return findFolded(text, len, needle, needleLen) >= 0;
+}
+
+static inline uint32_t packTrigram(const char *folded)
+{
+    return 0x1000000u | ((uint32_t)(uint8_t)folded[0] << 16) | ((uint32_t)(uint8_t)folded[1] << 8) |
+           (uint32_t)(uint8_t)folded[2];
+}
+
+static inline int32_t hashTrigram(uint32_t trigram, int32_t capacity)
+{
+    uint32_t hash = trigram * 0x9E3779B1u;
+    return (int32_t)((hash ^ (hash >> 15)) & (uint32_t)(capacity - 1));
+}
+
+// Finds the list of a trigram, or the unused slot it would go in
+static TrigramList *findList(TrigramList *lists, int32_t capacity, uint32_t trigram)
+{
+    int32_t i = hashTrigram(trigram, capacity);
+    while (lists[i].trigram && lists[i].trigram != trigram)
+        i = (i + 1) & (capacity - 1);
+
+    return &lists[i];
+}
+
+static void growIndex(TrigramIndex *index)
+{
+    int32_t capacity = index->capacity * 2;
+    TCON_STAT_ALLOC(1);
+    TrigramList *lists = calloc(capacity, sizeof(TrigramList));
+    if (!lists)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int32_t i = 0; i < index->capacity; i++)
+    {
+        if (index->lists[i].trigram)
+            *findList(lists, capacity, index->lists[i].trigram) = index->lists[i];
+    }
+
+    free(index->lists);
+    index->lists = lists;
+    index->capacity = capacity;
+}
+
+TrigramIndex *createTrigramIndex(void)
+{
+    TCON_STAT_ALLOC(2);
+    TrigramIndex *index = calloc(1, sizeof(TrigramIndex));
+    TrigramList *lists = calloc(TRIGRAM_INDEX_CAPACITY, sizeof(TrigramList));
+    if (!index || !lists)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    index->lists = lists;
+    index->capacity = TRIGRAM_INDEX_CAPACITY;
+    return index;
+}
+
+void freeTrigramIndex(TrigramIndex *index)
+{
+    if (!index)
+        return;
+
+    for (int32_t i = 0; i < index->capacity; i++)
+        free(index->lists[i].ids);
+
+    free(index->lists);
+    free(index);
+}
+
+void clearTrigramIndex(TrigramIndex *index)
+{
+    // The lists stay in place, most trigrams come back when the index is rebuilt
+    for (int32_t i = 0; i < index->capacity; i++)
+        index->lists[i].count = 0;
+
+    index->entries = 0;
+    index->staleEntries = 0;
+}
+
+void addTrigrams(TrigramIndex *index, uint32_t id, const char *text, int32_t len)
+{
+    char folded[TRIGRAM_LENGTH];
+
+    for (int32_t i = 0; i + TRIGRAM_LENGTH <= len; i++)
+    {
+        foldText(folded, text + i, TRIGRAM_LENGTH);
+        uint32_t trigram = packTrigram(folded);
+
+        TrigramList *list = findList(index->lists, index->capacity, trigram);
+        if (!list->trigram)
+        {
+            // Keep the table at most half full so probes stay short
+            if ((index->count + 1) * 2 > index->capacity)
+            {
+                growIndex(index);
+                list = findList(index->lists, index->capacity, trigram);
+            }
+
+            list->trigram = trigram;
+            index->count++;
+        }
+
+        if (list->count && list->ids[list->count - 1] == id)
+            continue;
+
+        if (list->count == list->capacity)
+        {
+            int32_t capacity = list->capacity ? list->capacity * 2 : TRIGRAM_LIST_CAPACITY;
+            TCON_STAT_ALLOC(1);
+            uint32_t *ids = realloc(list->ids, capacity * sizeof(uint32_t));
+            if (!ids)
+            {
+                perror("realloc");
+                exit(1);
+            }
+
+            list->ids = ids;
+            list->capacity = capacity;
+        }
+
+        list->ids[list->count++] = id;
+        index->entries++;
+    }
+}
+
+void dropTrigrams(TrigramIndex *index, int32_t len)
+{
+    if (len >= TRIGRAM_LENGTH)
+        index->staleEntries += len - (TRIGRAM_LENGTH - 1);
+}
+
+const TrigramList *findTrigramCandidates(TrigramIndex *index, const char *needle, int32_t needleLen)
+{
+    const TrigramList *best = NULL;
+
+    for (int32_t i = 0; i + TRIGRAM_LENGTH <= needleLen; i++)
+    {
+        const TrigramList *list = findList(index->lists, index->capacity, packTrigram(needle + i));
+        if (!list->trigram || !list->count)
+            return NULL;
+
+        if (!best || list->count < best->count)
+            best = list;
+    }
+
+    return best;
+}
+
+static inline void readRecord(const char *record, uint32_t *id, int32_t *len)
+{
+    memcpy(id, record, sizeof(uint32_t));
+    memcpy(len, record + sizeof(uint32_t), sizeof(int32_t));
+}
+
+TextStore *createTextStore(void)
+{
+    TCON_STAT_ALLOC(2);
+    TextStore *store = calloc(1, sizeof(TextStore));
+    char *bytes = malloc(TEXT_STORE_CAPACITY);
+    if (!store || !bytes)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    store->bytes = bytes;
+    store->capacity = TEXT_STORE_CAPACITY;
+    store->current = -1;
+    return store;
+}
+
+void freeTextStore(TextStore *store)
+{
+    if (!store)
+        return;
+
+    free(store->bytes);
+    free(store->starts);
+    free(store->signatures);
+    free(store);
+}
+
+void clearTextStore(TextStore *store)
+{
+    for (int32_t i = 0; i < store->ids; i++)
+    {
+        store->starts[i] = -1;
+        store->signatures[i] = 0;
+    }
+
+    store->used = 0;
+    store->stale = 0;
+    store->current = -1;
+}
+
+// Moves the live records to the front of the buffer, keeping their order. The record texts are
+// added to stays last
+static void compactTexts(TextStore *store)
+{
+    int64_t to = 0;
+
+    for (int64_t from = 0; from < store->used;)
+    {
+        uint32_t id;
+        int32_t len;
+        readRecord(store->bytes + from, &id, &len);
+        int64_t size = TEXT_RECORD_HEADER + len;
+
+        if (store->starts[id] == from)
+        {
+            memmove(store->bytes + to, store->bytes + from, size);
+            store->starts[id] = to;
+            if (store->current == from)
+                store->current = to;
+            to += size;
+        }
+
+        from += size;
+    }
+
+    store->used = to;
+    store->stale = 0;
+}
+
+// Makes room for size more bytes, compacting before the buffer grows
+static void reserveText(TextStore *store, int64_t size)
+{
+    if (store->used + size <= store->capacity)
+        return;
+
+    if (store->stale * 2 > store->used)
+    {
+        compactTexts(store);
+        if (store->used + size <= store->capacity)
+            return;
+    }
+
+    int64_t capacity = store->capacity * 2;
+    if (capacity < store->used + size)
+        capacity = store->used + size;
+
+    TCON_STAT_ALLOC(1);
+    char *bytes = realloc(store->bytes, capacity);
+    if (!bytes)
+    {
+        perror("realloc");
+        exit(1);
+    }
+
+    store->bytes = bytes;
+    store->capacity = capacity;
+}
+
+void beginText(TextStore *store, uint32_t id)
+{
+    if (id >= (uint32_t)store->ids)
+    {
+        int32_t ids = store->ids > 0 ? store->ids * 2 : TEXT_STORE_IDS;
+        if ((uint32_t)ids <= id)
+            ids = (int32_t)id + 1;
+
+        TCON_STAT_ALLOC(2);
+        int64_t *starts = realloc(store->starts, ids * sizeof(int64_t));
+        uint64_t *signatures = starts ? realloc(store->signatures, ids * sizeof(uint64_t)) : NULL;
+        if (!starts || !signatures)
+        {
+            perror("realloc");
+            exit(1);
+        }
+
+        for (int32_t i = store->ids; i < ids; i++)
+        {
+            starts[i] = -1;
+            signatures[i] = 0;
+        }
+
+        store->starts = starts;
+        store->signatures = signatures;
+        store->ids = ids;
+    }
+
+    dropText(store, id);
+    reserveText(store, TEXT_RECORD_HEADER);
+
+    int32_t len = 0;
+    memcpy(store->bytes + store->used, &id, sizeof(uint32_t));
+    memcpy(store->bytes + store->used + sizeof(uint32_t), &len, sizeof(int32_t));
+
+    store->starts[id] = store->used;
+    store->current = store->used;
+    store->used += TEXT_RECORD_HEADER;
+}
+
+void addText(TextStore *store, const char *text, int32_t len)
+{
+    if (store->current < 0 || len <= 0)
+        return;
+
+    uint32_t id;
+    int32_t recordLen;
+    readRecord(store->bytes + store->current, &id, &recordLen);
+
+    int32_t size = recordLen > 0 ? len + 1 : len;
+    reserveText(store, size);
+
+    // The record is the last one, the part goes on at the end of the buffer
+    char *end = store->bytes + store->used;
+    if (recordLen > 0)
+        *end++ = '\0';
+    foldText(end, text, len);
+
+    uint64_t signature = 0;
+    for (int32_t i = 0; i < len; i++)
+        signature |= signatureBit(end[i]);
+    store->signatures[id] |= signature;
+
+    recordLen += size;
+    memcpy(store->bytes + store->current + sizeof(uint32_t), &recordLen, sizeof(int32_t));
+    store->used += size;
+}
+
+int32_t dropText(TextStore *store, uint32_t id)
+{
+    if (id >= (uint32_t)store->ids || store->starts[id] < 0)
+        return 0;
+
+    uint32_t recordId;
+    int32_t len;
+    readRecord(store->bytes + store->starts[id], &recordId, &len);
+
+    if (store->current == store->starts[id])
+        store->current = -1;
+
+    store->stale += TEXT_RECORD_HEADER + len;
+    store->starts[id] = -1;
+    store->signatures[id] = 0;
+    return len;
+}
+
+// Up to four bytes of a text after an offset, the first in the lowest byte. Bytes past the end are 0
+static uint32_t bytesAfter(const char *text, int32_t len, int32_t offset)
+{
+    uint32_t bytes = 0;
+    for (int32_t i = 0; i < 4 && offset + i < len; i++)
+        bytes |= (uint32_t)(uint8_t)text[offset + i] << (8 * i);
+
+    return bytes;
+}
+
+bool textContains(TextStore *store, uint32_t id, const char *needle, int32_t needleLen)
+{
+    return findInText(store, id, needle, needleLen, 0, NULL);
+}
+
+bool findInText(TextStore *store, uint32_t id, const char *needle, int32_t needleLen, int32_t from, TextMatch *match)
+{
+    if (id >= (uint32_t)store->ids || store->starts[id] < 0)
+        return false;
+
+    uint32_t recordId;
+    int32_t len;
+    const char *record = store->bytes + store->starts[id];
+    readRecord(record, &recordId, &len);
+
+    if (from > len)
+        return false;
+
+    const char *text = record + TEXT_RECORD_HEADER;
+    int64_t found = findFolded(text + from, len - from, needle, needleLen);
+    if (found < 0)
+        return false;
+
+    if (match)
+    {
+        match->at = from + (int32_t)found;
+        match->next = bytesAfter(text, len, match->at + needleLen);
+    }
+
+    return true;
+}
+
+bool extendMatch(TextStore *store, uint32_t id, const char *needle, int32_t needleLen, int32_t extendsAt, int32_t extendsLen, TextMatch *match)
+{
+    // Bytes typed after the earlier needle are compared to the ones kept, a 0 is not known
+    int32_t typed = needleLen - extendsLen;
+    if (extendsAt == 0 && typed <= 4)
+    {
+        int32_t i = 0;
+        while (i < typed && (uint8_t)needle[extendsLen + i] == ((match->next >> (8 * i)) & 0xFF))
+            i++;
+
+        if (i == typed)
+        {
+            match->next = typed < 4 ? match->next >> (8 * typed) : 0;
+            return true;
+        }
+    }
+
+    // An occurrence of needle contains one of the earlier needle, which does not occur before match->at
+    int32_t from = match->at - extendsAt;
+    return findInText(store, id, needle, needleLen, from > 0 ? from : 0, match);
+}
+
+int32_t scanTexts(TextStore *store, const char *needle, int32_t needleLen, uint32_t *ids, TextMatch *matches)
+{
+    int32_t count = 0;
+    int64_t record = 0;
+    int64_t from = 0;
+
+    // A letter or digit of its own is in the texts whose signature has its bit
+    if (needleLen == 1 && signatureBit(needle[0]) < (1ull << 36))
+    {
+        uint64_t bit = signatureBit(needle[0]);
+        for (int32_t id = 0; id < store->ids; id++)
+        {
+            if (!(store->signatures[id] & bit))
+                continue;
+
+            ids[count++] = (uint32_t)id;
+            if (matches)
+            {
+                matches[id].at = 0;
+                matches[id].next = 0;
+            }
+        }
+
+        return count;
+    }
+
+    // The whole buffer is searched at once, records are only walked up to each occurrence. An
+    // occurrence overlapping a header or the end of a text matches nothing, the search goes on
+    // after its first byte
+    while (from < store->used)
+    {
+        int64_t found = findFolded(store->bytes + from, store->used - from, needle, needleLen);
+        if (found < 0)
+            break;
+        found += from;
+
+        uint32_t id;
+        int32_t len;
+        int64_t next;
+        for (;;)
+        {
+            readRecord(store->bytes + record, &id, &len);
+            next = record + TEXT_RECORD_HEADER + len;
+            if (found < next)
+                break;
+            record = next;
+        }
+
+        if (found < record + TEXT_RECORD_HEADER || found + needleLen > next)
+        {
+            from = found + 1;
+            continue;
+        }
+
+        // Records left behind are skipped, every id is found once
+        if (store->starts[id] == record)
+        {
+            ids[count++] = id;
+            if (matches)
+            {
+                int32_t at = (int32_t)(found - record - TEXT_RECORD_HEADER);
+                matches[id].at = at;
+                matches[id].next = bytesAfter(store->bytes + record + TEXT_RECORD_HEADER, len, at + needleLen);
+            }
+        }
+
+        record = next;
+        from = next;
+    }
+
+    return count;
+}
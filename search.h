@@ -0,0 +1,301 @@
+#include <stdbool.h>
+#include <inttypes.h>
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Bytes of a trigram, search text shorter than this can not use a trigram index
+#define TRIGRAM_LENGTH 3
+
+// Lists ids of the texts containing one trigram. Ids repeat and may be stale, see TrigramIndex
+typedef struct TrigramList
+{
+   uint32_t trigram; // The folded bytes, first byte highest, with bit 24 set. 0 marks an unused list
+   uint32_t *ids;
+   int32_t count;
+   int32_t capacity;
+} TrigramList;
+
+/*
+Maps every trigram of folded text to the ids of the texts containing it. Entries are only ever
+added: when a text changes its new trigrams are added and the old ones stay behind, so a lookup
+gives candidates that still have to be checked against the text. The owner reports the entries
+it left behind with dropTrigrams and rebuilds the index once they outweigh the live ones.
+*/
+typedef struct TrigramIndex
+{
+   TrigramList *lists;   // Open addressing hash table of capacity lists
+   int32_t capacity;     // Power of two
+   int32_t count;        // Lists in use
+   int64_t entries;      // Ids stored in all lists
+   int64_t staleEntries; // Estimate of the entries whose text changed since
+} TrigramIndex;
+
+/*
+Keeps one folded text per id back to back in one buffer, so a scan over all of them reads memory
+in order. Each record starts with its id and length. Changing a text appends a new record and
+leaves the old one behind, the buffer is compacted when it would otherwise grow while more than
+half of it is left behind.
+*/
+typedef struct TextStore
+{
+   char *bytes;
+   int64_t used;
+   int64_t capacity;
+   int64_t stale;    // Bytes of records left behind
+   int64_t *starts;  // Offset of the record of each id, -1 for ids without text
+   uint64_t *signatures; // Bits of the bytes in the text of each id, a letter or digit has a bit of its own
+   int32_t ids;      // Entries of starts and signatures
+   int64_t current;  // Record texts are added to, -1 for none
+} TextStore;
+
+// Where a needle occurs in a text, with the bytes after it, so a needle typed on from it is
+// usually checked without reading the text again
+typedef struct TextMatch
+{
+   int32_t at;    // Offset of the first occurrence in the text, or one it does not come before while next is 0
+   uint32_t next; // Up to four bytes after the occurrence, the first in the lowest byte. A 0 byte is not known
+} TextMatch;
+
+/*
+Folds text to lower case for searching. Only ASCII letters are folded, so the result does not
+depend on the locale.
+
+Arguments:
+   dst - receives len folded bytes, may be src
+   src - the text
+   len - the amount of bytes
+
+Returns:
+   Void
+*/
+void foldText(char *dst, const char *src, int32_t len);
+
+/*
+Looks for a substring, ignoring the case of ASCII letters. Where SSE2 is available 16 starting
+positions are tested at once by their first and last byte before any is compared in full.
+
+Arguments:
+   text - the text to search
+   len - the length of text
+   needle - the text to look for, folded with foldText
+   needleLen - the length of needle
+
+Returns:
+   true if text contains needle, always for an empty needle
+*/
+bool findText(const char *text, int32_t len, const char *needle, int32_t needleLen);
+
+/*
+Creates an empty trigram index.
+
+Arguments:
+   Void
+
+Returns:
+   Pointer to the index
+*/
+TrigramIndex *createTrigramIndex(void);
+
+/*
+Frees a trigram index.
+
+Arguments:
+   index - the index to free, may be NULL
+
+Returns:
+   Void
+*/
+void freeTrigramIndex(TrigramIndex *index);
+
+/*
+Removes every entry of a trigram index, keeping its memory for a rebuild.
+
+Arguments:
+   index - the index to clear
+
+Returns:
+   Void
+*/
+void clearTrigramIndex(TrigramIndex *index);
+
+/*
+Adds the trigrams of a text to an index. A trigram that already lists the id as its last entry
+is not added again, so the texts of one id are best added one after another.
+
+Arguments:
+   index - the index
+   id - the id the text belongs to
+   text - the text, not folded
+   len - the length of text
+
+Returns:
+   Void
+*/
+void addTrigrams(TrigramIndex *index, uint32_t id, const char *text, int32_t len);
+
+/*
+Records that a text added before has changed or is gone, its entries are stale from now on.
+
+Arguments:
+   index - the index
+   len - the length of the text when it was added
+
+Returns:
+   Void
+*/
+void dropTrigrams(TrigramIndex *index, int32_t len);
+
+/*
+Finds the shortest list among the trigrams of a needle. Every id whose text contains the needle
+is in it.
+
+Arguments:
+   index - the index
+   needle - the text looked for, folded with foldText
+   needleLen - the length of needle, at least TRIGRAM_LENGTH
+
+Returns:
+   The list, NULL if some trigram of the needle is in no text, so no text contains it
+*/
+const TrigramList *findTrigramCandidates(TrigramIndex *index, const char *needle, int32_t needleLen);
+
+/*
+Creates an empty text store.
+
+Arguments:
+   Void
+
+Returns:
+   Pointer to the store
+*/
+TextStore *createTextStore(void);
+
+/*
+Frees a text store.
+
+Arguments:
+   store - the store to free, may be NULL
+
+Returns:
+   Void
+*/
+void freeTextStore(TextStore *store);
+
+/*
+Removes every text of a store, keeping its memory.
+
+Arguments:
+   store - the store to clear
+
+Returns:
+   Void
+*/
+void clearTextStore(TextStore *store);
+
+/*
+Starts a new, empty text for an id, replacing the one it had. The text is built by addText.
+
+Arguments:
+   store - the store
+   id - the id
+
+Returns:
+   Void
+*/
+void beginText(TextStore *store, uint32_t id);
+
+/*
+Adds a part to the text begun last, folded with foldText. Parts are separated by a NUL byte, so
+no search text matches across parts.
+
+Arguments:
+   store - the store
+   text - the part
+   len - the length of text
+
+Returns:
+   Void
+*/
+void addText(TextStore *store, const char *text, int32_t len);
+
+/*
+Removes the text of an id.
+
+Arguments:
+   store - the store
+   id - the id
+
+Returns:
+   The length of the text removed, 0 if the id had none
+*/
+int32_t dropText(TextStore *store, uint32_t id);
+
+/*
+Checks whether the text of an id contains a needle.
+
+Arguments:
+   store - the store
+   id - the id
+   needle - the text to look for, folded with foldText
+   needleLen - the length of needle
+
+Returns:
+   true if it does, false if it does not or the id has no text
+*/
+bool textContains(TextStore *store, uint32_t id, const char *needle, int32_t needleLen);
+
+/*
+Finds the first occurrence of a needle in the text of an id, from an offset of the text on.
+
+Arguments:
+   store - the store
+   id - the id
+   needle - the text to look for, folded with foldText
+   needleLen - the length of needle
+   from - the offset in the text the search starts at
+   match - receives the occurrence, NULL if not needed
+
+Returns:
+   true if the text contains needle from the offset on, false if it does not or the id has no text
+*/
+bool findInText(TextStore *store, uint32_t id, const char *needle, int32_t needleLen, int32_t from, TextMatch *match);
+
+/*
+Finds the first occurrence of a needle that contains an earlier needle, from the match of the
+earlier one. Bytes typed after the earlier needle are compared to the ones kept in the match,
+the text is only searched when they are not known or do not match.
+
+Arguments:
+   store - the store
+   id - the id
+   needle - the text to look for, folded with foldText
+   needleLen - the length of needle
+   extendsAt - the offset of the earlier needle in needle
+   extendsLen - the length of the earlier needle
+   match - the match of the earlier needle, or an offset it does not occur before with next 0.
+           Receives the occurrence of needle
+
+Returns:
+   true if the text contains needle, false if it does not or the id has no text
+*/
+bool extendMatch(TextStore *store, uint32_t id, const char *needle, int32_t needleLen, int32_t extendsAt, int32_t extendsLen, TextMatch *match);
+
+/*
+Scans every text of a store for a needle, in the order they are stored. A needle of one letter or
+digit is looked up in the signatures instead, in the order of the ids.
+
+Arguments:
+   store - the store
+   needle - the text to look for, folded with foldText
+   needleLen - the length of needle
+   ids - receives the ids whose text contains needle, room for one entry per id
+   matches - receives the occurrence at the index of each id found, NULL if not needed. Found
+             by signature it is offset 0 with no bytes known
+
+Returns:
+   The amount of ids found
+*/
+int32_t scanTexts(TextStore *store, const char *needle, int32_t needleLen, uint32_t *ids, TextMatch *matches);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tcon.h"
+#include "stats.h"
+
+#ifdef TCON_STATS
+atomic_uint_fast64_t tconAllocations;
+
+static int compareLatency(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return (left > right) - (left < right);
+}
+#endif
+
+bool getConsoleStats(const Console *con, TconStats *stats)
+{
+#ifdef TCON_STATS
+    *stats = con->state->stats;
+    return true;
+#else
+    (void)con;
+    memset(stats, 0, sizeof(TconStats));
+    return false;
+#endif
+}
+
+uint64_t consoleFrameLatency(const Console *con, int32_t percentile)
+{
+#ifdef TCON_STATS
+    const TconStats *stats = &con->state->stats;
+    if (stats->latencyCount == 0)
+        return 0;
+
+    if (percentile < 0)
+        percentile = 0;
+    if (percentile > 100)
+        percentile = 100;
+
+    // The ring is small enough to sort a copy on every query, an overlay asks once a frame
+    uint64_t sorted[TCON_STATS_HISTORY];
+    memcpy(sorted, stats->latencies, (size_t)stats->latencyCount * sizeof(uint64_t));
+    qsort(sorted, stats->latencyCount, sizeof(uint64_t), compareLatency);
+
+    // Nearest rank
+    int32_t rank = (percentile * stats->latencyCount + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+#else
+    (void)con;
+    (void)percentile;
+    return 0;
+#endif
+}
+
+void resetConsoleStats(Console *con)
+{
+#ifdef TCON_STATS
+    TconStats *stats = &con->state->stats;
+
+    // An open transaction keeps counting towards the frame it draws
+    uint64_t composeStart = stats->composeStart;
+    memset(stats, 0, sizeof(TconStats));
+    stats->composeStart = composeStart;
+    stats->allocationMark = tconAllocations;
+#else
+    (void)con;
+#endif
+}
@@ -0,0 +1,60 @@
+#ifdef TCON_STATS
+#include <stdatomic.h>
+#endif
+#include <stdbool.h>
+#include <inttypes.h>
+
+#ifndef STATS_H
+#define STATS_H
+
+/*
+Frame statistics are compiled in with -DTCON_STATS, every translation unit has to be built with
+the same setting as it changes the layout of ConsoleState. Without it the counters below
+expand to nothing and getConsoleStats() reports that there are none.
+*/
+
+// Frames whose latency is kept for consoleFrameLatency()
+#define TCON_STATS_HISTORY 256
+
+// Counters of one frame, or summed over frames
+typedef struct TconFrameStats
+{
+   uint64_t cellsWritten; // Cells sent to the sink, unchanged cells inside merged runs included
+   uint64_t cellsChanged; // Cells that differed from what the sink showed
+   uint64_t runs;         // Runs sent to the sink
+   uint64_t bytes;        // Bytes the sink produced, see TconSink.frameBytes
+   uint64_t scrolledRows; // Rows moved with TconSink.scroll instead of being sent again
+   uint64_t allocations;  // Heap allocations tcon made since the previous frame, on any console
+   uint64_t reflows;      // Column layouts of tables on the console since the previous frame
+   uint64_t composeNs;    // Drawing inside transactions and compositing surfaces since the previous frame
+   uint64_t encodeNs;     // Diffing the framebuffer and encoding the runs
+   uint64_t flushNs;      // Handing the encoded frame to the terminal, see TconSink.endFrame
+} TconFrameStats;
+
+typedef struct TconStats
+{
+   TconFrameStats frame;  // The last presented frame
+   TconFrameStats total;  // All frames since the console was created or the stats were reset
+   TconFrameStats current; // Counted towards the next frame
+   uint64_t frames;
+   uint64_t latencies[TCON_STATS_HISTORY]; // compose + encode + flush of the last frames, a ring
+   int32_t latencyCount;
+   int32_t latencyNext;
+   uint64_t allocationMark; // tconAllocations when the last frame was presented
+   uint64_t composeStart;   // tconNowNs() when the outermost transaction began
+} TconStats;
+
+#ifdef TCON_STATS
+// Heap allocations made by tcon, from any thread
+extern atomic_uint_fast64_t tconAllocations;
+
+#define TCON_STAT_ADD(state, field, n) ((state)->stats.current.field += (uint64_t)(n))
+#define TCON_STAT_CLOCK(name) uint64_t name = tconNowNs()
+#define TCON_STAT_ALLOC(count) atomic_fetch_add_explicit(&tconAllocations, (count), memory_order_relaxed)
+#else
+#define TCON_STAT_ADD(state, field, n) ((void)0)
+#define TCON_STAT_CLOCK(name) ((void)0)
+#define TCON_STAT_ALLOC(count) ((void)0)
+#endif
+
+#endif
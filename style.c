@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#define STYLE_TABLE_CAPACITY 64
+
+// The 16 console colors in the order of their attribute bits
+static const uint8_t consoleRgb[16][3] = {
+    {0x00, 0x00, 0x00}, {0x00, 0x00, 0x80}, {0x00, 0x80, 0x00}, {0x00, 0x80, 0x80},
+    {0x80, 0x00, 0x00}, {0x80, 0x00, 0x80}, {0x80, 0x80, 0x00}, {0xC0, 0xC0, 0xC0},
+    {0x80, 0x80, 0x80}, {0x00, 0x00, 0xFF}, {0x00, 0xFF, 0x00}, {0x00, 0xFF, 0xFF},
+    {0xFF, 0x00, 0x00}, {0xFF, 0x00, 0xFF}, {0xFF, 0xFF, 0x00}, {0xFF, 0xFF, 0xFF}};
+
+// Levels of the 6x6x6 color cube of the 256 color palette
+static const uint8_t cubeLevels[6] = {0x00, 0x5F, 0x87, 0xAF, 0xD7, 0xFF};
+
+static uint32_t hashStyle(const TconStyle *style)
+{
+    uint32_t hash = style->foreground * 0x9E3779B1u;
+    hash ^= style->background * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+    hash ^= style->attributes * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+    return hash ^ (hash >> 16);
+}
+
+static bool styleEquals(const TconStyle *a, const TconStyle *b)
+{
+    return a->foreground == b->foreground && a->background == b->background && a->attributes == b->attributes;
+}
+
+// Puts an interned style index in the first free slot of its hash
+static void placeStyle(TconStyleTable *table, uint32_t index)
+{
+    uint32_t mask = (uint32_t)table->slotCapacity - 1;
+    uint32_t slot = hashStyle(&table->styles[index - TCON_STYLE_INTERNED]) & mask;
+
+    while (table->slots[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    table->slots[slot] = index;
+}
+
+// Doubles the hash table, keeping it at most half full
+static void growSlots(TconStyleTable *table)
+{
+    free(table->slots);
+
+    table->slotCapacity = table->slotCapacity > 0 ? table->slotCapacity * 2 : STYLE_TABLE_CAPACITY * 2;
+    TCON_STAT_ALLOC(1);
+    table->slots = calloc(table->slotCapacity, sizeof(uint32_t));
+    if (!table->slots)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int32_t i = 0; i < table->count; i++)
+        placeStyle(table, (uint32_t)i + TCON_STYLE_INTERNED);
+}
+
+uint32_t internStyle(Console *con, const TconStyle *style)
+{
+    if (TCON_COLOR_KIND(style->foreground) == TCON_COLOR_CONSOLE && TCON_COLOR_KIND(style->background) == TCON_COLOR_CONSOLE && style->attributes == 0)
+        return TCON_CONSOLE_STYLE(style->foreground & 0x0F, (style->background & 0x0F) << 4);
+
+    TconStyleTable *table = con->state->styleTable;
+
+    if (table->slotCapacity > 0)
+    {
+        uint32_t mask = (uint32_t)table->slotCapacity - 1;
+        for (uint32_t slot = hashStyle(style) & mask; table->slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            uint32_t index = table->slots[slot];
+            if (styleEquals(&table->styles[index - TCON_STYLE_INTERNED], style))
+                return index;
+        }
+    }
+
+    if (table->count == table->capacity)
+    {
+        table->capacity = table->capacity > 0 ? table->capacity * 2 : STYLE_TABLE_CAPACITY;
+        TCON_STAT_ALLOC(1);
+        TconStyle *styles = realloc(table->styles, table->capacity * sizeof(TconStyle));
+        if (!styles)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        table->styles = styles;
+    }
+
+    uint32_t index = (uint32_t)table->count + TCON_STYLE_INTERNED;
+    table->styles[table->count++] = *style;
+
+    if (table->count * 2 > table->slotCapacity)
+        growSlots(table);
+    else
+        placeStyle(table, index);
+
+    return index;
+}
+
+TconStyle getStyle(const TconStyleTable *table, uint32_t style)
+{
+    if (style < TCON_STYLE_INTERNED)
+    {
+        TconStyle console = {style & 0x0F, (style >> 4) & 0x0F, 0};
+        return console;
+    }
+
+    if (table && style - TCON_STYLE_INTERNED < (uint32_t)table->count)
+        return table->styles[style - TCON_STYLE_INTERNED];
+
+    TconStyle fallback = {FWHITE, BBLACK, 0};
+    return fallback;
+}
+
+// Console color closest to a color of any kind
+static uint32_t closestConsoleColor(uint32_t color)
+{
+    uint32_t kind = TCON_COLOR_KIND(color);
+    int32_t r, g, b;
+
+    if (kind == TCON_COLOR_CONSOLE)
+        return color & 0x0F;
+
+    if (kind == TCON_COLOR_PALETTE)
+    {
+        uint32_t index = color & 0xFF;
+
+        // The first 16 palette entries are the ANSI colors, red and blue swap places in attribute bits
+        if (index < 16)
+            return ((index & 1) << 2) | (index & 2) | ((index & 4) >> 2) | (index & 8);
+
+        if (index < 232)
+        {
+            index -= 16;
+            r = cubeLevels[index / 36];
+            g = cubeLevels[(index / 6) % 6];
+            b = cubeLevels[index % 6];
+        }
+        else
+        {
+            r = g = b = 8 + 10 * (int32_t)(index - 232);
+        }
+    }
+    else
+    {
+        r = (color >> 16) & 0xFF;
+        g = (color >> 8) & 0xFF;
+        b = color & 0xFF;
+    }
+
+    uint32_t closest = 0;
+    int32_t closestDistance = INT32_MAX;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        int32_t dr = r - consoleRgb[i][0];
+        int32_t dg = g - consoleRgb[i][1];
+        int32_t db = b - consoleRgb[i][2];
+        int32_t distance = dr * dr + dg * dg + db * db;
+
+        if (distance < closestDistance)
+        {
+            closest = i;
+            closestDistance = distance;
+        }
+    }
+
+    return closest;
+}
+
+uint32_t getStyleConsoleColors(const TconStyle *style)
+{
+    uint32_t fg = closestConsoleColor(style->foreground);
+    uint32_t bg = closestConsoleColor(style->background);
+
+    if (style->attributes & TCON_BOLD)
+        fg |= 0x08;
+
+    if (style->attributes & TCON_REVERSE)
+        return TCON_CONSOLE_STYLE(bg, fg << 4);
+
+    return TCON_CONSOLE_STYLE(fg, bg << 4);
+}
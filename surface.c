@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "surface.h"
+
+#define COMPOSITOR_CAPACITY 8
+
+static bool rectEmpty(SurfaceRect rect)
+{
+    return rect.rows <= 0 || rect.cols <= 0;
+}
+
+static int64_t rectArea(SurfaceRect rect)
+{
+    return (int64_t)rect.rows * rect.cols;
+}
+
+static bool rectContains(SurfaceRect outer, SurfaceRect inner)
+{
+    return inner.row >= outer.row && inner.col >= outer.col && inner.row + inner.rows <= outer.row + outer.rows && inner.col + inner.cols <= outer.col + outer.cols;
+}
+
+static SurfaceRect rectUnion(SurfaceRect a, SurfaceRect b)
+{
+    int32_t bottom = a.row + a.rows > b.row + b.rows ? a.row + a.rows : b.row + b.rows;
+    int32_t right = a.col + a.cols > b.col + b.cols ? a.col + a.cols : b.col + b.cols;
+
+    SurfaceRect rect;
+    rect.row = a.row < b.row ? a.row : b.row;
+    rect.col = a.col < b.col ? a.col : b.col;
+    rect.rows = bottom - rect.row;
+    rect.cols = right - rect.col;
+    return rect;
+}
+
+static SurfaceRect rectIntersect(SurfaceRect a, SurfaceRect b)
+{
+    int32_t bottom = a.row + a.rows < b.row + b.rows ? a.row + a.rows : b.row + b.rows;
+    int32_t right = a.col + a.cols < b.col + b.cols ? a.col + a.cols : b.col + b.cols;
+
+    SurfaceRect rect;
+    rect.row = a.row > b.row ? a.row : b.row;
+    rect.col = a.col > b.col ? a.col : b.col;
+    rect.rows = bottom - rect.row;
+    rect.cols = right - rect.col;
+    return rect;
+}
+
+// True if the union of two rectangles covers no cell outside of them
+static bool rectMergesExactly(SurfaceRect a, SurfaceRect b)
+{
+    if (rectContains(a, b) || rectContains(b, a))
+        return true;
+
+    if (a.col == b.col && a.cols == b.cols)
+        return a.row <= b.row + b.rows && b.row <= a.row + a.rows;
+
+    if (a.row == b.row && a.rows == b.rows)
+        return a.col <= b.col + b.cols && b.col <= a.col + a.cols;
+
+    return false;
+}
+
+static SurfaceRect surfaceRect(const Surface *surface)
+{
+    SurfaceRect rect = {surface->row, surface->col, surface->console.rows, surface->console.cols};
+    return rect;
+}
+
+void damageCompositor(Compositor *compositor, SurfaceRect rect)
+{
+    ConsoleState *state = compositor->con->state;
+    SurfaceRect screen = {0, 0, state->bufferRows, state->bufferCols};
+
+    rect = rectIntersect(rect, screen);
+    if (rectEmpty(rect))
+        return;
+
+    // Rows of a surface that changed line up, so most damage grows one rectangle
+    for (int32_t i = 0; i < compositor->damageCount;)
+    {
+        if (!rectMergesExactly(compositor->damage[i], rect))
+        {
+            i++;
+            continue;
+        }
+
+        rect = rectUnion(compositor->damage[i], rect);
+        compositor->damage[i] = compositor->damage[--compositor->damageCount];
+        i = 0;
+    }
+
+    if (compositor->damageCount < SURFACE_DAMAGE_RECTS)
+    {
+        compositor->damage[compositor->damageCount++] = rect;
+        return;
+    }
+
+    // Out of rectangles, the one growing the least takes it in
+    int32_t closest = 0;
+    int64_t closestGrowth = INT64_MAX;
+
+    for (int32_t i = 0; i < compositor->damageCount; i++)
+    {
+        int64_t growth = rectArea(rectUnion(compositor->damage[i], rect)) - rectArea(compositor->damage[i]);
+        if (growth < closestGrowth)
+        {
+            closest = i;
+            closestGrowth = growth;
+        }
+    }
+
+    compositor->damage[closest] = rectUnion(compositor->damage[closest], rect);
+}
+
+// Damages the cells of before that after does not cover, up to four rectangles around after
+static void damageExposed(Compositor *compositor, SurfaceRect before, SurfaceRect after)
+{
+    SurfaceRect common = rectIntersect(before, after);
+    if (rectEmpty(common))
+    {
+        damageCompositor(compositor, before);
+        return;
+    }
+
+    SurfaceRect top = {before.row, before.col, common.row - before.row, before.cols};
+    SurfaceRect bottom = {common.row + common.rows, before.col, before.row + before.rows - common.row - common.rows, before.cols};
+    SurfaceRect left = {common.row, before.col, common.rows, common.col - before.col};
+    SurfaceRect right = {common.row, common.col + common.cols, common.rows, before.col + before.cols - common.col - common.cols};
+
+    damageCompositor(compositor, top);
+    damageCompositor(compositor, bottom);
+    damageCompositor(compositor, left);
+    damageCompositor(compositor, right);
+}
+
+// Fills the cells of a damaged rectangle from the topmost surface down
+static void composeRect(Compositor *compositor, SurfaceRect rect)
+{
+    ConsoleState *state = compositor->con->state;
+    int32_t *spans = compositor->spans;
+    int32_t *next = compositor->spans + 2 * (compositor->capacity + 1);
+
+    for (int32_t row = rect.row; row < rect.row + rect.rows; row++)
+    {
+        Cell *dst = state->framebuffer + (size_t)row * state->stride;
+        int32_t spanCount = 1;
+        spans[0] = rect.col;
+        spans[1] = rect.col + rect.cols;
+
+        // Every surface takes the parts of the uncovered spans it overlaps, until none are left
+        int32_t s = 0;
+        for (; s < compositor->count && spanCount > 0; s++)
+        {
+            Surface *surface = compositor->surfaces[s];
+            ConsoleState *layer = surface->console.state;
+
+            if (!surface->visible || row < surface->row || row >= surface->row + surface->console.rows)
+                continue;
+
+            int32_t left = surface->col;
+            int32_t right = surface->col + surface->console.cols;
+            const Cell *src = layer->framebuffer + (size_t)(row - surface->row) * layer->stride;
+            int32_t kept = 0;
+
+            for (int32_t i = 0; i < spanCount; i++)
+            {
+                int32_t from = spans[2 * i] > left ? spans[2 * i] : left;
+                int32_t to = spans[2 * i + 1] < right ? spans[2 * i + 1] : right;
+
+                if (from >= to)
+                {
+                    next[2 * kept] = spans[2 * i];
+                    next[2 * kept + 1] = spans[2 * i + 1];
+                    kept++;
+                    continue;
+                }
+
+                memcpy(dst + from, src + (from - left), (size_t)(to - from) * sizeof(Cell));
+                compositor->composedCells += (uint64_t)(to - from);
+
+                if (spans[2 * i] < from)
+                {
+                    next[2 * kept] = spans[2 * i];
+                    next[2 * kept + 1] = from;
+                    kept++;
+                }
+                if (to < spans[2 * i + 1])
+                {
+                    next[2 * kept] = to;
+                    next[2 * kept + 1] = spans[2 * i + 1];
+                    kept++;
+                }
+            }
+
+            int32_t *swap = spans;
+            spans = next;
+            next = swap;
+            spanCount = kept;
+        }
+
+        // Surfaces below the ones that covered the row are never read
+        for (; s < compositor->count; s++)
+        {
+            Surface *surface = compositor->surfaces[s];
+            if (surface->visible && row >= surface->row && row < surface->row + surface->console.rows && surface->col < rect.col + rect.cols && surface->col + surface->console.cols > rect.col)
+                compositor->skippedRows++;
+        }
+
+        for (int32_t i = 0; i < spanCount; i++)
+        {
+            for (int32_t col = spans[2 * i]; col < spans[2 * i + 1]; col++)
+                dst[col] = compositor->background;
+            compositor->composedCells += (uint64_t)(spans[2 * i + 1] - spans[2 * i]);
+        }
+    }
+}
+
+// Composites all damage onto the console, false if there was none
+static bool composeDamage(Compositor *compositor)
+{
+    ConsoleState *state = compositor->con->state;
+
+    // The console may have been resized under the surfaces, everything is composited again
+    if (compositor->layoutResizes != state->resizes)
+    {
+        SurfaceRect screen = {0, 0, state->bufferRows, state->bufferCols};
+        compositor->layoutResizes = state->resizes;
+        compositor->damageCount = 0;
+        damageCompositor(compositor, screen);
+    }
+
+    if (compositor->damageCount == 0)
+        return false;
+
+    compositor->composedCells = 0;
+    compositor->skippedRows = 0;
+    TCON_STAT_CLOCK(composeStart);
+
+    for (int32_t i = 0; i < compositor->damageCount; i++)
+        composeRect(compositor, compositor->damage[i]);
+
+    compositor->damageCount = 0;
+    TCON_STAT_ADD(state, composeNs, tconNowNs() - composeStart);
+    return true;
+}
+
+void renderCompositor(Compositor *compositor, HANDLE hConsole, bool hlt)
+{
+    if (!compositor)
+        return;
+
+    composeDamage(compositor);
+    renderConsole(*compositor->con, hConsole, hlt);
+}
+
+static void surfaceSinkWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    Surface *surface = ((SurfaceSink *)sink)->surface;
+    Compositor *compositor = surface->compositor;
+
+    if (!surface->visible)
+        return;
+
+    SurfaceRect rect = {surface->row + row, surface->col + col, 1, len};
+
+    // Changes under a surface above that covers them can not show
+    for (int32_t s = 0; s < compositor->count && compositor->surfaces[s] != surface; s++)
+    {
+        Surface *above = compositor->surfaces[s];
+        if (above->visible && rectContains(surfaceRect(above), rect))
+            return;
+    }
+
+    damageCompositor(compositor, rect);
+}
+
+static void surfaceSinkEndFrame(TconSink *sink)
+{
+    Compositor *compositor = ((SurfaceSink *)sink)->surface->compositor;
+
+    if (composeDamage(compositor))
+        renderConsole(*compositor->con, compositor->hConsole, false);
+}
+
+// Index a surface of the given stacking order is inserted at, after the ones that cover it
+static int32_t surfacePosition(Compositor *compositor, int32_t z, uint64_t order)
+{
+    int32_t position = 0;
+    while (position < compositor->count)
+    {
+        Surface *other = compositor->surfaces[position];
+        if (other->z < z || (other->z == z && other->order < order))
+            break;
+        position++;
+    }
+
+    return position;
+}
+
+static void insertSurface(Compositor *compositor, Surface *surface)
+{
+    if (compositor->count == compositor->capacity)
+    {
+        int32_t capacity = compositor->capacity * 2;
+        TCON_STAT_ALLOC(2);
+        Surface **surfaces = realloc(compositor->surfaces, capacity * sizeof(Surface *));
+        int32_t *spans = realloc(compositor->spans, 4 * (capacity + 1) * sizeof(int32_t));
+        if (!surfaces || !spans)
+        {
+            perror("realloc");
+            exit(1);
+        }
+
+        compositor->surfaces = surfaces;
+        compositor->spans = spans;
+        compositor->capacity = capacity;
+    }
+
+    int32_t position = surfacePosition(compositor, surface->z, surface->order);
+    memmove(compositor->surfaces + position + 1, compositor->surfaces + position, (compositor->count - position) * sizeof(Surface *));
+    compositor->surfaces[position] = surface;
+    compositor->count++;
+}
+
+static void unlinkSurface(Compositor *compositor, Surface *surface)
+{
+    for (int32_t i = 0; i < compositor->count; i++)
+    {
+        if (compositor->surfaces[i] != surface)
+            continue;
+
+        memmove(compositor->surfaces + i, compositor->surfaces + i + 1, (compositor->count - i - 1) * sizeof(Surface *));
+        compositor->count--;
+        return;
+    }
+}
+
+Compositor *createCompositor(Console *con, HANDLE hConsole)
+{
+    TCON_STAT_ALLOC(1);
+    Compositor *compositor = calloc(1, sizeof(Compositor));
+    if (!compositor)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    compositor->capacity = COMPOSITOR_CAPACITY;
+    TCON_STAT_ALLOC(2);
+    compositor->surfaces = malloc(compositor->capacity * sizeof(Surface *));
+    compositor->spans = malloc(4 * (compositor->capacity + 1) * sizeof(int32_t));
+    if (!compositor->surfaces || !compositor->spans)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    compositor->con = con;
+    compositor->hConsole = hConsole;
+    compositor->layoutResizes = con->state->resizes;
+    compositor->background.Char = L' ';
+    compositor->background.Style = TCON_CONSOLE_STYLE(con->original.originalAttributes & 0x0F, con->original.originalAttributes & 0xF0);
+
+    return compositor;
+}
+
+void freeCompositor(Compositor *compositor)
+{
+    if (!compositor)
+        return;
+
+    for (int32_t i = 0; i < compositor->count; i++)
+    {
+        freeConsole(&compositor->surfaces[i]->console);
+        free(compositor->surfaces[i]);
+    }
+
+    free(compositor->surfaces);
+    free(compositor->spans);
+    free(compositor);
+}
+
+Surface *createSurface(Compositor *compositor, int32_t row, int32_t col, int32_t rows, int32_t cols, int32_t z)
+{
+    if (!compositor || rows < 0 || cols < 0)
+        return NULL;
+
+    // The sink points back at the surface, so the surface never moves
+    TCON_STAT_ALLOC(1);
+    Surface *surface = calloc(1, sizeof(Surface));
+    if (!surface)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    surface->row = row;
+    surface->col = col;
+    surface->z = z;
+    surface->visible = true;
+    surface->order = compositor->created++;
+    surface->compositor = compositor;
+    surface->sink.surface = surface;
+    surface->sink.sink.writeRun = surfaceSinkWriteRun;
+    surface->sink.sink.endFrame = surfaceSinkEndFrame;
+
+    // Blanks of the surface match the background, and styles are shared with the console
+    uint16_t attributes = compositor->con->original.originalAttributes;
+    surface->console = initHeadlessConsole(rows, cols, &surface->sink.sink);
+    surface->console.original.originalAttributes = attributes;
+    surface->console.state->styleTable = compositor->con->state->styleTable;
+    fillFramebuffer(&surface->console, attributes & 0x0F, attributes & 0xF0, L' ');
+
+    insertSurface(compositor, surface);
+    damageCompositor(compositor, surfaceRect(surface));
+
+    return surface;
+}
+
+void removeSurface(Surface *surface, HANDLE hConsole, bool hlt)
+{
+    if (!surface)
+        return;
+
+    Compositor *compositor = surface->compositor;
+
+    if (surface->visible)
+        damageCompositor(compositor, surfaceRect(surface));
+
+    unlinkSurface(compositor, surface);
+    freeConsole(&surface->console);
+    free(surface);
+
+    renderCompositor(compositor, hConsole, hlt);
+}
+
+void moveSurface(Surface *surface, int32_t row, int32_t col, HANDLE hConsole, bool hlt)
+{
+    if (!surface)
+        return;
+
+    SurfaceRect before = surfaceRect(surface);
+    surface->row = row;
+    surface->col = col;
+
+    if (surface->visible)
+    {
+        damageCompositor(surface->compositor, surfaceRect(surface));
+        damageExposed(surface->compositor, before, surfaceRect(surface));
+    }
+
+    renderCompositor(surface->compositor, hConsole, hlt);
+}
+
+void resizeSurface(Surface *surface, int32_t rows, int32_t cols, HANDLE hConsole, bool hlt)
+{
+    if (!surface || rows < 0 || cols < 0)
+        return;
+
+    SurfaceRect before = surfaceRect(surface);
+    resizeConsole(&surface->console, rows, cols);
+
+    if (surface->visible)
+    {
+        damageCompositor(surface->compositor, surfaceRect(surface));
+        damageExposed(surface->compositor, before, surfaceRect(surface));
+    }
+
+    renderCompositor(surface->compositor, hConsole, hlt);
+}
+
+void setSurfaceZ(Surface *surface, int32_t z, HANDLE hConsole, bool hlt)
+{
+    if (!surface)
+        return;
+
+    Compositor *compositor = surface->compositor;
+
+    unlinkSurface(compositor, surface);
+    surface->z = z;
+    surface->order = compositor->created++;
+    insertSurface(compositor, surface);
+
+    if (surface->visible)
+        damageCompositor(compositor, surfaceRect(surface));
+
+    renderCompositor(compositor, hConsole, hlt);
+}
+
+void setSurfaceVisible(Surface *surface, bool visible, HANDLE hConsole, bool hlt)
+{
+    if (!surface)
+        return;
+
+    if (surface->visible != visible)
+    {
+        surface->visible = visible;
+        damageCompositor(surface->compositor, surfaceRect(surface));
+    }
+
+    renderCompositor(surface->compositor, hConsole, hlt);
+}
@@ -0,0 +1,212 @@
+#include <stdbool.h>
+#include <inttypes.h>
+#include "tcon.h"
+
+#ifndef SURFACE_H
+#define SURFACE_H
+
+// Damaged rectangles kept apart before a new one is merged into the closest of them
+#define SURFACE_DAMAGE_RECTS 16
+
+// Cells of a console, clipped to its size when they are composited
+typedef struct SurfaceRect
+{
+   int32_t row;
+   int32_t col;
+   int32_t rows;
+   int32_t cols;
+} SurfaceRect;
+
+typedef struct Surface Surface;
+typedef struct Compositor Compositor;
+
+// Sink of the console of a surface, turns the runs that changed into damage of the compositor
+typedef struct SurfaceSink
+{
+   TconSink sink;
+   Surface *surface;
+} SurfaceSink;
+
+/*
+Off-screen layer of a compositor. The console of a surface is a headless console of the
+surface's size, everything that draws into a console (print, writeFormat, tables) draws into a
+surface through it. Rendering that console composites the cells that changed onto the console
+of the compositor and renders it. Styles are interned by the compositor's console, so they
+can be used on any of its surfaces. hlt flags given to the surface's console are ignored.
+*/
+struct Surface
+{
+   Console console;       // Draw into this console, its size is the size of the surface
+   int32_t row;           // Console cell of the top left cell, may be off screen
+   int32_t col;
+   int32_t z;             // Surfaces with a larger z cover those with a smaller one
+   bool visible;
+   uint64_t order;        // Creation order, breaks ties between equal z
+   Compositor *compositor;
+   SurfaceSink sink;
+};
+
+/*
+Stacks surfaces on a console. Only damaged rectangles are composited, and every row of them
+is filled from the topmost surface down, so surfaces stop being read where the ones above
+already cover the row and fully occluded surfaces are never touched. Cells no surface covers
+get the background. Cells outside damaged rectangles are left alone, so what was drawn into
+the console directly stays until a surface moves over it and away again.
+*/
+typedef struct Compositor
+{
+   Console *con;             // Console the surfaces are composited onto, must outlive the compositor
+   HANDLE hConsole;          // Handle renders of surface consoles present to
+   Surface **surfaces;       // Topmost first
+   int32_t count;
+   int32_t capacity;
+   int32_t *spans;           // Scratch for the uncovered spans of a row, two lists of capacity + 1 spans
+   SurfaceRect damage[SURFACE_DAMAGE_RECTS];
+   int32_t damageCount;
+   uint32_t layoutResizes;   // Console resizes seen by the last composite
+   uint64_t created;         // Surfaces created so far, see Surface.order
+   Cell background;          // Cells no surface covers
+   uint64_t composedCells;   // Cells the last composite copied from surfaces or filled with the background
+   uint64_t skippedRows;     // Damaged rows of visible surfaces the last composite never read, as ones above covered them
+} Compositor;
+
+/*
+Creates a compositor without surfaces, blank cells in the console's original colors show
+through where there are none.
+
+Arguments:
+   con - the console to composite onto, keep it alive and use it for renders afterwards
+   hConsole - the console handle, renders of surface consoles present with it
+
+Returns:
+   Pointer to the compositor
+*/
+Compositor *createCompositor(Console *con, HANDLE hConsole);
+
+/*
+Releases a compositor and all of its surfaces. The console keeps the last composited frame.
+
+Arguments:
+   compositor - the compositor to release
+
+Returns:
+   Void
+*/
+void freeCompositor(Compositor *compositor);
+
+/*
+Creates a visible surface filled with blanks. It shows once its console is rendered, or with
+the next renderCompositor().
+
+Arguments:
+   compositor - the compositor the surface belongs to
+   row - the console row of the top left cell, may be off screen
+   col - the console column of the top left cell, may be off screen
+   rows - the amount of rows of the surface
+   cols - the amount of columns of the surface
+   z - the stacking order, larger is on top, later surfaces cover earlier ones of the same z
+
+Returns:
+   Pointer to the surface, valid until removeSurface() or freeCompositor()
+*/
+Surface *createSurface(Compositor *compositor, int32_t row, int32_t col, int32_t rows, int32_t cols, int32_t z);
+
+/*
+Removes a surface, what it covered is composited again from the surfaces below.
+
+Arguments:
+   surface - the surface to remove, tables laid out on its console have to be removed first
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void removeSurface(Surface *surface, HANDLE hConsole, bool hlt);
+
+/*
+Moves a surface. Only the cells it covers now and the ones it exposed are composited again.
+
+Arguments:
+   surface - the surface to move
+   row - the new console row of the top left cell
+   col - the new console column of the top left cell
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void moveSurface(Surface *surface, int32_t row, int32_t col, HANDLE hConsole, bool hlt);
+
+/*
+Changes the size of a surface, see resizeConsole() for what happens to its content.
+
+Arguments:
+   surface - the surface to resize
+   rows - the new amount of rows
+   cols - the new amount of columns
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void resizeSurface(Surface *surface, int32_t rows, int32_t cols, HANDLE hConsole, bool hlt);
+
+/*
+Changes the stacking order of a surface, a surface becomes the topmost one of its new z.
+
+Arguments:
+   surface - the surface
+   z - the new stacking order
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void setSurfaceZ(Surface *surface, int32_t z, HANDLE hConsole, bool hlt);
+
+/*
+Shows or hides a surface. Hidden surfaces keep their content and are not composited.
+
+Arguments:
+   surface - the surface
+   visible - false to hide the surface
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void setSurfaceVisible(Surface *surface, bool visible, HANDLE hConsole, bool hlt);
+
+/*
+Marks cells of the console to be composited again, e.g. after something drew into the
+console directly.
+
+Arguments:
+   compositor - the compositor
+   rect - the cells in console coordinates, clipped to the console
+
+Returns:
+   Void
+*/
+void damageCompositor(Compositor *compositor, SurfaceRect rect);
+
+/*
+Composites the damaged cells onto the console and renders it. A resize of the console damages
+all of it.
+
+Arguments:
+   compositor - the compositor
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void renderCompositor(Compositor *compositor, HANDLE hConsole, bool hlt);
+
+#endif
@@ -1,133 +1,1497 @@
 #include "tcon.h"
 #include "table.h"
+#include "arena.h"
+#include "search.h"
+#include "utf8.h"
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <inttypes.h>
 
+// An indexed filter checks rows one by one only while they are fewer than rows / TABLE_SCAN_RATIO,
+// more are found faster by scanning the row texts in order
+#define TABLE_SCAN_RATIO 8
+
+// A shown row is checked against a filter typed on from its match about this many times faster
+// than a row listed for a trigram is checked against its text
+#define TABLE_KEPT_RATIO 4
+
 // TODO: Implement proper error handling (Consider a custom error handler)
 
-Table createTable(Console *con, int32_t rows, int32_t cols)
+// Rows are indexed under ids that stay with them while the ring moves them between slots
+struct TableIndex
+{
+    TrigramIndex *trigrams;
+    TextStore *texts;   // Folded contents of each row, scanned when the trigrams can not narrow a filter down
+    uint32_t *rowIds;   // Id of the row in each ring slot
+    int32_t *idSlots;   // Ring slot of each id, -1 once its row is gone
+    TextMatch *matches; // Where the filter occurs in the text of each id, kept for the ids of shown rows
+    int32_t ids;        // Ids handed out since the index was last built
+    int32_t idCapacity;
+};
+
+// Gives a cell a blank content of the given width
+static void initCellContent(Table *table, TableCell *cell, int32_t width)
+{
+    cell->content = arenaAlloc(table->arena, width + 1);
+    memset(cell->content, ' ', width);
+    cell->content[width] = '\0';
+}
+
+// Bytes of content, the blank padding cells start with does not count
+static int32_t contentLength(const char *content)
+{
+    if (!content)
+        return 0;
+
+    int32_t len = strlen(content);
+    while (len > 0 && content[len - 1] == ' ')
+        len--;
+
+    return len;
+}
+
+// Columns content takes on screen, wide chars count twice and combining marks not at all
+static int32_t contentWidth(const char *content)
+{
+    return content ? utf8Width(content, contentLength(content)) : 0;
+}
+
+// Counts a content width in or out of a column's histogram, the widest content follows it
+static void trackWidth(TableColumn *column, int32_t width, int32_t delta)
+{
+    if (width <= 0)
+        return;
+    if (width >= TABLE_WIDTH_BUCKETS)
+        width = TABLE_WIDTH_BUCKETS - 1;
+
+    column->widthCounts[width] += delta;
+
+    if (width > column->contentWidth && delta > 0)
+        column->contentWidth = width;
+
+    // Only emptying the widest bucket needs a search, over the buckets and never over the rows
+    while (column->contentWidth > 0 && column->widthCounts[column->contentWidth] == 0)
+        column->contentWidth--;
+}
+
+// Moves a cell of column col from one content width to another, auto widths are fitted again later
+static void updateWidth(Table *table, int32_t col, int32_t oldWidth, int32_t newWidth)
+{
+    if (oldWidth == newWidth)
+        return;
+
+    TableColumn *column = &table->columns[col];
+    int32_t widest = column->contentWidth;
+
+    trackWidth(column, oldWidth, -1);
+    trackWidth(column, newWidth, 1);
+
+    if (column->contentWidth != widest && table->autoWidth)
+        table->widthsChanged = true;
+}
+
+// Returns a cell's memory to the table arena and resets it to its defaults
+static void releaseCell(Table *table, TableCell *cell, int32_t col)
+{
+    updateWidth(table, col, contentWidth(cell->content), 0);
+    arenaFree(table->arena, cell->content);
+
+    cell->content = NULL;
+    cell->fgColor = FWHITE;
+    cell->bgColor = BBLACK;
+}
+
+// Ring slot of a stored row, rows are kept in a ring starting at headRow
+static int32_t rowSlot(Table *table, int32_t row)
+{
+    int32_t slot = table->headRow + row;
+    if (slot >= table->rowCapacity)
+        slot -= table->rowCapacity;
+
+    return slot;
+}
+
+// Stored row kept in a ring slot
+static int32_t slotRow(Table *table, int32_t slot)
+{
+    int32_t row = slot - table->headRow;
+    if (row < 0)
+        row += table->rowCapacity;
+
+    return row;
+}
+
+static TableCell **tableRowSlot(Table *table, int32_t row)
+{
+    return &table->cells[rowSlot(table, row)];
+}
+
+static TableCell *tableRow(Table *table, int32_t row)
+{
+    return *tableRowSlot(table, row);
+}
+
+// Framebuffer rows the table occupies
+static int32_t viewLines(Table *table)
+{
+    return table->viewHeight > 0 ? table->viewHeight : table->rows;
+}
+
+// Lines of the view that fit on the console, the rest is not drawn
+static int32_t visibleLines(Table *table)
+{
+    int32_t lines = viewLines(table);
+    int32_t fit = table->console->bufferRows - table->top;
+
+    if (lines > fit)
+        lines = fit;
+
+    return lines > 0 ? lines : 0;
+}
+
+// Positions of the view, a filtered table only shows the rows its filter lets through
+static int32_t shownRows(Table *table)
+{
+    return table->filter ? table->shownCount : table->rows;
+}
+
+// Stored row shown at a position, sorted tables show their rows through a permutation
+static int32_t rowAt(Table *table, int32_t position)
+{
+    if (table->filter)
+        return slotRow(table, table->shown[position]);
+
+    return table->sortKeyCount > 0 ? slotRow(table, table->order[position]) : position;
+}
+
+
+static bool isSortColumn(Table *table, int32_t col)
+{
+    for (int32_t k = 0; k < table->sortKeyCount; k++)
+    {
+        if (table->sortColumns[k].col == col)
+            return true;
+    }
+
+    return false;
+}
+
+// Sort key of a cell's content. Numbers map to integers that order the same way, content that
+// is no number comes after all numbers. Text keeps its first 8 bytes folded to lower case in
+// big endian order, so only rows with equal keys compare the rest of their text
+static uint64_t sortKey(const char *content, TableSortType type)
+{
+    if (type == SORT_NUMBER)
+    {
+        char *end;
+        double number = strtod(content, &end);
+        if (end == content || number != number)
+            return UINT64_MAX;
+
+        // Flipping the sign bit of positive and every bit of negative doubles orders them as integers
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return (bits & 0x8000000000000000ull) ? ~bits : bits | 0x8000000000000000ull;
+    }
+
+    uint64_t key = 0;
+    int32_t len = contentLength(content);
+    for (int32_t i = 0; i < 8; i++)
+        key = key << 8 | (i < len ? (uint8_t)tolower((unsigned char)content[i]) : 0);
+
+    return key;
+}
+
+// Compares text folded to lower case, then as it is. Trailing blanks do not count
+static int32_t compareText(const char *a, const char *b)
+{
+    int32_t lenA = contentLength(a);
+    int32_t lenB = contentLength(b);
+    int32_t len = lenA < lenB ? lenA : lenB;
+    int32_t exact = 0;
+
+    // Equal keys mostly come from equal text
+    if (lenA == lenB && memcmp(a, b, len) == 0)
+        return 0;
+
+    for (int32_t i = 0; i < len; i++)
+    {
+        int32_t foldedA = tolower((unsigned char)a[i]);
+        int32_t foldedB = tolower((unsigned char)b[i]);
+
+        if (foldedA != foldedB)
+            return foldedA < foldedB ? -1 : 1;
+        if (exact == 0 && a[i] != b[i])
+            exact = (unsigned char)a[i] < (unsigned char)b[i] ? -1 : 1;
+    }
+
+    if (lenA != lenB)
+        return lenA < lenB ? -1 : 1;
+
+    return exact;
+}
+
+// Orders the rows in two ring slots by the sort columns, rows with equal keys stay in the
+// order they are stored in. Never returns 0 for different slots
+static int32_t compareRows(Table *table, int32_t slotA, int32_t slotB)
+{
+    int32_t keys = table->sortKeyCount;
+
+    for (int32_t k = 0; k < keys; k++)
+    {
+        TableSortColumn *column = &table->sortColumns[k];
+        uint64_t keyA = table->sortKeys[(size_t)slotA * keys + k];
+        uint64_t keyB = table->sortKeys[(size_t)slotB * keys + k];
+        int32_t result = keyA == keyB ? 0 : (keyA < keyB ? -1 : 1);
+
+        // Content that is no number sorts last in either direction
+        if (result != 0 && column->type == SORT_NUMBER && (keyA == UINT64_MAX || keyB == UINT64_MAX))
+            return result;
+
+        if (result == 0 && column->type == SORT_TEXT)
+            result = compareText(table->cells[slotA][column->col].content, table->cells[slotB][column->col].content);
+
+        if (result != 0)
+            return column->descending ? -result : result;
+    }
+
+    int32_t rowA = slotRow(table, slotA);
+    int32_t rowB = slotRow(table, slotB);
+    return rowA == rowB ? 0 : (rowA < rowB ? -1 : 1);
+}
+
+static void computeSortKeys(Table *table, int32_t slot)
+{
+    for (int32_t k = 0; k < table->sortKeyCount; k++)
+    {
+        const char *content = table->cells[slot][table->sortColumns[k].col].content;
+        table->sortKeys[(size_t)slot * table->sortKeyCount + k] = sortKey(content ? content : "", table->sortColumns[k].type);
+    }
+}
+
+// Binary search for the position of a ring slot, while its keys and content are still the
+// ones it was sorted by
+static int32_t findPosition(Table *table, int32_t slot)
+{
+    int32_t low = 0;
+    int32_t high = table->rows - 1;
+
+    while (low < high)
+    {
+        int32_t mid = low + (high - low) / 2;
+        if (compareRows(table, table->order[mid], slot) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// Binary search for the index of a ring slot among the shown rows, or where it would be shown.
+// Like findPosition it needs the keys and content the row was placed by
+static int32_t findShown(Table *table, int32_t slot)
+{
+    int32_t low = 0;
+    int32_t high = table->shownCount;
+
+    while (low < high)
+    {
+        int32_t mid = low + (high - low) / 2;
+        if (compareRows(table, table->shown[mid], slot) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// Position a stored row is shown at, -1 if a filter hides it
+static int32_t positionOf(Table *table, int32_t row)
+{
+    int32_t slot = rowSlot(table, row);
+
+    if (table->filter)
+    {
+        int32_t at = findShown(table, slot);
+        return at < table->shownCount && table->shown[at] == slot ? at : -1;
+    }
+
+    return table->sortKeyCount > 0 ? findPosition(table, slot) : row;
+}
+
+// Whether a cell of the row in a ring slot contains the filter. An index keeps where it occurs
+static bool rowMatches(Table *table, int32_t slot)
+{
+    TableIndex *index = table->index;
+
+    if (index)
+    {
+        uint32_t id = index->rowIds[slot];
+        return findInText(index->texts, id, table->filter, table->filterLen, 0, &index->matches[id]);
+    }
+
+    TableCell *cells = table->cells[slot];
+
+    for (int32_t c = 0; c < table->cols; c++)
+    {
+        const char *content = cells[c].content;
+        if (content && findText(content, contentLength(content), table->filter, table->filterLen))
+            return true;
+    }
+
+    return false;
+}
+
+// Shows the row in a ring slot at its place if it matches the filter. Returns its position, -1
+// if it stays hidden
+static int32_t showRow(Table *table, int32_t slot)
+{
+    if (!rowMatches(table, slot))
+        return -1;
+
+    int32_t at = findShown(table, slot);
+    memmove(&table->shown[at + 1], &table->shown[at], (table->shownCount - at) * sizeof(int32_t));
+    table->shown[at] = slot;
+    table->shownCount++;
+
+    return at;
+}
+
+// Hides the row in a ring slot while it still has the keys and content it was shown by. Returns
+// the position it had, -1 if it was hidden already
+static int32_t hideRow(Table *table, int32_t slot)
+{
+    int32_t at = findShown(table, slot);
+    if (at >= table->shownCount || table->shown[at] != slot)
+        return -1;
+
+    memmove(&table->shown[at], &table->shown[at + 1], (table->shownCount - at - 1) * sizeof(int32_t));
+    table->shownCount--;
+
+    return at;
+}
+
+// Shows the rows whose ring slot is marked, walking the positions in the order they are shown
+static void showMarked(Table *table, const uint8_t *marks)
+{
+    int32_t count = 0;
+
+    for (int32_t p = 0; p < table->rows; p++)
+    {
+        int32_t slot = table->sortKeyCount > 0 ? table->order[p] : rowSlot(table, p);
+        if (marks[slot])
+            table->shown[count++] = slot;
+    }
+
+    table->shownCount = count;
+}
+
+// Finds the rows the filter lets through. A filter that contains the last one, extendsLen bytes at
+// offset extendsAt or -1 for any other filter, only has to check the rows shown. With an index
+// the fewest rows are checked out of those shown, those listed for the filter's rarest trigram,
+// or all, where checking them one by one would cost more than scanning the row texts in order.
+// Shown rows are checked from where the last filter occurred in them, bytes typed on are mostly
+// compared to the ones kept after it
+static void applyFilter(Table *table, int32_t extendsAt, int32_t extendsLen)
+{
+    TableIndex *index = table->index;
+    const TrigramList *list = NULL;
+    int32_t candidates = table->rows;
+
+    if (index && table->filterLen >= TRIGRAM_LENGTH)
+    {
+        list = findTrigramCandidates(index->trigrams, table->filter, table->filterLen);
+        candidates = list ? list->count : 0;
+    }
+
+    int32_t scanLimit = index ? table->rows / TABLE_SCAN_RATIO : table->rows;
+
+    // Checking every row shown on its own costs more than a scan in order when the shown rows of a
+    // sorted table jump around their texts, or when the last filter was one character, found by
+    // signature without a match to go on from, see scanTexts()
+    bool matchesKept = index && table->sortKeyCount == 0 && extendsLen > 1;
+    bool narrow = matchesKept ? table->shownCount <= (int64_t)candidates * TABLE_KEPT_RATIO
+                              : table->shownCount <= candidates && table->shownCount <= scanLimit;
+
+    if (extendsAt >= 0 && narrow)
+    {
+        int32_t count = 0;
+        for (int32_t i = 0; i < table->shownCount; i++)
+        {
+            int32_t slot = table->shown[i];
+            bool matches;
+
+            if (index)
+            {
+                uint32_t id = index->rowIds[slot];
+                matches = extendMatch(index->texts, id, table->filter, table->filterLen, extendsAt, extendsLen, &index->matches[id]);
+            }
+            else
+            {
+                matches = rowMatches(table, slot);
+            }
+
+            if (matches)
+                table->shown[count++] = slot;
+        }
+
+        table->shownCount = count;
+        return;
+    }
+
+    if (!index)
+    {
+        int32_t count = 0;
+        for (int32_t p = 0; p < table->rows; p++)
+        {
+            int32_t slot = table->sortKeyCount > 0 ? table->order[p] : rowSlot(table, p);
+            if (rowMatches(table, slot))
+                table->shown[count++] = slot;
+        }
+
+        table->shownCount = count;
+        return;
+    }
+
+    // Trigram lists may name a row more than once and under stale ids, marks collect each matching
+    // row once and in the order it is shown
+    uint8_t *marks = arenaAlloc(table->arena, table->rowCapacity > 0 ? table->rowCapacity : 1);
+    memset(marks, 0, table->rowCapacity);
+
+    if (list && candidates <= scanLimit)
+    {
+        for (int32_t i = 0; i < list->count; i++)
+        {
+            int32_t slot = index->idSlots[list->ids[i]];
+            if (slot >= 0 && !marks[slot] && rowMatches(table, slot))
+                marks[slot] = 1;
+        }
+    }
+    else if (candidates > 0)
+    {
+        uint32_t *ids = arenaAlloc(table->arena, (index->ids > 0 ? index->ids : 1) * sizeof(uint32_t));
+        int32_t count = scanTexts(index->texts, table->filter, table->filterLen, ids, index->matches);
+
+        for (int32_t i = 0; i < count; i++)
+        {
+            int32_t slot = index->idSlots[ids[i]];
+            if (slot >= 0)
+                marks[slot] = 1;
+        }
+
+        arenaFree(table->arena, ids);
+    }
+
+    showMarked(table, marks);
+    arenaFree(table->arena, marks);
+}
+
+// Puts the shown rows in the order of the positions, after the table was sorted again
+static void reorderShown(Table *table)
+{
+    uint8_t *marks = arenaAlloc(table->arena, table->rowCapacity > 0 ? table->rowCapacity : 1);
+    memset(marks, 0, table->rowCapacity);
+
+    for (int32_t i = 0; i < table->shownCount; i++)
+        marks[table->shown[i]] = 1;
+
+    showMarked(table, marks);
+    arenaFree(table->arena, marks);
+}
+
+// Hands out an id to the row in a ring slot
+static void assignRowId(Table *table, int32_t slot)
+{
+    TableIndex *index = table->index;
+
+    if (index->ids == index->idCapacity)
+    {
+        index->idCapacity = index->idCapacity > 0 ? index->idCapacity * 2 : 64;
+        index->idSlots = arenaRealloc(table->arena, index->idSlots, index->idCapacity * sizeof(int32_t));
+        index->matches = arenaRealloc(table->arena, index->matches, index->idCapacity * sizeof(TextMatch));
+    }
+
+    index->rowIds[slot] = (uint32_t)index->ids;
+    index->idSlots[index->ids] = slot;
+    memset(&index->matches[index->ids], 0, sizeof(TextMatch));
+    index->ids++;
+}
+
+// Adds the contents of the row in a ring slot to the index, under the row's id
+static void indexRow(Table *table, int32_t slot)
+{
+    TableIndex *index = table->index;
+    if (!index)
+        return;
+
+    uint32_t id = index->rowIds[slot];
+    beginText(index->texts, id);
+    memset(&index->matches[id], 0, sizeof(TextMatch));
+
+    for (int32_t c = 0; c < table->cols; c++)
+    {
+        const char *content = table->cells[slot][c].content;
+        int32_t len = contentLength(content);
+
+        addText(index->texts, content, len);
+        addTrigrams(index->trigrams, id, content, len);
+    }
+}
+
+// Takes the contents of the row in a ring slot out of the index, before they change. Its
+// trigram entries are left behind
+static void unindexRow(Table *table, int32_t slot)
+{
+    TableIndex *index = table->index;
+    if (index)
+        dropTrigrams(index->trigrams, dropText(index->texts, index->rowIds[slot]));
+}
+
+// Indexes every stored row again, under ids handed out in row order
+static void buildIndex(Table *table)
+{
+    clearTrigramIndex(table->index->trigrams);
+    clearTextStore(table->index->texts);
+    table->index->ids = 0;
+
+    for (int32_t r = 0; r < table->rows; r++)
+    {
+        int32_t slot = rowSlot(table, r);
+        assignRowId(table, slot);
+        indexRow(table, slot);
+    }
+}
+
+// Builds the index again once stale trigram entries or the ids of removed rows outweigh the live
+// ones, which costs about as much as the changes that made them. The row texts compact themselves
+static void compactIndex(Table *table)
+{
+    if (!table->index)
+        return;
+
+    TrigramIndex *trigrams = table->index->trigrams;
+    if (trigrams->staleEntries * 2 > trigrams->entries || table->index->ids > 2 * table->rows + 64)
+        buildIndex(table);
+}
+
+// Moves a row whose content changed from position from to its sorted position. The neighbours
+// are checked first, otherwise a binary search finds the new position and only the rows in
+// between shift. first and last receive the range of positions that show another row now
+static void resortRow(Table *table, int32_t row, int32_t from, int32_t *first, int32_t *last)
+{
+    int32_t slot = rowSlot(table, row);
+    int32_t to = from;
+
+    computeSortKeys(table, slot);
+
+    if (from > 0 && compareRows(table, slot, table->order[from - 1]) < 0)
+    {
+        // First earlier position whose row sorts after this one
+        int32_t low = 0;
+        int32_t high = from - 1;
+        while (low < high)
+        {
+            int32_t mid = low + (high - low) / 2;
+            if (compareRows(table, table->order[mid], slot) > 0)
+                high = mid;
+            else
+                low = mid + 1;
+        }
+
+        to = low;
+        memmove(&table->order[to + 1], &table->order[to], (from - to) * sizeof(int32_t));
+    }
+    else if (from < table->rows - 1 && compareRows(table, slot, table->order[from + 1]) > 0)
+    {
+        // Last later position whose row sorts before this one
+        int32_t low = from + 1;
+        int32_t high = table->rows - 1;
+        while (low < high)
+        {
+            int32_t mid = low + (high - low + 1) / 2;
+            if (compareRows(table, table->order[mid], slot) < 0)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+
+        to = low;
+        memmove(&table->order[from], &table->order[from + 1], (to - from) * sizeof(int32_t));
+    }
+
+    table->order[to] = slot;
+
+    *first = from < to ? from : to;
+    *last = from < to ? to : from;
+}
+
+// Puts the row added last in place. first and last receive the positions to draw again
+static void placeRow(Table *table, int32_t row, int32_t *first, int32_t *last)
+{
+    if (table->sortKeyCount > 0)
+    {
+        resortRow(table, row, row, first, last);
+        return;
+    }
+
+    *first = row;
+    *last = row;
+}
+
+// Takes a position out of the order, the rows after it move up
+static void removePosition(Table *table, int32_t position)
+{
+    memmove(&table->order[position], &table->order[position + 1], (table->rows - position - 1) * sizeof(int32_t));
+}
+
+// Moves a stored row into the slot of another one, together with its sort keys and index id
+static void moveRow(Table *table, int32_t to, int32_t from)
+{
+    int32_t toSlot = rowSlot(table, to);
+    int32_t fromSlot = rowSlot(table, from);
+
+    table->cells[toSlot] = table->cells[fromSlot];
+
+    if (table->index)
+    {
+        uint32_t id = table->index->rowIds[fromSlot];
+        table->index->rowIds[toSlot] = id;
+        table->index->idSlots[id] = toSlot;
+    }
+
+    if (table->sortKeyCount > 0)
+    {
+        int32_t keys = table->sortKeyCount;
+        memcpy(&table->sortKeys[(size_t)toSlot * keys], &table->sortKeys[(size_t)fromSlot * keys], keys * sizeof(uint64_t));
+    }
+}
+
+static void freeSortState(Table *table)
+{
+    arenaFree(table->arena, table->sortKeys);
+    arenaFree(table->arena, table->order);
+
+    table->sortKeys = NULL;
+    table->order = NULL;
+}
+
+// Sorts every row with a stable bottom-up merge sort of the order
+static void sortRows(Table *table)
+{
+    int32_t rows = table->rows;
+    int32_t *scratch = arenaAlloc(table->arena, (rows > 0 ? rows : 1) * sizeof(int32_t));
+    int32_t *from = table->order;
+    int32_t *to = scratch;
+
+    for (int32_t r = 0; r < rows; r++)
+    {
+        int32_t slot = rowSlot(table, r);
+        computeSortKeys(table, slot);
+        from[r] = slot;
+    }
+
+    for (int32_t width = 1; width < rows; width *= 2)
+    {
+        for (int32_t low = 0; low < rows; low += 2 * width)
+        {
+            int32_t mid = low + width < rows ? low + width : rows;
+            int32_t high = low + 2 * width < rows ? low + 2 * width : rows;
+            int32_t i = low;
+            int32_t j = mid;
+
+            for (int32_t k = low; k < high; k++)
+            {
+                if (i < mid && (j >= high || compareRows(table, from[i], from[j]) < 0))
+                    to[k] = from[i++];
+                else
+                    to[k] = from[j++];
+            }
+        }
+
+        int32_t *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != table->order)
+        memcpy(table->order, from, rows * sizeof(int32_t));
+
+    arenaFree(table->arena, scratch);
+}
+
+// Sets the sort columns and sorts the rows, no columns show the rows in storage order
+static void applySort(Table *table, const TableSortColumn *columns, int32_t count)
+{
+    freeSortState(table);
+    table->sortKeyCount = 0;
+
+    for (int32_t i = 0; i < count && table->sortKeyCount < TABLE_SORT_KEYS; i++)
+    {
+        if (columns[i].col >= 0 && columns[i].col < table->cols)
+            table->sortColumns[table->sortKeyCount++] = columns[i];
+    }
+
+    if (table->sortKeyCount == 0)
+        return;
+
+    int32_t capacity = table->rowCapacity > 0 ? table->rowCapacity : 1;
+    table->sortKeys = arenaAlloc(table->arena, (size_t)capacity * table->sortKeyCount * sizeof(uint64_t));
+    table->order = arenaAlloc(table->arena, capacity * sizeof(int32_t));
+
+    sortRows(table);
+}
+
+// First framebuffer cell of a table cell on a given line of the view, the rest of the cell follows contiguously
+static Cell *cellSpan(Table *table, int32_t line, int32_t col)
+{
+    ConsoleState *console = table->console;
+    return console->framebuffer + (size_t)(table->top + line) * console->stride + table->columns[col].x;
+}
+
+// Grows the column array to cols entries, columns from first on start without content
+static void reserveColumns(Table *table, int32_t first, int32_t cols)
+{
+    table->columns = arenaRealloc(table->arena, table->columns, (cols > 0 ? cols : 1) * sizeof(TableColumn));
+
+    for (int32_t c = first; c < cols; c++)
+    {
+        TableColumn *column = &table->columns[c];
+        memset(column, 0, sizeof(TableColumn));
+        column->minWidth = 1;
+        column->weight = 1;
+        column->widthCounts = arenaAlloc(table->arena, TABLE_WIDTH_BUCKETS * sizeof(int32_t));
+        memset(column->widthCounts, 0, TABLE_WIDTH_BUCKETS * sizeof(int32_t));
+    }
+}
+
+// Room a column has to grow or shrink within its limits
+static int32_t columnRoom(TableColumn *column, bool grow)
+{
+    if (!grow)
+        return column->width - column->minWidth;
+    if (column->weight <= 0)
+        return 0;
+
+    return column->maxWidth > 0 ? column->maxWidth - column->width : INT32_MAX;
+}
+
+// Adds amount cells to the column widths, or takes them away, in proportion to the column
+// weights. Returns what no column had room for
+static int32_t distributeWidth(Table *table, int32_t cols, int32_t amount, bool grow)
+{
+    while (amount > 0)
+    {
+        int64_t weights = 0;
+        for (int32_t c = 0; c < cols; c++)
+        {
+            if (columnRoom(&table->columns[c], grow) > 0)
+                weights += table->columns[c].weight > 0 ? table->columns[c].weight : 1;
+        }
+
+        if (weights == 0)
+            break;
+
+        int32_t left = amount;
+        for (int32_t c = 0; c < cols && left > 0; c++)
+        {
+            TableColumn *column = &table->columns[c];
+            int32_t room = columnRoom(column, grow);
+            if (room <= 0)
+                continue;
+
+            int32_t weight = column->weight > 0 ? column->weight : 1;
+            int32_t share = (int32_t)((int64_t)amount * weight / weights);
+            if (share < 1)
+                share = 1;
+            if (share > room)
+                share = room;
+            if (share > left)
+                share = left;
+
+            column->width += grow ? share : -share;
+            left -= share;
+        }
+
+        amount = left;
+    }
+
+    return amount;
+}
+
+// Sizes the columns to their widest content within their limits, then hands out the space left
+// over or missing by weight. Columns are separated by one cell
+static void fitColumns(Table *table, int32_t cols, int32_t consoleCols)
+{
+    int32_t budget = consoleCols - (cols - 1);
+    int32_t total = 0;
+
+    for (int32_t c = 0; c < cols; c++)
+    {
+        TableColumn *column = &table->columns[c];
+        int32_t width = column->contentWidth;
+
+        if (column->maxWidth > 0 && width > column->maxWidth)
+            width = column->maxWidth;
+        if (width < column->minWidth)
+            width = column->minWidth;
+
+        column->width = width;
+        total += width;
+    }
+
+    if (total < budget)
+        distributeWidth(table, cols, budget - total, true);
+    else if (total > budget)
+    {
+        // Minimum widths that do not fit give way from the right
+        int32_t excess = distributeWidth(table, cols, total - budget, false);
+        for (int32_t c = cols - 1; c >= 0 && excess > 0; c--)
+        {
+            int32_t take = table->columns[c].width < excess ? table->columns[c].width : excess;
+            table->columns[c].width -= take;
+            excess -= take;
+        }
+    }
+
+    int32_t x = 0;
+    for (int32_t c = 0; c < cols; c++)
+    {
+        table->columns[c].x = x;
+        x += table->columns[c].width + 1;
+    }
+}
+
+// Places cols columns on the console, fitted to their content or splitting the width evenly,
+// with a separator after each one
+static void layoutColumns(Table *table, ConsoleState *console, int32_t cols)
 {
-    Table table;
-    table.rows = rows;
-    table.cols = cols;
+    table->console = console;
+    table->layoutResizes = console->resizes;
+    table->widthsChanged = false;
+    TCON_STAT_ADD(console, reflows, 1);
 
-    // Allocate cells array in table
-    table.cells = malloc(rows * sizeof(TableCell *));
-    for (int32_t r = 0; r < rows; r++)
-        table.cells[r] = malloc(cols * sizeof(TableCell));
+    if (table->autoWidth && cols > 0 && console->bufferCols >= cols - 1)
+    {
+        fitColumns(table, cols, console->bufferCols);
+        return;
+    }
 
-    // Prepare separator columns
-    int32_t usableCols = con->cols;
+    int32_t usableCols = console->bufferCols;
     if (usableCols % 2 != 0)
         usableCols--;
 
-    int32_t colWidth = usableCols / cols;
+    int32_t colWidth = cols > 0 ? usableCols / cols : 0;
 
-    int32_t *separators = malloc(cols * sizeof(int32_t));
-    if (!separators)
-        return table;
+    for (int32_t c = 0; c < cols; c++)
+    {
+        // Columns span from after the previous separator up to their own, which sits at (c + 1) * colWidth
+        int32_t x = (c == 0) ? 0 : c * colWidth + 1;
+        int32_t width = (c + 1) * colWidth - x;
 
-    for (int32_t j = 0; j < cols; j++)
-        separators[j] = (j + 1) * colWidth;
+        table->columns[c].x = x;
+        table->columns[c].width = width > 0 ? width : 0;
+    }
+}
 
-    // Create column borders in framebuffer
-    for (int32_t i = 0; i < rows; i++)
+// Paints a cell's stored content into its span on a line of the view
+static void paintCell(Table *table, int32_t line, int32_t row, int32_t col)
+{
+    TableCell *cell = &tableRow(table, row)[col];
+    const char *value = cell->content ? cell->content : "";
+
+    int32_t width = table->columns[col].width;
+    int32_t len = contentLength(value);
+    int32_t used;
+    int32_t fit = (int32_t)utf8Fit(value, len, width, &used);
+
+    // Overflowing content ends in an ellipsis where the cell is wide enough for one, cut after
+    // the last whole grapheme that fits in front of it
+    int32_t maxContent = width;
+    if (fit < len && width >= 3)
     {
-        for (int32_t j = 0; j < cols - 1; j++)
-            setCellData(con, i, separators[j], FWHITE, BBLACK, '|');
+        maxContent = width - 3;
+        fit = (int32_t)utf8Fit(value, fit, maxContent, &used);
     }
 
-    // Link console cells to table cells
-    for (int32_t r = 0; r < rows; r++)
+    Cell *span = cellSpan(table, line, col);
+    int32_t x = 0;
+    int32_t pos = 0;
+
+    while (pos < fit)
+    {
+        int32_t ascii = pos + (int32_t)utf8AsciiPrefix(value + pos, fit - pos);
+        for (; pos < ascii; pos++)
+            span[x++].Char = (unsigned char)value[pos];
+
+        if (pos < fit)
+        {
+            uint32_t c;
+            int32_t charWidth;
+            pos += utf8Grapheme(value + pos, fit - pos, &c, &charWidth);
+
+            // A cell shows a single codepoint, graphemes without width are left out
+            if (charWidth > 0)
+                span[x++].Char = c;
+            if (charWidth == 2)
+                span[x++].Char = TCON_WIDE_TAIL;
+        }
+    }
+
+    for (; x < maxContent; x++)
+        span[x].Char = ' ';
+    for (; x < width; x++)
+        span[x].Char = '.';
+
+    uint32_t style = TCON_CONSOLE_STYLE(cell->fgColor, cell->bgColor);
+    for (int32_t j = 0; j < width; j++)
+        span[j].Style = style;
+}
+
+// Paints a cell, if its row is in view
+static void drawCell(Table *table, int32_t row, int32_t col)
+{
+    int32_t line = positionOf(table, row) - table->viewRow;
+    if (line < 0 || line >= visibleLines(table))
+        return;
+
+    paintCell(table, line, row, col);
+}
+
+// Sets a cell on a line of the view to a plain char
+static void setLineCell(Table *table, int32_t line, int32_t x, uint32_t ch)
+{
+    ConsoleState *console = table->console;
+    Cell *cell = &console->framebuffer[(size_t)(table->top + line) * console->stride + x];
+
+    cell->Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
+    cell->Char = ch;
+}
+
+// Draws one line of the view across the console: the row shown there with its separators, or
+// blank past the last row
+static void drawLine(Table *table, int32_t line)
+{
+    int32_t position = table->viewRow + line;
+    int32_t consoleCols = table->console->bufferCols;
+    int32_t end = 0;
+
+    if (position < shownRows(table))
+    {
+        int32_t row = rowAt(table, position);
+
+        for (int32_t c = 0; c < table->cols - 1; c++)
+        {
+            TableColumn *column = &table->columns[c];
+            setLineCell(table, line, column->x + column->width, '|');
+        }
+
+        for (int32_t c = 0; c < table->cols; c++)
+            paintCell(table, line, row, c);
+
+        if (table->cols > 0)
+            end = table->columns[table->cols - 1].x + table->columns[table->cols - 1].width;
+    }
+
+    for (int32_t fc = end; fc < consoleCols; fc++)
+        setLineCell(table, line, fc, L' ');
+}
+
+// Draws the view from line fromLine up to lines, which may include lines the table just gave up
+static void drawView(Table *table, int32_t fromLine, int32_t lines)
+{
+    int32_t fit = table->console->bufferRows - table->top;
+    if (lines > fit)
+        lines = fit;
+
+    for (int32_t line = fromLine < 0 ? 0 : fromLine; line < lines; line++)
+        drawLine(table, line);
+}
+
+// Draws the lines showing positions first to last, as far as they are in view
+static void drawPositions(Table *table, int32_t first, int32_t last)
+{
+    int32_t lines = last - table->viewRow + 1;
+    if (lines > viewLines(table))
+        lines = viewLines(table);
+
+    drawView(table, first - table->viewRow, lines);
+}
+
+// Lays the columns out again and redraws what moved
+static void relayoutTable(Table *table)
+{
+    ConsoleState *state = table->console;
+
+    // Only the part the last resize kept still holds what the table drew, after several
+    // resizes nothing is known and the table is drawn in full
+    int32_t keptRows = 0;
+    int32_t keptCols = 0;
+    if (state->resizes == table->layoutResizes)
+    {
+        keptRows = state->bufferRows;
+        keptCols = state->bufferCols;
+    }
+    else if (state->resizes == table->layoutResizes + 1)
+    {
+        keptRows = state->keptRows;
+        keptCols = state->keptCols;
+    }
+
+    int32_t cols = table->cols;
+    TableColumn *oldColumns = arenaAlloc(table->arena, (cols > 0 ? cols : 1) * sizeof(TableColumn));
+    memcpy(oldColumns, table->columns, cols * sizeof(TableColumn));
+    int32_t oldEnd = cols > 0 ? oldColumns[cols - 1].x + oldColumns[cols - 1].width : 0;
+
+    layoutColumns(table, table->console, cols);
+
+    int32_t newEnd = cols > 0 ? table->columns[cols - 1].x + table->columns[cols - 1].width : 0;
+    if (oldEnd > keptCols)
+        oldEnd = keptCols;
+
+    int32_t lines = visibleLines(table);
+    for (int32_t line = 0; line < lines; line++)
     {
+        int32_t position = table->viewRow + line;
+
+        // Lines that were not kept are blank, as are lines past the last row that were kept
+        if (table->top + line >= keptRows)
+        {
+            drawLine(table, line);
+            continue;
+        }
+        if (position >= shownRows(table))
+            continue;
+
+        int32_t row = rowAt(table, position);
+
         for (int32_t c = 0; c < cols; c++)
         {
-            TableCell *cell = &table.cells[r][c];
+            TableColumn *column = &table->columns[c];
+            bool moved = column->x != oldColumns[c].x || column->width != oldColumns[c].width;
 
-            int32_t startCol = (c == 0) ? 0 : separators[c - 1] + 1;
-            int32_t endCol = separators[c] - 1;
-            cell->size = endCol - startCol + 1;
+            // The column and its separator are only intact if they lie in the kept part
+            if (!moved && column->x + column->width < keptCols)
+                continue;
 
-            if (cell->size <= 0)
-            {
-                cell->size = 0;
-                cell->conCells = NULL;
-                continue; // skip this cell
-            }
+            if (c < cols - 1)
+                setLineCell(table, line, column->x + column->width, '|');
+            paintCell(table, line, row, c);
+        }
 
-            // Initialize content field
-            cell->content = malloc((cell->size + 1) * sizeof(char));
-            if (!cell->content)
-            {
-                perror("malloc");
-                exit(1);
-            }
-            memset(cell->content, ' ', cell->size);
-            cell->content[cell->size] = '\0';
+        // Whatever the old layout drew right of the new one is cleared
+        for (int32_t fc = newEnd; fc < oldEnd; fc++)
+            setLineCell(table, line, fc, L' ');
+    }
+
+    arenaFree(table->arena, oldColumns);
+}
+
+// Fits auto widths to content changes since the last layout
+static void refitColumns(Table *table)
+{
+    if (table->widthsChanged)
+        relayoutTable(table);
+}
+
+// Keeps the view inside the stored rows, and on the newest ones while it follows the tail
+static void clampView(Table *table)
+{
+    int32_t maxView = shownRows(table) - viewLines(table);
+    if (maxView < 0)
+        maxView = 0;
+
+    if (table->followTail || table->viewRow > maxView)
+        table->viewRow = maxView;
+}
+
+// Draws a filtered view after a row left position hiddenAt and was shown at shownAt, either one
+// -1 if the row was hidden before or after. Only the positions in between show other rows, unless
+// the amount of shown rows changed and all later ones moved
+static void drawShownChange(Table *table, int32_t oldViewRow, int32_t hiddenAt, int32_t shownAt)
+{
+    clampView(table);
+
+    if (table->viewRow != oldViewRow)
+    {
+        drawView(table, 0, viewLines(table));
+        return;
+    }
+
+    if (hiddenAt >= 0 && shownAt >= 0)
+        drawPositions(table, hiddenAt < shownAt ? hiddenAt : shownAt, hiddenAt < shownAt ? shownAt : hiddenAt);
+    else if (hiddenAt >= 0 || shownAt >= 0)
+        drawPositions(table, hiddenAt >= 0 ? hiddenAt : shownAt, table->viewRow + viewLines(table) - 1);
+}
+
+// Makes room for at least rows stored rows, unrolling the ring into the new array
+static void reserveRows(Table *table, int32_t rows)
+{
+    if (rows <= table->rowCapacity)
+        return;
+
+    int32_t capacity = table->rowCapacity * 2;
+    if (capacity < rows)
+        capacity = rows;
+    if (capacity < 8)
+        capacity = 8;
+    if (table->maxRows > 0 && capacity > table->maxRows)
+        capacity = table->maxRows > rows ? table->maxRows : rows;
+
+    TableCell **cells = arenaAlloc(table->arena, capacity * sizeof(TableCell *));
+    for (int32_t r = 0; r < table->rows; r++)
+        cells[r] = tableRow(table, r);
+
+    // The sort state follows the rows into their new slots
+    if (table->sortKeyCount > 0)
+    {
+        int32_t keys = table->sortKeyCount;
+        uint64_t *sortKeys = arenaAlloc(table->arena, (size_t)capacity * keys * sizeof(uint64_t));
+        int32_t *order = arenaAlloc(table->arena, capacity * sizeof(int32_t));
+
+        for (int32_t r = 0; r < table->rows; r++)
+            memcpy(&sortKeys[(size_t)r * keys], &table->sortKeys[(size_t)rowSlot(table, r) * keys], keys * sizeof(uint64_t));
+        for (int32_t p = 0; p < table->rows; p++)
+            order[p] = slotRow(table, table->order[p]);
+
+        freeSortState(table);
+        table->sortKeys = sortKeys;
+        table->order = order;
+    }
+
+    if (table->filter)
+    {
+        int32_t *shown = arenaAlloc(table->arena, capacity * sizeof(int32_t));
+        for (int32_t i = 0; i < table->shownCount; i++)
+            shown[i] = slotRow(table, table->shown[i]);
+
+        arenaFree(table->arena, table->shown);
+        table->shown = shown;
+    }
+
+    if (table->index)
+    {
+        uint32_t *rowIds = arenaAlloc(table->arena, capacity * sizeof(uint32_t));
+        for (int32_t r = 0; r < table->rows; r++)
+        {
+            rowIds[r] = table->index->rowIds[rowSlot(table, r)];
+            table->index->idSlots[rowIds[r]] = r;
+        }
 
-            // Set default colors
+        arenaFree(table->arena, table->index->rowIds);
+        table->index->rowIds = rowIds;
+    }
+
+    arenaFree(table->arena, table->cells);
+    table->cells = cells;
+    table->rowCapacity = capacity;
+    table->headRow = 0;
+}
+
+// Appends a blank row, evicting the oldest one when the table is at maxRows. Returns the new row,
+// a sorted table still has to place it
+static TableCell *pushRow(Table *table)
+{
+    TableCell *row;
+
+    if (table->maxRows > 0 && table->rows >= table->maxRows)
+    {
+        // The evicted head row becomes the new tail, its memory is reused as is. A sorted table
+        // shows it last until it is placed
+        row = tableRow(table, 0);
+
+        if (table->sortKeyCount > 0)
+        {
+            int32_t slot = rowSlot(table, 0);
+            removePosition(table, findPosition(table, slot));
+            table->order[table->rows - 1] = slot;
+        }
+
+        table->headRow++;
+        if (table->headRow >= table->rowCapacity)
+            table->headRow = 0;
+        table->evictedRows++;
+
+        // A view that is not following the tail stays on the same rows, see hideEvicted() for filtered tables
+        if (!table->followTail && table->viewRow > 0 && table->sortKeyCount == 0 && !table->filter)
+            table->viewRow--;
+
+        // The row keeps its index id, the caller indexes its new contents
+        unindexRow(table, rowSlot(table, table->rows - 1));
+
+        for (int32_t c = 0; c < table->cols; c++)
+        {
+            TableCell *cell = &row[c];
+            int32_t width = table->columns[c].width;
+
+            updateWidth(table, c, contentWidth(cell->content), 0);
+            cell->content = arenaRealloc(table->arena, cell->content, width + 1);
+            memset(cell->content, ' ', width);
+            cell->content[width] = '\0';
+            cell->fgColor = FWHITE;
             cell->bgColor = BBLACK;
+        }
+    }
+    else
+    {
+        reserveRows(table, table->rows + 1);
+
+        row = arenaAlloc(table->arena, (table->cols > 0 ? table->cols : 1) * sizeof(TableCell));
+        for (int32_t c = 0; c < table->cols; c++)
+        {
+            TableCell *cell = &row[c];
             cell->fgColor = FWHITE;
+            cell->bgColor = BBLACK;
+            initCellContent(table, cell, table->columns[c].width);
+        }
 
-            // Allocate array of pointers to console cells
-            cell->conCells = malloc(cell->size * sizeof(Cell *));
-            int32_t k = 0;
+        table->rows++;
+        *tableRowSlot(table, table->rows - 1) = row;
 
-            // Map framebuffer cells to this table cell
-            for (int32_t fc = startCol; fc <= endCol; fc++) // inclusive of endCol
-            {
-                cell->conCells[k++] = &con->framebuffer[r][fc];
-            }
-        }
+        if (table->sortKeyCount > 0)
+            table->order[table->rows - 1] = rowSlot(table, table->rows - 1);
+        if (table->index)
+            assignRowId(table, rowSlot(table, table->rows - 1));
     }
 
-    free(separators);
+    return row;
+}
+
+// Creates a table whose first row is drawn on framebuffer row top
+static Table createTableAt(Console *con, int32_t top, int32_t rows, int32_t cols)
+{
+    Table table;
+    memset(&table, 0, sizeof(Table));
+    table.cols = cols;
+    table.top = top;
+    table.followTail = true;
+
+    // All memory of the table comes from its arena and is released with it
+    table.arena = createArena();
+
+    reserveColumns(&table, 0, cols);
+    layoutColumns(&table, con->state, cols);
+
+    reserveRows(&table, rows);
+    for (int32_t r = 0; r < rows; r++)
+        pushRow(&table);
+
+    drawView(&table, 0, viewLines(&table));
+
     return table;
 }
 
-void setCellValue(Table *table, char *value, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor)
+Table createTable(Console *con, int32_t rows, int32_t cols)
+{
+    return createTableAt(con, 0, rows, cols);
+}
+
+// Clips a view of height rows starting at top to the console
+static int32_t clampViewHeight(Console *con, int32_t top, int32_t height)
+{
+    if (height > con->rows - top)
+        height = con->rows - top;
+    if (height < 0)
+        height = 0;
+
+    return height;
+}
+
+Table createRingTable(Console *con, int32_t top, int32_t height, int32_t cols, int32_t maxRows)
+{
+    if (top < 0)
+        top = 0;
+
+    Table table = createTableAt(con, top, 0, cols);
+    table.viewHeight = clampViewHeight(con, top, height);
+    table.maxRows = maxRows > 0 ? maxRows : 0;
+
+    // The empty view still owns its lines
+    drawView(&table, 0, viewLines(&table));
+
+    return table;
+}
+
+// Stores and draws a cell's content, auto widths are left to the caller to fit
+static void storeCellValue(Table *table, char *value, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor)
 {
     if (row >= table->rows || col >= table->cols)
         return;
 
-    TableCell *cell = &table->cells[row][col];
+    int32_t slot = rowSlot(table, row);
+    TableCell *cell = &table->cells[slot][col];
+    int32_t oldWidth = contentWidth(cell->content);
+    int32_t oldViewRow = table->viewRow;
 
-    int32_t spaceCounter = 0;
-    for (int32_t i = 0; i < strlen(value); i++)
+    // A sorted row is found by its content, before it changes. A filtered one is hidden until
+    // it is checked against the filter again
+    int32_t from = isSortColumn(table, col) ? findPosition(table, slot) : -1;
+    int32_t hiddenAt = table->filter ? hideRow(table, slot) : -1;
+
+    unindexRow(table, slot);
+
+    // The table owns its cell contents, keep a copy of the caller's string. The old
+    // content's memory is reused while the new one fits its size class
+    if (value != cell->content)
     {
-        if (isspace(value[i]))
-            spaceCounter++;
+        size_t size = strlen(value) + 1;
+        cell->content = arenaRealloc(table->arena, cell->content, size);
+        memcpy(cell->content, value, size);
+        value = cell->content;
     }
 
-    if (spaceCounter == strlen(value) && cell->size < strlen(value))
-        contentCut(value, cell->size - 1, strlen(value));
-
     int32_t len = strlen(value);
-    bool overflow = len > table->cells[row][col].size ? true : false;
+    int32_t spaceCounter = 0;
+    while (spaceCounter < len && isspace((unsigned char)value[spaceCounter]))
+        spaceCounter++;
+
+    if (spaceCounter == len && table->columns[col].width < len)
+        contentCut(value, table->columns[col].width - 1, len);
 
-    cell->content = value;
     cell->fgColor = fgColor;
     cell->bgColor = bgColor;
 
-    int32_t maxContent = overflow ? cell->size - 3 : cell->size;
+    updateWidth(table, col, oldWidth, contentWidth(value));
+    indexRow(table, slot);
+
+    int32_t first, last;
+    if (from >= 0)
+        resortRow(table, row, from, &first, &last);
 
-    for (int32_t j = 0; j < maxContent; j++)
+    if (table->filter)
     {
-        if (!cell->conCells[j])
-            continue;
-        cell->conCells[j]->Foreground = fgColor;
-        cell->conCells[j]->Background = bgColor;
-        cell->conCells[j]->Char = (j < len) ? value[j] : L' ';
+        drawShownChange(table, oldViewRow, hiddenAt, showRow(table, slot));
+        return;
+    }
+
+    if (from < 0)
+    {
+        drawCell(table, row, col);
+        return;
+    }
+
+    // The row may have moved, every position it passed shows another row now
+    drawPositions(table, first, last);
+}
+
+// Pulls the rows in the viewport from the source into the materialized cells
+static void fetchVirtualRows(Table *table)
+{
+    if (table->valueCols != table->cols)
+    {
+        table->rowValues = arenaRealloc(table->arena, table->rowValues, table->cols * sizeof(TableCellValue));
+        table->valueCols = table->cols;
+    }
+
+    for (int32_t r = 0; r < table->rows; r++)
+    {
+        int64_t sourceRow = table->scroll + r;
+
+        for (int32_t c = 0; c < table->cols; c++)
+        {
+            table->rowValues[c].content = "";
+            table->rowValues[c].fgColor = FWHITE;
+            table->rowValues[c].bgColor = BBLACK;
+        }
+
+        // Rows past the end of the source stay empty
+        if (sourceRow < table->sourceRows)
+            table->source(table->sourceData, sourceRow, table->rowValues, table->cols);
+
+        for (int32_t c = 0; c < table->cols; c++)
+        {
+            TableCellValue *value = &table->rowValues[c];
+            storeCellValue(table, (char *)(value->content ? value->content : ""), r, c, value->fgColor, value->bgColor);
+        }
+    }
+
+    refitColumns(table);
+}
+
+static int64_t clampScroll(Table *table, int64_t firstRow)
+{
+    int64_t maxScroll = table->sourceRows - table->rows;
+    if (firstRow > maxScroll)
+        firstRow = maxScroll;
+    if (firstRow < 0)
+        firstRow = 0;
+
+    return firstRow;
+}
+
+Table createVirtualTable(Console *con, int32_t top, int32_t height, int32_t cols, int64_t rows, TableRowSource source, void *userData)
+{
+    if (top < 0)
+        top = 0;
+
+    Table table = createTableAt(con, top, clampViewHeight(con, top, height), cols);
+    table.source = source;
+    table.sourceData = userData;
+    table.sourceRows = rows;
+    table.scroll = 0;
+
+    fetchVirtualRows(&table);
+    return table;
+}
+
+void scrollTable(Table *table, Console *con, int64_t firstRow, HANDLE hConsole, bool hlt)
+{
+    if (table->source)
+    {
+        table->scroll = clampScroll(table, firstRow);
+        fetchVirtualRows(table);
+    }
+    else
+    {
+        // Stored rows are only repainted from their contents, nothing is copied
+        int32_t maxView = shownRows(table) - viewLines(table);
+        if (maxView < 0)
+            maxView = 0;
+
+        if (firstRow > maxView)
+            firstRow = maxView;
+        if (firstRow < 0)
+            firstRow = 0;
+
+        table->viewRow = (int32_t)firstRow;
+        table->followTail = table->viewRow == maxView;
+
+        drawView(table, 0, viewLines(table));
     }
 
-    if (overflow)
-    {
-        cell->conCells[cell->size - 3]->Char = L'.';
-        cell->conCells[cell->size - 2]->Char = L'.';
-        cell->conCells[cell->size - 1]->Char = L'.';
-    }
+    renderConsole(*con, hConsole, hlt);
+}
+
+void setVirtualTableRows(Table *table, Console *con, int64_t rows, HANDLE hConsole, bool hlt)
+{
+    if (!table->source)
+        return;
+
+    table->sourceRows = rows < 0 ? 0 : rows;
+    table->scroll = clampScroll(table, table->scroll);
+    fetchVirtualRows(table);
+
+    renderConsole(*con, hConsole, hlt);
+}
+
+void refreshVirtualTable(Table *table, Console *con, HANDLE hConsole, bool hlt)
+{
+    if (!table->source)
+        return;
+
+    fetchVirtualRows(table);
+
+    renderConsole(*con, hConsole, hlt);
+}
+
+void setCellValue(Table *table, char *value, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor)
+{
+    storeCellValue(table, value, row, col, fgColor, bgColor);
+    refitColumns(table);
+    compactIndex(table);
 }
 
 void contentCut(char *str, int32_t begin, int32_t len)
@@ -143,16 +1507,17 @@ void contentCut(char *str, int32_t begin, int32_t len)
 
 void clearTable(Table *table, Console con, HANDLE hConsole, bool hlt)
 {
-    for (int32_t i = 0; i < table->rows; i++)
+    int32_t lines = visibleLines(table);
+
+    for (int32_t i = 0; i < lines && table->viewRow + i < shownRows(table); i++)
     {
         for (int32_t j = 0; j < table->cols; j++)
         {
-            TableCell *cell = &table->cells[i][j];
-            for (int32_t k = 0; k < cell->size; k++)
+            Cell *span = cellSpan(table, i, j);
+            for (int32_t k = 0; k < table->columns[j].width; k++)
             {
-                cell->conCells[k]->Char = L' ';
-                cell->conCells[k]->Foreground = FWHITE;
-                cell->conCells[k]->Background = BBLACK;
+                span[k].Char = L' ';
+                span[k].Style = TCON_CONSOLE_STYLE(FWHITE, BBLACK);
             }
         }
     }
@@ -162,19 +1527,25 @@ void clearTable(Table *table, Console con, HANDLE hConsole, bool hlt)
 
 void debugTableCellsByChar(Console *con, Table *table)
 {
+    int32_t lines = visibleLines(table);
+
     printf("=== Table Debug Start ===\n");
-    for (int32_t r = 0; r < table->rows; r++)
+    for (int32_t l = 0; l < lines && table->viewRow + l < shownRows(table); l++)
     {
+        int32_t r = rowAt(table, table->viewRow + l);
+
         for (int32_t c = 0; c < table->cols; c++)
         {
-            TableCell *cell = &table->cells[r][c];
-            printf("Cell [%d,%d], size=%d: ", r, c, cell->size);
+            Cell *span = cellSpan(table, l, c);
+            printf("Cell [%d,%d], size=%d: ", r, c, table->columns[c].width);
 
-            for (int32_t k = 0; k < cell->size; k++)
+            for (int32_t k = 0; k < table->columns[c].width; k++)
             {
-                wchar_t ch = cell->conCells[k]->Char;
+                wchar_t ch = (wchar_t)span[k].Char;
 
-                if (ch == L'|' || ch == L'┃')
+                if (span[k].Char == TCON_WIDE_TAIL)
+                    printf("[TAIL] ");
+                else if (ch == L'|' || ch == L'┃')
                     printf("[%lc|SEP] ", ch);
                 else
                     printf("%lc ", ch);
@@ -189,97 +1560,183 @@ void reDrawTable(Table *table, Console *con, HANDLE hConsole, bool hlt)
 {
     getWindowSize(con, hConsole);
 
-    // Recalculate separators
-    int32_t usableCols = con->cols;
-    if (usableCols % 2 != 0)
-        usableCols--;
+    // Relayout only touches the column geometry, cells find their framebuffer span from it
+    layoutColumns(table, con->state, table->cols);
+
+    // Reflow cell content
+    drawView(table, 0, viewLines(table));
+
+    // Rerender framebuffer
+    renderConsole(*con, hConsole, hlt);
+}
 
-    int32_t colWidth = usableCols / table->cols;
+void reflowTable(Table *table, Console *con, HANDLE hConsole, bool hlt)
+{
+    table->console = con->state;
+    relayoutTable(table);
+
+    renderConsole(*con, hConsole, hlt);
+}
+
+void setTableAutoWidth(Table *table, Console *con, bool autoWidth, HANDLE hConsole, bool hlt)
+{
+    table->autoWidth = autoWidth;
+    reflowTable(table, con, hConsole, hlt);
+}
+
+void setTableColumnWidth(Table *table, Console *con, int32_t col, int32_t minWidth, int32_t maxWidth, int32_t weight, HANDLE hConsole, bool hlt)
+{
+    if (col < 0 || col >= table->cols)
+        return;
+
+    TableColumn *column = &table->columns[col];
+    column->minWidth = minWidth > 0 ? minWidth : 0;
+    column->maxWidth = maxWidth > 0 ? maxWidth : 0;
+    column->weight = weight > 0 ? weight : 0;
+
+    if (column->maxWidth > 0 && column->minWidth > column->maxWidth)
+        column->minWidth = column->maxWidth;
 
-    int32_t *separators = malloc(table->cols * sizeof(int32_t));
-    if (!separators)
+    reflowTable(table, con, hConsole, hlt);
+}
+
+void sortTable(Table *table, Console *con, const TableSortColumn *columns, int32_t count, HANDLE hConsole, bool hlt)
+{
+    // A virtual table only holds its viewport, the source decides the order
+    if (table->source)
         return;
 
-    for (int32_t j = 0; j < table->cols; j++)
-        separators[j] = (j + 1) * colWidth;
+    applySort(table, columns, columns ? count : 0);
+    if (table->filter)
+        reorderShown(table);
+
+    drawView(table, 0, viewLines(table));
 
-    for (int32_t i = 0; i < table->rows; i++)
+    renderConsole(*con, hConsole, hlt);
+}
+
+void setTableIndex(Table *table, bool enable)
+{
+    if (table->source || enable == (table->index != NULL))
+        return;
+
+    if (!enable)
     {
-        for (int32_t j = 0; j < table->cols - 1; j++)
-            setCellData(con, i, separators[j], FWHITE, BBLACK, '|');
+        freeTrigramIndex(table->index->trigrams);
+        freeTextStore(table->index->texts);
+        arenaFree(table->arena, table->index->rowIds);
+        arenaFree(table->arena, table->index->idSlots);
+        arenaFree(table->arena, table->index->matches);
+        arenaFree(table->arena, table->index);
+        table->index = NULL;
+        return;
     }
 
-    // Update framebuffer cells for each table cell
-    for (int32_t tr = 0; tr < table->rows; tr++)
-    {
-        for (int32_t tc = 0; tc < table->cols; tc++)
-        {
-            TableCell *cell = &table->cells[tr][tc];
+    TableIndex *index = arenaAlloc(table->arena, sizeof(TableIndex));
+    memset(index, 0, sizeof(TableIndex));
+    index->trigrams = createTrigramIndex();
+    index->texts = createTextStore();
+    index->rowIds = arenaAlloc(table->arena, (table->rowCapacity > 0 ? table->rowCapacity : 1) * sizeof(uint32_t));
 
-            int32_t startCol = (tc == 0) ? 0 : separators[tc - 1] + 1;
-            int32_t endCol = separators[tc] - 1;
-            cell->size = endCol - startCol + 1;
+    table->index = index;
+    buildIndex(table);
+}
 
-            if (cell->size <= 0)
-            {
-                cell->size = 0;
-                cell->conCells = NULL;
-                continue; // skip this cell
-            }
+void filterTable(Table *table, Console *con, const char *text, HANDLE hConsole, bool hlt)
+{
+    if (table->source)
+        return;
 
-            cell->conCells = malloc(cell->size * sizeof(Cell *));
-            int32_t k = 0;
+    int32_t len = text ? strlen(text) : 0;
+    char *filter = NULL;
+    int32_t extendsAt = -1;
+    int32_t extendsLen = table->filterLen;
 
-            // Map framebuffer cells to this table cell
-            for (int32_t fc = startCol; fc <= endCol; fc++) // inclusive of endCol
-            {
-                cell->conCells[k++] = &con->framebuffer[tr][fc];
-            }
+    if (len > 0)
+    {
+        filter = arenaAlloc(table->arena, len + 1);
+        foldText(filter, text, len);
+        filter[len] = '\0';
+
+        // Rows containing the new filter contain the old one, typing on only narrows the rows down
+        for (int32_t at = 0; table->filter && at + table->filterLen <= len && extendsAt < 0; at++)
+        {
+            if (memcmp(filter + at, table->filter, table->filterLen) == 0)
+                extendsAt = at;
         }
     }
 
-    // Reflow cell content
-    for (int32_t tr = 0; tr < table->rows; tr++)
+    arenaFree(table->arena, table->filter);
+    table->filter = filter;
+    table->filterLen = len;
+
+    if (!filter)
     {
-        for (int32_t tc = 0; tc < table->cols; tc++)
-        {
-            TableCell *cell = &table->cells[tr][tc];
-            char *content = cell->content;
-            setCellValue(table, content, tr, tc, cell->fgColor, cell->bgColor);
-        }
+        arenaFree(table->arena, table->shown);
+        table->shown = NULL;
+        table->shownCount = 0;
+    }
+    else
+    {
+        if (!table->shown)
+            table->shown = arenaAlloc(table->arena, (table->rowCapacity > 0 ? table->rowCapacity : 1) * sizeof(int32_t));
+
+        applyFilter(table, extendsAt, extendsLen);
     }
 
-    free(separators);
+    // The view starts over at the first row shown, or stays on the newest ones
+    if (!table->followTail)
+        table->viewRow = 0;
+    clampView(table);
+
+    drawView(table, 0, viewLines(table));
 
-    // Rerender framebuffer
     renderConsole(*con, hConsole, hlt);
 }
 
-void removeTable(Table *table)
+int32_t getTableShownRows(Table *table)
 {
-    for (int32_t r = 0; r < table->rows; r++)
-    {
-        for (int32_t c = 0; c < table->cols; c++)
-        {
-            TableCell *cell = &table->cells[r][c];
+    return shownRows(table);
+}
 
-            if (cell->content)
-            {
-                cell->content = NULL;
-                free(cell->content);
-            }
+int32_t getTableRowAt(Table *table, int32_t position)
+{
+    if (position < 0 || position >= shownRows(table))
+        return -1;
 
-            if (cell->conCells)
-            {
-                cell->conCells = NULL;
-                free(cell->conCells);
-            }
+    return rowAt(table, position);
+}
 
-            cell->size = 0;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
-        }
+void removeTable(Table *table)
+{
+    // Every row, content and mapping lives in the arena, so they go with it at once. Only the
+    // index has memory of its own
+    if (table->index)
+    {
+        freeTrigramIndex(table->index->trigrams);
+        freeTextStore(table->index->texts);
     }
+
+    freeArena(table->arena);
+    table->arena = NULL;
+
+    table->cells = NULL;
+    table->columns = NULL;
+    table->rows = 0;
+    table->cols = 0;
+    table->rowCapacity = 0;
+    table->headRow = 0;
+    table->viewRow = 0;
+    table->rowValues = NULL;
+    table->valueCols = 0;
+    table->sortKeyCount = 0;
+    table->sortKeys = NULL;
+    table->order = NULL;
+    table->index = NULL;
+    table->filter = NULL;
+    table->filterLen = 0;
+    table->shown = NULL;
+    table->shownCount = 0;
 }
 
 void clearTableConsole(Table *table, Console *con, HANDLE hConsole, bool hlt)
@@ -294,244 +1751,269 @@ void resetTableConsole(Table *table, Console *con, HANDLE hConsole)
     resetConsole(con, hConsole);
 }
 
-void addTableRow(Table *table, Console *con, HANDLE hConsole, bool hlt)
+// Draws what an append changed, positions first to last show other rows than before. If the
+// view moved every line has and the whole view is drawn
+static void drawAppend(Table *table, int32_t oldViewRow, uint64_t oldEvicted, int32_t first, int32_t last)
 {
-    int32_t oldRows = table->rows;
-    int32_t newRows = table->rows + 1;
+    // Evicting the oldest row moves every stored row up, and any sorted row after its position
+    int32_t evicted = (int32_t)(table->evictedRows - oldEvicted);
+    bool moved = table->sortKeyCount > 0 ? evicted > 0 || table->viewRow != oldViewRow : table->viewRow != oldViewRow - evicted;
 
-    table->cells = realloc(table->cells, newRows * sizeof(TableCell *));
-    if (!table->cells)
+    if (moved)
+    {
+        drawView(table, 0, viewLines(table));
         return;
+    }
 
-    for (int32_t r = oldRows; r < newRows; r++)
-    {
-        table->cells[r] = malloc(table->cols * sizeof(TableCell));
-        if (!table->cells[r])
-            return;
+    drawPositions(table, first, last);
+}
 
-        for (int32_t c = 0; c < table->cols; c++)
-        {
-            TableCell *cell = &table->cells[r][c];
+// Hides the row the next append evicts from a filtered table, while it can still be found.
+// Returns the position it had, -1 if nothing is evicted or the row was hidden
+static int32_t hideEvicted(Table *table)
+{
+    if (!table->filter || table->maxRows <= 0 || table->rows < table->maxRows)
+        return -1;
 
-            cell->size = table->cells[0][0].size;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
+    int32_t at = hideRow(table, rowSlot(table, 0));
 
-            cell->content = malloc((cell->size + 1) * sizeof(char));
-            if (!cell->content)
-            {
-                perror("malloc");
-                exit(1);
-            }
-            memset(cell->content, ' ', cell->size);
-            cell->content[cell->size] = '\0';
+    // A view that is not following the tail stays on the same rows
+    if (at >= 0 && at < table->viewRow && !table->followTail)
+        table->viewRow--;
 
-            cell->conCells = malloc(cell->size * sizeof(Cell *));
-            if (!cell->conCells)
-                return;
+    return at;
+}
 
-            for (int i = 0; i < cell->size; i++)
-            {
-                int fbRow = r;
-                int fbCol = c * cell->size + i;
+// Draws what an append to a filtered table changed, the new row in the last ring slot is shown
+// if it matches
+static void drawFilteredAppend(Table *table, int32_t oldViewRow, int32_t hiddenAt)
+{
+    int32_t shownAt = showRow(table, rowSlot(table, table->rows - 1));
 
-                if (fbCol >= con->cols)
-                {
-                    cell->conCells[i] = NULL;
-                    continue;
-                }
+    refitColumns(table);
+    drawShownChange(table, oldViewRow, hiddenAt, shownAt);
+}
 
-                cell->conCells[i] = &con->framebuffer[fbRow][fbCol];
-            }
-        }
+void addTableRow(Table *table, Console *con, HANDLE hConsole, bool hlt)
+{
+    int32_t oldViewRow = table->viewRow;
+    uint64_t oldEvicted = table->evictedRows;
+    int32_t hiddenAt = hideEvicted(table);
+
+    int32_t first, last;
+    pushRow(table);
+    placeRow(table, table->rows - 1, &first, &last);
+
+    if (table->filter)
+        drawFilteredAppend(table, oldViewRow, hiddenAt);
+    else
+    {
+        clampView(table);
+        refitColumns(table);
+        drawAppend(table, oldViewRow, oldEvicted, first, last);
     }
 
-    table->rows = newRows;
+    compactIndex(table);
 
-    reDrawTable(table, con, hConsole, hlt);
+    renderConsole(*con, hConsole, hlt);
 }
 
-void removeTableRow(Table *table, Console *con, int32_t row, HANDLE hConsole, bool hlt)
+void appendTableRow(Table *table, Console *con, const TableCellValue *values, HANDLE hConsole, bool hlt)
 {
-    if (row < 0 || row + 1 > table->rows)
-        return;
+    int32_t oldViewRow = table->viewRow;
+    uint64_t oldEvicted = table->evictedRows;
+    int32_t hiddenAt = hideEvicted(table);
 
-    // If Last row set fb row to empty
-    if (row + 1 == table->rows)
-    {
-        // Free cell memory and reset their values
-        for (int32_t tc = 0; tc < table->cols; tc++)
-        {
-            // Free table cell memory
-            TableCell *cell = &table->cells[row][tc];
+    TableCell *row = pushRow(table);
 
-            if (cell->content)
-            {
-                free(cell->content);
-                cell->content = NULL;
-            }
+    for (int32_t c = 0; c < table->cols && values; c++)
+    {
+        const char *content = values[c].content ? values[c].content : "";
+        size_t size = strlen(content) + 1;
+
+        updateWidth(table, c, contentWidth(row[c].content), contentWidth(content));
+        row[c].content = arenaRealloc(table->arena, row[c].content, size);
+        memcpy(row[c].content, content, size);
+        row[c].fgColor = values[c].fgColor;
+        row[c].bgColor = values[c].bgColor;
+    }
 
-            if (cell->conCells)
-            {
-                free(cell->conCells);
-                cell->conCells = NULL;
-            }
+    indexRow(table, rowSlot(table, table->rows - 1));
 
-            cell->size = 0;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
-        }
+    int32_t first, last;
+    placeRow(table, table->rows - 1, &first, &last);
 
-        // Empty framebuffer cells
-        for (int32_t fc = 0; fc < con->cols; fc++)
-        {
-            setCellData(con, row, fc, FWHITE, BBLACK, L' ');
-        }
-    }
+    if (table->filter)
+        drawFilteredAppend(table, oldViewRow, hiddenAt);
     else
     {
-        // Else remove row and move all below one row up
-        for (int32_t tr = row; tr < table->rows; tr++)
+        clampView(table);
+        refitColumns(table);
+        drawAppend(table, oldViewRow, oldEvicted, first, last);
+    }
+
+    compactIndex(table);
+
+    renderConsole(*con, hConsole, hlt);
+}
+
+void evictTableRows(Table *table, Console *con, int32_t count, HANDLE hConsole, bool hlt)
+{
+    if (count <= 0 || table->rows == 0)
+        return;
+    if (count > table->rows)
+        count = table->rows;
+
+    int32_t oldLines = viewLines(table);
+
+    // Sorted positions close up over the evicted rows
+    if (table->sortKeyCount > 0)
+    {
+        int32_t kept = 0;
+        for (int32_t p = 0; p < table->rows; p++)
         {
-            // Break if row is last row
-            if (tr + 1 == table->rows)
-            {
+            int32_t slot = table->order[p];
+            if (slotRow(table, slot) < count)
                 continue;
-            }
 
-            for (int32_t tc = 0; tc < table->cols; tc++)
-            {
-                TableCell *nextCell = &table->cells[tr + 1][tc];
-                setCellValue(table, nextCell->content, tr, tc, nextCell->fgColor, nextCell->bgColor);
-            }
+            table->order[kept++] = slot;
         }
+    }
 
-        // Remove last row which should be empty
-        // Free cell memory and reset their values
-        for (int32_t tc = 0; tc < table->cols; tc++)
+    // So do the shown ones, the view keeps the rows it showed
+    int32_t hiddenAbove = count;
+    if (table->filter)
+    {
+        int32_t kept = 0;
+        hiddenAbove = 0;
+        for (int32_t i = 0; i < table->shownCount; i++)
         {
-            // Free table cell memory
-            TableCell *cell = &table->cells[table->rows - 1][tc];
-
-            if (cell->content)
-            {
-                free(cell->content);
-                cell->content = NULL;
-            }
+            int32_t slot = table->shown[i];
+            if (slotRow(table, slot) >= count)
+                table->shown[kept++] = slot;
+            else if (i < table->viewRow)
+                hiddenAbove++;
+        }
 
-            if (cell->conCells)
-            {
-                free(cell->conCells);
-                cell->conCells = NULL;
-            }
+        table->shownCount = kept;
+    }
 
-            cell->size = 0;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
-        }
+    for (int32_t r = 0; r < count; r++)
+    {
+        TableCell *row = tableRow(table, r);
+        for (int32_t c = 0; c < table->cols; c++)
+            releaseCell(table, &row[c], c);
+        arenaFree(table->arena, row);
 
-        // Empty framebuffer cells
-        for (int32_t fc = 0; fc < con->cols; fc++)
+        if (table->index)
         {
-            setCellData(con, table->rows - 1, fc, FWHITE, BBLACK, L' ');
+            unindexRow(table, rowSlot(table, r));
+            table->index->idSlots[table->index->rowIds[rowSlot(table, r)]] = -1;
         }
     }
 
-    table->rows--;
+    table->headRow = (table->headRow + count) % table->rowCapacity;
+    table->rows -= count;
+    table->evictedRows += count;
 
-    reDrawTable(table, con, hConsole, hlt);
-}
+    table->viewRow = table->viewRow > hiddenAbove ? table->viewRow - hiddenAbove : 0;
+    clampView(table);
+    refitColumns(table);
+    compactIndex(table);
 
-void addTableCol(Table *table, Console *con, HANDLE hConsole, bool hlt)
-{
-    // Calculate separators for new cell size
-    int32_t usableCols = con->cols;
-    if (usableCols % 2 != 0)
-        usableCols--;
+    drawView(table, 0, oldLines);
 
-    int32_t colWidth = usableCols / (table->cols + 1);
+    renderConsole(*con, hConsole, hlt);
+}
 
-    int32_t *separators = malloc((table->cols + 1) * sizeof(int32_t));
-    if (!separators)
+void removeTableRow(Table *table, Console *con, int32_t row, HANDLE hConsole, bool hlt)
+{
+    if (row < 0 || row + 1 > table->rows)
         return;
 
-    for (int32_t j = 0; j < table->cols + 1; j++)
-        separators[j] = (j + 1) * colWidth;
+    int32_t oldLines = viewLines(table);
+    int32_t oldViewRow = table->viewRow;
+    int32_t slot = rowSlot(table, row);
 
-    // Temporarily store copies of all cells to set them again later
-    TableCell tableCells[table->rows][table->cols];
-    // char *tableContents[table->rows][table->cols];
-    for (int32_t r = 0; r < table->rows; r++)
+    // Lines from the removed row's on show other rows, a row the filter hides changes none
+    int32_t shownAt = table->filter ? hideRow(table, slot) : positionOf(table, row);
+
+    // The order and the shown rows hold stored rows while the ring closes the gap
+    if (table->sortKeyCount > 0)
     {
-        for (int32_t c = 0; c < table->cols; c++)
-        {
-            tableCells[r][c] = table->cells[r][c];
-        }
+        removePosition(table, findPosition(table, slot));
+        for (int32_t p = 0; p < table->rows - 1; p++)
+            table->order[p] = slotRow(table, table->order[p]);
     }
 
-    for (int32_t r = 0; r < table->rows; r++)
+    for (int32_t i = 0; i < table->shownCount; i++)
+        table->shown[i] = slotRow(table, table->shown[i]);
+
+    TableCell *removed = tableRow(table, row);
+    for (int32_t tc = 0; tc < table->cols; tc++)
+        releaseCell(table, &removed[tc], tc);
+    arenaFree(table->arena, removed);
+
+    if (table->index)
     {
-        table->cells[r] = malloc((table->cols + 1) * sizeof(TableCell));
-        if (!table->cells[r])
-            return;
+        unindexRow(table, slot);
+        table->index->idSlots[table->index->rowIds[slot]] = -1;
+    }
 
-        for (int32_t c = 0; c < table->cols + 1; c++)
-        {
-            TableCell *cell = &table->cells[r][c];
+    // Close the gap from whichever side has fewer rows, only row pointers move
+    if (row < table->rows / 2)
+    {
+        for (int32_t tr = row; tr > 0; tr--)
+            moveRow(table, tr, tr - 1);
 
-            int32_t startCol = (c == 0) ? 0 : separators[c - 1] + 1;
-            int32_t endCol = separators[c] - 1;
-            cell->size = endCol - startCol + 1;
+        table->headRow++;
+        if (table->headRow >= table->rowCapacity)
+            table->headRow = 0;
+    }
+    else
+    {
+        for (int32_t tr = row; tr < table->rows - 1; tr++)
+            moveRow(table, tr, tr + 1);
+    }
 
-            if (cell->size <= 0)
-            {
-                cell->size = 0;
-                cell->conCells = NULL;
-                continue; // skip this cell
-            }
+    table->rows--;
 
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
+    if (table->sortKeyCount > 0)
+    {
+        for (int32_t p = 0; p < table->rows; p++)
+            table->order[p] = rowSlot(table, table->order[p] > row ? table->order[p] - 1 : table->order[p]);
+    }
 
-            cell->content = malloc((cell->size + 1) * sizeof(char));
-            if (!cell->content)
-            {
-                perror("Column content malloc");
-                exit(1);
-            }
-            memset(cell->content, ' ', cell->size);
-            cell->content[cell->size] = '\0';
+    for (int32_t i = 0; i < table->shownCount; i++)
+        table->shown[i] = rowSlot(table, table->shown[i] > row ? table->shown[i] - 1 : table->shown[i]);
 
-            cell->conCells = malloc(cell->size * sizeof(Cell *));
-            if (!cell->conCells)
-                return;
+    clampView(table);
+    refitColumns(table);
+    compactIndex(table);
 
-            for (int i = 0; i < cell->size; i++)
-            {
-                int fbRow = r;
-                int fbCol = c * cell->size + i;
+    // Lines above the removed row keep their rows unless the view moved
+    int32_t fromLine = table->viewRow != oldViewRow ? 0 : (shownAt >= 0 ? shownAt - table->viewRow : oldLines);
+    drawView(table, fromLine, oldLines);
 
-                if (fbCol >= con->cols)
-                {
-                    cell->conCells[i] = NULL;
-                    continue;
-                }
+    renderConsole(*con, hConsole, hlt);
+}
 
-                cell->conCells[i] = &con->framebuffer[fbRow][fbCol];
-            }
-        }
-    }
+void addTableCol(Table *table, Console *con, HANDLE hConsole, bool hlt)
+{
+    reserveColumns(table, table->cols, table->cols + 1);
+    layoutColumns(table, con->state, table->cols + 1);
 
-    // Restore old cell contents
+    // Grow every row in place where its size class allows, existing cells keep their contents
     for (int32_t r = 0; r < table->rows; r++)
     {
-        for (int32_t c = 0; c < table->cols; c++)
-        {
-            setCellValue(table, tableCells[r][c].content, r, c, tableCells[r][c].fgColor, tableCells[r][c].bgColor);
-        }
-    }
+        TableCell **slot = tableRowSlot(table, r);
+        *slot = arenaRealloc(table->arena, *slot, (table->cols + 1) * sizeof(TableCell));
 
-    free(separators);
+        TableCell *cell = &(*slot)[table->cols];
+        cell->fgColor = FWHITE;
+        cell->bgColor = BBLACK;
+        initCellContent(table, cell, table->columns[table->cols].width);
+    }
 
     table->cols++;
 
@@ -543,116 +2025,60 @@ void removeTableCol(Table *table, Console *con, int32_t col, HANDLE hConsole, bo
     if (col < 0 || col + 1 > table->cols)
         return;
 
-    // Calculate separators for new cell size
-    int32_t usableCols = con->cols;
-    if (usableCols % 2 != 0)
-        usableCols--;
-
-    int32_t colWidth = usableCols / (table->cols - 1);
-
-    int32_t *separators = malloc((table->cols - 1) * sizeof(int32_t));
-    if (!separators)
-        return;
-
-    for (int32_t j = 0; j < table->cols - 1; j++)
-        separators[j] = (j + 1) * colWidth;
+    // The removed column's separator and everything right of it is cleared, the relayout redraws the rest
+    int32_t clearFrom = table->cols > 1 ? table->columns[table->cols - 1].x - 1 : 0;
 
-    // If last column set fb column to empty
-    if (col + 1 == table->cols)
+    // Remove the column and shift the ones to its right one to the left, contents move with their cells
+    for (int32_t tr = 0; tr < table->rows; tr++)
     {
-        for (int32_t tr = 0; tr < table->rows; tr++)
-        {
-            TableCell *cell = &table->cells[tr][col];
-
-            if (cell->content)
-            {
-                free(cell->content);
-                cell->content = NULL;
-            }
-
-            if (cell->conCells)
-            {
-                free(cell->conCells);
-                cell->conCells = NULL;
-            }
-
-            cell->size = 0;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
-        }
+        TableCell *cells = tableRow(table, tr);
 
-        for (int32_t fr = 0; fr < con->rows; fr++)
-        {
-            for (int32_t fc = usableCols - table->cells[0][table->cols - 1].size; fc < con->cols; fc++)
-            {
-                setCellData(con, fr, fc, FWHITE, BBLACK, L' ');
-            }
-        }
+        releaseCell(table, &cells[col], col);
+        memmove(&cells[col], &cells[col + 1], (table->cols - col - 1) * sizeof(TableCell));
     }
-    else
+
+    for (int32_t line = 0; line < visibleLines(table); line++)
     {
-        // Else remove column and shift all columns to its right one to the left
-        // Temporarily store all cell contents to set them again later
-        char *tableContents[table->rows][table->cols - 1];
-        for (int32_t r = 0; r < table->rows; r++)
+        for (int32_t fc = clearFrom; fc < con->cols; fc++)
         {
-            for (int32_t c = 0; c < table->cols - 1; c++)
-            {
-                if (c == col)
-                    continue;
-                tableContents[r][c] = table->cells[r][c].content;
-            }
+            setCellData(con, table->top + line, fc, FWHITE, BBLACK, L' ');
         }
+    }
 
-        // Shift columns
-        for (int32_t tr = 0; tr < table->rows; tr++)
-        {
-            for (int32_t tc = col; tc < table->cols - 1; tc++)
-            {
-                if (tc + 1 == table->cols)
-                {
-                    break;
-                }
-
-                TableCell *nextCell = &table->cells[tr][tc + 1];
-                setCellValue(table, nextCell->content, tr, tc, nextCell->fgColor, nextCell->bgColor);
-            }
-        }
+    // The column's width statistics go with it
+    arenaFree(table->arena, table->columns[col].widthCounts);
+    memmove(&table->columns[col], &table->columns[col + 1], (table->cols - col - 1) * sizeof(TableColumn));
 
-        // Remove last column
-        for (int32_t tr = 0; tr < table->rows; tr++)
-        {
-            TableCell *cell = &table->cells[tr][table->cols - 1];
+    table->cols--;
 
-            if (cell->content)
-            {
-                cell->content = NULL;
-                free(cell->content);
-            }
+    // Sort columns right of the removed one move with it, the removed one no longer sorts
+    if (table->sortKeyCount > 0)
+    {
+        TableSortColumn columns[TABLE_SORT_KEYS];
+        int32_t count = 0;
 
-            if (cell->conCells)
-            {
-                cell->conCells = NULL;
-                free(cell->conCells);
-            }
+        for (int32_t k = 0; k < table->sortKeyCount; k++)
+        {
+            if (table->sortColumns[k].col == col)
+                continue;
 
-            cell->size = 0;
-            cell->fgColor = FWHITE;
-            cell->bgColor = BBLACK;
+            columns[count] = table->sortColumns[k];
+            if (columns[count].col > col)
+                columns[count].col--;
+            count++;
         }
 
-        for (int32_t fr = 0; fr < table->rows; fr++)
-        {
-            for (int32_t fc = usableCols - table->cells[0][table->cols - 1].size; fc < con->cols; fc++)
-            {
-                setCellData(con, fr, fc, FWHITE, BBLACK, L' ');
-            }
-        }
+        applySort(table, columns, count);
     }
 
-    free(separators);
-
-    table->cols--;
+    // The row texts still hold the removed cells, and these may have been the ones matching
+    if (table->index)
+        buildIndex(table);
+    if (table->filter)
+    {
+        applyFilter(table, -1, 0);
+        clampView(table);
+    }
 
     reDrawTable(table, con, hConsole, hlt);
-}
\ No newline at end of file
+}
@@ -1,25 +1,100 @@
-#include <windows.h>
 #include <stdbool.h>
 #include <inttypes.h>
 #include "tcon.h"
+#include "arena.h"
 
 #ifndef TABLE_H
 #define TABLE_H
 
 typedef struct TableCell
 {
-    int32_t size;
-    Cell **conCells;
     ColorForeground fgColor;
     ColorBackground bgColor;
     char *content;
 } TableCell;
 
+// Content widths tracked per column, wider content counts as the widest bucket
+#define TABLE_WIDTH_BUCKETS 256
+
+// Framebuffer columns a table column occupies, its separator follows at x + width
+typedef struct TableColumn
+{
+    int32_t x;
+    int32_t width;
+    int32_t minWidth;         // Limits of auto widths, see setTableColumnWidth()
+    int32_t maxWidth;         // 0 for no limit
+    int32_t weight;           // Share of the space left over or missing
+    int32_t *widthCounts;     // Cells per content width, TABLE_WIDTH_BUCKETS entries, empty cells are not counted
+    int32_t contentWidth;     // Widest content in the column
+} TableColumn;
+
+// Most columns a table is sorted by at once
+#define TABLE_SORT_KEYS 4
+
+typedef enum TableSortType
+{
+    SORT_TEXT,   // Case-insensitive, ties are broken case-sensitively
+    SORT_NUMBER  // Parsed as a floating point number, content that is no number sorts last
+} TableSortType;
+
+typedef struct TableSortColumn
+{
+    int32_t col;
+    TableSortType type;
+    bool descending;
+} TableSortColumn;
+
+// Trigram index over the cell contents of a table, see setTableIndex()
+typedef struct TableIndex TableIndex;
+
+typedef struct TableCellValue
+{
+    const char *content;
+    ColorForeground fgColor;
+    ColorBackground bgColor;
+} TableCellValue;
+
+/*
+Supplies one row of a virtual table. values holds one entry per column, preset to empty
+content in the default colors. The strings only need to stay valid until the callback
+returns, the table copies them.
+*/
+typedef void (*TableRowSource)(void *userData, int64_t row, TableCellValue *values, int32_t cols);
+
 typedef struct Table
 {
     int32_t rows;
     int32_t cols;
-    TableCell **cells;
+    TableCell **cells;        // Ring of rows, row r is in slot (headRow + r) % rowCapacity
+    int32_t rowCapacity;
+    int32_t headRow;
+    int32_t maxRows;          // Appending beyond this evicts the oldest row, 0 for no limit
+    uint64_t evictedRows;     // Rows dropped from the head so far
+    int32_t viewHeight;       // Framebuffer rows shown, 0 to show every row
+    int32_t viewRow;          // Row shown on the first line
+    bool followTail;          // Keep the newest rows in view as rows are appended
+    TableColumn *columns;     // Geometry of each column, shared by all rows
+    ConsoleState *console;    // Console the table was last laid out on, its framebuffer may move on resizes
+    uint32_t layoutResizes;   // Console resizes seen by the last layout
+    bool autoWidth;           // Columns fit their content, see setTableAutoWidth()
+    bool widthsChanged;       // The widest content of a column changed since the last layout
+    TableSortColumn sortColumns[TABLE_SORT_KEYS]; // See sortTable()
+    int32_t sortKeyCount;     // 0 when rows are shown in the order they are stored in
+    uint64_t *sortKeys;       // sortKeyCount keys per ring slot, precomputed from the sort columns
+    int32_t *order;           // Ring slot of the row shown at each position
+    TableIndex *index;        // Speeds up filterTable(), NULL without an index
+    char *filter;             // Text the shown rows contain, folded to lower case. NULL shows every row
+    int32_t filterLen;
+    int32_t *shown;           // Ring slots of the rows the filter lets through, in the order they are shown
+    int32_t shownCount;
+    int32_t top;              // Framebuffer row of the first table row
+    TableRowSource source;    // Set for virtual tables, see createVirtualTable()
+    void *sourceData;
+    int64_t sourceRows;       // Rows the source provides
+    int64_t scroll;           // Source row shown in the first table row
+    TableCellValue *rowValues; // Scratch row passed to the source
+    int32_t valueCols;
+    Arena *arena;             // Owns the rows, contents and mappings of the table
 } Table;
 
 /*
@@ -35,13 +110,98 @@ Returns:
 */
 Table createTable(Console *con, int32_t rows, int32_t cols);
 
+/*
+Generates an empty table that keeps its rows in a bounded ring, for tails of live data.
+Appending is amortized O(1), and once maxRows rows are stored each append evicts the oldest
+row and reuses its memory. The table shows height framebuffer rows, following the newest
+rows until it is scrolled elsewhere with scrollTable().
+
+Arguments:
+   console - the current instance of the console
+   top - the framebuffer row of the first visible row
+   height - the amount of visible rows, clipped to the console
+   cols - the amount of columns the table should have
+   maxRows - the amount of rows kept, 0 to keep every row
+
+Returns:
+   Table
+*/
+Table createRingTable(Console *con, int32_t top, int32_t height, int32_t cols, int32_t maxRows);
+
+/*
+Generates a virtual table. Only the rows in the viewport are materialized as cells, their
+contents are pulled from the source whenever the viewport moves or is refreshed, so the
+source can have far more rows than the console. The materialized viewport behaves like a
+normal table with height rows for all other table functions.
+
+Arguments:
+   console - the current instance of the console
+   top - the framebuffer row of the first visible row
+   height - the amount of visible rows, clipped to the console
+   cols - the amount of columns the table should have
+   rows - the amount of rows the source provides
+   source - the callback supplying rows
+   userData - passed to every source call
+
+Returns:
+   Table
+*/
+Table createVirtualTable(Console *con, int32_t top, int32_t height, int32_t cols, int64_t rows, TableRowSource source, void *userData);
+
+/*
+Moves the viewport of a table. Virtual tables pull the visible rows from their source, other
+tables repaint the stored rows without copying them. Scrolling to the last rows makes the
+view follow newly appended rows again.
+
+Arguments:
+   table - the table
+   con - your console object
+   firstRow - the row to show first, clamped to the available rows
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void scrollTable(Table *table, Console *con, int64_t firstRow, HANDLE hConsole, bool hlt);
+
+/*
+Changes the amount of rows the source of a virtual table provides and refreshes the viewport.
+
+Arguments:
+   table - the virtual table
+   con - your console object
+   rows - the new amount of source rows
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void setVirtualTableRows(Table *table, Console *con, int64_t rows, HANDLE hConsole, bool hlt);
+
+/*
+Pulls the visible rows of a virtual table from its source again, e.g. after the data changed.
+
+Arguments:
+   table - the virtual table
+   con - your console object
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void refreshVirtualTable(Table *table, Console *con, HANDLE hConsole, bool hlt);
+
 /*
 Sets the content, foreground color, and background color for any given cell
-in a Table.
+in a Table. Content wider than its column is cut after the last whole grapheme
+that fits and ends in "...", wide chars take two columns.
 
 Arguments:
    table - the table containing the cell
-   value - the content to set in form of a string
+   value - the content to set in form of a UTF-8 string
    row - the row of the given cell in the table
    col - the column of the given cell in the table
 
@@ -56,7 +216,7 @@ Clears all values and colors in a table and resets them to their default
 Arguments:
    table - the table to clear
    con - your console object to reset the framebuffer
-   hConsole - the windows stdout handle
+   hConsole - the console handle
    hlt - a flag to wait for user input before continuing
 
 Returns:
@@ -95,7 +255,7 @@ Re calculates the table and reflows the cell contents.
 Arguments:
    table - the table to update
    con - your console object
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -103,13 +263,149 @@ Returns:
 */
 void reDrawTable(Table *table, Console *con, HANDLE hConsole, bool hlt);
 
+/*
+Lays a table out again after its console was resized, see resizeConsole(). Only the cells
+whose column moved or changed its width and the lines that came into view are drawn again,
+everything else kept its place in the framebuffer.
+
+Arguments:
+   table - the table to update
+   con - your console object, already resized
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void reflowTable(Table *table, Console *con, HANDLE hConsole, bool hlt);
+
+/*
+Switches between columns fitted to their content and columns of equal width. Fitted columns
+are as wide as their widest content within their limits, the space left over is shared by
+weight and missing space is taken by weight down to the minimum widths. Widths follow the
+content as cells change, each change updates per column counts of content widths instead of
+scanning the column. Only columns that moved or changed their width are drawn again.
+
+Arguments:
+   table - the table to update
+   con - your console object
+   autoWidth - true to fit the columns to their content
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void setTableAutoWidth(Table *table, Console *con, bool autoWidth, HANDLE hConsole, bool hlt);
+
+/*
+Sets the limits of a column's auto width. New columns have a minimum of 1, no maximum and
+a weight of 1.
+
+Arguments:
+   table - the table to update
+   con - your console object
+   col - the column
+   minWidth - the narrowest the column gets unless the console is too narrow for all minimums
+   maxWidth - the widest the column gets, 0 for no limit
+   weight - the column's share of space left over or missing, 0 to never grow past its content
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void setTableColumnWidth(Table *table, Console *con, int32_t col, int32_t minWidth, int32_t maxWidth, int32_t weight, HANDLE hConsole, bool hlt);
+
+/*
+Sorts a table by one or more columns. Rows are not moved, the table shows them through a
+permutation of their positions, so row arguments of the other table functions keep referring
+to rows in the order they were added. The sort is stable, rows with equal keys show in that
+order. Keys are precomputed per row, a number or the first bytes of the text folded to lower
+case. The table stays sorted as rows are added and cells change. A changed row is found and
+placed again with binary searches, only the positions in between shift. Virtual tables are not
+sorted.
+
+Arguments:
+   table - the table to sort
+   con - your console object
+   columns - the sort columns, the first one decides first
+   count - the amount of sort columns, 0 to show the rows in the order they were added. Only
+           the first TABLE_SORT_KEYS are used
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void sortTable(Table *table, Console *con, const TableSortColumn *columns, int32_t count, HANDLE hConsole, bool hlt);
+
+/*
+Keeps a trigram index of a table's cell contents, or drops it. The index lists the rows each
+sequence of three characters occurs in and follows every change of a cell, so filterTable()
+only checks the rows listed for the rarest trigram of the filter instead of every row. It
+costs memory in proportion to the contents. Virtual tables are not indexed.
+
+Arguments:
+   table - the table
+   enable - true to keep an index, false to drop it
+
+Returns:
+   Void
+*/
+void setTableIndex(Table *table, bool enable);
+
+/*
+Shows only the rows with a cell that contains a text, ignoring the case of ASCII letters. The
+rows shown follow the filter as rows are added and cells change, and the view positions of the
+other table functions count the shown rows only. A filter that extends the previous one only
+checks the rows shown so far, with an index from where the previous one occurred in them, and
+with an index filters of three characters or more only check the rows it lists. Otherwise every
+row is scanned. Virtual tables are not filtered.
+
+Arguments:
+   table - the table to filter
+   con - your console object
+   text - the text to look for, NULL or empty to show every row again
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void filterTable(Table *table, Console *con, const char *text, HANDLE hConsole, bool hlt);
+
+/*
+Returns the amount of rows a table shows, the rows its filter lets through.
+
+Arguments:
+   table - the table
+
+Returns:
+   The amount of rows
+*/
+int32_t getTableShownRows(Table *table);
+
+/*
+Returns the row shown at a position of the table, 0 being the first position whether the table
+is scrolled or not. Rows a filter hides have no position.
+
+Arguments:
+   table - the table
+   position - the position
+
+Returns:
+   The row, -1 if the position is past the last row
+*/
+int32_t getTableRowAt(Table *table, int32_t position);
+
 /*
 Removes a given table from the console and clears the console.
 
 Arguments:
    table - the table to clear
    con - your console object
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -118,7 +414,8 @@ Returns:
 void clearTableConsole(Table *table, Console *con, HANDLE hConsole, bool hlt);
 
 /*
-Removes a given table.
+Removes a given table. All of its memory is released at once together with its arena,
+the table has no rows or columns afterwards.
 
 Arguments:
    table - the table to remove
@@ -134,7 +431,7 @@ Adds a new row to the end of a given table.
 Arguments:
    table - the table to add a row
    con - the current Console object
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -142,6 +439,37 @@ Returns:
 */
 void addTableRow(Table *table, Console *con, HANDLE hConsole, bool hlt);
 
+/*
+Appends a row with the given contents to the end of a table, evicting the oldest row if the
+table already holds its maximum. Only the new row is drawn unless the view has to move.
+
+Arguments:
+   table - the table to append to
+   con - the current Console object
+   values - one value per column, copied into the table. NULL appends an empty row
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void appendTableRow(Table *table, Console *con, const TableCellValue *values, HANDLE hConsole, bool hlt);
+
+/*
+Drops the oldest rows of a table.
+
+Arguments:
+   table - the table to drop rows from
+   con - the current Console object
+   count - the amount of rows to drop from the head
+   hConsole - the console handle
+   hlt - a flag to halt execution and wait for user input
+
+Returns:
+   Void
+*/
+void evictTableRows(Table *table, Console *con, int32_t count, HANDLE hConsole, bool hlt);
+
 /*
 Removes a given row from a table.
 
@@ -149,7 +477,7 @@ Arguments:
    table - the table to remove the row from
    con - the current Console object
    row - the row to remove
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -163,7 +491,7 @@ Adds a new column to the end of a given table.
 Arguments:
    table - the table to add the column
    con - the current Console object
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -178,7 +506,7 @@ Arguments:
    table - the table to remove the column from
    con - the current Console object
    col - the column to remove
-   hConsole - a windows stdout handle
+   hConsole - the console handle
    hlt - a flag to halt execution and wait for user input
 
 Returns:
@@ -1,238 +1,979 @@
-#include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 #include "tcon.h"
-// TODO: Update print function to work like printf()
+#include "backend.h"
+#include "pool.h"
 // TODO: Implement a read function that automatically resizes its buffer
 // TODO: Implement proper error handling (Consider a custom error handler)
 
 void showCursor(Console console, HANDLE hConsole)
 {
-    CONSOLE_CURSOR_INFO cursorInfo;
-    GetConsoleCursorInfo(hConsole, &cursorInfo);
-    cursorInfo.bVisible = true;
-    SetConsoleCursorInfo(hConsole, &cursorInfo);
+    backendSetCursorVisible(hConsole, true);
 }
 
 void hideCursor(Console console, HANDLE hConsole)
 {
-    CONSOLE_CURSOR_INFO cursorInfo;
-    GetConsoleCursorInfo(hConsole, &cursorInfo);
-    cursorInfo.bVisible = false;
-    SetConsoleCursorInfo(hConsole, &cursorInfo);
+    backendSetCursorVisible(hConsole, false);
 }
 
 void resetCursor(Console con, HANDLE hConsole)
 {
-    SetConsoleCursorInfo(hConsole, &con.original.originalCursor);
+    backendResetCursor(hConsole, &con.original);
 }
 
 void disableScroll()
 {
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    backendDisableScroll();
+}
 
-    GetConsoleScreenBufferInfo(hOut, &csbi);
+void hlt()
+{
+    backendWaitKey();
+}
 
-    // Set buffer size equal to window size
-    COORD newSize;
-    newSize.X = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-    newSize.Y = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+HANDLE tconGetStdHandle(void)
+{
+    return backendStdHandle();
+}
 
-    SetConsoleScreenBufferSize(hOut, newSize);
+HANDLE tconGetStdInputHandle(void)
+{
+    return backendStdInputHandle();
 }
 
-void hlt()
+uint64_t tconNowNs(void)
+{
+    return backendNowNs();
+}
+
+static void memorySinkBeginFrame(TconSink *sink, int32_t rows, int32_t cols)
+{
+    MemorySink *ms = (MemorySink *)sink;
+    ms->frameCells = 0;
+    ms->frameRuns = 0;
+}
+
+static void memorySinkWriteRun(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len)
+{
+    MemorySink *ms = (MemorySink *)sink;
+    ms->frameCells += len;
+    ms->frameRuns++;
+    sink->frameBytes += len * sizeof(Cell);
+}
+
+static void memorySinkEndFrame(TconSink *sink)
 {
-    INPUT_RECORD rec;
-    DWORD read;
-    HANDLE hIn = GetStdHandle(STD_INPUT_HANDLE);
+    MemorySink *ms = (MemorySink *)sink;
+    ms->frames++;
+    ms->totalCells += ms->frameCells;
+    ms->totalRuns += ms->frameRuns;
+}
+
+void initMemorySink(MemorySink *sink)
+{
+    memset(sink, 0, sizeof(MemorySink));
+    sink->sink.beginFrame = memorySinkBeginFrame;
+    sink->sink.writeRun = memorySinkWriteRun;
+    sink->sink.endFrame = memorySinkEndFrame;
+}
+
+static bool cellEquals(const Cell *a, const Cell *b)
+{
+    return a->Char == b->Char && a->Style == b->Style;
+}
+
+static Cell *allocCells(int32_t rows, int32_t stride)
+{
+    TCON_STAT_ALLOC(1);
 
-    while (1)
+    size_t size = (size_t)rows * stride * sizeof(Cell);
+    if (size == 0)
+        size = TCON_CELL_ALIGN;
+
+#ifdef _WIN32
+    Cell *cells = _aligned_malloc(size, TCON_CELL_ALIGN);
+#else
+    Cell *cells = NULL;
+    if (posix_memalign((void **)&cells, TCON_CELL_ALIGN, size) != 0)
+        cells = NULL;
+#endif
+
+    if (!cells)
     {
-        ReadConsoleInput(hIn, &rec, 1, &read);
-        if (rec.EventType == KEY_EVENT && rec.Event.KeyEvent.bKeyDown)
-        {
-            char c = rec.Event.KeyEvent.uChar.AsciiChar;
-            break; // single key pressed
-        }
+        perror("framebuffer alloc");
+        exit(1);
     }
+
+    return cells;
 }
 
-CHAR_INFO *framebufferToLinearBuffer(Console con)
+static void freeCells(Cell *cells)
 {
-    CHAR_INFO *charInfos = malloc(con.rows * con.cols * sizeof(CHAR_INFO));
+#ifdef _WIN32
+    _aligned_free(cells);
+#else
+    free(cells);
+#endif
+}
 
-    int32_t k = 0;
+// Sends the changed runs of a single row and brings the front row up to date.
+static void renderRow(TconSink *sink, const Cell *back, Cell *front, int32_t row, int32_t cols, bool full, int32_t *frameCells, int32_t *frameRuns, int32_t *frameWritten)
+{
+    if (!full && memcmp(back, front, cols * sizeof(Cell)) == 0)
+        return;
 
-    for (int32_t row = 0; row < con.rows; row++)
+    int32_t col = 0;
+    while (col < cols)
     {
-        for (int32_t col = 0; col < con.cols; col++)
+        if (!full && cellEquals(&back[col], &front[col]))
         {
-            CHAR_INFO temp;
-            temp.Char.UnicodeChar = con.framebuffer[row][col].Char;
-            temp.Attributes = con.framebuffer[row][col].Foreground | con.framebuffer[row][col].Background;
+            col++;
+            continue;
+        }
+
+        // Extend the run until more than TCON_RUN_MERGE_GAP unchanged cells follow
+        int32_t start = col;
+        int32_t end = col + 1;
+        int32_t changed = 1;
+        int32_t gap = 0;
 
-            k = row * con.cols + col;
-            charInfos[k] = temp;
+        for (int32_t c = col + 1; c < cols; c++)
+        {
+            if (full || !cellEquals(&back[c], &front[c]))
+            {
+                end = c + 1;
+                changed++;
+                gap = 0;
+            }
+            else if (++gap > TCON_RUN_MERGE_GAP)
+            {
+                break;
+            }
         }
+
+        // A wide char is sent with its tail, also when only one of the two changed or the
+        // change overwrote half of the wide char shown before. Runs start at the head of a wide
+        // char, a tail sent on its own would be a blank that erases the char on the terminal
+        while (start > 0 && (back[start].Char == TCON_WIDE_TAIL || front[start].Char == TCON_WIDE_TAIL))
+            start--;
+        while (end < cols && (back[end].Char == TCON_WIDE_TAIL || front[end].Char == TCON_WIDE_TAIL))
+            end++;
+
+        sink->writeRun(sink, row, start, &back[start], end - start);
+        memcpy(&front[start], &back[start], (end - start) * sizeof(Cell));
+
+        *frameCells += changed;
+        *frameWritten += end - start;
+        (*frameRuns)++;
+        col = end;
     }
+}
 
-    return charInfos;
+void clearScreen(HANDLE hConsole, Console *con, bool hlt)
+{
+    fillFramebuffer(con, FWHITE, BBLACK, L' ');
+    renderConsole(*con, hConsole, hlt);
 }
 
-void printScreen(HANDLE hConsole, CHAR_INFO *charInfo, Console con)
+void getWindowSize(Console *con, HANDLE hConsole)
 {
-    COORD bufferSize;
-    bufferSize.X = con.cols;
-    bufferSize.Y = con.rows;
+    // A headless console is as large as it was created or resized to
+    if (con->state && con->state->headless)
+    {
+        con->rows = con->state->bufferRows;
+        con->cols = con->state->bufferCols;
+        return;
+    }
+
+    int32_t rows = 0;
+    int32_t columns = 0;
 
-    COORD bufferCoord;
-    bufferCoord.X = 0;
-    bufferCoord.Y = 0;
+    backendGetWindowSize(hConsole, &rows, &columns);
 
-    SMALL_RECT writeRegion;
-    writeRegion.Top = 0;
-    writeRegion.Left = 0;
-    writeRegion.Right = con.cols - 1;
-    writeRegion.Bottom = con.rows - 1;
+    // Before initConsole allocated the buffers there is nothing to resize
+    if (con->state)
+    {
+        resizeConsole(con, rows, columns);
+        return;
+    }
 
-    WriteConsoleOutput(hConsole, charInfo, bufferSize, bufferCoord, &writeRegion);
+    con->rows = rows;
+    con->cols = columns;
 }
 
-void clearScreen(HANDLE hConsole, Console *con, bool hlt)
+// Allocates framebuffer, front buffer and render state for con->rows x con->cols
+static void allocConsoleBuffers(Console *con)
 {
-    for (int32_t r = 0; r < con->rows; r++)
+    con->stride = (con->cols + TCON_STRIDE_CELLS - 1) / TCON_STRIDE_CELLS * TCON_STRIDE_CELLS;
+    con->framebuffer = allocCells(con->rows, con->stride);
+
+    con->state = calloc(1, sizeof(ConsoleState));
+    if (!con->state)
     {
-        for (int32_t c = 0; c < con->cols; c++)
+        perror("calloc");
+        exit(1);
+    }
+    TCON_STAT_ALLOC(1);
+
+    con->state->bufferRows = con->rows;
+    con->state->bufferCols = con->cols;
+    con->state->framebuffer = con->framebuffer;
+    con->state->stride = con->stride;
+    con->state->capacityRows = con->rows;
+    con->state->fullRepaint = true;
+    con->state->autoFlush = true;
+    con->state->styleTable = &con->state->styles;
+
+    con->state->frontbuffer = allocCells(con->rows, con->stride);
+    memset(con->state->frontbuffer, 0, (size_t)con->rows * con->stride * sizeof(Cell));
+
+#ifdef TCON_STATS
+    // Creating the console is not part of its first frame
+    con->state->stats.allocationMark = tconAllocations;
+#endif
+}
+
+Console initConsole(HANDLE hConsole)
+{
+    Console con;
+    memset(&con, 0, sizeof(Console));
+    con.cursorVisible = true;
+
+    getWindowSize(&con, hConsole);
+    backendInit(hConsole, &con.original);
+
+    allocConsoleBuffers(&con);
+    backendInitSink(&con.state->consoleSink, hConsole);
+
+    // Populate Cells
+    fillFramebuffer(&con, con.original.originalAttributes & 0x0F, con.original.originalAttributes & 0xF0, L' ');
+
+    return con;
+}
+
+// Sets the cells from column from up to column to of rows [firstRow, lastRow) in both buffers
+static void fillCells(ConsoleState *state, int32_t firstRow, int32_t lastRow, int32_t from, int32_t to, Cell back, Cell front)
+{
+    for (int32_t row = firstRow; row < lastRow; row++)
+    {
+        size_t offset = (size_t)row * state->stride;
+        for (int32_t col = from; col < to; col++)
         {
-            con->framebuffer[r][c].Char = L' ';
-            con->framebuffer[r][c].Background = BBLACK;
-            con->framebuffer[r][c].Foreground = FWHITE;
+            state->framebuffer[offset + col] = back;
+            state->frontbuffer[offset + col] = front;
         }
     }
-
-    renderConsole(*con, hConsole, hlt);
 }
 
-void getWindowSize(Console *con, HANDLE hConsole)
+void resizeConsole(Console *con, int32_t rows, int32_t cols)
 {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    ConsoleState *state = con->state;
+
+    if (rows < 0)
+        rows = 0;
+    if (cols < 0)
+        cols = 0;
+
+    int32_t oldRows = state->bufferRows;
+    int32_t oldCols = state->bufferCols;
 
-    if (hConsole == INVALID_HANDLE_VALUE)
+    // An unchanged size only brings a stale copy of con up to date
+    if (rows == oldRows && cols == oldCols)
     {
-        fprintf(stderr, "Error: invalid handle\n");
-        exit(EXIT_FAILURE);
+        con->rows = rows;
+        con->cols = cols;
+        con->framebuffer = state->framebuffer;
+        con->stride = state->stride;
+        return;
     }
 
-    if (!GetConsoleScreenBufferInfo(hConsole, &csbi))
+    Cell blank;
+    blank.Char = L' ';
+    blank.Style = TCON_CONSOLE_STYLE(con->original.originalAttributes & 0x0F, con->original.originalAttributes & 0xF0);
+
+    // The front buffer does not know what the sink shows in exposed cells, zero never matches a blank
+    Cell unknown;
+    memset(&unknown, 0, sizeof(Cell));
+
+    if (rows > state->capacityRows || cols > state->stride)
+    {
+        // Leave room to grow, so dragging a window edge does not move the buffers on every step
+        int32_t capacityRows = rows > state->capacityRows ? rows + rows / 4 : state->capacityRows;
+        int32_t capacityCols = cols > state->stride ? cols + cols / 4 : state->stride;
+        int32_t stride = (capacityCols + TCON_STRIDE_CELLS - 1) / TCON_STRIDE_CELLS * TCON_STRIDE_CELLS;
+
+        Cell *framebuffer = allocCells(capacityRows, stride);
+        Cell *frontbuffer = allocCells(capacityRows, stride);
+
+        int32_t keepRows = rows < oldRows ? rows : oldRows;
+        int32_t keepCols = cols < oldCols ? cols : oldCols;
+
+        for (int32_t row = 0; row < keepRows; row++)
+        {
+            memcpy(framebuffer + (size_t)row * stride, state->framebuffer + (size_t)row * state->stride, keepCols * sizeof(Cell));
+            memcpy(frontbuffer + (size_t)row * stride, state->frontbuffer + (size_t)row * state->stride, keepCols * sizeof(Cell));
+        }
+
+        freeCells(state->framebuffer);
+        freeCells(state->frontbuffer);
+
+        state->framebuffer = framebuffer;
+        state->frontbuffer = frontbuffer;
+        state->stride = stride;
+        state->capacityRows = capacityRows;
+
+        // Padding and rows past the new size match in both buffers, so they never count as changed
+        fillCells(state, 0, keepRows, keepCols, stride, blank, blank);
+        fillCells(state, keepRows, capacityRows, 0, stride, blank, blank);
+        fillCells(state, 0, keepRows, keepCols, cols, blank, unknown);
+        fillCells(state, keepRows, rows, 0, cols, blank, unknown);
+    }
+    else
     {
-        fprintf(stderr, "Error: could not get console info\n");
-        exit(EXIT_FAILURE);
+        // Within the allocation only the cells that become visible are touched
+        fillCells(state, 0, rows < oldRows ? rows : oldRows, oldCols, cols, blank, unknown);
+        fillCells(state, oldRows, rows, 0, cols, blank, unknown);
     }
 
-    int32_t columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-    int32_t rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    state->bufferRows = rows;
+    state->bufferCols = cols;
+    state->keptRows = rows < oldRows ? rows : oldRows;
+    state->keptCols = cols < oldCols ? cols : oldCols;
+    state->resizes++;
 
     con->rows = rows;
-    con->cols = columns;
+    con->cols = cols;
+    con->framebuffer = state->framebuffer;
+    con->stride = state->stride;
+
+    if (!state->headless)
+        state->fullRepaint = true;
 }
 
-Console initConsole(HANDLE hConsole)
+Console initHeadlessConsole(int32_t rows, int32_t cols, TconSink *sink)
 {
     Console con;
-    con.rows = 0;
-    con.cols = 0;
-    con.cursorVisible = true;
+    memset(&con, 0, sizeof(Console));
+    con.rows = rows;
+    con.cols = cols;
+    con.cursorVisible = false;
+    con.original.originalAttributes = FWHITE | BBLACK;
 
-    getWindowSize(&con, hConsole);
+    allocConsoleBuffers(&con);
+    con.state->headless = true;
+    con.state->sink = sink;
+
+    fillFramebuffer(&con, FWHITE, BBLACK, L' ');
 
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
+    return con;
+}
 
-    DWORD mode;
-    GetConsoleMode(hConsole, &mode);
+void fillFramebuffer(Console *con, ColorForeground Fcolor, ColorBackground Bcolor, uint32_t Char)
+{
+    Cell fill;
+    fill.Char = Char;
+    fill.Style = TCON_CONSOLE_STYLE(Fcolor, Bcolor);
 
-    CONSOLE_CURSOR_INFO cursorInfo;
-    GetConsoleCursorInfo(hConsole, &cursorInfo);
+    // Padding cells at the end of each row are filled as well, keeping this one linear pass
+    Cell *cells = con->framebuffer;
+    int32_t count = con->state->capacityRows * con->stride;
 
-    con.original.originalAttributes = csbi.wAttributes;
-    con.original.originalBufferSize = csbi.dwSize;
-    con.original.originalWindow = csbi.srWindow;
-    con.original.originalMode = mode;
-    con.original.originalCursor = cursorInfo;
+    for (int32_t i = 0; i < count; i++)
+        cells[i] = fill;
+}
 
-    con.framebuffer = malloc(con.rows * sizeof(Cell *));
-    for (int32_t i = 0; i < con.rows; i++)
+void setCellData(Console *con, int32_t row, int32_t col, ColorForeground Fcolor, ColorBackground Bcolor, uint32_t Char)
+{
+    Cell *cell = getCell(con, row, col);
+    cell->Style = TCON_CONSOLE_STYLE(Fcolor, Bcolor);
+    cell->Char = Char;
+}
+
+void setCellStyle(Console *con, int32_t row, int32_t col, uint32_t style, uint32_t Char)
+{
+    Cell *cell = getCell(con, row, col);
+    cell->Style = style;
+    cell->Char = Char;
+}
+
+// Work shared by the bands of one frame
+typedef struct BandJob
+{
+    ConsoleState *state;
+    int32_t rows;
+    int32_t cols;
+    bool full;
+} BandJob;
+
+static void renderBand(void *arg, int32_t task)
+{
+    BandJob *job = arg;
+    ConsoleState *state = job->state;
+    TconBand *band = &state->bands[task];
+    TconSink *sink = band->sink;
+
+    band->frameCells = 0;
+    band->frameRuns = 0;
+    band->frameWritten = 0;
+    sink->frameBytes = 0;
+    sink->styles = state->styleTable;
+
+    if (sink->beginFrame)
+        sink->beginFrame(sink, job->rows, job->cols);
+
+    // Bands never share a row, so every thread owns its part of both buffers
+    for (int32_t row = band->firstRow; row < band->firstRow + band->rows; row++)
     {
-        con.framebuffer[i] = malloc(con.cols * sizeof(Cell));
+        size_t offset = (size_t)row * state->stride;
+        renderRow(sink, state->framebuffer + offset, state->frontbuffer + offset, row, job->cols, job->full, &band->frameCells, &band->frameRuns, &band->frameWritten);
     }
+}
 
-    // Populate Cells
-    for (int32_t row = 0; row < con.rows; row++)
+static void freeBands(ConsoleState *state)
+{
+    for (int32_t b = 0; b < state->bandCount; b++)
+        state->bands[b].sink->freeBand(state->bands[b].sink);
+
+    free(state->bands);
+    state->bands = NULL;
+    state->bandCount = 0;
+    state->bandParent = NULL;
+}
+
+// Creates the band sinks of sink once, they are kept for the following frames
+static void bindBands(ConsoleState *state, TconSink *sink)
+{
+    int32_t count = state->pool->threads * TCON_BANDS_PER_THREAD;
+    if (state->bandParent == sink && state->bandCount == count)
+        return;
+
+    freeBands(state);
+
+    state->bands = calloc(count, sizeof(TconBand));
+    if (!state->bands)
     {
-        for (int32_t col = 0; col < con.cols; col++)
+        perror("calloc");
+        exit(1);
+    }
+    TCON_STAT_ALLOC(1);
+
+    for (int32_t b = 0; b < count; b++)
+        state->bands[b].sink = sink->createBand(sink);
+
+    state->bandCount = count;
+    state->bandParent = sink;
+}
+
+// Encodes the changed rows in bands on the worker pool, false if the frame is better encoded serially
+static bool renderBands(ConsoleState *state, TconSink *sink, int32_t rows, int32_t cols)
+{
+    if (!state->pool || !sink->createBand || (int64_t)rows * cols < TCON_PARALLEL_MIN_CELLS)
+        return false;
+
+    // Only the rows between the first and the last changed one are split up
+    int32_t first = 0;
+    int32_t last = rows - 1;
+    if (!state->fullRepaint)
+    {
+        size_t rowSize = (size_t)cols * sizeof(Cell);
+        while (first <= last && memcmp(state->framebuffer + (size_t)first * state->stride, state->frontbuffer + (size_t)first * state->stride, rowSize) == 0)
+            first++;
+        while (last > first && memcmp(state->framebuffer + (size_t)last * state->stride, state->frontbuffer + (size_t)last * state->stride, rowSize) == 0)
+            last--;
+    }
+
+    int32_t dirty = last - first + 1;
+    if ((int64_t)dirty * cols < TCON_PARALLEL_MIN_CELLS || dirty < 2 * TCON_BAND_MIN_ROWS)
+        return false;
+
+    bindBands(state, sink);
+
+    int32_t count = dirty / TCON_BAND_MIN_ROWS;
+    if (count > state->bandCount)
+        count = state->bandCount;
+
+    for (int32_t b = 0; b < count; b++)
+    {
+        TconBand *band = &state->bands[b];
+        band->firstRow = first + (int32_t)((int64_t)dirty * b / count);
+        band->rows = first + (int32_t)((int64_t)dirty * (b + 1) / count) - band->firstRow;
+    }
+
+    BandJob job = { state, rows, cols, state->fullRepaint };
+    runWorkerPool(state->pool, renderBand, &job, count);
+
+    for (int32_t b = 0; b < count; b++)
+    {
+        TconBand *band = &state->bands[b];
+        sink->joinBand(sink, band->sink);
+        state->frameCells += band->frameCells;
+        state->frameRuns += band->frameRuns;
+        state->frameWritten += band->frameWritten;
+    }
+
+    state->bandedFrames++;
+    return true;
+}
+
+// Hash of the cells of a row, only a hint, rows with equal hashes are compared before they are
+// scrolled. Four cells are mixed in at a time on independent lanes, the row is hashed twice a frame
+static uint64_t hashRow(const Cell *cells, int32_t cols)
+{
+    uint64_t lanes[4] = {(uint64_t)cols, 1, 2, 3};
+    int32_t col = 0;
+
+    for (; col + 4 <= cols; col += 4)
+    {
+        for (int32_t i = 0; i < 4; i++)
+            lanes[i] = (lanes[i] ^ ((uint64_t)cells[col + i].Char | (uint64_t)cells[col + i].Style << 32)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    for (; col < cols; col++)
+        lanes[0] = (lanes[0] ^ ((uint64_t)cells[col].Char | (uint64_t)cells[col].Style << 32)) * 0x9E3779B97F4A7C15ull;
+
+    uint64_t hash = lanes[0] ^ (lanes[1] >> 17 | lanes[1] << 47) ^ (lanes[2] >> 31 | lanes[2] << 33) ^ (lanes[3] >> 43 | lanes[3] << 21);
+    return hash ^ hash >> 29;
+}
+
+static void reserveScrollScratch(ConsoleState *state, int32_t rows)
+{
+    if (rows <= state->scrollCapacity)
+        return;
+
+    free(state->rowHashes);
+    free(state->hashSlots);
+    free(state->sameHash);
+    free(state->scrollVotes);
+
+    // The hash table stays at most half full, votes cover every distance from -rows to rows
+    state->rowHashes = malloc((size_t)rows * sizeof(uint64_t));
+    state->hashSlots = malloc((size_t)rows * 4 * sizeof(int32_t));
+    state->sameHash = malloc((size_t)rows * sizeof(int32_t));
+    state->scrollVotes = malloc(((size_t)rows * 2 + 1) * sizeof(int32_t));
+    if (!state->rowHashes || !state->hashSlots || !state->sameHash || !state->scrollVotes)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    TCON_STAT_ALLOC(4);
+
+    state->scrollCapacity = rows;
+}
+
+// Finds the rows of the front buffer that moved to another row of the framebuffer, scrolls them
+// on the sink and moves them in the front buffer too, so only the rows it exposed differ
+static void scrollFrame(ConsoleState *state, TconSink *sink, int32_t rows, int32_t cols)
+{
+    Cell *back = state->framebuffer;
+    Cell *front = state->frontbuffer;
+    size_t stride = (size_t)state->stride;
+    size_t rowSize = (size_t)cols * sizeof(Cell);
+
+    // Rows outside the changed ones can not have moved
+    int32_t first = 0;
+    int32_t last = rows - 1;
+    while (first < rows && memcmp(back + first * stride, front + first * stride, rowSize) == 0)
+        first++;
+    if (first == rows)
+        return;
+    while (memcmp(back + last * stride, front + last * stride, rowSize) == 0)
+        last--;
+    if (last - first < TCON_SCROLL_MIN_ROWS)
+        return;
+
+    reserveScrollScratch(state, rows);
+
+    // Front rows by hash, rows with the same hash are chained from the first of them
+    uint32_t slotCount = 1;
+    while (slotCount < (uint32_t)(last - first + 1) * 2)
+        slotCount *= 2;
+    uint32_t mask = slotCount - 1;
+    int32_t *slots = state->hashSlots;
+    for (uint32_t i = 0; i < slotCount; i++)
+        slots[i] = -1;
+
+    for (int32_t row = last; row >= first; row--)
+    {
+        uint64_t hash = hashRow(front + row * stride, cols);
+        state->rowHashes[row] = hash;
+
+        uint32_t slot = (uint32_t)hash & mask;
+        while (slots[slot] != -1 && state->rowHashes[slots[slot]] != hash)
+            slot = (slot + 1) & mask;
+
+        state->sameHash[row] = slots[slot];
+        slots[slot] = row;
+    }
+
+    // Every changed row votes for the distances to the front rows it may have come from. Repeated
+    // content, like blank rows, only gets a few votes, so it can not outvote the rows that moved
+    int32_t *votes = state->scrollVotes + rows;
+    memset(state->scrollVotes, 0, ((size_t)rows * 2 + 1) * sizeof(int32_t));
+    int32_t distance = 0;
+
+    for (int32_t row = first; row <= last; row++)
+    {
+        // Rows that did not change do not have to come from anywhere
+        if (memcmp(back + row * stride, front + row * stride, rowSize) == 0)
+            continue;
+
+        uint64_t hash = hashRow(back + row * stride, cols);
+
+        uint32_t slot = (uint32_t)hash & mask;
+        while (slots[slot] != -1 && state->rowHashes[slots[slot]] != hash)
+            slot = (slot + 1) & mask;
+
+        int32_t candidates = 0;
+        for (int32_t from = slots[slot]; from != -1 && candidates < TCON_SCROLL_CANDIDATES; from = state->sameHash[from], candidates++)
         {
-            Cell cell = con.framebuffer[row][col];
-            cell.Char = L' ';
+            if (from != row && ++votes[from - row] > votes[distance])
+                distance = from - row;
+        }
+    }
+
+    if (distance == 0 || votes[distance] < TCON_SCROLL_MIN_ROWS)
+        return;
 
-            cell.Foreground = con.original.originalAttributes & 0x0F;
-            cell.Background = con.original.originalAttributes & 0xF0;
+    // The block of rows that moved by that distance, cell for cell, that saves sending the most rows
+    int32_t blockStart = 0;
+    int32_t blockRows = 0;
+    int32_t blockSaved = 0;
+    int32_t runStart = 0;
+    int32_t runRows = 0;
+    int32_t runSaved = 0;
 
-            con.framebuffer[row][col] = cell;
+    for (int32_t row = first; row <= last; row++)
+    {
+        int32_t from = row + distance;
+        if (from >= first && from <= last && memcmp(back + row * stride, front + from * stride, rowSize) == 0)
+        {
+            if (runRows++ == 0)
+            {
+                runStart = row;
+                runSaved = 0;
+            }
+            if (memcmp(back + row * stride, front + row * stride, rowSize) != 0)
+                runSaved++;
+            if (runSaved > blockSaved)
+            {
+                blockStart = runStart;
+                blockRows = runRows;
+                blockSaved = runSaved;
+            }
+        }
+        else
+        {
+            runRows = 0;
         }
     }
 
-    return con;
+    // The rows the scroll exposes are sent in full, it has to save more rows than that
+    if (blockSaved < TCON_SCROLL_MIN_ROWS || blockSaved <= (distance > 0 ? distance : -distance))
+        return;
+
+    // The region spans the block and the rows it moved away from
+    int32_t top = distance > 0 ? blockStart : blockStart + distance;
+    int32_t regionRows = blockRows + (distance > 0 ? distance : -distance);
+    int32_t exposed = distance > 0 ? blockStart + blockRows : top;
+
+    sink->scroll(sink, top, regionRows, distance);
+
+    memmove(front + blockStart * stride, front + (blockStart + distance) * stride, (size_t)blockRows * stride * sizeof(Cell));
+
+    // The sink does not say what it left in the exposed rows, zero never matches a cell. Padding is
+    // taken from the framebuffer, so unchanged frames still compare equal as a whole
+    for (int32_t row = top; row < top + regionRows; row++)
+        memcpy(front + row * stride + cols, back + row * stride + cols, (stride - cols) * sizeof(Cell));
+    for (int32_t row = exposed; row < exposed + regionRows - blockRows; row++)
+        memset(front + row * stride, 0, rowSize);
+
+    state->scrolls++;
+    state->scrolledRows += (uint64_t)blockRows;
 }
 
-void setCellData(Console *con, int32_t row, int32_t col, ColorForeground Fcolor, ColorBackground Bcolor, wchar_t Char)
+#ifdef TCON_STATS
+// Closes the counters of the frame that was just presented, what was counted since the last one
+static void countFrameStats(ConsoleState *state, TconSink *sink, uint64_t scrolledRows, uint64_t encodeNs, uint64_t flushNs)
 {
-    con->framebuffer[row][col].Foreground = Fcolor;
-    con->framebuffer[row][col].Background = Bcolor;
-    con->framebuffer[row][col].Char = Char;
+    TconStats *stats = &state->stats;
+    TconFrameStats *frame = &stats->current;
+
+    uint64_t allocations = tconAllocations;
+    frame->allocations += allocations - stats->allocationMark;
+    stats->allocationMark = allocations;
+
+    frame->cellsWritten += (uint64_t)state->frameWritten;
+    frame->cellsChanged += (uint64_t)state->frameCells;
+    frame->runs += (uint64_t)state->frameRuns;
+    frame->bytes += sink->frameBytes;
+    frame->scrolledRows += state->scrolledRows - scrolledRows;
+    frame->encodeNs += encodeNs;
+    frame->flushNs += flushNs;
+
+    TconFrameStats *total = &stats->total;
+    total->cellsWritten += frame->cellsWritten;
+    total->cellsChanged += frame->cellsChanged;
+    total->runs += frame->runs;
+    total->bytes += frame->bytes;
+    total->scrolledRows += frame->scrolledRows;
+    total->allocations += frame->allocations;
+    total->reflows += frame->reflows;
+    total->composeNs += frame->composeNs;
+    total->encodeNs += frame->encodeNs;
+    total->flushNs += frame->flushNs;
+
+    stats->latencies[stats->latencyNext] = frame->composeNs + frame->encodeNs + frame->flushNs;
+    stats->latencyNext = (stats->latencyNext + 1) % TCON_STATS_HISTORY;
+    if (stats->latencyCount < TCON_STATS_HISTORY)
+        stats->latencyCount++;
+
+    stats->frame = *frame;
+    memset(frame, 0, sizeof(TconFrameStats));
+    stats->frames++;
 }
+#endif
 
-void resetConsole(Console *con, HANDLE hConsole)
+// Diffs the framebuffer against the front buffer and sends the changes, regardless of transactions
+static void presentFrame(Console con, HANDLE hConsole)
 {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
+    ConsoleState *state = con.state;
+    TconSink *sink = state->sink;
+
+    state->framePending = false;
+
+    // Headless consoles have no console sink to fall back to
+    if (!sink && state->headless)
+        return;
+
+    if (!sink)
+    {
+        backendBindSink(&state->consoleSink, hConsole);
+        sink = &state->consoleSink.sink;
+    }
+
+    uint64_t frameStart = tconNowNs();
+    state->lastPresentNs = frameStart;
+
+    // Never read past the framebuffer contents, con may be a copy from before a resize
+    int32_t rows = con.rows < state->bufferRows ? con.rows : state->bufferRows;
+    int32_t cols = con.cols < state->bufferCols ? con.cols : state->bufferCols;
+
+    state->frameCells = 0;
+    state->frameRuns = 0;
+    state->frameWritten = 0;
+    sink->frameBytes = 0;
+    sink->styles = state->styleTable;
+#ifdef TCON_STATS
+    uint64_t scrolledRows = state->scrolledRows;
+#endif
+
+    if (sink->beginFrame)
+        sink->beginFrame(sink, rows, cols);
+
+    // The buffers are taken from the state, con may be a copy from before a resize moved them
+    size_t frameSize = (size_t)rows * state->stride * sizeof(Cell);
+    bool unchanged = !state->fullRepaint && memcmp(state->framebuffer, state->frontbuffer, frameSize) == 0;
+
+    if (!unchanged && !state->fullRepaint && sink->scroll)
+        scrollFrame(state, sink, rows, cols);
+
+    if (!unchanged && !renderBands(state, sink, rows, cols))
+    {
+        for (int32_t row = 0; row < rows; row++)
+        {
+            size_t offset = (size_t)row * state->stride;
+            renderRow(sink, state->framebuffer + offset, state->frontbuffer + offset, row, cols, state->fullRepaint, &state->frameCells, &state->frameRuns, &state->frameWritten);
+        }
+    }
+
+    // After a full repaint the row padding is in sync too, which keeps the whole-frame compare valid
+    if (state->fullRepaint)
+        memcpy(state->frontbuffer, state->framebuffer, frameSize);
 
-    SetConsoleTextAttribute(hConsole, con->original.originalAttributes);
-    SetConsoleScreenBufferSize(hConsole, con->original.originalBufferSize);
-    SetConsoleWindowInfo(hConsole, TRUE, &con->original.originalWindow);
-    SetConsoleMode(hConsole, con->original.originalMode);
+    TCON_STAT_CLOCK(flushStart);
+    if (sink->endFrame)
+        sink->endFrame(sink);
 
-    clearScreen(hConsole, con, false);
-    resetCursor(*con, hConsole);
+    sink->totalBytes += sink->frameBytes;
+    state->fullRepaint = false;
+    state->frameNs = tconNowNs() - frameStart;
+    state->frames++;
+
+#ifdef TCON_STATS
+    countFrameStats(state, sink, scrolledRows, flushStart - frameStart, frameStart + state->frameNs - flushStart);
+#endif
+}
+
+// Nanoseconds until the target frame rate allows the next frame, 0 if it may be presented now
+static uint64_t frameWaitNs(ConsoleState *state)
+{
+    if (state->frameIntervalNs == 0)
+        return 0;
 
-    COORD topLeft = {0, 0};
-    SetConsoleCursorPosition(hConsole, topLeft);
+    uint64_t elapsed = tconNowNs() - state->lastPresentNs;
+    return elapsed < state->frameIntervalNs ? state->frameIntervalNs - elapsed : 0;
 }
 
 void renderConsole(Console con, HANDLE hConsole, bool hltf)
 {
-    CHAR_INFO *linearBuffer = framebufferToLinearBuffer(con);
-    printScreen(hConsole, linearBuffer, con);
+    ConsoleState *state = con.state;
+
+    // Inside a transaction or without auto flush the frame is only marked for later
+    if (state->frameDepth > 0 || !state->autoFlush)
+    {
+        if (state->framePending)
+            state->coalescedFrames++;
+        state->framePending = true;
+
+        // Halting has to show the current state first, so it still presents right away
+        if (!hltf)
+            return;
+    }
+    else if (!hltf && frameWaitNs(state) > 0)
+    {
+        // Too soon after the last frame, a pending state nobody has seen yet is replaced by this one
+        if (state->framePending)
+            state->droppedFrames++;
+        state->framePending = true;
+        return;
+    }
+
+    presentFrame(con, hConsole);
 
-    if (hltf)
+    // There is nobody to press a key on a headless console
+    if (hltf && !state->headless)
         hlt();
+}
+
+void beginConsoleFrame(Console *con)
+{
+#ifdef TCON_STATS
+    if (con->state->frameDepth == 0)
+        con->state->stats.composeStart = tconNowNs();
+#endif
 
-    free(linearBuffer);
+    con->state->frameDepth++;
 }
 
-void tconReadInput(Console con, HANDLE hConsole, int32_t row, int32_t col, char *buffer, int32_t maxLen)
+void commitConsoleFrame(Console *con, HANDLE hConsole)
 {
-    COORD pos;
-    pos.X = col;
-    pos.Y = row;
+    ConsoleState *state = con->state;
+
+    if (state->frameDepth > 0)
+        state->frameDepth--;
+
+    if (state->frameDepth == 0)
+        TCON_STAT_ADD(state, composeNs, tconNowNs() - state->stats.composeStart);
+
+    // Paced frames that are not due yet are left to pollConsoleFrame
+    if (state->frameDepth == 0 && state->autoFlush && state->framePending && frameWaitNs(state) == 0)
+        presentFrame(*con, hConsole);
+}
+
+void setConsoleAutoFlush(Console *con, bool autoFlush)
+{
+    con->state->autoFlush = autoFlush;
+}
+
+void flushConsole(Console *con, HANDLE hConsole)
+{
+    if (con->state->framePending)
+        presentFrame(*con, hConsole);
+}
+
+void setConsoleTargetFps(Console *con, int32_t fps)
+{
+    con->state->frameIntervalNs = fps > 0 ? 1000000000ull / (uint64_t)fps : 0;
+}
 
-    SetConsoleCursorPosition(hConsole, pos);
+int64_t pollConsoleFrame(Console *con, HANDLE hConsole)
+{
+    ConsoleState *state = con->state;
+
+    // Transactions and disabled auto flush present on their own terms
+    if (!state->framePending || state->frameDepth > 0 || !state->autoFlush)
+        return -1;
+
+    uint64_t wait = frameWaitNs(state);
+    if (wait > 0)
+        return (int64_t)wait;
+
+    presentFrame(*con, hConsole);
+    return 0;
+}
+
+void resetConsole(Console *con, HANDLE hConsole)
+{
+    // The cleared screen has to reach the terminal before it is restored, open transactions or not
+    fillFramebuffer(con, FWHITE, BBLACK, L' ');
+    presentFrame(*con, hConsole);
+    con->state->frameDepth = 0;
+
+    backendReset(hConsole, &con->original);
+
+    // The restored buffer no longer matches what was rendered
+    invalidateConsole(con);
+}
+
+void setConsoleSink(Console *con, TconSink *sink)
+{
+    con->state->sink = sink;
+    if (sink)
+        sink->totalBytes = 0;
+
+    invalidateConsole(con);
+}
+
+void setConsoleRenderThreads(Console *con, int32_t threads)
+{
+    ConsoleState *state = con->state;
+
+    freeBands(state);
+    freeWorkerPool(state->pool);
+    state->pool = threads > 1 ? createWorkerPool(threads) : NULL;
+}
+
+void freeConsole(Console *con)
+{
+    ConsoleState *state = con->state;
+    if (!state)
+        return;
+
+    freeBands(state);
+    freeWorkerPool(state->pool);
+    freeCells(state->framebuffer);
+    freeCells(state->frontbuffer);
+    free(state->styles.styles);
+    free(state->styles.slots);
+    free(state->rowHashes);
+    free(state->hashSlots);
+    free(state->sameHash);
+    free(state->scrollVotes);
+    free(state);
+
+    con->state = NULL;
+    con->framebuffer = NULL;
+    con->rows = 0;
+    con->cols = 0;
+}
+
+void invalidateConsole(Console *con)
+{
+    con->state->fullRepaint = true;
+}
+
+void tconReadInput(Console con, HANDLE hConsole, int32_t row, int32_t col, char *buffer, int32_t maxLen)
+{
+    backendSetCursorPosition(hConsole, row, col);
     showCursor(con, hConsole);
 
-    DWORD charsRead = 0;
-    ReadConsoleA(GetStdHandle(STD_INPUT_HANDLE), buffer, maxLen - 1, &charsRead, NULL);
+    int32_t charsRead = backendReadLine(buffer, maxLen - 1);
 
     // Strip CR/LF
     while (charsRead > 0 && (buffer[charsRead - 1] == '\n' || buffer[charsRead - 1] == '\r'))
@@ -246,17 +987,13 @@ void tconReadInput(Console con, HANDLE hConsole, int32_t row, int32_t col, char
 
 void print(Console con, HANDLE hConsole, int32_t row, int32_t col, char *buffer, ColorForeground fgColor, ColorBackground bgColor, bool hlt)
 {
-    int32_t size = strlen(buffer);
-
-    if (size <= 0)
+    if (buffer[0] == '\0')
     {
         return;
     }
 
-    for (int i = 0; i < size; i++)
-    {
-        setCellData(&con, row, col + i, fgColor, bgColor, buffer[i]);
-    }
+    // Clipped at the console edge and decoded as UTF-8
+    writeFormat(&con, row, col, 0, fgColor, bgColor, "%s", buffer);
 
     renderConsole(con, hConsole, hlt);
 }
\ No newline at end of file
@@ -1,50 +1,66 @@
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <termios.h>
+#endif
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <inttypes.h>
+#include "stats.h"
 
 #ifndef TCON_H
 #define TCON_H
 
+#ifndef _WIN32
+// On POSIX targets a handle carries the file descriptor of the terminal, see tconGetStdHandle()
+typedef void *HANDLE;
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#endif
+
+// Color values are the Windows console attribute bits (FOREGROUND_* / BACKGROUND_*):
+// blue = 1, green = 2, red = 4, intensity = 8, shifted left by 4 for backgrounds.
 typedef enum ColorForeground
 {
    FBLACK = 0,
-   FDARKBLUE = FOREGROUND_BLUE,
-   FDARKGREEN = FOREGROUND_GREEN,
-   FDARKCYAN = FOREGROUND_GREEN | FOREGROUND_BLUE,
-   FDARKRED = FOREGROUND_RED,
-   FDARKMAGENTA = FOREGROUND_RED | FOREGROUND_BLUE,
-   FDARKYELLOW = FOREGROUND_RED | FOREGROUND_GREEN,
-   FDARKGRAY = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE,
-   FGRAY = FOREGROUND_INTENSITY,
-   FBLUE = FOREGROUND_INTENSITY | FOREGROUND_BLUE,
-   FGREEN = FOREGROUND_INTENSITY | FOREGROUND_GREEN,
-   FCYAN = FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE,
-   FRED = FOREGROUND_INTENSITY | FOREGROUND_RED,
-   FMAGENTA = FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE,
-   FYELLOW = FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN,
-   FWHITE = FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE,
+   FDARKBLUE = 0x01,
+   FDARKGREEN = 0x02,
+   FDARKCYAN = 0x02 | 0x01,
+   FDARKRED = 0x04,
+   FDARKMAGENTA = 0x04 | 0x01,
+   FDARKYELLOW = 0x04 | 0x02,
+   FDARKGRAY = 0x04 | 0x02 | 0x01,
+   FGRAY = 0x08,
+   FBLUE = 0x08 | 0x01,
+   FGREEN = 0x08 | 0x02,
+   FCYAN = 0x08 | 0x02 | 0x01,
+   FRED = 0x08 | 0x04,
+   FMAGENTA = 0x08 | 0x04 | 0x01,
+   FYELLOW = 0x08 | 0x04 | 0x02,
+   FWHITE = 0x08 | 0x04 | 0x02 | 0x01,
 } ColorForeground;
 
 typedef enum ColorBackground
 {
    BBLACK = 0,
-   BDARKBLUE = BACKGROUND_BLUE,
-   BDARKGREEN = BACKGROUND_GREEN,
-   BDARKCYAN = BACKGROUND_GREEN | BACKGROUND_BLUE,
-   BDARKRED = BACKGROUND_RED,
-   BDARKMAGENTA = BACKGROUND_RED | BACKGROUND_BLUE,
-   BDARKYELLOW = BACKGROUND_RED | BACKGROUND_GREEN,
-   BDARKGRAY = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE,
-   BGRAY = BACKGROUND_INTENSITY,
-   BBLUE = BACKGROUND_INTENSITY | BACKGROUND_BLUE,
-   BGREEN = BACKGROUND_INTENSITY | BACKGROUND_GREEN,
-   BCYAN = BACKGROUND_INTENSITY | BACKGROUND_GREEN | BACKGROUND_BLUE,
-   BRED = BACKGROUND_INTENSITY | BACKGROUND_RED,
-   BMAGENTA = BACKGROUND_INTENSITY | BACKGROUND_RED | BACKGROUND_BLUE,
-   BYELLOW = BACKGROUND_INTENSITY | BACKGROUND_RED | BACKGROUND_GREEN,
-   BWHITE = BACKGROUND_INTENSITY | BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE,
+   BDARKBLUE = 0x10,
+   BDARKGREEN = 0x20,
+   BDARKCYAN = 0x20 | 0x10,
+   BDARKRED = 0x40,
+   BDARKMAGENTA = 0x40 | 0x10,
+   BDARKYELLOW = 0x40 | 0x20,
+   BDARKGRAY = 0x40 | 0x20 | 0x10,
+   BGRAY = 0x80,
+   BBLUE = 0x80 | 0x10,
+   BGREEN = 0x80 | 0x20,
+   BCYAN = 0x80 | 0x20 | 0x10,
+   BRED = 0x80 | 0x40,
+   BMAGENTA = 0x80 | 0x40 | 0x10,
+   BYELLOW = 0x80 | 0x40 | 0x20,
+   BWHITE = 0x80 | 0x40 | 0x20 | 0x10,
 } ColorBackground;
 
+#ifdef _WIN32
 typedef struct OriginalVals
 {
    WORD originalAttributes;            // From csbi.wAttributes
@@ -53,21 +69,233 @@ typedef struct OriginalVals
    DWORD originalMode;                 // From GetConsoleMode()
    CONSOLE_CURSOR_INFO originalCursor; // From GetConsoleCursorInfo()
 } OriginalVals;
+#else
+typedef struct OriginalVals
+{
+   uint16_t originalAttributes;        // Colors the framebuffer starts with
+   struct termios originalTermios;     // From tcgetattr()
+   bool isTerminal;                    // False when the handle is not a tty, nothing to restore
+} OriginalVals;
+#endif
+
+// Style of no cell, sinks start from it when they do not know the terminal's colors
+#define TCON_STYLE_UNKNOWN 0xFFFFFFFFu
+
+// A wide char takes two cells, the one right of it holds this in place of a char. Sinks draw a
+// wide char without its tail, or a tail without its wide char, as a blank
+#define TCON_WIDE_TAIL 0xFFFFFFFFu
+
+// Styles below this are the console colors fg | bg, see TCON_CONSOLE_STYLE. Styles from
+// internStyle() start here
+#define TCON_STYLE_INTERNED 256
+#define TCON_CONSOLE_STYLE(fg, bg) ((uint32_t)(fg) | (uint32_t)(bg))
+
+// Attributes of a TconStyle
+#define TCON_BOLD 0x01
+#define TCON_UNDERLINE 0x02
+#define TCON_REVERSE 0x04
+
+// Colors of a TconStyle. The kind is in the top byte: one of the 16 console colors (a
+// ColorForeground value, or a ColorBackground shifted right by 4), an index into the
+// 256 color palette or a 24 bit RGB value
+#define TCON_COLOR_CONSOLE 0
+#define TCON_COLOR_PALETTE 1
+#define TCON_COLOR_RGB 2
+#define TCON_COLOR_KIND(color) ((color) >> 24)
+#define TCON_PALETTE(index) ((uint32_t)TCON_COLOR_PALETTE << 24 | ((uint32_t)(index) & 0xFF))
+#define TCON_RGB(r, g, b) ((uint32_t)TCON_COLOR_RGB << 24 | ((uint32_t)(r) & 0xFF) << 16 | ((uint32_t)(g) & 0xFF) << 8 | ((uint32_t)(b) & 0xFF))
+
+typedef struct TconStyle
+{
+   uint32_t foreground; // See TCON_COLOR_KIND
+   uint32_t background;
+   uint32_t attributes; // TCON_BOLD, TCON_UNDERLINE and TCON_REVERSE
+} TconStyle;
+
+/*
+Styles interned by a console. Cells keep a style index, so a cell stays 8 bytes whatever
+colors and attributes it is drawn with, and comparing two styles is comparing two indices.
+*/
+typedef struct TconStyleTable
+{
+   TconStyle *styles;  // Style index - TCON_STYLE_INTERNED
+   int32_t count;
+   int32_t capacity;
+   uint32_t *slots;    // Open addressing hash table of style indices, 0 marks a free slot
+   int32_t slotCapacity; // Power of two
+} TconStyleTable;
 
 typedef struct Cell
 {
-   wchar_t Char;
-   WORD Foreground;
-   WORD Background;
+   uint32_t Char;  // Codepoint, or TCON_WIDE_TAIL
+   uint32_t Style; // TCON_CONSOLE_STYLE colors or a style from internStyle()
 } Cell;
 
+// Framebuffer allocations start on this byte boundary and rows are padded to a multiple of
+// TCON_STRIDE_CELLS cells, so every row can be scanned as one linear span.
+#define TCON_CELL_ALIGN 64
+#define TCON_STRIDE_CELLS 8
+
+// Unchanged cells between two changed spans that still get merged into one run.
+// Re-sending a few cells is cheaper than starting a new run (cursor move / extra write call).
+#define TCON_RUN_MERGE_GAP 4
+
+// Frames whose dirty rows cover fewer cells are encoded on one thread, see setConsoleRenderThreads()
+#define TCON_PARALLEL_MIN_CELLS 16384
+// Fewest rows encoded by one band, and bands per render thread to even out unevenly dirty rows
+#define TCON_BAND_MIN_ROWS 8
+#define TCON_BANDS_PER_THREAD 2
+
+// Fewest rows that have to move by the same amount before a frame scrolls them on the terminal
+// instead of sending them again, see TconSink.scroll
+#define TCON_SCROLL_MIN_ROWS 2
+// Front rows with the content of a changed row it is checked against, repeated content only counts this often
+#define TCON_SCROLL_CANDIDATES 4
+
+typedef struct TconSink TconSink;
+
+/*
+Receives the changed runs of a frame from renderConsole. A run is a horizontal span of
+cells in a single row. Implementations encode the cells for their target and add the
+bytes they emit to frameBytes. beginFrame and endFrame may be NULL.
+
+Sinks that set createBand let large frames be encoded in row bands on several threads. Each
+band is a sink of its own that encodes into memory and starts every frame without knowing the
+cursor. joinBand appends the frame of a band to the sink, in row order, before its endFrame
+flushes everything at once. Bands are released with their own freeBand.
+
+Sinks that set scroll let the renderer move blocks of rows that shifted since the last frame,
+e.g. a table that scrolled by a line, on the terminal itself. scroll is called after beginFrame
+and before any run. It moves the rows of the region [top, top + rows) up by count rows, or
+down for a negative count. The rows it exposes are sent again as runs, whatever it left there.
+*/
+struct TconSink
+{
+   void (*beginFrame)(TconSink *sink, int32_t rows, int32_t cols);
+   void (*writeRun)(TconSink *sink, int32_t row, int32_t col, const Cell *cells, int32_t len);
+   void (*scroll)(TconSink *sink, int32_t top, int32_t rows, int32_t count);
+   void (*endFrame)(TconSink *sink);
+   TconSink *(*createBand)(TconSink *sink);
+   void (*joinBand)(TconSink *sink, TconSink *band);
+   void (*freeBand)(TconSink *band);
+   void *userData;
+   const TconStyleTable *styles; // Styles of the console that renders to the sink, set before each frame
+   uint64_t frameBytes; // Bytes emitted by the last frame, added to by writeRun/endFrame
+   uint64_t totalBytes; // Bytes emitted since the sink was attached, kept by renderConsole
+};
+
+/*
+Encodes runs as VT/ANSI escape sequences into one byte buffer that is reused between frames.
+The whole frame is flushed with a single write() in endFrame. With fd set to -1 the bytes
+of the last frame stay in buf instead.
+*/
+typedef struct AnsiSink
+{
+   TconSink sink;
+   int fd;
+   char *buf;
+   size_t len;
+   size_t cap;
+   int32_t cols;
+   int32_t cursorRow;  // Terminal cursor after the last run, -1 when unknown
+   int32_t cursorCol;
+   uint32_t style;      // Last style sent with SGR, TCON_STYLE_UNKNOWN when unknown
+   uint32_t attributes; // TconStyle attributes the terminal has turned on
+} AnsiSink;
+
+#ifdef _WIN32
+typedef struct ConsoleSink
+{
+   TconSink sink;
+   HANDLE hConsole;
+   CHAR_INFO *staging; // Reused between frames, grows to the widest run
+   int32_t stagingSize;
+   int32_t cols;       // Width of the frame, scrolled regions span it
+} ConsoleSink;
+#else
+typedef AnsiSink ConsoleSink;
+#endif
+
+typedef struct MemorySink
+{
+   TconSink sink;
+   uint64_t frames;     // Frames presented
+   uint64_t frameCells; // Cells received in the last frame
+   uint64_t frameRuns;  // Runs received in the last frame
+   uint64_t totalCells;
+   uint64_t totalRuns;
+} MemorySink;
+
+// Rows of a frame encoded into one band sink
+typedef struct TconBand
+{
+   TconSink *sink;
+   int32_t firstRow;
+   int32_t rows;
+   int32_t frameCells; // Cells that changed in the band
+   int32_t frameRuns;
+   int32_t frameWritten;
+} TconBand;
+
+/*
+Mutable render state of a console. Console is passed around by value, so everything that
+has to survive a renderConsole call lives behind this pointer.
+*/
+typedef struct ConsoleState
+{
+   Cell *frontbuffer;  // What the sink currently shows, same stride as the framebuffer
+   int32_t bufferRows; // Size of the framebuffer contents, see resizeConsole()
+   int32_t bufferCols;
+   Cell *framebuffer;  // Same as Console.framebuffer, which may be a stale copy after a resize
+   int32_t stride;
+   int32_t capacityRows; // Rows allocated for framebuffer and frontbuffer, never less than bufferRows
+   uint32_t resizes;   // Count of resizes, see resizeConsole()
+   int32_t keptRows;   // Part of the framebuffer the last resize kept, the rest is blank
+   int32_t keptCols;
+   TconSink *sink;     // Custom sink, NULL to write to the console handle
+   ConsoleSink consoleSink;
+   bool fullRepaint;   // Front buffer is unknown, send every cell on the next frame
+   bool headless;      // Not attached to a terminal, see initHeadlessConsole()
+   int32_t frameCells; // Cells that changed in the last frame
+   int32_t frameRuns;  // Runs sent in the last frame
+   int32_t frameWritten; // Cells those runs held, unchanged cells between merged changes included
+   uint64_t frameNs;   // Time renderConsole spent on the last frame
+   uint64_t frames;    // Frames rendered
+   int32_t frameDepth; // Open beginConsoleFrame calls
+   bool autoFlush;     // Present when the outermost transaction commits
+   bool framePending;  // A render was requested but not presented yet
+   uint64_t coalescedFrames; // Render requests merged into a later frame
+   uint64_t frameIntervalNs; // Minimum time between two presented frames, 0 for no pacing
+   uint64_t lastPresentNs; // tconNowNs() when the last frame was presented
+   uint64_t droppedFrames; // Paced render requests whose state was replaced before it was shown
+   struct WorkerPool *pool; // Encodes large frames in bands, NULL to encode on the rendering thread
+   TconBand *bands;
+   int32_t bandCount;
+   TconSink *bandParent;    // Sink the bands were created by
+   uint64_t bandedFrames;   // Frames encoded in bands
+   TconStyleTable styles;   // See internStyle()
+   TconStyleTable *styleTable; // Table Cell.Style refers to, styles or those of the console a surface is composited onto
+   uint64_t *rowHashes;     // Scratch of the scroll detection, hashes of the changed front rows
+   int32_t *hashSlots;      // Open addressing table of front rows by hash
+   int32_t *sameHash;       // Next front row with the same hash, -1 after the last
+   int32_t *scrollVotes;    // Rows that moved by each distance
+   int32_t scrollCapacity;  // Rows the scratch has room for
+   uint64_t scrolls;        // Frames that moved rows with TconSink.scroll
+   uint64_t scrolledRows;   // Rows those frames moved instead of sending them again
+#ifdef TCON_STATS
+   TconStats stats;         // See getConsoleStats()
+#endif
+} ConsoleState;
+
 typedef struct Console
 {
    int32_t rows;
    int32_t cols;
    bool cursorVisible;
-   Cell **framebuffer;
+   int32_t stride;     // Cells between the starts of two framebuffer rows
+   Cell *framebuffer;  // One contiguous allocation of capacityRows * stride cells
    OriginalVals original;
+   ConsoleState *state;
 } Console;
 
 /*
@@ -75,7 +303,7 @@ Sets the cursor to visible
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
 
 Returns:
    Void
@@ -87,7 +315,7 @@ Sets the cursor to hidden
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
 
 Returns:
    Void
@@ -99,7 +327,7 @@ Resets the cursor to its original values
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
 
 Returns:
    Void
@@ -118,68 +346,119 @@ Returns:
 void disableScroll();
 
 /*
-Casts the 2d framebuffer into a 1d CHAR_INFO array
+Clears the console screen by filling the console buffer with empty spaces and
+resizing the console buffer to remove the scrollable area.
 
 Arguments:
+   hConsole - the console handle, see tconGetStdHandle()
    console - the current instance of the console
+   hlt - a flag which when flagged makes the program wait for user input on rerender
 
 Returns:
-   A 1d CHAR_INFO array
+   Void
 */
-CHAR_INFO *framebufferToLinearBuffer(Console con);
+void clearScreen(HANDLE hConsole, Console *con, bool hlt);
 
 /*
-Writes a CHAR_INFO array to the console buffer.
+Gets the current width and height of the console screen buffer and
+updates the fields "rows" and "cols" in the con parameter. The framebuffer
+is resized to match, see resizeConsole().
 
 Arguments:
-    hConsole - the windows console api handler
-    charInfo - a 1d array of type CHAR_INFO containing the data to print
-    console - the current instance of the console
+   con - the current instance of the console in form of a pointer
+   hConsole - the console handle, see tconGetStdHandle()
 
 Returns:
    Void
 */
-void printScreen(HANDLE hConsole, CHAR_INFO *charInfo, Console con);
+void getWindowSize(Console *con, HANDLE hConsole);
 
 /*
-Clears the console screen by filling the console buffer with empty spaces and
-resizing the console buffer to remove the scrollable area.
+Initializes the console by creating a new instance of Console, getting and storing
+all needed default values for reseting, and creates and populates all cells in the
+framebuffer.
 
 Arguments:
-   hConsole - the windows console api handler
-   console - the current instance of the console
-   hlt - a flag which when flagged makes the program wait for user input on rerender
+   hConsole - the console handle, see tconGetStdHandle()
+
+Returns:
+   Console
+*/
+Console initConsole(HANDLE hConsole);
+
+/*
+Changes the size of the framebuffer. Content in the part both sizes share is kept, cells that
+become visible are blank. Shrinking and growing back within the largest size so far works in
+place, growing past it moves the framebuffer, so copies of con made before are stale. Tables
+follow the move, their layout is updated with reflowTable(). Consoles attached to a terminal
+are sent in full with the next frame, as the terminal may have rearranged the screen.
+
+Arguments:
+   con - the current instance of the console
+   rows - the new amount of rows
+   cols - the new amount of columns
 
 Returns:
    Void
 */
-void clearScreen(HANDLE hConsole, Console *con, bool hlt);
+void resizeConsole(Console *con, int32_t rows, int32_t cols);
 
 /*
-Gets the current width and height of the console screen buffer and
-updates the fields "rows" and "cols" in the con parameter.
+Returns a pointer to a cell in the framebuffer.
 
 Arguments:
-   con - the current instance of the console in form of a pointer
-   hConsole - the windows console api handler
+   con - the current instance of the console
+   row - the row of the cell in the framebuffer
+   col - the column of the cell in the framebuffer
+
+Returns:
+   Pointer to the cell, cells of the same row follow it directly
+*/
+static inline Cell *getCell(Console *con, int32_t row, int32_t col)
+{
+   return &con->framebuffer[row * con->stride + col];
+}
+
+/*
+Fills every cell of the framebuffer with the same char and colors in a single pass.
+
+Arguments:
+   con - the current instance of the console
+   Fcolor - the foreground color for the cells
+   Bcolor - the background color for the cells
+   Char - the codepoint that gets set to the cells, not a wide one
 
 Returns:
    Void
 */
-void getWindowSize(Console *con, HANDLE hConsole);
+void fillFramebuffer(Console *con, ColorForeground Fcolor, ColorBackground Bcolor, uint32_t Char);
 
 /*
-Initializes the console by creating a new instance of Console, getting and storing
-all needed default values for reseting, and creates and populates all cells in the
-framebuffer.
+Creates a console that is not attached to any terminal. Frames go only to the given sink,
+getWindowSize keeps the size it was created with and hlt flags are ignored. Useful to
+drive consoles and tables in tests, benchmarks and on machines without a tty.
 
 Arguments:
-   hConsole - the windows console api handler
+   rows - the amount of rows of the console
+   cols - the amount of columns of the console
+   sink - the sink that receives all frames, e.g. a HeadlessSink (see headless.h)
 
 Returns:
    Console
 */
-Console initConsole(HANDLE hConsole);
+Console initHeadlessConsole(int32_t rows, int32_t cols, TconSink *sink);
+
+/*
+Releases the framebuffer and render state of a console. Tables laid out on it have to be
+removed first, the terminal is left as it is, see resetConsole().
+
+Arguments:
+   con - the console to release
+
+Returns:
+   Void
+*/
+void freeConsole(Console *con);
 
 /*
 Sets foreground color, background color, and char of a given cell in the framebuffer.
@@ -190,19 +469,73 @@ Arguments:
    col - the column of the cell in the framebuffer
    Fcolor - the foreground color for the cell
    Bcolor - the background color for the cell
-   Char - the char that gets set to the cell
+   Char - the codepoint that gets set to the cell, a wide one needs TCON_WIDE_TAIL in the next cell
 
 Returns:
    Void
 */
-void setCellData(Console *con, int32_t row, int32_t col, ColorForeground Fcolor, ColorBackground Bcolor, wchar_t Char);
+void setCellData(Console *con, int32_t row, int32_t col, ColorForeground Fcolor, ColorBackground Bcolor, uint32_t Char);
+
+/*
+Sets the style and char of a given cell in the framebuffer.
+
+Arguments:
+   con - the current instance of the console
+   row - the row of the cell in the framebuffer
+   col - the column of the cell in the framebuffer
+   style - a style from internStyle() or TCON_CONSOLE_STYLE
+   Char - the codepoint that gets set to the cell, a wide one needs TCON_WIDE_TAIL in the next cell
+
+Returns:
+   Void
+*/
+void setCellStyle(Console *con, int32_t row, int32_t col, uint32_t style, uint32_t Char);
+
+/*
+Gives the index of a style, adding it to the styles of the console the first time it is
+used. Styles of console colors without attributes are TCON_CONSOLE_STYLE and never added.
+Not thread safe, intern styles on the thread that renders or before starting a render thread.
+
+Arguments:
+   con - the current instance of the console
+   style - the colors and attributes
+
+Returns:
+   The style index for Cell.Style
+*/
+uint32_t internStyle(Console *con, const TconStyle *style);
+
+/*
+Looks up the colors and attributes of a style index.
+
+Arguments:
+   table - the styles of the console, see TconSink.styles, may be NULL
+   style - the style index
+
+Returns:
+   The style, white on black for indices the table does not know
+*/
+TconStyle getStyle(const TconStyleTable *table, uint32_t style);
+
+/*
+Finds the console colors closest to the colors of a style, for targets that only show the
+16 console colors.
+
+Arguments:
+   style - the style
+
+Returns:
+   TCON_CONSOLE_STYLE of the closest colors, bold brightens the foreground and reverse swaps
+   foreground and background
+*/
+uint32_t getStyleConsoleColors(const TconStyle *style);
 
 /*
 Resets all console values to pre execution state
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
 
 Returns:
    Void
@@ -210,12 +543,12 @@ Returns:
 void resetConsole(Console *con, HANDLE hConsole);
 
 /*
-Turns the current framebuffer into a linear buffer and prints it to the screen.
-If the hlt flag is true it also waits for user input
+Compares the framebuffer against what is currently on screen and sends only the changed
+runs to the console's sink. If the hlt flag is true it also waits for user input
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
    hltf - a flag which when flagged makes the program wait for user input
 
 Returns:
@@ -223,13 +556,241 @@ Returns:
 */
 void renderConsole(Console con, HANDLE hConsole, bool hltf);
 
+/*
+Opens a frame transaction. Until the matching commitConsoleFrame, renderConsole calls (and
+with them print, clearScreen and the table functions) only mark the frame as changed, and
+all writes are presented together once. Transactions can be nested. A call with the hlt
+flag set still presents right away, so the user sees what they are waiting on.
+
+Arguments:
+   con - the current instance of the console
+
+Returns:
+   Void
+*/
+void beginConsoleFrame(Console *con);
+
+/*
+Closes a frame transaction. Closing the outermost one presents the frame if anything was
+rendered inside it and auto flush is enabled.
+
+Arguments:
+   con - the current instance of the console
+   hConsole - the console handle, see tconGetStdHandle()
+
+Returns:
+   Void
+*/
+void commitConsoleFrame(Console *con, HANDLE hConsole);
+
+/*
+Enables or disables auto flush. Without auto flush renderConsole never presents on its own
+(except for hlt) and frames are only presented by flushConsole. Enabled by default.
+
+Arguments:
+   con - the current instance of the console
+   autoFlush - false to present only on flushConsole
+
+Returns:
+   Void
+*/
+void setConsoleAutoFlush(Console *con, bool autoFlush);
+
+/*
+Presents the pending frame, if any, even inside a transaction.
+
+Arguments:
+   con - the current instance of the console
+   hConsole - the console handle, see tconGetStdHandle()
+
+Returns:
+   Void
+*/
+void flushConsole(Console *con, HANDLE hConsole);
+
+/*
+Limits how often frames are presented. renderConsole then presents right away only if the
+last frame is at least 1/fps seconds old, otherwise it marks the frame pending and returns.
+Intermediate states a fast producer renders in between are never shown and are counted in
+droppedFrames. Pending frames are presented by pollConsoleFrame once they are due, or at
+once by flushConsole or a render with hlt set.
+
+Arguments:
+   con - the current instance of the console
+   fps - the maximum frames per second, 0 to present on every render
+
+Returns:
+   Void
+*/
+void setConsoleTargetFps(Console *con, int32_t fps);
+
+/*
+Presents the pending frame once it is due under the target frame rate. Call it regularly, e.g.
+from the application's main loop, when frames are paced.
+
+Arguments:
+   con - the current instance of the console
+   hConsole - the console handle, see tconGetStdHandle()
+
+Returns:
+   Nanoseconds until the pending frame is due, 0 if it was presented, -1 if there is nothing
+   to present, including frames held back by a transaction or disabled auto flush
+*/
+int64_t pollConsoleFrame(Console *con, HANDLE hConsole);
+
+/*
+Routes all following frames of a console into a custom sink instead of the console handle.
+The next frame is sent in full.
+
+Arguments:
+   con - the current instance of the console
+   sink - the sink to write to, NULL to write to the console handle again
+
+Returns:
+   Void
+*/
+void setConsoleSink(Console *con, TconSink *sink);
+
+/*
+Encodes the changed rows of large frames in bands on several threads. The bands are joined
+in row order and flushed with one write, as before. Only sinks that support bands, like the
+ansi sink, are encoded in parallel, frames with fewer than TCON_PARALLEL_MIN_CELLS changed
+cells always stay on the rendering thread.
+
+Arguments:
+   con - the current instance of the console
+   threads - the threads encoding a frame, including the rendering thread. 1 or less to encode
+             every frame on the rendering thread
+
+Returns:
+   Void
+*/
+void setConsoleRenderThreads(Console *con, int32_t threads);
+
+/*
+Forces the next renderConsole call to send every cell, e.g. after something else
+wrote to the terminal.
+
+Arguments:
+   con - the current instance of the console
+
+Returns:
+   Void
+*/
+void invalidateConsole(Console *con);
+
+/*
+Copies the frame statistics of a console, e.g. to draw a debug overlay. Only available when
+tcon is built with TCON_STATS, see stats.h.
+
+Arguments:
+   con - the current instance of the console
+   stats - receives the statistics, zeroed when they are compiled out
+
+Returns:
+   False if tcon was built without TCON_STATS
+*/
+bool getConsoleStats(const Console *con, TconStats *stats);
+
+/*
+Returns a percentile of the latency of the last TCON_STATS_HISTORY frames, measured from the
+start of the transaction that drew a frame to the end of its flush.
+
+Arguments:
+   con - the current instance of the console
+   percentile - 0 to 100, e.g. 50 for the median or 99
+
+Returns:
+   The latency in nanoseconds, 0 without frames or without TCON_STATS
+*/
+uint64_t consoleFrameLatency(const Console *con, int32_t percentile);
+
+/*
+Clears the frame statistics of a console, the totals start over.
+
+Arguments:
+   con - the current instance of the console
+
+Returns:
+   Void
+*/
+void resetConsoleStats(Console *con);
+
+/*
+Initializes a sink that encodes frames as VT/ANSI escape sequences.
+
+Arguments:
+   sink - the ansi sink to initialize
+   fd - the file descriptor to write each frame to, -1 to keep the frame in sink->buf
+
+Returns:
+   Void
+*/
+void initAnsiSink(AnsiSink *sink, int fd);
+
+/*
+Releases the encode buffer of an ansi sink.
+
+Arguments:
+   sink - the ansi sink to release
+
+Returns:
+   Void
+*/
+void freeAnsiSink(AnsiSink *sink);
+
+/*
+Returns the handle of the process' standard output, the handle to pass to initConsole.
+
+Arguments:
+   Void
+
+Returns:
+   HANDLE
+*/
+HANDLE tconGetStdHandle(void);
+
+/*
+Returns the handle of the process' standard input, the handle to pass to createEventLoop.
+
+Arguments:
+   Void
+
+Returns:
+   HANDLE
+*/
+HANDLE tconGetStdInputHandle(void);
+
+/*
+Returns a monotonic timestamp in nanoseconds, only useful for measuring intervals.
+
+Arguments:
+   Void
+
+Returns:
+   Nanoseconds since an unspecified point in time
+*/
+uint64_t tconNowNs(void);
+
+/*
+Initializes a sink that keeps the frames in memory and only counts what it receives.
+Every cell is accounted as sizeof(Cell) bytes.
+
+Arguments:
+   sink - the memory sink to initialize
+
+Returns:
+   Void
+*/
+void initMemorySink(MemorySink *sink);
+
 /*
 Turns the current framebuffer into a linear buffer and prints it to the screen.
 If the hlt flag is true it also waits for user input
 
 Arguments:
    console - the current instance of the console
-   hConsole - the windows console api handler
+   hConsole - the console handle, see tconGetStdHandle()
    row - the row in framebuffer in which the input should be
    col - the specific column in the framebuffer in which the input should be
    buffer - the input buffer in which the user input gets written
@@ -255,6 +816,69 @@ Returns:
 */
 void hlt();
 
+/*
+Writes a UTF-8 string into the framebuffer, clipped at the console edge, and renders.
+
+Arguments:
+   con - the current instance of the console
+   hConsole - the console handle, see tconGetStdHandle()
+   row - the row of the first char
+   col - the column of the first char
+   buffer - the null-terminated string to write
+   fgColor - the foreground color of the text
+   bgColor - the background color of the text
+   hlt - a flag which when flagged makes the program wait for user input
+
+Returns:
+   Void
+*/
 void print(Console con, HANDLE hConsole, int32_t row, int32_t col, char *buffer, ColorForeground fgColor, ColorBackground bgColor, bool hlt);
 
+/*
+Formats text like printf() straight into the framebuffer cells of a row, without heap
+allocations and without rendering. Supports the flags - 0 + and space, width and precision
+(also as *), the length modifiers hh h l ll z j t and the conversions d i u x X p c s f %.
+Strings are UTF-8, %c takes a codepoint. Widths and precisions count columns: wide chars take
+two cells and combining marks none, as a cell shows a single codepoint. Four extra conversions
+switch colors inline: %F takes a ColorForeground, %B a ColorBackground, %S a style from
+internStyle() and %R goes back to fgColor/bgColor.
+Cells left of column 0, right of the console or past maxWidth are clipped.
+
+Arguments:
+   con - the current instance of the console
+   row - the row to write to
+   col - the column of the first char, may be negative
+   maxWidth - the amount of columns the text may take, 0 for up to the console edge
+   fgColor - the foreground color of the text
+   bgColor - the background color of the text
+   format - the format string
+
+Returns:
+   The amount of cells written
+*/
+int32_t writeFormat(Console *con, int32_t row, int32_t col, int32_t maxWidth, ColorForeground fgColor, ColorBackground bgColor, const char *format, ...);
+
+/*
+Same as writeFormat, with the arguments as a va_list.
+*/
+int32_t vwriteFormat(Console *con, int32_t row, int32_t col, int32_t maxWidth, ColorForeground fgColor, ColorBackground bgColor, const char *format, va_list args);
+
+/*
+Formats text like writeFormat and renders the console.
+
+Arguments:
+   con - the current instance of the console
+   hConsole - the console handle, see tconGetStdHandle()
+   row - the row to write to
+   col - the column of the first char
+   fgColor - the foreground color of the text
+   bgColor - the background color of the text
+   hlt - a flag which when flagged makes the program wait for user input
+   format - the format string, see writeFormat
+
+Returns:
+   Void
+*/
+void printFormat(Console con, HANDLE hConsole, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor, bool hlt, const char *format, ...);
+
 #endif
\ No newline at end of file
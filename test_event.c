@@ -0,0 +1,216 @@
+// Checks the event loop against a pseudo terminal pair: the loop reads the slave side like it
+// would read a terminal, the test types into the master side. Exits with a failure status when
+// any check fails, so CI can run it as is. POSIX only.
+//
+// Build:  cc -O2 -pthread -o tconeventtest test_event.c tcon.c style.c surface.c record.c table.c search.c ansi.c utf8.c headless.c format.c arena.c update.c pool.c event.c stats.c backend_posix.c -lm -lutil
+// Run:    ./tconeventtest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "event.h"
+
+#ifdef _WIN32
+int main(void)
+{
+    printf("pty checks need a POSIX system, skipped\n");
+    return EXIT_SUCCESS;
+}
+#else
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+// Longest a check waits for an event that should come right away
+#define TEST_EVENT_TIMEOUT_NS 1000000000ull
+
+static int32_t failures;
+
+static void check(bool ok, const char *name, const char *detail)
+{
+    if (ok)
+        return;
+
+    fprintf(stderr, "FAIL %s: %s\n", name, detail);
+    failures++;
+}
+
+static void type(int master, const char *bytes)
+{
+    size_t len = strlen(bytes);
+    if (write(master, bytes, len) != (ssize_t)len)
+        perror("write");
+}
+
+static void waitNs(uint64_t ns)
+{
+    uint64_t until = tconNowNs() + ns;
+    while (tconNowNs() < until)
+        usleep(1000);
+}
+
+// Polls until an event arrives or TEST_EVENT_TIMEOUT_NS passed
+static bool nextEvent(EventLoop *loop, Event *event)
+{
+    uint64_t deadline = tconNowNs() + TEST_EVENT_TIMEOUT_NS;
+    uint64_t now = tconNowNs();
+
+    while (now < deadline)
+    {
+        if (pollEvent(loop, event, (int64_t)(deadline - now)))
+            return true;
+        now = tconNowNs();
+    }
+
+    return false;
+}
+
+static bool isKey(const Event *event, KeyCode code, uint32_t ch)
+{
+    return event->type == EVENT_KEY && event->key.code == code && event->key.ch == ch;
+}
+
+// Escape and UTF-8 sequences split over several writes come out as one key each
+static void testSplitSequences(EventLoop *loop, int master)
+{
+    Event event;
+
+    type(master, "\x1b[");
+    waitNs(5000000);
+    type(master, "A");
+    check(nextEvent(loop, &event) && isKey(&event, KEY_UP, 0), "split escape sequence", "no KEY_UP");
+
+    type(master, "\x1b[1;");
+    waitNs(5000000);
+    type(master, "5C");
+    check(nextEvent(loop, &event) && isKey(&event, KEY_RIGHT, 0) && event.key.mods == KEYMOD_CTRL, "split modified key", "no ctrl KEY_RIGHT");
+
+    type(master, "\xe4\xb8");
+    waitNs(5000000);
+    type(master, "\xad");
+    check(nextEvent(loop, &event) && isKey(&event, KEY_CHAR, 0x4E2D), "split UTF-8 char", "no KEY_CHAR U+4E2D");
+
+    type(master, "ab");
+    bool first = nextEvent(loop, &event) && isKey(&event, KEY_CHAR, 'a');
+    bool second = nextEvent(loop, &event) && isKey(&event, KEY_CHAR, 'b');
+    check(first && second, "two chars in one read", "not a then b");
+}
+
+// A lone escape byte is the Escape key, but only once the rest of a sequence would have arrived
+static void testEscapeTimeout(EventLoop *loop, int master)
+{
+    Event event;
+
+    uint64_t start = tconNowNs();
+    type(master, "\x1b");
+    bool early = pollEvent(loop, &event, 5000000);
+    check(!early, "escape timeout", "Escape reported before the delay");
+
+    bool late = nextEvent(loop, &event) && isKey(&event, KEY_ESCAPE, 0);
+    uint64_t elapsed = tconNowNs() - start;
+    check(late && elapsed >= EVENT_ESCAPE_DELAY_NS, "escape timeout", "no KEY_ESCAPE after the delay");
+
+    // Alt is an escape byte followed by the key within the delay
+    type(master, "\x1bx");
+    check(nextEvent(loop, &event) && isKey(&event, KEY_CHAR, 'x') && event.key.mods == KEYMOD_ALT, "alt key", "no alt x");
+}
+
+static void testResize(EventLoop *loop, int master)
+{
+    Event event;
+
+    struct winsize size;
+    memset(&size, 0, sizeof(size));
+    size.ws_row = 31;
+    size.ws_col = 97;
+    ioctl(master, TIOCSWINSZ, &size);
+
+    // The pty is not the controlling terminal of the test, so the signal is sent by hand
+    kill(getpid(), SIGWINCH);
+
+    bool resized = nextEvent(loop, &event) && event.type == EVENT_RESIZE;
+    check(resized && event.rows == 31 && event.cols == 97, "resize", "no EVENT_RESIZE to 97x31");
+
+    // A signal without a new size is not reported
+    kill(getpid(), SIGWINCH);
+    check(!pollEvent(loop, &event, 20000000), "repeated resize", "same size reported again");
+}
+
+static void testUserHandle(EventLoop *loop)
+{
+    Event event;
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        check(false, "user handle", "no pipe");
+        return;
+    }
+
+    static int marker;
+    HANDLE handle = (HANDLE)(intptr_t)fds[0];
+    watchEventHandle(loop, handle, EVENT_READABLE, &marker);
+
+    check(!pollEvent(loop, &event, 10000000), "idle user handle", "reported before it was readable");
+
+    if (write(fds[1], "x", 1) != 1)
+        perror("write");
+
+    bool ready = nextEvent(loop, &event) && event.type == EVENT_HANDLE;
+    check(ready && event.handle == handle && (event.ready & EVENT_READABLE) && event.userData == &marker, "user handle", "no EVENT_HANDLE for the pipe");
+
+    char byte;
+    if (read(fds[0], &byte, 1) != 1)
+        perror("read");
+
+    unwatchEventHandle(loop, handle);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(void)
+{
+    int master = -1;
+    int slave = -1;
+    struct winsize size = {24, 80, 0, 0};
+    if (openpty(&master, &slave, NULL, NULL, &size) != 0)
+    {
+        perror("openpty");
+        return EXIT_FAILURE;
+    }
+
+    // Raw mode, so typed bytes reach the loop as they are written
+    struct termios raw;
+    tcgetattr(slave, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(slave, TCSANOW, &raw);
+
+    HANDLE hSlave = (HANDLE)(intptr_t)slave;
+    EventLoop *loop = createEventLoop(NULL, hSlave, hSlave);
+
+    testSplitSequences(loop, master);
+    testEscapeTimeout(loop, master);
+    testResize(loop, master);
+    testUserHandle(loop);
+
+    freeEventLoop(loop);
+    close(slave);
+    close(master);
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%" PRId32 " checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,365 @@
+// Regression checks of what the renderer sends, run on headless consoles. Exits with a failure
+// status when any check fails, so CI can run it as is.
+//
+// Build:  cc -O2 -pthread -o tcontest test_headless.c tcon.c style.c surface.c record.c table.c search.c ansi.c utf8.c headless.c format.c arena.c update.c pool.c event.c stats.c backend_posix.c -lm
+// Run:    ./tcontest [--update] [golden directory]
+//
+// Table layouts and styled text are compared against the golden frames in golden/, run from the
+// repository root or pass the directory. --update stores the current frames as the new golden
+// frames, review their diff before committing them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "table.h"
+#include "headless.h"
+#include "record.h"
+
+static int32_t failures;
+
+static void check(bool ok, const char *name, const char *detail)
+{
+    if (ok)
+        return;
+
+    fprintf(stderr, "FAIL %s: %s\n", name, detail);
+    failures++;
+}
+
+// Bytes the ansi sink sent for the last frame, escapes made readable
+static void describeFrame(const AnsiSink *sink, char *out, size_t size)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < sink->len && len + 3 < size; i++)
+    {
+        if (sink->buf[i] == '\x1b')
+        {
+            out[len++] = '\\';
+            out[len++] = 'e';
+        }
+        else
+        {
+            out[len++] = sink->buf[i];
+        }
+    }
+    out[len] = '\0';
+}
+
+// Overwriting the head of a wide char with another wide char one column to the left leaves an
+// orphaned tail. Changing that tail must not send the tail of the intact char as a blank
+static void testWideCharRunStart(void)
+{
+    AnsiSink sink;
+    initAnsiSink(&sink, -1);
+    Console con = initHeadlessConsole(2, 10, &sink.sink);
+    char frame[256];
+
+    writeFormat(&con, 0, 2, 0, FWHITE, BBLACK, "中");
+    renderConsole(con, NULL, false);
+    writeFormat(&con, 0, 1, 0, FWHITE, BBLACK, "中");
+    renderConsole(con, NULL, false);
+    writeFormat(&con, 0, 3, 0, FWHITE, BBLACK, "y");
+    renderConsole(con, NULL, false);
+
+    describeFrame(&sink, frame, sizeof(frame));
+    check(strstr(frame, "\\e[1;2H") != NULL && strstr(frame, "中y") != NULL, "wide char run start", frame);
+
+    // The terminal got every change, nothing is left to send
+    renderConsole(con, NULL, false);
+    check(sink.len == 0, "wide char run start settled", "frame after the change was not empty");
+
+    freeConsole(&con);
+    freeAnsiSink(&sink);
+}
+
+// Compares %f formatted into cells against snprintf, which rounds the exact decimal value
+static int32_t floatMismatches(Console *con, const char *format, double value, char *detail, size_t size)
+{
+    char expected[64];
+    char actual[64];
+    snprintf(expected, sizeof(expected), format, value);
+
+    int32_t len = writeFormat(con, 0, 0, 60, FWHITE, BBLACK, format, value);
+    for (int32_t i = 0; i < len; i++)
+        actual[i] = (char)con->framebuffer[i].Char;
+    actual[len] = '\0';
+
+    if (strcmp(expected, actual) == 0)
+        return 0;
+
+    snprintf(detail, size, "%s of %.17g is %s, expected %s", format, value, actual, expected);
+    return 1;
+}
+
+static void testFloatRounding(void)
+{
+    MemorySink sink;
+    initMemorySink(&sink);
+    Console con = initHeadlessConsole(1, 64, &sink.sink);
+    char detail[256] = "";
+    int32_t mismatches = 0;
+
+    // Near halves of a rounded product, and digits beyond the precision of a double
+    mismatches += floatMismatches(&con, "%.1f", 2771.65, detail, sizeof(detail));
+    mismatches += floatMismatches(&con, "%.1f", 395.95, detail, sizeof(detail));
+    mismatches += floatMismatches(&con, "%.2f", 4294945.665, detail, sizeof(detail));
+    mismatches += floatMismatches(&con, "%.1f", 24544416368007660.0, detail, sizeof(detail));
+    mismatches += floatMismatches(&con, "%.0f", 2.5, detail, sizeof(detail));
+
+    for (int32_t i = 0; i < 200000; i++)
+    {
+        mismatches += floatMismatches(&con, "%.1f", i / 1000.0, detail, sizeof(detail));
+        mismatches += floatMismatches(&con, "%.2f", i / 1000.0, detail, sizeof(detail));
+    }
+
+    check(mismatches == 0, "float rounding", detail);
+    freeConsole(&con);
+}
+
+// Replays a recording of a single keyframe with the given payload
+static bool replayKeyframe(Console *con, const uint8_t *payload, uint32_t size)
+{
+    FILE *file = tmpfile();
+    if (!file)
+        return false;
+
+    uint8_t header[5] = {RECORD_KEYFRAME, size & 0xFF, (size >> 8) & 0xFF, (size >> 16) & 0xFF, size >> 24};
+    fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_SIZE, file);
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(payload, 1, size, file);
+    rewind(file);
+
+    Replay replay;
+    bool read = openReplay(&replay, file) && readReplayFrame(&replay, con);
+    bool corrupt = replay.corrupt;
+    closeReplay(&replay);
+    fclose(file);
+    return read && !corrupt;
+}
+
+// Keyframes whose size is out of range or not covered by their runs are corrupt records, the
+// console keeps its size instead of allocating one
+static void testCorruptKeyframe(void)
+{
+    MemorySink sink;
+    initMemorySink(&sink);
+    Console con = initHeadlessConsole(4, 8, &sink.sink);
+
+    // 46000 x 46000 cells and no runs
+    const uint8_t huge[] = {0, 0xB0, 0xE7, 0x02, 0xB0, 0xE7, 0x02};
+    check(!replayKeyframe(&con, huge, sizeof(huge)) && con.rows == 4 && con.cols == 8, "huge keyframe", "replayed or resized");
+
+    // 24 x 80 cells, a run of 5 blanks covers only part of them
+    const uint8_t partial[] = {0, 24, 80, 5, ' ', 0x0F};
+    check(!replayKeyframe(&con, partial, sizeof(partial)) && con.rows == 4 && con.cols == 8, "partial keyframe", "replayed or resized");
+
+    // 2 x 3 cells in one run
+    const uint8_t whole[] = {0, 2, 3, 6, 'x', 0x0F};
+    check(replayKeyframe(&con, whole, sizeof(whole)) && con.rows == 2 && con.cols == 3 && con.framebuffer[0].Char == 'x', "whole keyframe", "not replayed");
+
+    freeConsole(&con);
+}
+
+// Compares the rows a table shows against the expected rows, in order
+static void checkTableOrder(Table *table, const int32_t *expected, int32_t count, const char *name)
+{
+    char detail[128] = "shown";
+    size_t len = strlen(detail);
+    bool ok = getTableShownRows(table) == count;
+
+    for (int32_t p = 0; p < getTableShownRows(table) && len < sizeof(detail); p++)
+    {
+        int32_t row = getTableRowAt(table, p);
+        ok = ok && p < count && row == expected[p];
+        len += snprintf(detail + len, sizeof(detail) - len, " %" PRId32, row);
+    }
+
+    check(ok, name, detail);
+}
+
+// Rows sorted by a text column, then by a descending number column whose content is not always a
+// number. Content that is no number sorts last in either direction, equal rows keep their order
+static void testTableSort(void)
+{
+    MemorySink sink;
+    initMemorySink(&sink);
+    Console con = initHeadlessConsole(10, 40, &sink.sink);
+
+    static const char *values[6][2] = {{"a", "3"}, {"b", "n/a"}, {"a", "10"}, {"a", "n/a"}, {"b", "1"}, {"a", "3"}};
+    Table table = createTable(&con, 6, 2);
+    for (int32_t row = 0; row < 6; row++)
+    {
+        for (int32_t col = 0; col < 2; col++)
+            setCellValue(&table, (char *)values[row][col], row, col, FWHITE, BBLACK);
+    }
+
+    TableSortColumn columns[2] = {{0, SORT_TEXT, false}, {1, SORT_NUMBER, true}};
+    sortTable(&table, &con, columns, 2, NULL, false);
+    const int32_t sorted[] = {2, 0, 5, 3, 4, 1};
+    checkTableOrder(&table, sorted, 6, "descending number sort");
+
+    // Changed cells move their row to its new place
+    setCellValue(&table, "20", 3, 1, FWHITE, BBLACK);
+    const int32_t raised[] = {3, 2, 0, 5, 4, 1};
+    checkTableOrder(&table, raised, 6, "row becoming a number");
+
+    setCellValue(&table, "none", 2, 1, FWHITE, BBLACK);
+    const int32_t lowered[] = {3, 0, 5, 2, 4, 1};
+    checkTableOrder(&table, lowered, 6, "row becoming no number");
+
+    // Ascending, numbers still come first
+    columns[1].descending = false;
+    sortTable(&table, &con, columns, 2, NULL, false);
+    const int32_t ascending[] = {0, 5, 3, 2, 4, 1};
+    checkTableOrder(&table, ascending, 6, "ascending number sort");
+
+    removeTable(&table);
+    freeConsole(&con);
+}
+
+static const char *goldenDir = "golden";
+static bool updateGolden;
+
+// Compares the headless grid against golden/<name>.txt, or stores it there with --update
+static void checkGolden(HeadlessSink *sink, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.txt", goldenDir, name);
+
+    if (updateGolden)
+    {
+        check(saveGoldenFrame(sink, path), name, "can't write the golden frame");
+        return;
+    }
+
+    int32_t differences = compareGoldenFrame(sink, path, stderr);
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%" PRId32 " cells differ from %s.txt", differences, name);
+    check(differences == 0, name, detail);
+}
+
+typedef struct GoldenConsole
+{
+    HeadlessSink sink;
+    Console con;
+} GoldenConsole;
+
+static void openGoldenConsole(GoldenConsole *golden, int32_t rows, int32_t cols)
+{
+    initHeadlessSink(&golden->sink, rows, cols);
+    golden->con = initHeadlessConsole(rows, cols, &golden->sink.sink);
+}
+
+static void closeGoldenConsole(GoldenConsole *golden)
+{
+    freeConsole(&golden->con);
+    freeHeadlessSink(&golden->sink);
+}
+
+static void fillGoldenTable(Table *table, int32_t rows, int32_t cols)
+{
+    static const char *words[] = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"};
+
+    for (int32_t row = 0; row < rows; row++)
+    {
+        for (int32_t col = 0; col < cols; col++)
+        {
+            char value[32];
+            snprintf(value, sizeof(value), "%s %" PRId32, words[(row * 3 + col) % 8], row * cols + col);
+            setCellValue(table, value, row, col, row == 0 ? FYELLOW : FWHITE, col % 2 ? BDARKBLUE : BBLACK);
+        }
+    }
+}
+
+static void testGoldenTables(void)
+{
+    GoldenConsole golden;
+
+    openGoldenConsole(&golden, 12, 60);
+    Table table = createTable(&golden.con, 4, 3);
+    fillGoldenTable(&table, 4, 3);
+    reDrawTable(&table, &golden.con, NULL, false);
+    checkGolden(&golden.sink, "table_redraw");
+
+    // The new column takes its share of the width, existing cells keep their content
+    addTableCol(&table, &golden.con, NULL, false);
+    setCellValue(&table, "added", 1, 3, FGREEN, BBLACK);
+    reDrawTable(&table, &golden.con, NULL, false);
+    checkGolden(&golden.sink, "table_add_col");
+    removeTable(&table);
+    closeGoldenConsole(&golden);
+
+    // Wide chars are laid out by display width and cut with their tail
+    openGoldenConsole(&golden, 8, 40);
+    table = createTable(&golden.con, 3, 2);
+    setCellValue(&table, "中文字符测试中文字符测试", 0, 0, FWHITE, BBLACK);
+    setCellValue(&table, "한국어", 0, 1, FCYAN, BBLACK);
+    setCellValue(&table, "naïve café", 1, 0, FWHITE, BBLACK);
+    setCellValue(&table, "ascii", 2, 1, FRED, BBLACK);
+    reDrawTable(&table, &golden.con, NULL, false);
+    checkGolden(&golden.sink, "table_wide");
+    removeTable(&table);
+    closeGoldenConsole(&golden);
+}
+
+static void testGoldenStyles(void)
+{
+    GoldenConsole golden;
+    openGoldenConsole(&golden, 3, 24);
+
+    TconStyle bar = {TCON_RGB(0x10, 0x20, 0x30), TCON_RGB(0xE0, 0xD0, 0xC0), TCON_BOLD};
+    TconStyle accent = {TCON_PALETTE(208), TCON_COLOR_CONSOLE, TCON_UNDERLINE | TCON_REVERSE};
+    uint32_t barStyle = internStyle(&golden.con, &bar);
+    uint32_t accentStyle = internStyle(&golden.con, &accent);
+
+    const char *text = "status: ok";
+    for (int32_t col = 0; col < 24; col++)
+        setCellStyle(&golden.con, 0, col, barStyle, col < 10 ? (uint32_t)text[col] : ' ');
+    setCellStyle(&golden.con, 1, 2, accentStyle, '!');
+    renderConsole(golden.con, NULL, false);
+    checkGolden(&golden.sink, "styles");
+
+    // Only the RGB value changes, the closest console colors stay the same
+    if (!updateGolden)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/styles.txt", goldenDir);
+
+        TconStyle shifted = bar;
+        shifted.foreground = TCON_RGB(0x10, 0x20, 0x31);
+        setCellStyle(&golden.con, 0, 12, internStyle(&golden.con, &shifted), ' ');
+        renderConsole(golden.con, NULL, false);
+        check(compareGoldenFrame(&golden.sink, path, NULL) == 1, "style change", "changed style not reported");
+    }
+
+    closeGoldenConsole(&golden);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            updateGolden = true;
+        else
+            goldenDir = argv[i];
+    }
+
+    testWideCharRunStart();
+    testFloatRounding();
+    testCorruptKeyframe();
+    testTableSort();
+    testGoldenTables();
+    testGoldenStyles();
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%" PRId32 " checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
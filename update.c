@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "table.h"
+#include "update.h"
+#include "utf8.h"
+#include "backend.h"
+
+// Longest a render thread sleeps without a push or a due frame, it also bounds a missed wakeup
+#define RENDER_IDLE_NS 50000000ull
+
+UpdateQueue *createUpdateQueue(int32_t capacity)
+{
+    size_t size = 2;
+    while ((int64_t)size < capacity)
+        size <<= 1;
+
+    TCON_STAT_ALLOC(2);
+    UpdateQueue *queue = calloc(1, sizeof(UpdateQueue));
+    UpdateSlot *slots = malloc(size * sizeof(UpdateSlot));
+    if (!queue || !slots)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    // A slot is free for the producer at position p when its sequence equals p
+    for (size_t i = 0; i < size; i++)
+        atomic_init(&slots[i].sequence, i);
+
+    queue->slots = slots;
+    queue->mask = size - 1;
+    atomic_init(&queue->enqueuePos, 0);
+    atomic_init(&queue->sleeping, false);
+    atomic_init(&queue->fullWaits, 0);
+    queue->wakeup = backendCreateWakeup();
+
+    return queue;
+}
+
+void freeUpdateQueue(UpdateQueue *queue)
+{
+    if (!queue)
+        return;
+
+    backendFreeWakeup(queue->wakeup);
+    free(queue->slots);
+    free(queue);
+}
+
+// Wakes the consumer if it went to sleep on an empty queue
+static void wakeConsumer(UpdateQueue *queue)
+{
+    // Pairs with the fence in the render thread, either it sees the push or this sees it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&queue->sleeping, memory_order_relaxed) &&
+        atomic_exchange_explicit(&queue->sleeping, false, memory_order_relaxed))
+        backendSignalWakeup(queue->wakeup);
+}
+
+bool tryPushUpdate(UpdateQueue *queue, const UpdateCommand *command)
+{
+    size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    UpdateSlot *slot;
+
+    for (;;)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            // The slot is free, claim the position. On failure pos holds the current one
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // The consumer has not freed this slot of the previous lap yet
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+
+    slot->command = *command;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+    wakeConsumer(queue);
+    return true;
+}
+
+void pushUpdate(UpdateQueue *queue, const UpdateCommand *command)
+{
+    while (!tryPushUpdate(queue, command))
+    {
+        atomic_fetch_add_explicit(&queue->fullWaits, 1, memory_order_relaxed);
+        wakeConsumer(queue);
+        backendYield();
+    }
+}
+
+bool popUpdate(UpdateQueue *queue, UpdateCommand *command)
+{
+    size_t pos = queue->dequeuePos;
+    UpdateSlot *slot = &queue->slots[pos & queue->mask];
+
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1)
+        return false;
+
+    *command = slot->command;
+
+    // Hand the slot to the producer of the next lap
+    atomic_store_explicit(&slot->sequence, pos + queue->mask + 1, memory_order_release);
+    queue->dequeuePos = pos + 1;
+
+    return true;
+}
+
+static bool queueEmpty(UpdateQueue *queue)
+{
+    UpdateSlot *slot = &queue->slots[queue->dequeuePos & queue->mask];
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) != queue->dequeuePos + 1;
+}
+
+// Appends a row whose column values are separated by tabs
+static void applyTableRow(Console *con, HANDLE hConsole, UpdateCommand *command)
+{
+    Table *table = command->table;
+    appendTableRow(table, con, NULL, hConsole, false);
+
+    char *value = command->text;
+    for (int32_t c = 0; c < table->cols && value; c++)
+    {
+        char *tab = strchr(value, '\t');
+        if (tab)
+            *tab = '\0';
+
+        setCellValue(table, value, table->rows - 1, c, command->fgColor, command->bgColor);
+        value = tab ? tab + 1 : NULL;
+    }
+}
+
+int32_t applyUpdates(UpdateQueue *queue, Console *con, HANDLE hConsole, int32_t maxCount)
+{
+    UpdateCommand command;
+    int32_t applied = 0;
+    bool flush = false;
+
+    // Everything applied here reaches the terminal as one frame
+    beginConsoleFrame(con);
+
+    while (applied < maxCount && popUpdate(queue, &command))
+    {
+        applied++;
+
+        // Producers are not trusted with the console size
+        switch (command.kind)
+        {
+        case UPDATE_CELL:
+            if (command.row >= 0 && command.row < con->rows && command.col >= 0 && command.col < con->cols)
+                setCellData(con, command.row, command.col, command.fgColor, command.bgColor, command.ch);
+            break;
+        case UPDATE_PRINT:
+            writeFormat(con, command.row, command.col, 0, command.fgColor, command.bgColor, "%s", command.text);
+            break;
+        case UPDATE_TABLE_CELL:
+            if (command.row >= 0 && command.col >= 0)
+                setCellValue(command.table, command.text, command.row, command.col, command.fgColor, command.bgColor);
+            break;
+        case UPDATE_TABLE_ROW:
+            applyTableRow(con, hConsole, &command);
+            break;
+        case UPDATE_FLUSH:
+            flush = true;
+            break;
+        }
+    }
+
+    queue->applied += applied;
+
+    if (applied > 0)
+        renderConsole(*con, hConsole, false);
+
+    commitConsoleFrame(con, hConsole);
+
+    if (flush)
+        flushConsole(con, hConsole);
+
+    return applied;
+}
+
+static void pushText(UpdateQueue *queue, UpdateCommand *command, const char *text)
+{
+    // Longer text is cut off after the last whole grapheme, the consumer sees a terminated
+    // string either way
+    if (!text)
+        text = "";
+
+    size_t len = strnlen(text, UPDATE_TEXT_SIZE);
+    if (len == UPDATE_TEXT_SIZE)
+    {
+        size_t keep = utf8AsciiPrefix(text, UPDATE_TEXT_SIZE - 1);
+        while (keep < len)
+        {
+            uint32_t c;
+            int32_t width;
+            size_t next = keep + utf8Grapheme(text + keep, len - keep, &c, &width);
+            if (next > UPDATE_TEXT_SIZE - 1)
+                break;
+            keep = next;
+        }
+        len = keep;
+    }
+
+    memcpy(command->text, text, len);
+    command->text[len] = '\0';
+
+    pushUpdate(queue, command);
+}
+
+void queueCellUpdate(UpdateQueue *queue, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor, uint32_t ch)
+{
+    UpdateCommand command;
+    command.kind = UPDATE_CELL;
+    command.row = row;
+    command.col = col;
+    command.fgColor = fgColor;
+    command.bgColor = bgColor;
+    command.ch = ch;
+    command.table = NULL;
+    command.text[0] = '\0';
+
+    pushUpdate(queue, &command);
+}
+
+void queuePrint(UpdateQueue *queue, int32_t row, int32_t col, const char *text, ColorForeground fgColor, ColorBackground bgColor)
+{
+    UpdateCommand command;
+    command.kind = UPDATE_PRINT;
+    command.row = row;
+    command.col = col;
+    command.fgColor = fgColor;
+    command.bgColor = bgColor;
+    command.ch = 0;
+    command.table = NULL;
+
+    pushText(queue, &command, text);
+}
+
+void queueTableCell(UpdateQueue *queue, Table *table, int32_t row, int32_t col, const char *text, ColorForeground fgColor, ColorBackground bgColor)
+{
+    UpdateCommand command;
+    command.kind = UPDATE_TABLE_CELL;
+    command.row = row;
+    command.col = col;
+    command.fgColor = fgColor;
+    command.bgColor = bgColor;
+    command.ch = 0;
+    command.table = table;
+
+    pushText(queue, &command, text);
+}
+
+void queueTableRow(UpdateQueue *queue, Table *table, const char *text, ColorForeground fgColor, ColorBackground bgColor)
+{
+    UpdateCommand command;
+    command.kind = UPDATE_TABLE_ROW;
+    command.row = 0;
+    command.col = 0;
+    command.fgColor = fgColor;
+    command.bgColor = bgColor;
+    command.ch = 0;
+    command.table = table;
+
+    pushText(queue, &command, text);
+}
+
+void queueFlush(UpdateQueue *queue)
+{
+    UpdateCommand command;
+    memset(&command, 0, sizeof(UpdateCommand));
+    command.kind = UPDATE_FLUSH;
+
+    pushUpdate(queue, &command);
+}
+
+static void renderThreadMain(void *arg)
+{
+    RenderThread *thread = arg;
+    UpdateQueue *queue = thread->queue;
+
+    for (;;)
+    {
+        bool running = atomic_load_explicit(&thread->running, memory_order_acquire);
+
+        int32_t applied = applyUpdates(queue, &thread->con, thread->hConsole, UPDATE_BATCH);
+        if (applied > 0)
+            thread->batches++;
+
+        int64_t wait = pollConsoleFrame(&thread->con, thread->hConsole);
+
+        // Keep draining while producers are ahead, after a stop until the queue is empty
+        if (applied > 0)
+            continue;
+        if (!running)
+            break;
+
+        // Nothing queued: sleep until a producer pushes or the paced frame is due
+        atomic_store_explicit(&queue->sleeping, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (queueEmpty(queue) && atomic_load_explicit(&thread->running, memory_order_acquire))
+            backendWaitWakeup(queue->wakeup, wait > 0 ? (uint64_t)wait : RENDER_IDLE_NS);
+
+        atomic_store_explicit(&queue->sleeping, false, memory_order_relaxed);
+    }
+
+    // The last state is shown even if it is not due yet
+    flushConsole(&thread->con, thread->hConsole);
+}
+
+RenderThread *startRenderThread(Console *con, HANDLE hConsole, UpdateQueue *queue)
+{
+    TCON_STAT_ALLOC(1);
+    RenderThread *thread = calloc(1, sizeof(RenderThread));
+    if (!thread)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    thread->con = *con;
+    thread->hConsole = hConsole;
+    thread->queue = queue;
+    atomic_init(&thread->running, true);
+
+    thread->thread = backendStartThread(renderThreadMain, thread);
+
+    return thread;
+}
+
+void stopRenderThread(RenderThread *thread)
+{
+    atomic_store_explicit(&thread->running, false, memory_order_release);
+    backendSignalWakeup(thread->queue->wakeup);
+
+    backendJoinThread(thread->thread);
+    free(thread);
+}
@@ -0,0 +1,251 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "tcon.h"
+#include "table.h"
+
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#define UPDATE_TEXT_SIZE 96
+#define UPDATE_CACHE_LINE 64
+
+// Commands applied by one applyUpdates call before the frame is presented
+#define UPDATE_BATCH 4096
+
+typedef enum UpdateKind
+{
+   UPDATE_CELL,       // setCellData at row, col
+   UPDATE_PRINT,      // text written at row, col like print, clipped to the console
+   UPDATE_TABLE_CELL, // setCellValue on table
+   UPDATE_TABLE_ROW,  // appendTableRow on table, text holds the columns separated by '\t'
+   UPDATE_FLUSH       // present right away, regardless of the target frame rate
+} UpdateKind;
+
+typedef struct UpdateCommand
+{
+   UpdateKind kind;
+   int32_t row;
+   int32_t col;
+   ColorForeground fgColor;
+   ColorBackground bgColor;
+   uint32_t ch;
+   Table *table;
+   char text[UPDATE_TEXT_SIZE]; // Longer text is cut off
+} UpdateCommand;
+
+typedef struct UpdateSlot
+{
+   atomic_size_t sequence; // Tells producers and the consumer whose turn the slot is
+   UpdateCommand command;
+} UpdateSlot;
+
+/*
+Bounded lock-free queue of framebuffer updates. Any amount of threads can push, a single thread
+drains it, usually a render thread. Producers only contend on one atomic counter and never take
+a lock, the consumer is woken through a counted wakeup when it sleeps.
+*/
+typedef struct UpdateQueue
+{
+   UpdateSlot *slots;
+   size_t mask;
+   char padBefore[UPDATE_CACHE_LINE];
+   atomic_size_t enqueuePos;         // Kept apart from the consumer's fields, producers hammer it
+   char padAfter[UPDATE_CACHE_LINE];
+   size_t dequeuePos;
+   uint64_t applied;                 // Commands applied so far
+   atomic_bool sleeping;             // The consumer waits for a push
+   atomic_uint_fast64_t fullWaits;   // Times a producer had to wait for room
+   struct BackendWakeup *wakeup;
+} UpdateQueue;
+
+/*
+Drains an update queue on its own thread and presents the result. The console passed to
+startRenderThread belongs to the render thread until stopRenderThread returns, as do tables
+updated through the queue.
+*/
+typedef struct RenderThread
+{
+   Console con;
+   HANDLE hConsole;
+   UpdateQueue *queue;
+   atomic_bool running;
+   uint64_t batches; // Non-empty drains of the queue
+   struct BackendThread *thread;
+} RenderThread;
+
+/*
+Creates an update queue.
+
+Arguments:
+   capacity - the amount of commands the queue holds, rounded up to a power of two
+
+Returns:
+   Pointer to the queue
+*/
+UpdateQueue *createUpdateQueue(int32_t capacity);
+
+/*
+Frees an update queue. Nobody may push to or drain it anymore.
+
+Arguments:
+   queue - the queue to free
+
+Returns:
+   Void
+*/
+void freeUpdateQueue(UpdateQueue *queue);
+
+/*
+Pushes a command without waiting. Safe to call from any thread.
+
+Arguments:
+   queue - the queue to push to
+   command - the command, copied into the queue
+
+Returns:
+   false if the queue is full
+*/
+bool tryPushUpdate(UpdateQueue *queue, const UpdateCommand *command);
+
+/*
+Pushes a command, yielding while the queue is full. Safe to call from any thread.
+
+Arguments:
+   queue - the queue to push to
+   command - the command, copied into the queue
+
+Returns:
+   Void
+*/
+void pushUpdate(UpdateQueue *queue, const UpdateCommand *command);
+
+/*
+Takes the oldest command off the queue. Only one thread may drain a queue.
+
+Arguments:
+   queue - the queue to drain
+   command - receives the command
+
+Returns:
+   false if the queue is empty
+*/
+bool popUpdate(UpdateQueue *queue, UpdateCommand *command);
+
+/*
+Applies queued commands to the framebuffer and renders once for all of them. Only one thread
+may drain a queue, it must be the only one touching the console.
+
+Arguments:
+   queue - the queue to drain
+   con - the console to apply the commands to
+   hConsole - the console handle, see tconGetStdHandle()
+   maxCount - the most commands to apply
+
+Returns:
+   The amount of commands applied
+*/
+int32_t applyUpdates(UpdateQueue *queue, Console *con, HANDLE hConsole, int32_t maxCount);
+
+/*
+Queues setting a single framebuffer cell.
+
+Arguments:
+   queue - the queue to push to
+   row - the framebuffer row
+   col - the framebuffer column
+   fgColor - the foreground color
+   bgColor - the background color
+   ch - the character
+
+Returns:
+   Void
+*/
+void queueCellUpdate(UpdateQueue *queue, int32_t row, int32_t col, ColorForeground fgColor, ColorBackground bgColor, uint32_t ch);
+
+/*
+Queues printing text to the framebuffer, like print.
+
+Arguments:
+   queue - the queue to push to
+   row - the framebuffer row
+   col - the framebuffer column
+   text - the UTF-8 text, cut off after the last whole grapheme within UPDATE_TEXT_SIZE - 1 bytes
+   fgColor - the foreground color
+   bgColor - the background color
+
+Returns:
+   Void
+*/
+void queuePrint(UpdateQueue *queue, int32_t row, int32_t col, const char *text, ColorForeground fgColor, ColorBackground bgColor);
+
+/*
+Queues setting the value of a table cell, like setCellValue.
+
+Arguments:
+   queue - the queue to push to
+   table - the table, owned by the consumer of the queue
+   row - the row of the cell
+   col - the column of the cell
+   text - the value, cut off after the last whole grapheme within UPDATE_TEXT_SIZE - 1 bytes
+   fgColor - the foreground color
+   bgColor - the background color
+
+Returns:
+   Void
+*/
+void queueTableCell(UpdateQueue *queue, Table *table, int32_t row, int32_t col, const char *text, ColorForeground fgColor, ColorBackground bgColor);
+
+/*
+Queues appending a row to a table, like appendTableRow.
+
+Arguments:
+   queue - the queue to push to
+   table - the table, owned by the consumer of the queue
+   text - the column values separated by '\t', cut off after the last whole grapheme within UPDATE_TEXT_SIZE - 1 bytes
+   fgColor - the foreground color of every column
+   bgColor - the background color of every column
+
+Returns:
+   Void
+*/
+void queueTableRow(UpdateQueue *queue, Table *table, const char *text, ColorForeground fgColor, ColorBackground bgColor);
+
+/*
+Queues presenting the frame right away, ignoring the target frame rate.
+
+Arguments:
+   queue - the queue to push to
+
+Returns:
+   Void
+*/
+void queueFlush(UpdateQueue *queue);
+
+/*
+Starts a thread that applies the commands of a queue as they arrive and presents the frames,
+paced by setConsoleTargetFps if a target frame rate is set.
+
+Arguments:
+   con - the console, not to be touched by other threads until stopRenderThread returns
+   hConsole - the console handle, see tconGetStdHandle()
+   queue - the queue to drain
+
+Returns:
+   Pointer to the render thread
+*/
+RenderThread *startRenderThread(Console *con, HANDLE hConsole, UpdateQueue *queue);
+
+/*
+Applies the commands still queued, presents the last frame and stops the render thread.
+
+Arguments:
+   thread - the render thread to stop, freed by this call
+
+Returns:
+   Void
+*/
+void stopRenderThread(RenderThread *thread);
+
+#endif
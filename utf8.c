@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "utf8.h"
+#include "utf8width.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTF8_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Every codepoint below this takes one column, see mkwidth.py
+#define UTF8_FIRST_MARK 0x300
+
+char *utf8Encode(char *out, uint32_t c)
+{
+    if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+        c = UTF8_REPLACEMENT;
+
+    if (c < 0x80)
+    {
+        *out++ = (char)c;
+    }
+    else if (c < 0x800)
+    {
+        *out++ = (char)(0xC0 | (c >> 6));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        *out++ = (char)(0xE0 | (c >> 12));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+        *out++ = (char)(0xF0 | (c >> 18));
+        *out++ = (char)(0x80 | ((c >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    }
+
+    return out;
+}
+
+int32_t utf8Decode(const char *str, size_t len, uint32_t *c)
+{
+    const unsigned char *s = (const unsigned char *)str;
+
+    if (s[0] < 0x80)
+    {
+        *c = s[0];
+        return 1;
+    }
+
+    int32_t need;
+    uint32_t value;
+    uint32_t min;
+
+    if ((s[0] & 0xE0) == 0xC0)
+    {
+        need = 2;
+        value = s[0] & 0x1F;
+        min = 0x80;
+    }
+    else if ((s[0] & 0xF0) == 0xE0)
+    {
+        need = 3;
+        value = s[0] & 0x0F;
+        min = 0x800;
+    }
+    else if ((s[0] & 0xF8) == 0xF0)
+    {
+        need = 4;
+        value = s[0] & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        *c = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    if ((size_t)need > len)
+    {
+        *c = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    for (int32_t i = 1; i < need; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            *c = UTF8_REPLACEMENT;
+            return 1;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+
+    // Overlong encodings, surrogates and values past the unicode range are malformed
+    if (value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+    {
+        *c = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    *c = value;
+    return need;
+}
+
+int32_t utf8CharWidth(uint32_t c)
+{
+    if (c < UTF8_FIRST_MARK || c > 0x10FFFF)
+        return 1;
+
+    uint32_t offset = c & ((1u << UTF8_WIDTH_BLOCK_BITS) - 1);
+    const uint8_t *block = utf8WidthBlocks[utf8WidthIndex[c >> UTF8_WIDTH_BLOCK_BITS]];
+
+    return (block[offset >> 2] >> ((offset & 3) * 2)) & 3;
+}
+
+#ifdef UTF8_SSE2
+static inline int32_t lowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int32_t)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+size_t utf8AsciiPrefix(const char *str, size_t len)
+{
+    size_t pos = 0;
+
+#ifdef UTF8_SSE2
+    // Four blocks are tested together while all of them are ASCII, the first that is not is
+    // found below
+    for (; pos + 64 <= len; pos += 64)
+    {
+        const __m128i *blocks = (const __m128i *)(str + pos);
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(blocks), _mm_loadu_si128(blocks + 1)),
+                                   _mm_or_si128(_mm_loadu_si128(blocks + 2), _mm_loadu_si128(blocks + 3)));
+        if (_mm_movemask_epi8(any) != 0)
+            break;
+    }
+
+    // The top bit of every byte at once, set ones are not ASCII
+    for (; pos + 16 <= len; pos += 16)
+    {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(str + pos)));
+        if (mask != 0)
+        {
+            pos += lowestBit(mask);
+            break;
+        }
+    }
+#endif
+
+    while (pos < len && (unsigned char)str[pos] < 0x80)
+        pos++;
+
+    if (pos < len && pos > 0)
+        pos--;
+
+    return pos;
+}
+
+int32_t utf8Grapheme(const char *str, size_t len, uint32_t *c, int32_t *width)
+{
+    size_t pos = utf8Decode(str, len, c);
+    bool join = false;
+
+    *width = utf8CharWidth(*c);
+
+    // ASCII never extends a grapheme, so runs of it can be skipped without looking behind them
+    while (pos < len && (unsigned char)str[pos] >= 0x80)
+    {
+        uint32_t next;
+        int32_t used = utf8Decode(str + pos, len - pos, &next);
+
+        if (!join && utf8CharWidth(next) != 0)
+            break;
+
+        join = next == UTF8_ZERO_WIDTH_JOINER;
+        pos += used;
+    }
+
+    return (int32_t)pos;
+}
+
+int32_t utf8Width(const char *str, size_t len)
+{
+    size_t pos = 0;
+    int32_t width = 0;
+
+    while (pos < len)
+    {
+        size_t ascii = utf8AsciiPrefix(str + pos, len - pos);
+        pos += ascii;
+        width += (int32_t)ascii;
+
+        if (pos < len)
+        {
+            uint32_t c;
+            int32_t charWidth;
+            pos += utf8Grapheme(str + pos, len - pos, &c, &charWidth);
+            width += charWidth;
+        }
+    }
+
+    return width;
+}
+
+size_t utf8Fit(const char *str, size_t len, int32_t maxWidth, int32_t *width)
+{
+    size_t pos = 0;
+    int32_t used = 0;
+
+    while (pos < len)
+    {
+        // Taking at most the columns left needs to look one byte further, for a mark after the last
+        int32_t left = maxWidth > used ? maxWidth - used : 0;
+        size_t window = len - pos < (size_t)left + 1 ? len - pos : (size_t)left + 1;
+        size_t ascii = utf8AsciiPrefix(str + pos, window);
+        if (ascii > (size_t)left)
+            ascii = left;
+
+        pos += ascii;
+        used += (int32_t)ascii;
+
+        if (pos >= len)
+            break;
+
+        uint32_t c;
+        int32_t charWidth;
+        int32_t bytes = utf8Grapheme(str + pos, len - pos, &c, &charWidth);
+        if (used + charWidth > maxWidth)
+            break;
+
+        pos += bytes;
+        used += charWidth;
+    }
+
+    if (width)
+        *width = used;
+
+    return pos;
+}
@@ -0,0 +1,109 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifndef UTF8_H
+#define UTF8_H
+
+// Codepoint used for malformed input
+#define UTF8_REPLACEMENT 0xFFFD
+// Joins the codepoint after it to the grapheme before it
+#define UTF8_ZERO_WIDTH_JOINER 0x200D
+
+/*
+Encodes a codepoint as UTF-8.
+
+Arguments:
+   out - receives up to 4 bytes
+   c - the codepoint to encode
+
+Returns:
+   Pointer behind the last byte written
+*/
+char *utf8Encode(char *out, uint32_t c);
+
+/*
+Decodes one codepoint from a UTF-8 string. Malformed sequences decode to
+UTF8_REPLACEMENT and consume a single byte.
+
+Arguments:
+   str - the string to decode from
+   len - the amount of bytes left in str, must be at least 1
+   c - receives the codepoint
+
+Returns:
+   The amount of bytes consumed
+*/
+int32_t utf8Decode(const char *str, size_t len, uint32_t *c);
+
+/*
+Gives the amount of columns a codepoint takes on screen, looked up in a table generated from
+the Unicode database by mkwidth.py. Combining marks and other codepoints drawn onto the one
+before them take none, East Asian wide and fullwidth chars two.
+
+Arguments:
+   c - the codepoint
+
+Returns:
+   0, 1 or 2, 1 for control chars and values past the unicode range
+*/
+int32_t utf8CharWidth(uint32_t c);
+
+/*
+Counts the leading bytes of a UTF-8 string that are ASCII chars of one column each. The last
+ASCII char before a non-ASCII byte is left out, marks after it may belong to it. Where SSE2 is
+available 16 bytes are checked at once.
+
+Arguments:
+   str - the string
+   len - the amount of bytes in str
+
+Returns:
+   The amount of bytes, every one of them a grapheme of its own
+*/
+size_t utf8AsciiPrefix(const char *str, size_t len);
+
+/*
+Decodes one grapheme from a UTF-8 string: a codepoint with the zero width codepoints following
+it and the codepoint after a zero width joiner. This approximates extended grapheme clusters
+closely enough that no char is parted from its combining marks.
+
+Arguments:
+   str - the string to decode from
+   len - the amount of bytes left in str, must be at least 1
+   c - receives the first codepoint, the one a single cell shows of the grapheme
+   width - receives the amount of columns the grapheme takes, that of its first codepoint
+
+Returns:
+   The amount of bytes consumed
+*/
+int32_t utf8Grapheme(const char *str, size_t len, uint32_t *c, int32_t *width);
+
+/*
+Measures the amount of columns a UTF-8 string takes on screen. Runs of ASCII are counted by
+utf8AsciiPrefix, so on ASCII text this costs about as much as strlen().
+
+Arguments:
+   str - the string
+   len - the amount of bytes in str
+
+Returns:
+   The width in columns
+*/
+int32_t utf8Width(const char *str, size_t len);
+
+/*
+Finds the longest start of a UTF-8 string that fits a width, ending on a grapheme boundary.
+
+Arguments:
+   str - the string
+   len - the amount of bytes in str
+   maxWidth - the amount of columns available
+   width - receives the amount of columns the start takes, may be NULL
+
+Returns:
+   The amount of bytes of the start
+*/
+size_t utf8Fit(const char *str, size_t len, int32_t maxWidth, int32_t *width);
+
+#endif